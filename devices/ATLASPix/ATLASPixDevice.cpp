@@ -13,7 +13,9 @@
 #include <string>
 #include <thread>
 
+#include "utils/asyncwriter.hpp"
 #include "utils/log.hpp"
+#include "utils/runfile.hpp"
 
 using namespace caribou;
 
@@ -37,7 +39,7 @@ uint32_t grey_decode(uint32_t g, uint32_t length) {
   return g;
 }
 
-pixelhit decodeHit(uint32_t hit, uint32_t ckdivend2 = 1, bool gray_decoding_state = false) {
+pixelhit caribou::decodeHit(uint32_t hit, uint32_t ckdivend2, bool gray_decoding_state) {
   pixelhit tmp;
 
   tmp.col = (hit >> 25) & 0b11111;
@@ -161,6 +163,15 @@ ATLASPixDevice::ATLASPixDevice(const caribou::Configuration config)
 
   _memory.add(ATLASPix_MEMORY);
 
+  // Resolve the FIFO registers polled by the readout loops once:
+  _fifo_data = getMemoryHandle("data");
+  _fifo_status = getMemoryHandle("fifo_status");
+
+  if(carboard_emulator::emulatesMemory()) {
+    _generator = std::make_shared<ATLASPixGenerator>(_config);
+    carboard_emulator::getInstance().attach(_generator, ATLASPixGenerator::addresses());
+  }
+
   // Always set up common periphery for all matrices:
   _periphery.add("VDDD", PWR_OUT_4);
   _periphery.add("VDDA", PWR_OUT_3);
@@ -210,6 +221,15 @@ ATLASPixDevice::~ATLASPixDevice() {
   powerOff();
 }
 
+async_writer::sync_policy ATLASPixDevice::getSyncPolicy() {
+  try {
+    return async_writer::getSyncPolicy(_config.Get("output_sync", "close"));
+  } catch(ConfigInvalid& e) {
+    LOG(WARNING) << e.what() << ", synchronizing data on close";
+    return async_writer::sync_policy::close;
+  }
+}
+
 void ATLASPixDevice::setOutputDirectory(std::string dir) {
   LOG(INFO) << "Setting output directory to: " << dir;
   _output_directory = std::move(dir);
@@ -278,6 +298,8 @@ void ATLASPixDevice::setOutput(std::string datatype) {
     data_type = "text";
   } else if(datatype == "raw") {
     data_type = "raw";
+  } else if(datatype == "run") {
+    data_type = "run";
   } else {
     LOG(INFO) << "Data type not recongnized, using binary ";
     data_type = "binary";
@@ -535,15 +557,8 @@ void ATLASPixDevice::configureClock() {
   _hal->configureSI5345((SI5345_REG_T const* const)si5345_revb_registers, SI5345_REVB_REG_CONFIG_NUM_REGS);
   LOG(DEBUG) << "Waiting for clock to lock...";
 
-  // Try for a limited time to lock, otherwise abort:
-  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
-  while(!_hal->isLockedSI5345()) {
-    auto dur = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - start);
-    if(dur.count() > 0.5)
-      // throw DeviceException("Cannot lock to external clock.");
-      break;
-  }
-  if(_hal->isLockedSI5345()) {
+  // Try for a limited time to lock, otherwise continue free running:
+  if(_hal->waitLockedSI5345(std::chrono::seconds(1))) {
     LOG(INFO) << "PLL locked to external clock...";
   } else {
     LOG(INFO) << "Cannot lock to external clock, PLL will continue in freerunning mode...";
@@ -1404,7 +1419,7 @@ void ATLASPixDevice::MeasureTOT(double vmin, double vmax, uint32_t npulses, uint
 }
 
 void ATLASPixDevice::isLocked() {
-  if((getMemory("fifo_status") >> 5) & 0b1) {
+  if((_fifo_status.read() >> 5) & 0b1) {
     std::cout << "yes" << std::endl;
   } else {
     std::cout << "no" << std::endl;
@@ -1426,12 +1441,17 @@ std::vector<uint32_t> ATLASPixDevice::getRawData() {
     throw NoDataAvailable();
   }
 
+  // Read full frames from the DMA ring buffer if configured:
+  if(!_dma_path.empty()) {
+    return CaribouDevice::getRawData();
+  }
+
   uint32_t dataRead;
   std::vector<uint32_t> rawDataVec;
 
   // if a filter for WEIRD_DATA is set and the data has a WEIRD_DATA header read next data.
   do {
-    dataRead = getMemory("data");
+    dataRead = _fifo_data.read();
   } while((filter_weird_data && (dataRead >> 24 == 0b00000100)));
 
   // if there was data, store data to return vector
@@ -1448,10 +1468,12 @@ pearydata ATLASPixDevice::getDataBin() {
   theMatrix.writeGlobal(_output_directory + "/config.cfg");
   theMatrix.writeTDAC(_output_directory + "/config_TDAC.cfg");
 
-  std::ofstream disk;
-  disk.open(_output_directory + "/data.bin", std::ios::out | std::ios::binary);
-  if(!disk.is_open()) {
-    LOG(WARNING) << "Output data file NOT opened!";
+  std::unique_ptr<async_writer> disk;
+  try {
+    disk = std::make_unique<async_writer>(_output_directory + "/data.bin", getSyncPolicy());
+  } catch(DataException& e) {
+    LOG(WARNING) << "Output data file NOT opened: " << e.what();
+    return pearydata();
   }
 
   uint32_t d1;
@@ -1463,16 +1485,81 @@ pearydata ATLASPixDevice::getDataBin() {
       break;
     }
     // check for new data in fifo
-    d1 = getMemory("data");
+    d1 = _fifo_data.read();
     if((d1 == 0) || (filter_weird_data && (d1 >> 24 == 0b00000100))) {
       continue;
     } else {
-      disk.write((char*)&d1, sizeof(uint32_t));
-      disk.flush();
+      disk->write(&d1, sizeof(uint32_t));
     }
   }
 
-  disk.close();
+  disk->close();
+
+  pearydata dummy;
+  return dummy;
+}
+
+pearydata ATLASPixDevice::getDataRun() {
+
+  make_directories(_output_directory);
+  // write actual configuration
+  theMatrix.writeGlobal(_output_directory + "/config.cfg");
+  theMatrix.writeTDAC(_output_directory + "/config_TDAC.cfg");
+
+  runfile_header header;
+  header.metadata.emplace_back("Device", getName());
+  header.metadata.emplace_back("Software version", getVersion());
+  header.metadata.emplace_back("Firmware version", getFirmwareVersion());
+  header.metadata.emplace_back("Timestamp", LOGTIME);
+  header.registers = getRegisters();
+
+  std::unique_ptr<runfile_writer> disk;
+  try {
+    disk = std::make_unique<runfile_writer>(_output_directory + "/data.run", header, getSyncPolicy());
+  } catch(DataException& e) {
+    LOG(WARNING) << "Output data file NOT opened: " << e.what();
+    return pearydata();
+  }
+
+  // Words are collected until the FIFO runs empty and then written as one record
+  const size_t max_record_words = 4096;
+  std::vector<uint32_t> record;
+  record.reserve(max_record_words);
+
+  while(true) {
+
+    // check for stop request from another thread
+    if(!this->_daqContinue.test_and_set()) {
+      LOG(DEBUG) << "Exiting DAQ thread";
+      break;
+    }
+
+    // check for new data in fifo
+    if((_fifo_status.read() & 0x1) == 1) {
+      uint32_t d1 = _fifo_data.read();
+      if((d1 != 0) && !(filter_weird_data && (d1 >> 24 == 0b00000100))) {
+        record.push_back(d1);
+      }
+      if(record.size() < max_record_words) {
+        continue;
+      }
+    }
+
+    if(!record.empty()) {
+      disk->write(record, runfile_writer::now());
+      record.clear();
+    }
+  }
+
+  if(!record.empty()) {
+    disk->write(record, runfile_writer::now());
+  }
+  disk->close();
+  if(disk->good()) {
+    LOG(INFO) << "Wrote " << disk->frames() << " records to " << _output_directory << "/data.run";
+  } else {
+    LOG(ERROR) << "Failed to write " << _output_directory << "/data.run, records have been lost";
+  }
 
   pearydata dummy;
   return dummy;
@@ -1481,9 +1568,21 @@ pearydata ATLASPixDevice::getDataBin() {
 pearydata ATLASPixDevice::getData() {
 
   make_directories(_output_directory);
-  std::ofstream disk;
-  disk.open(_output_directory + "/data.txt", std::ios::out);
-  disk << "X:	Y:	   TS1:	   TS2: 	TOT:FPGA_TS:  TR_CNT:  BinCounter :  " << std::endl;
+  std::unique_ptr<async_writer> disk;
+  try {
+    disk = std::make_unique<async_writer>(_output_directory + "/data.txt", getSyncPolicy());
+  } catch(DataException& e) {
+    LOG(WARNING) << "Output data file NOT opened: " << e.what();
+    return pearydata();
+  }
+
+  // Lines are formatted into a buffer which is handed to the writer whenever the FIFO runs empty or it grows large
+  std::ostringstream text;
+  text << "X:	Y:	   TS1:	   TS2: 	TOT:FPGA_TS:  TR_CNT:  BinCounter :  \n";
+  auto flush = [&]() {
+    disk->write(text.str());
+    text.str("");
+  };
 
   uint64_t fpga_ts = 0;
   uint64_t fpga_ts_last = 0;
@@ -1498,11 +1597,17 @@ pearydata ATLASPixDevice::getData() {
     if(!this->_daqContinue.test_and_set())
       break;
     // check for new data in fifo
-    if((getMemory("fifo_status") & 0x1) == 0) {
+    if((_fifo_status.read() & 0x1) == 0) {
+      if(text.tellp() > 0) {
+        flush();
+      }
       continue;
     }
+    if(text.tellp() > 64 * 1024) {
+      flush();
+    }
 
-    uint32_t d1 = getMemory("data");
+    uint32_t d1 = _fifo_data.read();
 
     // HIT data of bit 31 is = 1
     if((d1 >> 31) == 1) {
@@ -1513,16 +1618,16 @@ pearydata ATLASPixDevice::getData() {
 
       if(filter_hp) {
         if(std::find(hplist.begin(), hplist.end(), hit) == hplist.end()) {
-          disk << "HIT " << hit.col << "	" << hit.row << "	" << hit.ts1 << "	" << hit.ts2 << "	" << hit.tot << "	"
+          text << "HIT " << hit.col << "	" << hit.row << "	" << hit.ts1 << "	" << hit.ts2 << "	" << hit.tot << "	"
                << fpga_ts_last << "	"
-               << " " << TrCNT << " " << ((timestamp >> 8) & 0xFFFF) << " " << timing << std::endl;
+               << " " << TrCNT << " " << ((timestamp >> 8) & 0xFFFF) << " " << timing << "\n";
         }
 
       } else {
 
-        disk << "HIT " << hit.col << "	" << hit.row << "	" << hit.ts1 << "	" << hit.ts2 << "	" << hit.tot << "	"
+        text << "HIT " << hit.col << "	" << hit.row << "	" << hit.ts1 << "	" << hit.ts2 << "	" << hit.tot << "	"
              << fpga_ts_last << "	"
-             << " " << TrCNT << " " << ((timestamp >> 8) & 0xFFFF) << " " << timing << std::endl;
+             << " " << TrCNT << " " << ((timestamp >> 8) & 0xFFFF) << " " << timing << "\n";
       }
     }
 
@@ -1537,7 +1642,7 @@ pearydata ATLASPixDevice::getData() {
         timestamp = d1 & 0xFFFFFF;
         break;
       case 0b00000001: // Buffer overflow, data after this are lost
-        disk << "BUFFER_OVERFLOW" << std::endl;
+        text << "BUFFER_OVERFLOW" << "\n";
         break;
       case 0b00010000: // Trigger cnt 24bits
         TrCNT = d1 & 0xFFFFFF;
@@ -1551,23 +1656,23 @@ pearydata ATLASPixDevice::getData() {
         break;
       case 0b01100000: // End of fpga_ts (24 bits)
         fpga_ts = fpga_ts + ((d1)&0xFFFFFF);
-        disk << "TRIGGER " << TrCNT << " " << fpga_ts << std::endl;
+        text << "TRIGGER " << TrCNT << " " << fpga_ts << "\n";
         fpga_ts_last = fpga_ts;
         fpga_ts = 0;
         break;
       case 0b00000010: // BUSY asserted with 24bit LSB of Trigger FPGA TS
         fpga_ts_busy = d1 & 0xFFFFFF;
-        disk << "BUSY_ASSERTED " << fpga_ts_busy << std::endl;
+        text << "BUSY_ASSERTED " << fpga_ts_busy << "\n";
         break;
       case 0b00001100: // SERDES lock lost
-        disk << "SERDES_LOCK_LOST" << std::endl;
+        text << "SERDES_LOCK_LOST" << "\n";
         break;
       case 0b00001000: // SERDES lock established
-        disk << "SERDES_LOCK_ESTABLISHED" << std::endl;
+        text << "SERDES_LOCK_ESTABLISHED" << "\n";
         break;
       case 0b00000100: // Unexpected/weird data came
         if(!filter_weird_data) {
-          disk << "WEIRD_DATA " << std::hex << d1 << std::dec << std::endl;
+          text << "WEIRD_DATA " << std::hex << d1 << std::dec << "\n";
         }
         break;
       default: // weird stuff, should not happend
@@ -1576,7 +1681,8 @@ pearydata ATLASPixDevice::getData() {
       }
     }
   }
-  disk.close();
+  flush();
+  disk->close();
 
   // write additional information
   // std::ofstream stats(_output_directory + "/stats.txt", std::ios::out);
@@ -1610,7 +1716,7 @@ pearydata ATLASPixDevice::getDataTO(int /* maskx */, int /* masky */) {
     }
 
     // Check for new data in FIFO
-    if((getMemory("fifo_status") & 0x1) == 0) {
+    if((_fifo_status.read() & 0x1) == 0) {
       // wait a microsecond and keep track of it
       usleep(1);
       tocnt += 1;
@@ -1633,7 +1739,7 @@ pearydata ATLASPixDevice::getDataTO(int /* maskx */, int /* masky */) {
       break;
     }
 
-    uint32_t d1 = getMemory("data");
+    uint32_t d1 = _fifo_data.read();
     // std::cout << std::bitset<32>(d1) << std::endl;
 
     // HIT data of bit 31 is = 1
@@ -1723,7 +1829,7 @@ std::vector<pixelhit> ATLASPixDevice::getDataTOvector(uint32_t /* timeout */, bo
       break;
     // check for new first half-word or restart loop
 
-    if((getMemory("fifo_status") & 0x1) == 0) {
+    if((_fifo_status.read() & 0x1) == 0) {
       usleep(1);
       tocnt += 1;
       if(tocnt == Tuning_timeout) {
@@ -1738,7 +1844,7 @@ std::vector<pixelhit> ATLASPixDevice::getDataTOvector(uint32_t /* timeout */, bo
       break;
     }
 
-    uint32_t d1 = getMemory("data");
+    uint32_t d1 = _fifo_data.read();
 
     // HIT data of bit 31 is = 1
     pixelhit hit = decodeHit(d1, theMatrix.CurrentDACConfig->GetParameter("ckdivend2"), gray_decoding_state);
@@ -1819,7 +1925,7 @@ std::vector<pixelhit> ATLASPixDevice::getDataTimer(uint32_t timeout, bool to_nod
     }
     // check for new first half-word or restart loop
 
-    if((getMemory("fifo_status") & 0x1) == 0) {
+    if((_fifo_status.read() & 0x1) == 0) {
       usleep(1);
       tocnt += 1;
       if(tocnt == Tuning_timeout && to_nodata) {
@@ -1830,7 +1936,7 @@ std::vector<pixelhit> ATLASPixDevice::getDataTimer(uint32_t timeout, bool to_nod
       }
     }
 
-    uint32_t d1 = getMemory("data");
+    uint32_t d1 = _fifo_data.read();
     // std::cout << std::bitset<32>(d1) << std::endl;
 
     // HIT data of bit 31 is = 1
@@ -2375,6 +2481,8 @@ void ATLASPixDevice::runDaq() {
     getDataBin();
   } else if(data_type == "text") {
     getData();
+  } else if(data_type == "run") {
+    getDataRun();
   } else {
     LOG(WARNING) << "Unknown output format \"" << data_type << "\"";
     return;
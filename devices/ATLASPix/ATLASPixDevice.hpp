@@ -14,36 +14,16 @@
 #include <thread>
 
 #include "device/CaribouDevice.hpp"
+#include "utils/asyncwriter.hpp"
 #include "interfaces/I2C/i2c.hpp"
 
+#include "ATLASPixGenerator.hpp"
+#include "ATLASPixHit.hpp"
 #include "ATLASPixMatrix.hpp"
 #include "ATLASPix_defaults.hpp"
 
 namespace caribou {
 
-  struct pixelhit {
-
-    uint32_t col = 0;
-    uint32_t row = 0;
-    uint32_t ts1 = 0;
-    uint32_t ts2 = 0;
-    uint64_t fpga_ts = 0;
-    uint32_t tot = 0;
-    uint32_t SyncedTS = 0;
-    uint32_t triggercnt;
-    uint32_t ATPbinaryCnt;
-    uint32_t ATPGreyCnt;
-
-    bool operator==(const pixelhit& hit) {
-
-      if((col == hit.col) && (row == hit.row)) {
-        return true;
-      } else {
-        return false;
-      }
-    }
-  };
-
   typedef std::map<std::pair<int, int>, unsigned int> CounterMap;
   typedef std::map<std::pair<int, int>, double> TOTMap;
 
@@ -115,6 +95,9 @@ namespace caribou {
     uint32_t getTriggerCounter();
 
     pearydata getDataBin();
+    pearydata getDataRun();
+    // Sync policy of the data files, read from the "output_sync" configuration key for every run
+    async_writer::sync_policy getSyncPolicy();
 
     std::vector<uint32_t> getRawData();
     pearydata getData();
@@ -189,6 +172,13 @@ namespace caribou {
     std::thread _daqThread;
     std::thread _monitorPowerThread;
 
+    // Pre-resolved handles to the readout FIFO
+    memory_handle _fifo_data;
+    memory_handle _fifo_status;
+
+    // Synthetic data served to the readout when the memory interface is emulated
+    std::shared_ptr<ATLASPixGenerator> _generator;
+
     std::string _output_directory;
     std::string data_type;
     std::vector<pixelhit> hplist;
@@ -0,0 +1,85 @@
+#include "ATLASPixGenerator.hpp"
+
+#include <chrono>
+
+#include "ATLASPix_defaults.hpp"
+
+using namespace caribou;
+
+namespace {
+  const std::intptr_t FIFO_DATA = ATLASPix_READOUT_BASE_ADDRESS + 0x0;
+  const std::intptr_t FIFO_STATUS = ATLASPix_READOUT_BASE_ADDRESS + 0x4;
+  const std::intptr_t FIFO_CONFIG = ATLASPix_READOUT_BASE_ADDRESS + 0x8;
+
+  uint32_t grey_encode(uint32_t value) { return value ^ (value >> 1); }
+} // namespace
+
+std::vector<std::intptr_t> ATLASPixGenerator::addresses() {
+  return {FIFO_DATA, FIFO_STATUS, FIFO_CONFIG};
+}
+
+uint32_t ATLASPixGenerator::read(std::intptr_t address, uint32_t stored) {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  if(address == FIFO_DATA) {
+    // Reading the empty FIFO yields zeros, which are skipped by the readout
+    if(_fifo.empty()) {
+      return 0;
+    }
+    auto word = _fifo.front();
+    _fifo.pop_front();
+    return word;
+  } else if(address == FIFO_STATUS) {
+    if(_fifo.empty() && due(1) > 0) {
+      generateEvent();
+    }
+    // Data available and SERDES locked:
+    return (stored & ~0x21u) | 0x20 | (_fifo.empty() ? 0x0 : 0x1);
+  }
+  return stored;
+}
+
+void ATLASPixGenerator::write(std::intptr_t address, uint32_t value) {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  if(address == FIFO_CONFIG) {
+    if(value & 0x10) {
+      _fifo.clear();
+    }
+    _gray_decoded = (value >> 10) & 0x1;
+  }
+}
+
+std::vector<uint32_t> ATLASPixGenerator::event() {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  _fifo.clear();
+  generateEvent();
+  std::vector<uint32_t> words(_fifo.begin(), _fifo.end());
+  _fifo.clear();
+  return words;
+}
+
+void ATLASPixGenerator::generateEvent() {
+  // Trigger counter and FPGA timestamp in cycles of the 100MHz clock, split over four words
+  auto ts = static_cast<uint64_t>(
+              std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+                .count()) /
+            10;
+  _trigger_counter++;
+  _fifo.push_back((0x10u << 24) | (_trigger_counter & 0xFFFFFF));
+  _fifo.push_back((0x30u << 24) | (((_trigger_counter >> 24) & 0xFF) << 16) | ((ts >> 48) & 0xFFFF));
+  _fifo.push_back((0x20u << 24) | ((ts >> 24) & 0xFFFFFF));
+  _fifo.push_back((0x60u << 24) | (ts & 0xFFFFFF));
+
+  // Hits: flag, column, row and the leading and trailing edge timestamps
+  for(auto pixel : hits(ncol_m1 * nrow_m1)) {
+    uint32_t ts1 = random(10);
+    uint32_t ts2 = random(6);
+    if(!_gray_decoded) {
+      ts1 = grey_encode(ts1);
+      ts2 = grey_encode(ts2);
+    }
+    _fifo.push_back((1u << 31) | ((pixel / nrow_m1) << 25) | ((pixel % nrow_m1) << 16) | (ts1 << 6) | ts2);
+  }
+}
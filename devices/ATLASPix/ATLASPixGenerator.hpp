@@ -0,0 +1,43 @@
+#ifndef DEVICE_ATLASPIXGENERATOR_H
+#define DEVICE_ATLASPIXGENERATOR_H
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "carboard/generator.hpp"
+
+/** Synthetic ATLASPix data in the emulated readout FIFO
+ *
+ * Every event made available to the readout consists of the trigger words of the FPGA followed by the hits of the M1
+ * matrix according to the occupancy. The timestamps of the hits are Gray-encoded unless the decoding is done in the
+ * FPGA, as selected via the "fifo_config" register.
+ */
+class ATLASPixGenerator : public caribou::data_generator {
+public:
+  explicit ATLASPixGenerator(const caribou::Configuration& config) : data_generator(config){};
+
+  uint32_t read(std::intptr_t address, uint32_t stored) override;
+  void write(std::intptr_t address, uint32_t value) override;
+
+  /**
+   * @brief Physical addresses of the readout registers served by the generator
+   */
+  static std::vector<std::intptr_t> addresses();
+
+  /**
+   * @brief Produce the words of an event directly instead of via the emulated registers, e.g. to benchmark the decoder
+   *
+   * Data waiting in the FIFO is discarded.
+   */
+  std::vector<uint32_t> event();
+
+private:
+  void generateEvent();
+
+  std::deque<uint32_t> _fifo;
+  uint32_t _trigger_counter{0};
+  bool _gray_decoded{false};
+};
+
+#endif
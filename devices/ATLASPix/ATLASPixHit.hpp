@@ -0,0 +1,38 @@
+#ifndef DEVICE_ATLASPIXHIT_H
+#define DEVICE_ATLASPIXHIT_H
+
+#include <cstdint>
+
+namespace caribou {
+
+  /** Hit read from the ATLASPix readout FIFO
+   */
+  struct pixelhit {
+
+    uint32_t col = 0;
+    uint32_t row = 0;
+    uint32_t ts1 = 0;
+    uint32_t ts2 = 0;
+    uint64_t fpga_ts = 0;
+    uint32_t tot = 0;
+    uint32_t SyncedTS = 0;
+    uint32_t triggercnt;
+    uint32_t ATPbinaryCnt;
+    uint32_t ATPGreyCnt;
+
+    bool operator==(const pixelhit& hit) {
+
+      if((col == hit.col) && (row == hit.row)) {
+        return true;
+      } else {
+        return false;
+      }
+    }
+  };
+
+  /** Decode a hit word of the readout FIFO, the timestamps are Gray-decoded unless this is done by the FPGA already
+   */
+  pixelhit decodeHit(uint32_t hit, uint32_t ckdivend2 = 1, bool gray_decoding_state = false);
+} // namespace caribou
+
+#endif
@@ -92,6 +92,9 @@ void C3PDDevice::reset() {
   usleep(1);
   // deny reset:
   setMemory("reset", getMemory("reset") | C3PD_CONTROL_RESET_MASK);
+
+  // The chip registers are back to their default values:
+  invalidateRegisters();
 }
 
 C3PDDevice::~C3PDDevice() {
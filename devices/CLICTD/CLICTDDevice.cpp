@@ -41,6 +41,33 @@ CLICTDDevice::CLICTDDevice(const caribou::Configuration config)
   // Add memory pages to the dictionary:
   _memory.add(CLICTD_MEMORY);
 
+  // Resolve the readout and timestamp FIFO registers once:
+  rdfifo_ = getMemoryHandle("rdfifo");
+  rdstatus_ = getMemoryHandle("rdstatus");
+  tsfifodata_lsb_ = getMemoryHandle("tsfifodata_lsb");
+  tsfifodata_msb_ = getMemoryHandle("tsfifodata_msb");
+  tsstatus_ = getMemoryHandle("tsstatus");
+
+  // Resolve the matrix configuration registers once:
+  configdata_ = getRegisterHandle("configdata");
+  configdata_lsb_ = getRegisterHandle("configdata_lsb");
+  configdata_msb_ = getRegisterHandle("configdata_msb");
+  configctrl_ = getRegisterHandle("configctrl");
+
+  // Registers whose writes trigger an action are never cached: the configuration control register shifts the matrix
+  // configuration, the strobe, readout and test pulse control registers start sequences of the chip.
+  setRegisterVolatile("configctrl");
+  setRegisterVolatile("internalstrobes");
+  setRegisterVolatile("readoutctrl");
+  setRegisterVolatile("tpulsectrl_lsb");
+  setRegisterVolatile("tpulsectrl_msb");
+  enableRegisterCache();
+
+  if(carboard_emulator::emulatesMemory()) {
+    frame_generator_ = std::make_shared<CLICTDFrameGenerator>(_config);
+    carboard_emulator::getInstance().attach(frame_generator_, CLICTDFrameGenerator::addresses());
+  }
+
   // Matrix not configured yet:
   matrixConfigured = false;
 }
@@ -56,9 +83,16 @@ void CLICTDDevice::setMem(std::string name, uint32_t value) {
 
 void CLICTDDevice::configure() {
   LOG(INFO) << "Configuring";
-  configureClock(_config.Get<bool>("clock_internal", true));
-  reset();
-  mDelay(10);
+
+  // A configured chip running from the requested clock only needs the settings updated which have changed:
+  bool clock_internal = _config.Get<bool>("clock_internal", true);
+  if(is_configured() && clock_internal == clockInternal) {
+    LOG(INFO) << "Device already configured, applying changed settings only";
+  } else {
+    configureClock(clock_internal);
+    reset();
+    mDelay(10);
+  }
 
   // Call the base class configuration function:
   CaribouDevice<iface_i2c>::configure();
@@ -72,17 +106,19 @@ void CLICTDDevice::configure() {
     LOG(INFO) << "No pattern generator found in configuration.";
   }
 
-  if(!matrixConfigured) {
-    // Read matrix file from the configuration and program it:
-    std::string matrix = _config.Get("matrix", "");
-    if(!matrix.empty()) {
-      LOG(INFO) << "Found pixel matrix setup in configuration, programming file \"" << matrix << "\"...";
-      configureMatrix(matrix);
+  // Read matrix file from the configuration and program it unless the chip holds this configuration already:
+  std::string matrix = _config.Get("matrix", "");
+  if(!matrix.empty()) {
+    auto pixels = readMatrix(matrix);
+    if(matrixConfigured && pixels == pixelConfiguration) {
+      LOG(INFO) << "Matrix was already configured. Skipping.";
     } else {
-      LOG(INFO) << "No pixel matrix configuration setting found.";
+      LOG(INFO) << "Found pixel matrix setup in configuration, programming file \"" << matrix << "\"...";
+      pixelConfiguration = pixels;
+      configureMatrix(std::string());
     }
   } else {
-    LOG(INFO) << "Matrix was already configured. Skipping.";
+    LOG(INFO) << "No pixel matrix configuration setting found.";
   }
 
   // CLICTD signal order (from LSB):
@@ -268,6 +304,10 @@ void CLICTDDevice::reset() {
   usleep(5);
   // deny reset:
   setMemory("chipcontrol", 0);
+
+  // The chip registers and the pixel matrix are back to their default values:
+  invalidateRegisters();
+  matrixConfigured = false;
 }
 
 CLICTDDevice::~CLICTDDevice() {
@@ -285,13 +325,10 @@ void CLICTDDevice::configureClock(bool internal) {
   if(!internal) {
     LOG(DEBUG) << "Waiting for clock to lock...";
     // Try for a limited time to lock, otherwise abort:
-    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
-    while(!_hal->isLockedSI5345()) {
-      auto dur = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - start);
-      if(dur.count() > 3)
-        throw DeviceException("Cannot lock to external clock.");
-    }
+    if(!_hal->waitLockedSI5345(std::chrono::seconds(3)))
+      throw DeviceException("Cannot lock to external clock.");
   }
+  clockInternal = internal;
 }
 
 std::vector<uint32_t> CLICTDDevice::getRawData() {
@@ -322,7 +359,7 @@ std::vector<uint32_t> CLICTDDevice::getFrame(bool manual_readout) {
     LOG(DEBUG) << "Frame readout requested";
     setMemory("rdcontrol", 1);
     uint32_t attempts = 0;
-    while((getMemory("rdstatus")) & 0x20) {
+    while(rdstatus_.read() & 0x20) {
       usleep(100);
       if(attempts++ >= 16384) {
         LOG(ERROR) << "Frame readout timeout";
@@ -333,9 +370,9 @@ std::vector<uint32_t> CLICTDDevice::getFrame(bool manual_readout) {
 
   // Poll data until there nothing something left anymore
   std::vector<uint32_t> rawdata;
-  while((getMemory("rdstatus")) & 0b1) {
+  while(rdstatus_.read() & 0b1) {
     LOG(TRACE) << "Reading word " << rawdata.size() << " from FIFO";
-    uint32_t data = getMemory("rdfifo");
+    uint32_t data = rdfifo_.read();
     rawdata.push_back(data);
   }
   LOG(DEBUG) << "Read " << rawdata.size() << " 32bit words from FIFO.";
@@ -351,7 +388,7 @@ std::vector<uint32_t> CLICTDDevice::getTimestamps() {
 
   LOG(DEBUG) << "Requesting timestamps";
 
-  if((getMemory("tsstatus") & 0x1) == 0) {
+  if((tsstatus_.read() & 0x1) == 0) {
     LOG(WARNING) << "Timestamps FIFO is empty";
     return std::vector<uint32_t>();
   }
@@ -359,13 +396,13 @@ std::vector<uint32_t> CLICTDDevice::getTimestamps() {
   std::vector<uint32_t> timestamps;
   do {
     // Read LSB and MSB of timestamp
-    uint32_t ts_lsb = getMemory("tsfifodata_lsb");
-    uint32_t ts_msb = getMemory("tsfifodata_msb");
+    uint32_t ts_lsb = tsfifodata_lsb_.read();
+    uint32_t ts_msb = tsfifodata_msb_.read();
 
     timestamps.push_back(ts_msb);
     timestamps.push_back(ts_lsb);
     LOG(DEBUG) << ts_msb << " | " << ts_lsb << "\t= " << ((static_cast<uint64_t>(ts_msb) << 32) | ts_lsb);
-  } while(getMemory("tsstatus") & 0x1);
+  } while(tsstatus_.read() & 0x1);
 
   LOG(DEBUG) << "Received " << timestamps.size() / 2 << " timestamps: " << listVector(timestamps, ",", false);
 
@@ -450,7 +487,7 @@ void CLICTDDevice::programMatrix() {
   auto check_clk_stopped = [this]() {
     // check if readout clock is running
     int retry = 0;
-    while(!(getMemory("rdstatus") & 0x10)) {
+    while(!(rdstatus_.read() & 0x10)) {
       if(++retry > 3) {
         LOG(ERROR) << "Readout clock still running despite being in the matrix configuration mode.";
         return false;
@@ -462,7 +499,7 @@ void CLICTDDevice::programMatrix() {
   auto check_clk_running = [this]() {
     // check if readout clock is stopped
     int retry = 0;
-    while(getMemory("rdstatus") & 0x10) {
+    while(rdstatus_.read() & 0x10) {
       if(++retry > 3) {
         LOG(ERROR) << "Readout clock not running despite the matrix configuration mode should be off.";
         return false;
@@ -497,13 +534,13 @@ void CLICTDDevice::programMatrix() {
         int retry = 0;
         while(retry <= CLICTD_MAX_CONF_RETRY) {
           // Write the value to ’configData’ register
-          this->setRegister("configdata", value);
+          this->setRegister(configdata_, value);
           // Write 0x11/0x12 to ’configCtrl’ register to shift configuration in the matrix
-          this->setRegister("configctrl", 0x10 | (first_stage ? 0x01 : 0x02));
+          this->setRegister(configctrl_, 0x10 | (first_stage ? 0x01 : 0x02));
           // Write 0x01/0x02 to ’configCtrl’ register
-          this->setRegister("configctrl", 0x00 | (first_stage ? 0x01 : 0x02));
+          this->setRegister(configctrl_, 0x00 | (first_stage ? 0x01 : 0x02));
           // Repeat until the clock pulse was generated
-          if((getMemory("rdstatus") & 0x6) == 0x6) {
+          if((rdstatus_.read() & 0x6) == 0x6) {
             break;
           }
           retry++;
@@ -570,13 +607,13 @@ void CLICTDDevice::programMatrix() {
 
   LOG(INFO) << "Matrix configuration - Stage 1";
   // Write 0x01 to ’configCtrl’ register (start 1st configuration stage)
-  this->setRegister("configctrl", 0x01);
+  this->setRegister(configctrl_, 0x01);
   // Check if clock is stopped and also clear readout/clock status register by reading it
   check_clk_stopped();
   // Configure stage 1
   configure_stage(true);
   // Write 0x00 to ’configCtrl’ register - switch back to readout mode.
-  this->setRegister("configctrl", 0x00);
+  this->setRegister(configctrl_, 0x00);
   // Check if the clock was restarted
   check_clk_running();
 
@@ -587,13 +624,13 @@ void CLICTDDevice::programMatrix() {
 
   LOG(INFO) << "Matrix configuration - Stage 2";
   // Write 0x02 to ’configCtrl’ register (start 2nd configuration stage)
-  this->setRegister("configctrl", 0x02);
+  this->setRegister(configctrl_, 0x02);
   // Check if clock is stopped and also clear readout/clock status register by reading it
   check_clk_stopped();
   // Configure stage 2
   configure_stage(false);
   // Write 0x00 to ’configCtrl’ register - switch back to readout mode.
-  this->setRegister("configctrl", 0x00);
+  this->setRegister(configctrl_, 0x00);
   // Check if the clock was restarted
   check_clk_running();
 
@@ -622,8 +659,8 @@ void CLICTDDevice::setSpecialRegister(std::string name, uint32_t value) {
     uint8_t lsb = value & 0x00FF;
     uint8_t msb = (value >> 8) & 0xFF;
     // Set the two values:
-    this->setRegister(name + "_msb", msb);
-    this->setRegister(name + "_lsb", lsb);
+    this->setRegister(configdata_msb_, msb);
+    this->setRegister(configdata_lsb_, lsb);
   } else if(name == "longcnt") {
     // Reconfiguring the frame decoder with the new setting:
     frame_decoder_.setLongCounter(static_cast<bool>(value));
@@ -746,6 +783,11 @@ pearydata CLICTDDevice::getData() {
   return frame_decoder_.decodeFrame(rawdata);
 }
 
+void CLICTDDevice::getHits(pearyhits& hits) {
+  auto rawdata = getFrame();
+  frame_decoder_.decodeFrame(rawdata, hits);
+}
+
 void CLICTDDevice::setOutputMultiplexer(std::string name) {
   std::map<std::string, int> monitordacsel{{"vbiasresettransistor", 1},
                                            {"vreset", 2},
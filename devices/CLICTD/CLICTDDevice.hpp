@@ -12,6 +12,7 @@
 
 #include "CLICTDDefaults.hpp"
 #include "CLICTDFrameDecoder.hpp"
+#include "CLICTDFrameGenerator.hpp"
 #include "CLICTDPixels.hpp"
 
 namespace caribou {
@@ -25,6 +26,10 @@ namespace caribou {
     ~CLICTDDevice();
 
     /** Initializer function for CLICTD
+     *
+     *  If the chip has been configured before with the same clock source, the clock setup and the chip reset are skipped
+     *  and only settings which changed are applied, the pixel matrix is only programmed if it differs. Use configureFull()
+     *  to run the complete initialization sequence.
      */
     void configure();
 
@@ -52,6 +57,7 @@ namespace caribou {
     void reset();
 
     pearydata getData();
+    void getHits(pearyhits& hits);
     std::vector<uint32_t> getRawData();
 
     void setSpecialRegister(std::string name, uint32_t value);
@@ -84,6 +90,9 @@ namespace caribou {
 
     bool matrixConfigured;
 
+    // Clock source the device has last been configured for
+    bool clockInternal{true};
+
     std::vector<uint32_t> getFrame(bool manual_readout = false);
 
     std::vector<uint32_t> getTimestamps();
@@ -95,6 +104,22 @@ namespace caribou {
 
     CLICTDFrameDecoder frame_decoder_;
 
+    // Pre-resolved handles to the FIFO registers accessed in the readout loops
+    memory_handle rdfifo_;
+    memory_handle rdstatus_;
+    memory_handle tsfifodata_lsb_;
+    memory_handle tsfifodata_msb_;
+    memory_handle tsstatus_;
+
+    // Pre-resolved handles to the registers written for every bit of the matrix configuration
+    register_handle configdata_;
+    register_handle configdata_lsb_;
+    register_handle configdata_msb_;
+    register_handle configctrl_;
+
+    // Synthetic frames served to the readout when the memory interface is emulated
+    std::shared_ptr<CLICTDFrameGenerator> frame_generator_;
+
     matrixConfig readMatrix(std::string filename) const;
   };
 
@@ -60,25 +60,42 @@ uint32_t CLICTDFrameDecoder::getNextPixel(const std::vector<uint32_t>& rawFrame,
 }
 
 pearydata CLICTDFrameDecoder::decodeFrame(const std::vector<uint32_t>& rawFrame, bool decode_lfsr) {
+  pearyhits hits;
+  decodeFrame(rawFrame, hits, decode_lfsr);
+
+  return hits.toPearydata([decode_lfsr](const pearyhits::hit& hit) -> std::unique_ptr<pixel> {
+    if(!decode_lfsr) {
+      return std::make_unique<CLICTDPixelReadout>(hit.raw, hit.longcnt);
+    } else if(hit.longcnt) {
+      return std::make_unique<CLICTDPixelReadout>(true, hit.toa, static_cast<uint8_t>(hit.cnt));
+    }
+    return std::make_unique<CLICTDPixelReadout>(
+      true, static_cast<uint8_t>(hit.tot), static_cast<uint8_t>(hit.toa), static_cast<uint8_t>(hit.cnt));
+  });
+}
+
+void CLICTDFrameDecoder::decodeFrame(const std::vector<uint32_t>& rawFrame, pearyhits& hits, bool decode_lfsr) {
   unsigned wrd = 0;
   unsigned bit = 31;
-  pearydata data;
+  hits.clear();
 
   if(getNextPixel(rawFrame, wrd, bit) != CLICTD_FRAME_START) {
     LOG(ERROR) << "The first word does not match the frame start pattern.";
-    return data;
+    return;
   }
 
-  for(uint8_t col = 0; col < CLICTD_COLUMNS; col++) {
+  // A corrupted column header ends the frame, the pixels collected so far are kept:
+  uint8_t col = 0;
+  for(; col < CLICTD_COLUMNS; col++) {
     // start of column
     uint32_t bits_of_data = getNextPixel(rawFrame, wrd, bit);
     if((bits_of_data & ~CLICTD_COLUMN_ID_MASK) != CLICTD_COLUMN_ID) {
       LOG(ERROR) << "Column " << col << " header does not match the pattern.";
-      return data;
+      break;
     }
     if(((bits_of_data & CLICTD_COLUMN_ID_MASK) >> CLICTD_COLUMN_ID_MASK_SHIFT) != col) {
       LOG(ERROR) << "Column " << col << " header does not match the expected column number.";
-      return data;
+      break;
     }
     // row data
     for(uint8_t row = 0; row < CLICTD_ROWS; row++) {
@@ -91,26 +108,32 @@ pearydata CLICTDFrameDecoder::decodeFrame(const std::vector<uint32_t>& rawFrame,
       }
 
       if(decode_lfsr) {
-        auto tot = static_cast<uint8_t>(LFSR::LUT5((bits_of_data >> 16) & 0x1f));
-        auto toa = (longcnt ? static_cast<uint16_t>(LFSR::LUT13((bits_of_data >> 8) & 0x1fff))
-                            : static_cast<uint8_t>(LFSR::LUT8((bits_of_data >> 8) & 0xff)));
-        auto hits = static_cast<uint8_t>(bits_of_data & 0xff);
-
-        // Create new pixel
-        auto pixel = (longcnt ? std::make_unique<CLICTDPixelReadout>(true, toa, hits)
-                              : std::make_unique<CLICTDPixelReadout>(true, tot, toa, hits));
-
-        data[std::make_pair(col, row)] = std::move(pixel);
+        // Store the raw counter values, they are decoded for all pixels at once below
+        auto tot = (longcnt ? 0 : static_cast<uint16_t>((bits_of_data >> 16) & 0x1f));
+        auto toa = static_cast<uint16_t>((bits_of_data >> 8) & (longcnt ? 0x1fff : 0xff));
+        auto cnt = static_cast<uint16_t>(bits_of_data & 0xff);
+        hits.add(col, row, bits_of_data, tot, toa, cnt, longcnt);
       } else {
-        data[std::make_pair(col, row)] = std::make_unique<CLICTDPixelReadout>(bits_of_data, longcnt);
+        hits.add(col, row, bits_of_data, 0, 0, 0, longcnt);
       }
     }
   }
-  if(getNextPixel(rawFrame, wrd, bit) != CLICTD_FRAME_END) {
+  if(col == CLICTD_COLUMNS && getNextPixel(rawFrame, wrd, bit) != CLICTD_FRAME_END) {
     LOG(ERROR) << "The last word does not match the frame end pattern.";
-    return data;
   }
-  return data;
+
+  if(decode_lfsr) {
+    decodeCounters(hits);
+  }
+}
+
+void CLICTDFrameDecoder::decodeCounters(pearyhits& hits) {
+  if(longcnt) {
+    LFSR::LUT13(hits.toa(), hits.toa(), hits.size());
+  } else {
+    LFSR::LUT5(hits.tot(), hits.tot(), hits.size());
+    LFSR::LUT8(hits.toa(), hits.toa(), hits.size());
+  }
 }
 
 std::vector<uint32_t> CLICTDFrameDecoder::splitFrame(const std::vector<uint32_t>& rawFrame) {
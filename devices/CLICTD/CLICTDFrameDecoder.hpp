@@ -26,10 +26,13 @@ namespace caribou {
     void setLongCounter(bool value) { longcnt = value; };
 
     pearydata decodeFrame(const std::vector<uint32_t>& rawFrame, bool decode_lfsr = true);
+    void decodeFrame(const std::vector<uint32_t>& rawFrame, pearyhits& hits, bool decode_lfsr = true);
     std::vector<uint32_t> splitFrame(const std::vector<uint32_t>& rawFrame);
 
   private:
     uint32_t getNextPixel(const std::vector<uint32_t>& rawFrame, unsigned& word, unsigned& bit);
+    // Decode the LFSR counters of all hits in the container
+    void decodeCounters(pearyhits& hits);
     bool longcnt{};
   };
 }
@@ -0,0 +1,137 @@
+#include "CLICTDFrameGenerator.hpp"
+
+#include <chrono>
+
+using namespace caribou;
+
+namespace {
+  // Addresses of the registers of the readout firmware, see the CLICTD memory map
+  const std::intptr_t RDFIFO = CLICTD_READOUT_BASE_ADDRESS + CLICTD_READOUT_RDFIFO_OFFSET;
+  const std::intptr_t RDSTATUS = CLICTD_READOUT_BASE_ADDRESS + CLICTD_READOUT_RDSTATUS_OFFSET;
+  const std::intptr_t RDCONTROL = CLICTD_READOUT_BASE_ADDRESS + CLICTD_READOUT_RDCONTROL_OFFSET;
+  const std::intptr_t WGCONTROL = CLICTD_READOUT_BASE_ADDRESS + (5 << CLICTD_READOUT_LSB);
+  const std::intptr_t TSFIFODATA_LSB = CLICTD_READOUT_BASE_ADDRESS + (12 << CLICTD_READOUT_LSB);
+  const std::intptr_t TSFIFODATA_MSB = CLICTD_READOUT_BASE_ADDRESS + (13 << CLICTD_READOUT_LSB);
+  const std::intptr_t TSSTATUS = CLICTD_READOUT_BASE_ADDRESS + (14 << CLICTD_READOUT_LSB);
+
+  // Timestamps are counted in cycles of the 100MHz clock of the readout firmware
+  uint64_t timestamp() {
+    return static_cast<uint64_t>(
+             std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+               .count()) /
+           10;
+  }
+} // namespace
+
+std::vector<std::intptr_t> CLICTDFrameGenerator::addresses() {
+  return {RDFIFO, RDSTATUS, RDCONTROL, WGCONTROL, TSFIFODATA_LSB, TSFIFODATA_MSB, TSSTATUS};
+}
+
+uint32_t CLICTDFrameGenerator::read(std::intptr_t address, uint32_t stored) {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  if(address == RDFIFO) {
+    if(_fifo.empty()) {
+      return 0;
+    }
+    auto word = _fifo.front();
+    _fifo.pop_front();
+    return word;
+  } else if(address == RDSTATUS) {
+    // A read of an empty FIFO ends the frame, the next one is made available at the following status read if it is due
+    if(_fifo.empty() && !_pending && due(1) > 0) {
+      generateFrame(false);
+    }
+    if(_fifo.empty()) {
+      _pending = false;
+    }
+    // Readout requests are served immediately, the request flag is never pending
+    return (stored & ~0x21u) | (_fifo.empty() ? 0x0 : 0x1);
+  } else if(address == TSSTATUS) {
+    return (stored & ~0x1u) | (_timestamps.empty() ? 0x0 : 0x1);
+  } else if(address == TSFIFODATA_LSB) {
+    return _timestamps.empty() ? 0 : static_cast<uint32_t>(_timestamps.front());
+  } else if(address == TSFIFODATA_MSB) {
+    // The timestamp is consumed with the read of its upper half
+    if(_timestamps.empty()) {
+      return 0;
+    }
+    auto msb = static_cast<uint32_t>(_timestamps.front() >> 32);
+    _timestamps.pop_front();
+    return msb;
+  }
+  return stored;
+}
+
+void CLICTDFrameGenerator::write(std::intptr_t address, uint32_t value) {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  if(address == RDCONTROL) {
+    if(value & 0x2) {
+      // Reset of the readout state machine clears the FIFO
+      _fifo.clear();
+      _pending = false;
+    }
+    if(value & 0x1) {
+      generateFrame(false);
+    }
+  } else if(address == WGCONTROL && (value & 0x1)) {
+    // The pattern generator opens the shutter and triggers the readout of the frame
+    generateFrame(true);
+  }
+}
+
+std::vector<uint32_t> CLICTDFrameGenerator::frame() {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  _fifo.clear();
+  generateFrame(false);
+  std::vector<uint32_t> frame(_fifo.begin(), _fifo.end());
+  _fifo.clear();
+  _pending = false;
+  return frame;
+}
+
+void CLICTDFrameGenerator::generateFrame(bool shutter) {
+  if(shutter) {
+    _timestamps.push_back(timestamp());
+  }
+
+  push(CLICTD_FRAME_START, CLICTD_PIXEL_BITS);
+  auto hit = hits(CLICTD_COLUMNS * CLICTD_ROWS);
+  auto next = hit.begin();
+  for(uint32_t col = 0; col < CLICTD_COLUMNS; col++) {
+    push(CLICTD_COLUMN_ID | (col << CLICTD_COLUMN_ID_MASK_SHIFT), CLICTD_PIXEL_BITS);
+    for(size_t row = 0; row < CLICTD_ROWS; row++) {
+      // Zero-suppressed pixels take a single bit, hit pixels are flagged by their most significant bit
+      if(next != hit.end() && *next == col * CLICTD_ROWS + row) {
+        push((1u << (CLICTD_PIXEL_BITS - 1)) | random(CLICTD_PIXEL_BITS - 1), CLICTD_PIXEL_BITS);
+        ++next;
+      } else {
+        push(0, 1);
+      }
+    }
+  }
+  push(CLICTD_FRAME_END, CLICTD_PIXEL_BITS);
+
+  // The last word is padded with zeros
+  if(_nbits > 0) {
+    push(0, 32 - _nbits);
+  }
+  _pending = true;
+
+  if(shutter) {
+    _timestamps.push_back(timestamp());
+  }
+}
+
+void CLICTDFrameGenerator::push(uint32_t value, unsigned int bits) {
+  // Bits are shifted out most significant first, filling the FIFO words from their most significant bit
+  _bits = (_bits << bits) | value;
+  _nbits += bits;
+  if(_nbits >= 32) {
+    _nbits -= 32;
+    _fifo.push_back(static_cast<uint32_t>(_bits >> _nbits));
+    _bits &= (1ull << _nbits) - 1;
+  }
+}
@@ -0,0 +1,54 @@
+#ifndef CLICTD_FRAMEGENERATOR_HPP
+#define CLICTD_FRAMEGENERATOR_HPP
+
+#include <deque>
+#include <vector>
+
+#include "carboard/generator.hpp"
+
+#include "CLICTDDefaults.hpp"
+#include "CLICTDFrameDecoder.hpp"
+
+namespace caribou {
+
+  /** Synthetic CLICTD frames in the emulated readout FIFO
+   *
+   *  Frames are produced in the zero-suppressed format of the chip when a readout is requested via the "rdcontrol" or
+   *  "wgcontrol" registers, and at the configured rate otherwise. Frames triggered by the pattern generator come with the
+   *  timestamps of the shutter.
+   */
+  class CLICTDFrameGenerator : public data_generator {
+  public:
+    explicit CLICTDFrameGenerator(const Configuration& config) : data_generator(config){};
+
+    uint32_t read(std::intptr_t address, uint32_t stored) override;
+    void write(std::intptr_t address, uint32_t value) override;
+
+    /**
+     * @brief Physical addresses of the readout registers served by the generator
+     */
+    static std::vector<std::intptr_t> addresses();
+
+    /**
+     * @brief Produce a frame directly instead of via the emulated registers, e.g. to benchmark the decoder
+     *
+     * Data waiting in the FIFO is discarded.
+     */
+    std::vector<uint32_t> frame();
+
+  private:
+    // Append a frame to the FIFO, optionally with the timestamps of the shutter opening and closing
+    void generateFrame(bool shutter);
+    void push(uint32_t value, unsigned int bits);
+
+    std::deque<uint32_t> _fifo;
+    std::deque<uint64_t> _timestamps;
+
+    // Set while the FIFO holds a frame which has not been reported as read completely
+    bool _pending{false};
+    uint64_t _bits{0};
+    unsigned int _nbits{0};
+  };
+} // namespace caribou
+
+#endif
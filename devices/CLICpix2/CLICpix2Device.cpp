@@ -49,6 +49,32 @@ CLICpix2Device::CLICpix2Device(const caribou::Configuration config)
   // Add memory pages to the dictionary:
   _memory.add(CLICPIX2_MEMORY);
 
+  // Resolve the frame and timestamp FIFO registers once:
+  _frame = getMemoryHandle("frame");
+  _frame_size = getMemoryHandle("frame_size");
+  _timestamp_lsb = getMemoryHandle("timestamp_lsb");
+  _timestamp_msb = getMemoryHandle("timestamp_msb");
+  _wave_control = getMemoryHandle("wave_control");
+
+  // Resolve the readout register written for every frame once:
+  _readout = getRegisterHandle("readout");
+
+  // The readout and matrix programming registers trigger an action on every write, the pulse generator counts and delay
+  // are consumed by the pulse generator. Never cache them:
+  setRegisterVolatile("readout");
+  setRegisterVolatile("matrix_programming");
+  setRegisterVolatile("pulsegen_counts_LSB");
+  setRegisterVolatile("pulsegen_counts_MSB");
+  setRegisterVolatile("pulsegen_delay_LSB");
+  setRegisterVolatile("pulsegen_delay_MSB");
+  enableRegisterCache();
+
+  if(carboard_emulator::emulatesMemory()) {
+    _generator =
+      std::make_shared<clicpix2_frameGenerator>(_config, _config.Get("devicepath", std::string(DEFAULT_DEVICEPATH)));
+    carboard_emulator::getInstance().attach(_generator, clicpix2_frameGenerator::addresses());
+  }
+
   // set default CLICpix2 control
   setMemory("reset", 0);
 }
@@ -64,9 +90,16 @@ void CLICpix2Device::setMem(std::string name, uint32_t value) {
 
 void CLICpix2Device::configure() {
   LOG(INFO) << "Configuring";
-  configureClock(_config.Get<bool>("clock_internal", false));
-  reset();
-  mDelay(10);
+
+  // A configured chip running from the requested clock only needs the settings updated which have changed:
+  bool clock_internal = _config.Get<bool>("clock_internal", false);
+  if(is_configured() && clock_internal == _clock_internal) {
+    LOG(INFO) << "Device already configured, applying changed settings only";
+  } else {
+    configureClock(clock_internal);
+    reset();
+    mDelay(10);
+  }
 
   // Read pattern generator from the configuration and program it:
   std::string pg = _config.Get("patterngenerator", "");
@@ -77,11 +110,17 @@ void CLICpix2Device::configure() {
     LOG(INFO) << "No pattern generator found in configuration.";
   }
 
-  // Read matrix file from the configuration and program it:
+  // Read matrix file from the configuration and program it unless the chip holds this configuration already:
   std::string matrix = _config.Get("matrix", "");
   if(!matrix.empty()) {
-    LOG(INFO) << "Found pixel matrix setup in configuration, programming...";
-    configureMatrix(matrix);
+    auto pixels = readMatrix(matrix);
+    if(_matrix_programmed && pixels == pixelsConfig) {
+      LOG(INFO) << "Pixel matrix configuration unchanged, skipping.";
+    } else {
+      LOG(INFO) << "Found pixel matrix setup in configuration, programming...";
+      pixelsConfig = pixels;
+      configureMatrix();
+    }
   } else {
     LOG(INFO) << "No pixel matrix configuration setting found.";
   }
@@ -91,7 +130,7 @@ void CLICpix2Device::configure() {
   CaribouDevice<iface_spi_CLICpix2>::configure();
 
   // If no matrix was given via the config, set a fully masked matrix:
-  if(_config.Get("matrix", "").empty()) {
+  if(matrix.empty() && !_matrix_programmed) {
     configureMatrix();
   }
 }
@@ -104,6 +143,10 @@ void CLICpix2Device::reset() {
   usleep(1);
   // deny reset:
   setMemory("reset", getMemory("reset") | CLICPIX2_CONTROL_RESET_MASK);
+
+  // The chip registers and the pixel matrix are back to their default values:
+  invalidateRegisters();
+  _matrix_programmed = false;
 }
 
 CLICpix2Device::~CLICpix2Device() {
@@ -201,6 +244,7 @@ void CLICpix2Device::powerUp() {
 
 void CLICpix2Device::powerDown() {
   LOG(INFO) << "Power off";
+  _matrix_programmed = false;
 
   LOG(DEBUG) << "Power off CML_IREF";
   this->switchOff("cml_iref");
@@ -238,7 +282,8 @@ void CLICpix2Device::configureMatrix(std::string filename) {
   }
 
   // Prepare decoder for configuration:
-  clicpix2_frameDecoder decoder(false, false, pixelsConfig);
+  _decoder.setPixelConfiguration(pixelsConfig);
+  _decoder.setCompression(false, false);
 
   // Retry programming matrix:
   int retry = 0;
@@ -250,14 +295,14 @@ void CLICpix2Device::configureMatrix(std::string filename) {
       // Read back the matrix configuration and thus clear it:
       LOG(DEBUG) << "Flushing matrix...";
       std::vector<uint32_t> frame = getFrame();
-      decoder.decode(frame, false);
+      _decoder.decode(frame, false);
 
       LOG(INFO) << "Verifing matrix configuration...";
       bool configurationError = false;
       for(const auto& px : pixelsConfig) {
 
         // Fetch readback value for this pixel:
-        pixelReadout pxv = decoder.get(px.first.first, px.first.second);
+        pixelReadout pxv = _decoder.get(px.first.first, px.first.second);
 
         // The flag bit if the readout is returned as (mask | (threshold & 0x1)), thus resetting to mask state only:
         if(pxv.GetBit(8)) {
@@ -291,6 +336,7 @@ void CLICpix2Device::configureMatrix(std::string filename) {
   // Reset compression state to previous values:
   this->setRegister("comp", comp);
   this->setRegister("sp_comp", sp_comp);
+  _matrix_programmed = true;
 }
 
 void CLICpix2Device::triggerPatternGenerator(bool sleep) {
@@ -298,8 +344,8 @@ void CLICpix2Device::triggerPatternGenerator(bool sleep) {
   LOG(DEBUG) << "Triggering pattern generator once.";
 
   // Write into enable register of pattern generator:
-  setMemory("wave_control", getMemory("wave_control") & ~(CLICPIX2_CONTROL_WAVE_GENERATOR_ENABLE_MASK));
-  setMemory("wave_control", getMemory("wave_control") | CLICPIX2_CONTROL_WAVE_GENERATOR_ENABLE_MASK);
+  _wave_control.write(_wave_control.read() & ~(CLICPIX2_CONTROL_WAVE_GENERATOR_ENABLE_MASK));
+  _wave_control.write(_wave_control.read() | CLICPIX2_CONTROL_WAVE_GENERATOR_ENABLE_MASK);
 
   // Wait for its length before returning:
   if(sleep)
@@ -419,7 +465,8 @@ void CLICpix2Device::programMatrix() {
 
   LOG(DEBUG) << "Number of SPI commands: " << spi_data.size();
 
-  // Finally, send the data over the SPI interface:
+  // Finally, send the data over the SPI interface, after any register writes held back:
+  flushRegisters();
   _hal->send(spi_data);
 }
 
@@ -436,13 +483,10 @@ void CLICpix2Device::configureClock(bool internal) {
     LOG(DEBUG) << "Waiting for clock to lock...";
 
     // Try for a limited time to lock, otherwise abort:
-    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
-    while(!_hal->isLockedSI5345()) {
-      auto dur = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - start);
-      if(dur.count() > 3)
-        throw DeviceException("Cannot lock to external clock.");
-    }
+    if(!_hal->waitLockedSI5345(std::chrono::seconds(3)))
+      throw DeviceException("Cannot lock to external clock.");
   }
+  _clock_internal = internal;
 }
 
 void CLICpix2Device::powerStatusLog() {
@@ -501,6 +545,7 @@ void CLICpix2Device::exploreInterface() {
     pairvec.push_back(std::make_pair(i, default_rx[y++].second));
   }
   _hal->send(pairvec);
+  invalidateRegisters();
   LOG(INFO) << "Reverting the default values of registers (addresses range 0x0a - 0x3E)";
   LOG(INFO) << "Exploring interface capabilities... Done";
 }
@@ -514,35 +559,49 @@ pearydata CLICpix2Device::decodeFrame(const std::vector<uint32_t>& frame) {
   uint32_t comp = _register_cache["comp"];
   uint32_t sp_comp = _register_cache["sp_comp"];
 
-  clicpix2_frameDecoder decoder((bool)comp, (bool)sp_comp, pixelsConfig);
-  decoder.decode(frame);
-  LOG(DEBUG) << "Decoded frame [row][column]:\n" << decoder;
-  return decoder.getZerosuppressedFrame();
+  _decoder.setCompression((bool)comp, (bool)sp_comp);
+  _decoder.decode(frame);
+  LOG(DEBUG) << "Decoded frame [row][column]:\n" << _decoder;
+  return _decoder.getZerosuppressedFrame();
+}
+
+void CLICpix2Device::decodeFrame(const std::vector<uint32_t>& frame, pearyhits& hits) {
+
+  uint32_t comp = _register_cache["comp"];
+  uint32_t sp_comp = _register_cache["sp_comp"];
+
+  _decoder.setCompression((bool)comp, (bool)sp_comp);
+  _decoder.decode(frame);
+  LOG(DEBUG) << "Decoded frame [row][column]:\n" << _decoder;
+  _decoder.getZerosuppressedFrame(hits);
 }
 
 pearydata CLICpix2Device::getData() {
   return decodeFrame(getFrame());
 }
 
+void CLICpix2Device::getHits(pearyhits& hits) {
+  decodeFrame(getFrame(), hits);
+}
+
 std::vector<uint32_t> CLICpix2Device::getFrame() {
 
   LOG(DEBUG) << "Frame readout requested";
-  this->setRegister("readout", 0);
+  this->setRegister(_readout, 0);
   std::vector<uint32_t> frame;
 
   // Poll data until frameSize doesn't change anymore
-  unsigned int frameSize = getMemory("frame_size");
+  unsigned int frameSize = _frame_size.read();
   unsigned int frameSize_previous;
   do {
     frameSize_previous = frameSize;
     usleep(100);
-    frameSize = getMemory("frame_size");
+    frameSize = _frame_size.read();
   } while(frameSize != frameSize_previous);
 
-  frame.reserve(frameSize);
-  for(unsigned int i = 0; i < frameSize; ++i) {
-    frame.emplace_back(getMemory("frame"));
-  }
+  // Drain the full frame from the FIFO in one go:
+  frame.resize(frameSize);
+  _frame.read(frame.data(), frame.size());
   LOG(DEBUG) << "Read raw SerDes data:\n" << listVector(frame, ", ", true);
   return frame;
 }
@@ -580,7 +639,7 @@ std::vector<uint32_t> CLICpix2Device::getTimestamps() {
   LOG(DEBUG) << "Requesting timestamps";
 
   // dummy readout
-  if((getMemory("timestamp_msb") & 0x80000000) != 0) {
+  if((_timestamp_msb.read() & 0x80000000) != 0) {
     LOG(WARNING) << "Timestamps FIFO is empty";
     return timestamps;
   }
@@ -589,10 +648,10 @@ std::vector<uint32_t> CLICpix2Device::getTimestamps() {
   uint32_t ts_msb;
   do {
     // Read LSB
-    ts_lsb = getMemory("timestamp_lsb");
+    ts_lsb = _timestamp_lsb.read();
 
     // Read MSB and remove top header bits
-    ts_msb = getMemory("timestamp_msb");
+    ts_msb = _timestamp_msb.read();
 
     timestamps.push_back(ts_msb & 0x7ffff);
     timestamps.push_back(ts_lsb);
@@ -16,6 +16,7 @@
 #include "clockgenerator/Si5345-RevB-CLICpix2-Registers.h"
 #include "clockgenerator/Si5345-RevB-CLICpix2-Registers_freeRunningMode.h"
 #include "framedecoder/clicpix2_frameDecoder.hpp"
+#include "framedecoder/clicpix2_frameGenerator.hpp"
 
 namespace caribou {
 
@@ -33,6 +34,10 @@ namespace caribou {
     ~CLICpix2Device();
 
     /** Initializer function for CLICpix2
+     *
+     *  If the chip has been configured before with the same clock source, the clock setup and the chip reset are skipped
+     *  and only settings which changed are applied, the pixel matrix is only programmed if it differs. Use configureFull()
+     *  to run the complete initialization sequence.
      */
     void configure();
 
@@ -85,6 +90,13 @@ namespace caribou {
      */
     pearydata getData();
 
+    /**
+     * Reading one decoded data frame from CLICpix2 into a flat hit container
+     * @warning This function does NOT trigger the Pattern Generator! It needs to be done manually before calling getHits()
+     * @param hits Container filled with the pixel hits from one frame, in row-major order
+     */
+    void getHits(pearyhits& hits);
+
     void setSpecialRegister(std::string name, uint32_t value);
 
     // Reset the chip
@@ -119,14 +131,41 @@ namespace caribou {
      */
     std::map<std::pair<uint8_t, uint8_t>, pixelConfig> pixelsConfig{};
 
+    /* Flag indicating that the chip holds the matrix configuration stored above, cleared by a reset of the chip
+     */
+    bool _matrix_programmed{false};
+
+    /* Clock source the device has last been configured for
+     */
+    bool _clock_internal{false};
+
+    /* Frame decoder, kept for the lifetime of the device. The pixel configuration is updated whenever the matrix is
+     * configured, the compression settings before decoding each frame.
+     */
+    clicpix2_frameDecoder _decoder{false, false, {}};
+
     // Retrieve frame from device
     std::vector<uint32_t> getFrame();
 
     // Methods decodes frame
     pearydata decodeFrame(const std::vector<uint32_t>& frame);
+    void decodeFrame(const std::vector<uint32_t>& frame, pearyhits& hits);
 
     // Total pattern generator length
     uint32_t pg_total_length;
+
+    // Pre-resolved handles to the frame and timestamp FIFO registers and the pattern generator control
+    memory_handle _frame;
+    memory_handle _frame_size;
+    memory_handle _timestamp_lsb;
+    memory_handle _timestamp_msb;
+    memory_handle _wave_control;
+
+    // Pre-resolved handle to the chip register starting the readout of a frame
+    register_handle _readout;
+
+    // Synthetic frames served to the receiver when the memory interface is emulated
+    std::shared_ptr<clicpix2_frameGenerator> _generator;
   };
 
 } // namespace caribou
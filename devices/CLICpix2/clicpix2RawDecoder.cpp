@@ -1,6 +1,11 @@
+#include <algorithm>
+#include <atomic>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "clicpix2_utilities.hpp"
@@ -8,13 +13,242 @@
 
 #include "utils/exceptions.hpp"
 #include "utils/log.hpp"
+#include "utils/runfile.hpp"
+#include "utils/utils.hpp"
 
 using namespace caribou;
 using namespace clicpix2_utils;
 
+namespace {
+  // Part of the raw data file starting with a frame header line ("=====") and ending before the next one
+  struct frame_chunk {
+    std::string text;
+    std::vector<std::string> header;
+    std::vector<uint32_t> rawData;
+    // Decoded CSV lines, number of pixel responses or the decoding error
+    std::string decoded;
+    size_t responses{0};
+    std::string error;
+  };
+
+  // Split the text into frame header lines, timestamps and raw data words
+  void parseChunk(frame_chunk& chunk) {
+    size_t pos = 0;
+    while(pos < chunk.text.size()) {
+      size_t end = chunk.text.find('\n', pos);
+      if(end == std::string::npos) {
+        end = chunk.text.size();
+      }
+      std::string line = chunk.text.substr(pos, end - pos);
+      pos = end + 1;
+
+      // Ignore empty lines and comments:
+      if(!line.length() || '#' == line.at(0)) {
+        continue;
+      }
+      // Frame headers and timestamps
+      if(line.find("====") != std::string::npos || line.find(":") != std::string::npos) {
+        chunk.header.push_back(line);
+      }
+      // Pixel hits
+      else {
+        chunk.rawData.push_back(atoi(line.c_str()));
+      }
+    }
+    chunk.text.clear();
+  }
+
+  // Decode the raw data of the chunk and format the pixel responses
+  void decodeChunk(clicpix2_frameDecoder& decoder, pearyhits& data, frame_chunk& chunk) {
+    try {
+      decoder.decode(chunk.rawData);
+      decoder.getZerosuppressedFrame(data);
+      data.sort();
+      std::ostringstream out;
+      for(const auto& hit : data) {
+        pixelReadout px(static_cast<uint16_t>(hit.raw), hit.longcnt);
+        out << hit.column << "," << hit.row << "," << px << "\n";
+      }
+      chunk.decoded = out.str();
+      chunk.responses = data.size();
+    } catch(caribou::DataException& e) {
+      chunk.error = e.what();
+    }
+  }
+
+  // Find the start of the next frame header line in the buffer, not considering lines starting before the given position
+  size_t findFrameHeader(const std::string& buffer, const size_t from) {
+    size_t pos = from;
+    while((pos = buffer.find("====", pos)) != std::string::npos) {
+      size_t start = buffer.rfind('\n', pos);
+      start = (start == std::string::npos ? 0 : start + 1);
+      // Skip comment lines
+      if(start >= from && buffer[start] != '#') {
+        return start;
+      }
+      pos = buffer.find('\n', pos);
+    }
+    return std::string::npos;
+  }
+
+  /* Decode batches of frames on multiple threads
+   *
+   * Frames of a batch are parsed and decoded in parallel, every thread using its own decoder instance, while the next
+   * batch is read from file. The results are written in order and the output is identical to the sequential decoding.
+   */
+  unsigned int decodeBatches(const std::function<std::vector<frame_chunk>()>& readBatch,
+                             std::ofstream& outfile,
+                             const unsigned int threads,
+                             const bool comp,
+                             const bool sp_comp,
+                             const std::map<std::pair<uint8_t, uint8_t>, pixelConfig>& conf) {
+    std::vector<clicpix2_frameDecoder> decoders(threads + 1, clicpix2_frameDecoder(comp, sp_comp, conf));
+    std::vector<pearyhits> data(threads + 1);
+
+    unsigned int frames = 0;
+    frame_chunk pending;
+    std::vector<frame_chunk> batch = readBatch();
+    while(!batch.empty()) {
+      // Parse and decode the batch in parallel:
+      std::atomic<size_t> index{0};
+      std::vector<std::thread> workers;
+      for(unsigned int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+          size_t i;
+          while((i = index++) < batch.size()) {
+            parseChunk(batch[i]);
+            if(!batch[i].rawData.empty() && !batch[i].header.empty()) {
+              decodeChunk(decoders[t], data[t], batch[i]);
+            }
+          }
+        });
+      }
+
+      // Read the next batch meanwhile:
+      std::vector<frame_chunk> next_batch = readBatch();
+      for(auto& worker : workers) {
+        worker.join();
+      }
+
+      // Write the results in order
+      for(auto& chunk : batch) {
+        // Frames without data or header are accumulated with the following one, decode the merged frame here:
+        if(!pending.header.empty() || !pending.rawData.empty()) {
+          pending.header.insert(pending.header.end(), chunk.header.begin(), chunk.header.end());
+          pending.rawData.insert(pending.rawData.end(), chunk.rawData.begin(), chunk.rawData.end());
+          chunk = std::move(pending);
+          pending = frame_chunk();
+          if(!chunk.rawData.empty() && !chunk.header.empty()) {
+            decodeChunk(decoders[threads], data[threads], chunk);
+          }
+        }
+
+        if(chunk.rawData.empty() || chunk.header.empty()) {
+          pending = std::move(chunk);
+          continue;
+        }
+
+        for(const auto& h : chunk.header) {
+          outfile << h << "\n";
+        }
+        if(!chunk.error.empty()) {
+          LOG(ERROR) << "Caugth DataException: " << chunk.error << ", clearing event data.";
+          continue;
+        }
+        outfile << chunk.decoded;
+        LOG(INFO) << chunk.header.front() << ": " << chunk.responses << " pixel responses";
+        frames++;
+      }
+      batch = std::move(next_batch);
+    }
+
+    return frames;
+  }
+
+  /* Decode the data body of a text file on multiple threads
+   *
+   * The file is read in large blocks and split at the frame headers, the frames are then handed to decodeBatches().
+   */
+  unsigned int decodeParallel(std::ifstream& f,
+                              std::ofstream& outfile,
+                              const unsigned int threads,
+                              const bool comp,
+                              const bool sp_comp,
+                              const std::map<std::pair<uint8_t, uint8_t>, pixelConfig>& conf) {
+    const size_t block_size = 16 * 1024 * 1024;
+    const size_t batch_size = 256 * threads;
+
+    // Read the next batch of frame chunks from file. Data after the last frame header is only complete once the end of
+    // the file is reached, the sequential decoding never writes the last frame of a file, so it is dropped here too.
+    std::string buffer;
+    std::vector<char> block(block_size);
+    auto readBatch = [&]() {
+      std::vector<frame_chunk> batch;
+      while(batch.size() < batch_size && f) {
+        f.read(block.data(), static_cast<std::streamsize>(block.size()));
+        buffer.append(block.data(), static_cast<size_t>(f.gcount()));
+
+        size_t start = 0, next;
+        while((next = findFrameHeader(buffer, start + 1)) != std::string::npos) {
+          frame_chunk chunk;
+          chunk.text = buffer.substr(start, next - start);
+          batch.push_back(std::move(chunk));
+          start = next;
+        }
+        buffer.erase(0, start);
+      }
+      return batch;
+    };
+
+    return decodeBatches(readBatch, outfile, threads, comp, sp_comp, conf);
+  }
+
+  /* Decode a binary run file
+   *
+   * The file header is replicated as comment lines, the compression settings are taken from the register snapshot. All
+   * frame records are complete, so also the last frame of the file is decoded.
+   */
+  unsigned int decodeRunfile(const std::string& datafile,
+                             std::ofstream& outfile,
+                             const unsigned int threads,
+                             const std::map<std::pair<uint8_t, uint8_t>, pixelConfig>& conf) {
+    runfile_reader reader(datafile);
+    const runfile_header& header = reader.header();
+
+    for(const auto& entry : header.metadata) {
+      LOG(DEBUG) << "Detected file header: " << entry.first << ": " << entry.second;
+      outfile << "# " << entry.first << ": " << entry.second << "\n";
+    }
+    outfile << "# Register state: " << listVector(header.registers) << "\n";
+
+    const bool comp = static_cast<bool>(header.getRegister("comp", 1));
+    const bool sp_comp = static_cast<bool>(header.getRegister("sp_comp", 1));
+    LOG(INFO) << "Superpixel Compression: " << (sp_comp ? "ON" : "OFF");
+    LOG(INFO) << "     Pixel Compression: " << (comp ? "ON" : "OFF");
+    LOG(INFO) << "Finished reading file header, now decoding " << reader.frames() << " frames...";
+
+    const size_t batch_size = 256 * threads;
+    runfile_frame frame;
+    auto readBatch = [&]() {
+      std::vector<frame_chunk> batch;
+      while(batch.size() < batch_size && reader.read(frame)) {
+        frame_chunk chunk;
+        chunk.header.push_back("===== " + std::to_string(frame.sequence) + " =====");
+        chunk.header.push_back("timestamp: " + std::to_string(frame.timestamp));
+        chunk.rawData = frame.data;
+        batch.push_back(std::move(chunk));
+      }
+      return batch;
+    };
+
+    return decodeBatches(readBatch, outfile, threads, comp, sp_comp, conf);
+  }
+} // namespace
+
 int main(int argc, char* argv[]) {
 
   std::string datafile, matrixfile;
+  unsigned int threads = 1;
 
   Log::setReportingLevel(LogLevel::INFO);
 
@@ -24,6 +258,7 @@ int main(int argc, char* argv[]) {
       std::cout << "-v verbosity   verbosity level, default INFO" << std::endl;
       std::cout << "-d datafile    data file to be decoded" << std::endl;
       std::cout << "-m matrixfile  matrix configuration to read pixel states from" << std::endl;
+      std::cout << "-j threads     number of threads to decode frames in parallel, default 1" << std::endl;
       return 0;
     } else if(!strcmp(argv[i], "-v")) {
       try {
@@ -39,6 +274,9 @@ int main(int argc, char* argv[]) {
     } else if(!strcmp(argv[i], "-m")) {
       matrixfile = std::string(argv[++i]);
       continue;
+    } else if(!strcmp(argv[i], "-j")) {
+      threads = static_cast<unsigned int>(std::max(1, atoi(argv[++i])));
+      continue;
     } else {
       std::cout << "Unrecognized argument: " << argv[i] << std::endl;
     }
@@ -60,9 +298,23 @@ int main(int argc, char* argv[]) {
   LOG(STATUS) << "Reading Clicpix2 rawdata from: " << datafile;
   std::ifstream f;
   std::ofstream outfile;
-  f.open(datafile);
   size_t lastindex = datafile.find_last_of(".");
   outfile.open(datafile.substr(0, lastindex) + ".csv");
+
+  // Binary run files carry their own header and frame index
+  if(runfile_reader::isRunfile(datafile)) {
+    try {
+      unsigned int frames = decodeRunfile(datafile, outfile, threads, conf);
+      outfile.close();
+      LOG(STATUS) << "...all written: " << frames << " frames.";
+    } catch(caribou::DataException& e) {
+      LOG(ERROR) << "Failed to read run file: " << e.what();
+      return 1;
+    }
+    return 0;
+  }
+
+  f.open(datafile);
   std::string line;
 
   // Compression flags
@@ -101,15 +353,27 @@ int main(int argc, char* argv[]) {
     }
   }
 
-  clicpix2_frameDecoder decoder(comp, sp_comp, conf);
   LOG(INFO) << "Finished reading file header, now decoding data...";
 
+  // Parse the main body
+  f.clear();
+  f.seekg(oldpos);
+  if(threads > 1) {
+    LOG(INFO) << "Decoding frames on " << threads << " threads";
+    unsigned int frames = decodeParallel(f, outfile, threads, comp, sp_comp, conf);
+    f.close();
+    outfile.close();
+    LOG(STATUS) << "...all written: " << frames << " frames.";
+    return 0;
+  }
+
+  clicpix2_frameDecoder decoder(comp, sp_comp, conf);
+
   std::vector<std::string> header;
   std::vector<uint32_t> rawData;
+  pearyhits data;
   unsigned int frames = 0;
 
-  // Parse the main body
-  f.seekg(oldpos);
   while(getline(f, line)) {
     // Ignore empty lines and comments:
     if(!line.length() || '#' == line.at(0)) {
@@ -132,10 +396,12 @@ int main(int argc, char* argv[]) {
         LOG(DEBUG) << "Writing decoded data:";
         try {
           decoder.decode(rawData);
-          pearydata data = decoder.getZerosuppressedFrame();
-          for(const auto& px : data) {
-            outfile << px.first.first << "," << px.first.second << "," << (*px.second) << "\n";
-            LOG(DEBUG) << px.first.first << "," << px.first.second << "," << (*px.second);
+          decoder.getZerosuppressedFrame(data);
+          data.sort();
+          for(const auto& hit : data) {
+            pixelReadout px(static_cast<uint16_t>(hit.raw), hit.longcnt);
+            outfile << hit.column << "," << hit.row << "," << px << "\n";
+            LOG(DEBUG) << hit.column << "," << hit.row << "," << px;
           }
           LOG(INFO) << header.front() << ": " << data.size() << " pixel responses";
           frames++;
@@ -134,6 +134,7 @@ namespace caribou {
     // Default constructor
     // Disables the pixel
     pixelReadout() : clicpix2_pixel(0x0), longflag(false){};
+    pixelReadout(uint16_t latches, bool longcnt) : clicpix2_pixel(latches), longflag(longcnt){};
     pixelReadout(bool flag, uint8_t tot, uint8_t toa) : pixelReadout() {
       SetFlag(flag);
       SetTOT(tot);
@@ -180,6 +181,9 @@ namespace caribou {
     void SetCounter(uint8_t cnt) { return SetTOA(cnt); }
     uint16_t GetCounter() const { return GetTOA(); }
 
+    // Long counter mode of the pixel
+    bool GetLongCounter() const { return longflag; }
+
     /** Overloaded print function for ostream operator
      */
     void print(std::ostream& out) const {
@@ -5,275 +5,265 @@
 #include "utils/lfsr.hpp"
 #include "utils/utils.hpp"
 
+#include <algorithm>
 #include <cmath>
-#include <iterator>
 
 using namespace caribou;
 
-const clicpix2_frameDecoder::WORD_TYPE clicpix2_frameDecoder::DELIMITER(1, 0xf7);
+const uint8_t clicpix2_frameDecoder::DELIMITER;
+
+namespace {
+  // Each 32bit word from the FPGA carries two SERDES words: the control bits are stored at bits 17 (MSByte) and 16
+  // (LSByte), the data bytes in the lower 16 bits
+  inline bool is_control(const std::vector<uint32_t>& frame, const size_t position) {
+    return (frame[position / 2] >> (position % 2 ? 16 : 17)) & 0x1;
+  }
+  inline uint8_t data_byte(const std::vector<uint32_t>& frame, const size_t position) {
+    return (frame[position / 2] >> (position % 2 ? 0 : 8)) & 0xFF;
+  }
+
+  // Lookup table to de-interleave the double-column streams of a package. For every RCR mode and data byte, it holds the
+  // bits belonging to each double-column in order of arrival, the first bit received being the most significant one.
+  typedef std::array<std::array<std::array<uint8_t, 8>, 256>, 4> lane_table_t;
+
+  const lane_table_t& lane_table() {
+    static const lane_table_t table = []() {
+      lane_table_t t{};
+      for(unsigned int rcr = 1; rcr < 4; rcr++) {
+        const unsigned int columns = (1u << rcr);
+        for(unsigned int byte = 0; byte < 256; byte++) {
+          for(unsigned int c = 0; c < columns; c++) {
+            uint8_t bits = 0;
+            for(unsigned int i = c; i < 8; i += columns) {
+              bits = static_cast<uint8_t>((bits << 1) | ((byte >> i) & 0x1));
+            }
+            t[rcr][byte][c] = bits;
+          }
+        }
+      }
+      return t;
+    }();
+    return table;
+  }
+
+  // Reads the bit stream of a single double-column from the package data, consuming a full byte at a time
+  class lane_reader {
+  public:
+    lane_reader(const std::vector<uint8_t>& data,
+                const std::array<std::array<uint8_t, 8>, 256>& table,
+                const unsigned int column,
+                const unsigned int width)
+        : _data(data.data()), _end(data.data() + data.size()), _table(table), _column(column), _width(width) {}
+
+    uint16_t read(const unsigned int n) {
+      while(_available < n) {
+        if(_data == _end) {
+          throw DataException("Partial double column");
+        }
+        _buffer = (_buffer << _width) | _table[*_data++][_column];
+        _available += _width;
+      }
+      _available -= n;
+      return static_cast<uint16_t>((_buffer >> _available) & ((1u << n) - 1));
+    }
+
+  private:
+    const uint8_t* _data;
+    const uint8_t* _end;
+    const std::array<std::array<uint8_t, 8>, 256>& _table;
+    const unsigned int _column;
+    const unsigned int _width;
+    uint32_t _buffer{0};
+    unsigned int _available{0};
+  };
+} // namespace
 
 clicpix2_frameDecoder::clicpix2_frameDecoder(const bool pixelCompressionEnabled,
                                              const bool DCandSuperPixelCompressionEnabled,
                                              const std::map<std::pair<uint8_t, uint8_t>, pixelConfig>& pixel_conf)
     : pixelCompressionEnabled(pixelCompressionEnabled),
       DCandSuperPixelCompressionEnabled(DCandSuperPixelCompressionEnabled) {
+  setPixelConfiguration(pixel_conf);
+}
 
+void clicpix2_frameDecoder::setCompression(const bool pixelCompression, const bool DCandSuperPixelCompression) {
+  pixelCompressionEnabled = pixelCompression;
+  DCandSuperPixelCompressionEnabled = DCandSuperPixelCompression;
+}
+
+void clicpix2_frameDecoder::setPixelConfiguration(const std::map<std::pair<uint8_t, uint8_t>, pixelConfig>& pixel_conf) {
   // Resolve and store long-counter states:
+  counter_config.reset();
   for(const auto& pixel : pixel_conf) {
-    counter_config[pixel.first.first][pixel.first.second] = pixel.second.GetLongCounter();
+    counter_config[pixel.first.first * CLICPIX2_COL + pixel.first.second] = pixel.second.GetLongCounter();
   }
 }
 
 void clicpix2_frameDecoder::decode(const std::vector<uint32_t>& frame, bool decodeCnt) {
-  std::vector<WORD_TYPE> dataVector = repackageFrame(frame);
+  const size_t size = 2 * frame.size();
 
-  if(dataVector.empty()) {
+  if(size == 0) {
     throw caribou::DataException("Frame is empty");
   }
 
-  auto data = dataVector.cbegin();
-  auto dataEnd = dataVector.cend();
-
+  size_t position = 0;
   do {
-    decodeHeader(*data++); // header
-    extractColumns(data, dataEnd);
-  } while(std::distance(data, dataEnd) && !(std::distance(data, dataEnd) == 1 && *data == DELIMITER));
+    decodeHeader(is_control(frame, position), data_byte(frame, position)); // header
+    position = extractColumns(frame, position + 1);
+  } while(position < size &&
+          !(size - position == 1 && is_control(frame, position) && data_byte(frame, position) == DELIMITER));
 
   if(decodeCnt)
     decodeCounter();
 }
 
 pearydata clicpix2_frameDecoder::getZerosuppressedFrame() {
-  pearydata decframe;
+  pearyhits hits;
+  getZerosuppressedFrame(hits);
+
+  return hits.toPearydata([](const pearyhits::hit& hit) -> std::unique_ptr<pixel> {
+    return std::make_unique<pixelReadout>(static_cast<uint16_t>(hit.raw), hit.longcnt);
+  });
+}
+
+void clicpix2_frameDecoder::getZerosuppressedFrame(pearyhits& hits) {
+  hits.clear();
 
   for(auto r = 0; r < static_cast<int>(clicpix2_frameDecoder::CLICPIX2_ROW); ++r) {
     for(auto c = 0; c < static_cast<int>(clicpix2_frameDecoder::CLICPIX2_COL); ++c) {
       // Only return pixels with flag set:
-      if(matrix[r][c].GetFlag()) {
-        decframe[std::make_pair(c, r)] = std::make_unique<pixelReadout>(matrix[r][c]);
+      const pixelReadout& px = matrix[r][c];
+      if(!px.GetFlag()) {
         continue;
       }
-    }
-  }
-  return decframe;
-}
 
-std::vector<clicpix2_frameDecoder::WORD_TYPE> clicpix2_frameDecoder::repackageFrame(const std::vector<uint32_t>& frame) {
-  std::vector<WORD_TYPE> data;
-  for(auto const& it : frame) {
-    data.emplace_back((it >> 17) & 0x1, (it >> 8) & 0xFF); // MSByte
-    data.emplace_back((it >> 16) & 0x1, it & 0xFF);        // LSByte
+      if(px.GetLongCounter()) {
+        hits.add(c, r, px.GetLatches(), 0, 0, px.GetCounter(), true);
+      } else {
+        hits.add(c, r, px.GetLatches(), px.GetTOT(), px.GetTOA(), 0, false);
+      }
+    }
   }
-  return data;
 }
 
-void clicpix2_frameDecoder::decodeHeader(const clicpix2_frameDecoder::WORD_TYPE word) {
-  if(word.is_control != 0) {
-    throw DataException("Packet header should be a regular data word: " + to_hex_string(word.word));
+void clicpix2_frameDecoder::decodeHeader(const bool control, const uint8_t word) {
+  if(control) {
+    throw DataException("Packet header should be a regular data word: " + to_hex_string(word));
   }
 
-  rcr = (word.word >> 6) & 0x3;
+  rcr = (word >> 6) & 0x3;
 
   if(rcr == 0) {
     throw DataException("Unsupported RCR in packet header");
   }
 
-  firstColumn = word.word & 0x1F;
+  firstColumn = word & 0x1F;
 }
 
-void clicpix2_frameDecoder::extractColumns(std::vector<clicpix2_frameDecoder::WORD_TYPE>::const_iterator& data,
-                                           std::vector<clicpix2_frameDecoder::WORD_TYPE>::const_iterator dataEnd) {
-  std::array<std::array<pixelReadout, 8>, CLICPIX2_ROW * 2>
-    pixels_dc; // stores results of the processed doube columns (up to 8 if compression is enabled)
-  std::array<int, 8> row_index = {
-    0, 0, 0, 0, 0, 0, 0, 0}; // 8 independent (in case of compression) counters navigating through the <pixels_dc>
-  std::array<int, 8> row_slice = {
-    CLICPIX2_PIXEL_SIZE - 1,
-    CLICPIX2_PIXEL_SIZE - 1,
-    CLICPIX2_PIXEL_SIZE - 1,
-    CLICPIX2_PIXEL_SIZE - 1,
-    CLICPIX2_PIXEL_SIZE - 1,
-    CLICPIX2_PIXEL_SIZE - 1,
-    CLICPIX2_PIXEL_SIZE - 1,
-    CLICPIX2_PIXEL_SIZE - 1,
-  }; // 8 independent
-//(in case of compression) counters navigating through the <pixels_dc>
-#define DC_COUNTER_INIT (2 * (CLICPIX2_ROW * CLICPIX2_PIXEL_SIZE + CLICPIX2_ROW / CLICPIX2_SUPERPIXEL_SIZE) + 1)
-  std::array<int, 8> dc_counter = {DC_COUNTER_INIT,
-                                   DC_COUNTER_INIT,
-                                   DC_COUNTER_INIT,
-                                   DC_COUNTER_INIT,
-                                   DC_COUNTER_INIT,
-                                   DC_COUNTER_INIT,
-                                   DC_COUNTER_INIT,
-                                   DC_COUNTER_INIT}; // 8 independent (in case of compression)
-  // counters indicating number of bits processed for the given double-column
-  // value 3601 indicates beginning of the double-column
-  std::array<int, 8> sp_counter = {
-    0, 0, 0, 0, 0, 0, 0, 0}; // number of pixels in the processed super-pixel for the given column
-
-  do {
-    WORD_TYPE word = *data++;
-    if(word == DELIMITER) // end of double column
+size_t clicpix2_frameDecoder::extractColumns(const std::vector<uint32_t>& frame, size_t position) {
+  // Collect the data bytes of the package up to the delimiter
+  package.clear();
+  const size_t size = 2 * frame.size();
+  while(position < size) {
+    const bool control = is_control(frame, position);
+    const uint8_t word = data_byte(frame, position++);
+    if(control && word == DELIMITER) // end of double column
       break;
-    if(word.is_control)
+    if(control)
       throw DataException("Found control word different than delimiter");
+    package.push_back(word);
+  }
 
-    unraveDC(pixels_dc, dc_counter, sp_counter, row_index, row_slice, word.word);
-  } while(std::distance(data, dataEnd));
+  // The package interleaves 2^RCR double-column streams bit by bit, decode them one after the other
+  const unsigned int columns = (1u << rcr);
+  const unsigned int width = 8 / columns;
+  const auto& table = lane_table()[rcr];
+  std::array<std::array<uint16_t, CLICPIX2_ROW * 2>, 8> pixels_dc;
 
-  for(unsigned int i = 0; i < static_cast<unsigned int>(1 << rcr); i++)
-    if(dc_counter[i] != 3600)
-      throw DataException("Partial double column");
+  for(unsigned int c = 0; c < columns; c++) {
+    lane_reader lane(package, table, c, width);
+    auto& pixels = pixels_dc[c];
 
-  // remove snake pattern
-  for(unsigned int r = 0; r < 256; ++r)
-    for(unsigned int c = 0; c < static_cast<unsigned int>(1 << rcr); c++) {
-      switch(r % 4) {
-      case 0:
-        matrix[r / 2][c * 2 * 64 / static_cast<unsigned int>(1 << rcr) + firstColumn * 2] = pixels_dc[r][c];
-        break; // left column
-      case 1:
-        matrix[r / 2][c * 2 * 64 / static_cast<unsigned int>(1 << rcr) + firstColumn * 2 + 1] = pixels_dc[r][c];
-        break; // right column
-      case 2:
-        matrix[r / 2][c * 2 * 64 / static_cast<unsigned int>(1 << rcr) + firstColumn * 2 + 1] = pixels_dc[r][c];
-        break; // right column
-      case 3:
-        matrix[r / 2][c * 2 * 64 / static_cast<unsigned int>(1 << rcr) + firstColumn * 2] = pixels_dc[r][c];
-        break; // left column
-      }
+    // Double-column bit:
+    if(!lane.read(1) && DCandSuperPixelCompressionEnabled) {
+      pixels.fill(0);
+      continue;
     }
-}
 
-void clicpix2_frameDecoder::unraveDC(std::array<std::array<pixelReadout, 8>, CLICPIX2_ROW * 2>& pixels_dc,
-                                     std::array<int, 8>& dc_counter,
-                                     std::array<int, 8>& sp_counter,
-                                     std::array<int, 8>& row_index,
-                                     std::array<int, 8>& row_slice,
-                                     const uint8_t data) {
-
-  // unravel the double-columns
-  switch(rcr) {
-  case 1:
-    for(int i = 0; i < 8; i += 2) {
-      processDCbit(pixels_dc, dc_counter[0], sp_counter[0], row_index[0], 0, row_slice[0], (data >> (i)) & 0x1);
-      processDCbit(pixels_dc, dc_counter[1], sp_counter[1], row_index[1], 1, row_slice[1], (data >> (i + 1)) & 0x1);
-    }
-    break;
-  case 2:
-    for(int i = 0; i < 8; i += 4) {
-      processDCbit(pixels_dc, dc_counter[0], sp_counter[0], row_index[0], 0, row_slice[0], (data >> (i)) & 0x1);
-      processDCbit(pixels_dc, dc_counter[1], sp_counter[1], row_index[1], 1, row_slice[1], (data >> (i + 1)) & 0x1);
-      processDCbit(pixels_dc, dc_counter[2], sp_counter[2], row_index[2], 2, row_slice[2], (data >> (i + 2)) & 0x1);
-      processDCbit(pixels_dc, dc_counter[3], sp_counter[3], row_index[3], 3, row_slice[3], (data >> (i + 3)) & 0x1);
-    }
-    break;
-  case 3:
-    for(int i = 0; i < 8; i += 8) {
-      processDCbit(pixels_dc, dc_counter[0], sp_counter[0], row_index[0], 0, row_slice[0], (data >> (i)) & 0x1);
-      processDCbit(pixels_dc, dc_counter[1], sp_counter[1], row_index[1], 1, row_slice[1], (data >> (i + 1)) & 0x1);
-      processDCbit(pixels_dc, dc_counter[2], sp_counter[2], row_index[2], 2, row_slice[2], (data >> (i + 2)) & 0x1);
-      processDCbit(pixels_dc, dc_counter[3], sp_counter[3], row_index[3], 3, row_slice[3], (data >> (i + 3)) & 0x1);
-      processDCbit(pixels_dc, dc_counter[4], sp_counter[4], row_index[4], 4, row_slice[4], (data >> (i + 4)) & 0x1);
-      processDCbit(pixels_dc, dc_counter[5], sp_counter[5], row_index[5], 5, row_slice[5], (data >> (i + 5)) & 0x1);
-      processDCbit(pixels_dc, dc_counter[6], sp_counter[6], row_index[6], 6, row_slice[6], (data >> (i + 6)) & 0x1);
-      processDCbit(pixels_dc, dc_counter[7], sp_counter[7], row_index[7], 7, row_slice[7], (data >> (i + 7)) & 0x1);
-    }
-    break;
-  }
-}
-
-void clicpix2_frameDecoder::processDCbit(std::array<std::array<pixelReadout, 8>, CLICPIX2_ROW * 2>& pixels_dc,
-                                         int& dc_counter,
-                                         int& sp_counter,
-                                         int& row_index,
-                                         const int col_index,
-                                         int& row_slice,
-                                         const bool data) {
-
-  // middle of the double-column
-  if(dc_counter < static_cast<int>(2 * (CLICPIX2_ROW * CLICPIX2_PIXEL_SIZE + CLICPIX2_ROW / CLICPIX2_SUPERPIXEL_SIZE))) {
-    // super-pixel bit
-    if(sp_counter == 0) {
-      if(data ||                               // not empty super-pixel
-         !DCandSuperPixelCompressionEnabled) { // or sp compression disabled
-        dc_counter++;
-        sp_counter++;
-      } else { // empty super-pixel
-
-        for(auto i = 0; i < static_cast<int>(CLICPIX2_SUPERPIXEL_SIZE); ++i)
-          pixels_dc[row_index++][col_index].setLatches(0x00);
-
-        dc_counter += CLICPIX2_SUPERPIXEL_SIZE * CLICPIX2_PIXEL_SIZE + 1;
-      }
-    }
+    for(unsigned int sp = 0; sp < CLICPIX2_ROW * 2 / CLICPIX2_SUPERPIXEL_SIZE; sp++) {
+      auto pixel = pixels.begin() + sp * CLICPIX2_SUPERPIXEL_SIZE;
 
-    // pixel bit
-    else if(row_slice == CLICPIX2_PIXEL_SIZE - 1) {
-
-      if(data ||                     // not empty pixel
-         !pixelCompressionEnabled) { // or pixel compression disabled
-        pixels_dc[row_index][col_index].setLatches(data, row_slice--);
-        dc_counter++;
-        sp_counter++;
-      } else { // empty pixel
-        pixels_dc[row_index++][col_index].setLatches(0x00);
-        dc_counter += CLICPIX2_PIXEL_SIZE;
-        sp_counter += CLICPIX2_PIXEL_SIZE;
+      // Super-pixel bit:
+      if(!lane.read(1) && DCandSuperPixelCompressionEnabled) {
+        std::fill(pixel, pixel + CLICPIX2_SUPERPIXEL_SIZE, 0);
+        continue;
       }
-    }
-
-    // pixel payload
-    else {
-      pixels_dc[row_index][col_index].setLatches(data, row_slice--);
-      dc_counter++;
-      sp_counter++;
 
-      if(row_slice < 0) {
-        row_index++;
-        row_slice = CLICPIX2_PIXEL_SIZE - 1;
+      for(unsigned int px = 0; px < CLICPIX2_SUPERPIXEL_SIZE; px++, pixel++) {
+        // Hit flag, followed by the pixel payload if not compressed:
+        const uint16_t flag = lane.read(1);
+        if(!flag && pixelCompressionEnabled) {
+          *pixel = 0;
+        } else {
+          *pixel = static_cast<uint16_t>((flag << (CLICPIX2_PIXEL_SIZE - 1)) | lane.read(CLICPIX2_PIXEL_SIZE - 1));
+        }
       }
     }
+  }
 
-    if(sp_counter > static_cast<int>(CLICPIX2_SUPERPIXEL_SIZE * CLICPIX2_PIXEL_SIZE)) // reset sp_counter
-      sp_counter = 0;
-
+  if(firstColumn * 2 + (columns - 1) * CLICPIX2_COL / columns + 1 >= CLICPIX2_COL) {
+    throw DataException("Double columns exceed the matrix, first column " + std::to_string(firstColumn));
   }
-  // beginning of the double-column (dc_counter == 3601)
-  else {
-    if(dc_counter ==
-       static_cast<int>(2 * (CLICPIX2_ROW * CLICPIX2_PIXEL_SIZE + CLICPIX2_ROW / CLICPIX2_SUPERPIXEL_SIZE) + 1)) {
-      if(data ||                             // not empty double-column
-         !DCandSuperPixelCompressionEnabled) // or collumn compression disabled
-        dc_counter = 0;
-      else { // empty double-column
-        for(auto i = 0; i < static_cast<int>(2 * CLICPIX2_ROW); ++i)
-          pixels_dc[row_index++][col_index].setLatches(0x00);
-
-        dc_counter = 2 * (CLICPIX2_ROW * CLICPIX2_PIXEL_SIZE + CLICPIX2_ROW / CLICPIX2_SUPERPIXEL_SIZE); // 3600
-      }
+
+  // remove snake pattern
+  for(unsigned int r = 0; r < CLICPIX2_ROW * 2; ++r) {
+    // left column for r%4 == 0,3 and right column for r%4 == 1,2
+    const unsigned int right = ((r + 1) >> 1) & 0x1;
+    for(unsigned int c = 0; c < columns; c++) {
+      matrix[r / 2][c * CLICPIX2_COL / columns + firstColumn * 2 + right] = pixelReadout(pixels_dc[c][r], false);
     }
   }
+
+  return position;
 }
 
 void clicpix2_frameDecoder::decodeCounter() {
 
-  for(auto r = 0; r < static_cast<int>(clicpix2_frameDecoder::CLICPIX2_ROW); ++r) {
-    for(auto c = 0; c < static_cast<int>(clicpix2_frameDecoder::CLICPIX2_COL); ++c) {
-      // Only decode pixels with a flag set
-      if(!matrix[r][c].GetFlag()) {
-        continue;
-      }
+  // Collect the raw counter values of all pixels with a flag set:
+  long_pixels.clear();
+  short_pixels.clear();
+  long_counters.clear();
+  tot_counters.clear();
+  toa_counters.clear();
+  for(unsigned int i = 0; i < CLICPIX2_ROW * CLICPIX2_COL; ++i) {
+    const pixelReadout& px = matrix[i / CLICPIX2_COL][i % CLICPIX2_COL];
+    if(!px.GetFlag()) {
+      continue;
+    }
 
-      if(counter_config[r][c]) {
-        matrix[r][c].SetCounter(LFSR::LUT13(matrix[r][c].GetLatches() & 0x1fff));
-      } else {
-        matrix[r][c].SetTOT(LFSR::LUT5((matrix[r][c].GetLatches() >> 8) & 0x1f));
-        matrix[r][c].SetTOA(LFSR::LUT8(matrix[r][c].GetLatches() & 0xff));
-      }
+    if(counter_config[i]) {
+      long_pixels.push_back(i);
+      long_counters.push_back(px.GetLatches() & 0x1fff);
+    } else {
+      short_pixels.push_back(i);
+      tot_counters.push_back((px.GetLatches() >> 8) & 0x1f);
+      toa_counters.push_back(px.GetLatches() & 0xff);
     }
   }
+
+  // Decode them in one go and store them back:
+  LFSR::LUT13(long_counters.data(), long_counters.data(), long_counters.size());
+  LFSR::LUT5(tot_counters.data(), tot_counters.data(), tot_counters.size());
+  LFSR::LUT8(toa_counters.data(), toa_counters.data(), toa_counters.size());
+
+  for(size_t i = 0; i < long_pixels.size(); ++i) {
+    matrix[long_pixels[i] / CLICPIX2_COL][long_pixels[i] % CLICPIX2_COL].SetCounter(long_counters[i]);
+  }
+  for(size_t i = 0; i < short_pixels.size(); ++i) {
+    auto& px = matrix[short_pixels[i] / CLICPIX2_COL][short_pixels[i] % CLICPIX2_COL];
+    px.SetTOT(static_cast<uint8_t>(tot_counters[i]));
+    px.SetTOA(static_cast<uint8_t>(toa_counters[i]));
+  }
 }
 
 namespace caribou {
@@ -5,6 +5,7 @@
 #define CLICPIX2_FRAMEDECODER_HPP
 
 #include <array>
+#include <bitset>
 #include <cstdint>
 #include <ostream>
 #include <vector>
@@ -15,48 +16,25 @@ namespace caribou {
 
   class clicpix2_frameDecoder {
 
-    // Internal class representing a SERDES word
-    class WORD_TYPE {
-
-    public:
-      WORD_TYPE(){};
-      WORD_TYPE(bool is_control, uint8_t word) : is_control(is_control), word(word){};
-
-      bool operator==(const WORD_TYPE& a) const { return a.is_control == is_control && a.word == word; };
-
-      bool operator!=(const WORD_TYPE& a) const { return a.is_control != is_control || a.word != word; };
-
-      bool is_control;
-      uint8_t word;
-    };
-
     // Parameters of the Frame decoder
     static const unsigned int CLICPIX2_ROW = 128;
     static const unsigned int CLICPIX2_COL = 128;
     // Number of pixels in the super-pixel
     static const unsigned int CLICPIX2_SUPERPIXEL_SIZE = 16;
     static const unsigned int CLICPIX2_PIXEL_SIZE = 14;
-    static const WORD_TYPE DELIMITER; // K23.7 Carrier extender
+    static const uint8_t DELIMITER = 0xf7; // K23.7 Carrier extender
 
     std::array<std::array<pixelReadout, CLICPIX2_COL>, CLICPIX2_ROW> matrix; //[row][column]
 
-    // repackage uint32_t words into WORD_TYPE
-    std::vector<WORD_TYPE> repackageFrame(const std::vector<uint32_t>& frame);
-    void decodeHeader(const WORD_TYPE word);
-    void extractColumns(std::vector<WORD_TYPE>::const_iterator& data, std::vector<WORD_TYPE>::const_iterator dataEnd);
-    void unraveDC(std::array<std::array<pixelReadout, 8>, CLICPIX2_ROW * 2>& pixels_dc,
-                  std::array<int, 8>& dc_counter,
-                  std::array<int, 8>& sp_counter,
-                  std::array<int, 8>& row_index,
-                  std::array<int, 8>& row_slice,
-                  const uint8_t data);
-    void processDCbit(std::array<std::array<pixelReadout, 8>, CLICPIX2_ROW * 2>& pixels_dc,
-                      int& dc_counter,
-                      int& sp_counter,
-                      int& row_index,
-                      const int col_index,
-                      int& row_slice,
-                      const bool data);
+    // Data bytes of the currently analyzed package, reused between packages
+    std::vector<uint8_t> package;
+
+    // Pixel indices and raw counter values of long- and short-counter pixels for batch decoding, reused between frames
+    std::vector<unsigned int> long_pixels, short_pixels;
+    std::vector<uint16_t> long_counters, tot_counters, toa_counters;
+
+    void decodeHeader(const bool control, const uint8_t word);
+    size_t extractColumns(const std::vector<uint32_t>& frame, size_t position);
     void decodeCounter();
 
     // current RCR register value
@@ -68,16 +46,28 @@ namespace caribou {
     // Configutation
     bool pixelCompressionEnabled;
     bool DCandSuperPixelCompressionEnabled;
-    std::map<unsigned int, std::map<unsigned int, bool>> counter_config; // [row][column]
+    std::bitset<CLICPIX2_ROW * CLICPIX2_COL> counter_config; // [row * CLICPIX2_COL + column]
 
   public:
     clicpix2_frameDecoder(const bool pixelCompressionEnabled,
                           const bool DCandSuperPixelCompressionEnabled,
                           const std::map<std::pair<uint8_t, uint8_t>, pixelConfig>& pixel_config);
 
+    /** Update the compression settings, to be called whenever the comp/sp_comp registers of the chip change
+     */
+    void setCompression(const bool pixelCompressionEnabled, const bool DCandSuperPixelCompressionEnabled);
+
+    /** Update the long-counter states from the pixel matrix configuration (row/column)
+     */
+    void setPixelConfiguration(const std::map<std::pair<uint8_t, uint8_t>, pixelConfig>& pixel_config);
+
     void decode(const std::vector<uint32_t>& frame, bool decodeCnt = true);
     pearydata getZerosuppressedFrame();
 
+    /** Fill all pixels with hit flag set into the provided container, in row-major order
+     */
+    void getZerosuppressedFrame(pearyhits& hits);
+
     pixelReadout get(const unsigned int row, const unsigned int column) { return matrix[row][column]; };
 
     /** Overloaded ostream operator for simple printing of pixel data
@@ -0,0 +1,192 @@
+// Implementation of the CLICpix2 frame generator
+
+#include "clicpix2_frameGenerator.hpp"
+#include "clicpix2_defaults.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+using namespace caribou;
+
+const uint8_t clicpix2_frameGenerator::DELIMITER;
+
+namespace {
+  const std::intptr_t FRAME = CLICPIX2_RECEIVER_BASE_ADDRESS + CLICPIX2_RECEIVER_FIFO_OFFSET;
+  const std::intptr_t FRAME_SIZE = CLICPIX2_RECEIVER_BASE_ADDRESS + CLICPIX2_RECEIVER_COUNTER_OFFSET;
+  const std::intptr_t WAVE_CONTROL = CLICPIX2_CONTROL_BASE_ADDRESS + CLICPIX2_WAVE_CONTROL_OFFSET;
+  const std::intptr_t TIMESTAMP_LSB = CLICPIX2_CONTROL_BASE_ADDRESS + CLICPIX2_TIMESTAMPS_LSB_OFFSET;
+  const std::intptr_t TIMESTAMP_MSB = CLICPIX2_CONTROL_BASE_ADDRESS + CLICPIX2_TIMESTAMPS_MSB_OFFSET;
+
+  // Readout configuration register of the chip: parallel columns, pixel and double-column/super-pixel compression
+  const uint32_t RCR_REGISTER = 0x3E;
+
+  // Timestamps are counted in cycles of the 100MHz clock of the control firmware
+  uint64_t timestamp() {
+    return static_cast<uint64_t>(
+             std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+               .count()) /
+           10;
+  }
+} // namespace
+
+std::vector<std::intptr_t> clicpix2_frameGenerator::addresses() {
+  return {FRAME, FRAME_SIZE, WAVE_CONTROL, TIMESTAMP_LSB, TIMESTAMP_MSB};
+}
+
+uint32_t clicpix2_frameGenerator::read(std::intptr_t address, uint32_t stored) {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  if(address == FRAME) {
+    if(_fifo.empty()) {
+      return 0;
+    }
+    auto word = _fifo.front();
+    _fifo.pop_front();
+    if(_fifo.empty()) {
+      _pending = false;
+    }
+    return word;
+  } else if(address == FRAME_SIZE) {
+    // The next frame is received once the previous one has been read, if it is due
+    if(!_pending && due(1) > 0) {
+      generateFrame();
+    }
+    return static_cast<uint32_t>(_fifo.size());
+  } else if(address == TIMESTAMP_LSB) {
+    // The timestamp is consumed with the read of its lower half
+    if(!_timestamps.empty()) {
+      _timestamp = _timestamps.front();
+      _timestamps.pop_front();
+    }
+    return static_cast<uint32_t>(_timestamp);
+  } else if(address == TIMESTAMP_MSB) {
+    // The most significant bit flags the FIFO to be empty
+    return static_cast<uint32_t>((_timestamp >> 32) & 0x7ffff) | (_timestamps.empty() ? 0x80000000 : 0x0);
+  }
+  return stored;
+}
+
+void clicpix2_frameGenerator::write(std::intptr_t address, uint32_t value) {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  // Enabling the pattern generator opens and closes the shutter, each recorded with a timestamp
+  if(address == WAVE_CONTROL && (value & CLICPIX2_CONTROL_WAVE_GENERATOR_ENABLE_MASK)) {
+    _timestamps.push_back(timestamp());
+    _timestamps.push_back(timestamp());
+  }
+}
+
+std::vector<uint32_t> clicpix2_frameGenerator::frame() {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  generateFrame();
+  std::vector<uint32_t> frame(_fifo.begin(), _fifo.end());
+  _fifo.clear();
+  _pending = false;
+  return frame;
+}
+
+void clicpix2_frameGenerator::generateFrame() {
+  _fifo.clear();
+  _bytes = 0;
+
+  uint32_t rcr_register = 0;
+  carboard_emulator::getInstance().getSPIRegister(_devicepath, RCR_REGISTER, rcr_register);
+  const bool pixelCompression = (rcr_register & 0x10);
+  const bool DCandSuperPixelCompression = (rcr_register & 0x20);
+  // Fall back to eight parallel columns if the chip has not been configured:
+  const unsigned int rcr = ((rcr_register & 0x3) == 0 ? 3 : (rcr_register & 0x3));
+
+  std::vector<bool> hit(CLICPIX2_ROW * CLICPIX2_COL, false);
+  for(auto pixel : hits(CLICPIX2_ROW * CLICPIX2_COL)) {
+    hit[pixel] = true;
+  }
+
+  const unsigned int columns = (1u << rcr);
+  const unsigned int width = 8 / columns;
+  std::vector<std::vector<bool>> lanes(columns);
+
+  // One package per group of double columns read out in parallel
+  for(unsigned int firstColumn = 0; firstColumn < CLICPIX2_COL / 2 / columns; firstColumn++) {
+    size_t length = 0;
+    for(unsigned int c = 0; c < columns; c++) {
+      auto& lane = lanes[c];
+      lane.clear();
+
+      // Pixels of the double column in the order of the snake pattern
+      const auto pixel = [&](unsigned int r) {
+        const unsigned int right = ((r + 1) >> 1) & 0x1;
+        return (r / 2) * CLICPIX2_COL + c * CLICPIX2_COL / columns + firstColumn * 2 + right;
+      };
+      const auto occupied = [&](unsigned int from, unsigned int to) {
+        for(unsigned int r = from; r < to; r++) {
+          if(hit[pixel(r)]) {
+            return true;
+          }
+        }
+        return false;
+      };
+
+      // Double-column bit:
+      const bool dc = occupied(0, CLICPIX2_ROW * 2);
+      lane.push_back(dc);
+      if(!dc && DCandSuperPixelCompression) {
+        length = std::max(length, lane.size());
+        continue;
+      }
+
+      for(unsigned int sp = 0; sp < CLICPIX2_ROW * 2 / CLICPIX2_SUPERPIXEL_SIZE; sp++) {
+        // Super-pixel bit:
+        const bool filled = occupied(sp * CLICPIX2_SUPERPIXEL_SIZE, (sp + 1) * CLICPIX2_SUPERPIXEL_SIZE);
+        lane.push_back(filled);
+        if(!filled && DCandSuperPixelCompression) {
+          continue;
+        }
+
+        for(unsigned int px = 0; px < CLICPIX2_SUPERPIXEL_SIZE; px++) {
+          // Hit flag, followed by the pixel payload if not compressed:
+          const bool flag = hit[pixel(sp * CLICPIX2_SUPERPIXEL_SIZE + px)];
+          lane.push_back(flag);
+          if(!flag && pixelCompression) {
+            continue;
+          }
+          const uint32_t payload = (flag ? random(CLICPIX2_PIXEL_SIZE - 1) : 0);
+          for(unsigned int bit = CLICPIX2_PIXEL_SIZE - 1; bit > 0; bit--) {
+            lane.push_back((payload >> (bit - 1)) & 0x1);
+          }
+        }
+      }
+      length = std::max(length, lane.size());
+    }
+
+    // Header, followed by the interleaved double-column streams, the first bit of each stream in the lowest bits:
+    push(false, static_cast<uint8_t>((rcr << 6) | firstColumn));
+    for(size_t position = 0; position < length; position += width) {
+      uint8_t byte = 0;
+      for(unsigned int c = 0; c < columns; c++) {
+        for(unsigned int k = 0; k < width; k++) {
+          if(position + k < lanes[c].size() && lanes[c][position + k]) {
+            byte |= static_cast<uint8_t>(1u << (c + k * columns));
+          }
+        }
+      }
+      push(false, byte);
+    }
+    push(true, DELIMITER);
+  }
+
+  // Complete the last FIFO word with a delimiter
+  if(_bytes % 2) {
+    push(true, DELIMITER);
+  }
+  _pending = !_fifo.empty();
+}
+
+void clicpix2_frameGenerator::push(const bool control, const uint8_t word) {
+  // The first SERDES word goes to the upper byte with its control bit at bit 17, the second to the lower byte with bit 16
+  if(_bytes++ % 2 == 0) {
+    _fifo.push_back((static_cast<uint32_t>(control) << 17) | (static_cast<uint32_t>(word) << 8));
+  } else {
+    _fifo.back() |= (static_cast<uint32_t>(control) << 16) | word;
+  }
+}
@@ -0,0 +1,69 @@
+// CLICpix2 frame generator
+// Produces the SERDES data stream of the chip as read back by the receiver firmware
+
+#ifndef CLICPIX2_FRAMEGENERATOR_HPP
+#define CLICPIX2_FRAMEGENERATOR_HPP
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "carboard/generator.hpp"
+
+namespace caribou {
+
+  /** Synthetic CLICpix2 frames in the emulated receiver FIFO
+   *
+   *  A frame is made available when the frame size is polled after the previous one has been read. The frame follows the
+   *  readout configuration last written to the chip via SPI: the number of parallel columns and the pixel, double-column
+   *  and super-pixel compression.
+   */
+  class clicpix2_frameGenerator : public data_generator {
+
+    static const unsigned int CLICPIX2_ROW = 128;
+    static const unsigned int CLICPIX2_COL = 128;
+    static const unsigned int CLICPIX2_SUPERPIXEL_SIZE = 16;
+    static const unsigned int CLICPIX2_PIXEL_SIZE = 14;
+    static const uint8_t DELIMITER = 0xf7; // K23.7 Carrier extender
+
+  public:
+    /**
+     * @param config Device configuration
+     * @param devicepath SPI device of the chip, used to look up its readout configuration
+     */
+    clicpix2_frameGenerator(const Configuration& config, const std::string& devicepath)
+        : data_generator(config), _devicepath(devicepath){};
+
+    uint32_t read(std::intptr_t address, uint32_t stored) override;
+    void write(std::intptr_t address, uint32_t value) override;
+
+    /**
+     * @brief Physical addresses of the receiver and timestamp registers served by the generator
+     */
+    static std::vector<std::intptr_t> addresses();
+
+    /**
+     * @brief Produce a frame directly instead of via the emulated registers, e.g. to benchmark the decoder
+     *
+     * Data waiting in the FIFO is discarded.
+     */
+    std::vector<uint32_t> frame();
+
+  private:
+    void generateFrame();
+    // Append a SERDES word, two of them are packed into each FIFO word
+    void push(const bool control, const uint8_t word);
+
+    std::string _devicepath;
+
+    std::deque<uint32_t> _fifo;
+    size_t _bytes{0};
+    // Set while the FIFO holds a frame which has not been read completely
+    bool _pending{false};
+
+    std::deque<uint64_t> _timestamps;
+    uint64_t _timestamp{0};
+  };
+} // namespace caribou
+#endif
@@ -0,0 +1,534 @@
+/**
+ * Benchmarks of the peary hot paths
+ *
+ * Measures the frame decoders, the LFSR lookups, the dictionary, dispatcher and configuration lookups, the logger and
+ * register round trips through the HAL. The HAL round trips reset the CaR board and write to the chip registers, they
+ * are therefore only run against the CaR board emulator, i.e. when built with the emulated interfaces or if
+ * PEARY_EMULATOR is set, and follow the timing model selected via PEARY_EMULATOR_TIMING. The results are written as JSON
+ * such that they can be compared between revisions.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include "carboard/HAL.hpp"
+#include "carboard/emulator.hpp"
+#include "interfaces/I2C/i2c.hpp"
+#include "utils/configuration.hpp"
+#include "utils/datatypes.hpp"
+#include "utils/dictionary.hpp"
+#include "utils/dispatcher.hpp"
+#include "utils/exceptions.hpp"
+#include "utils/lfsr.hpp"
+#include "utils/log.hpp"
+
+#include "ATLASPixGenerator.hpp"
+#include "ATLASPixHit.hpp"
+#include "CLICTDFrameDecoder.hpp"
+#include "CLICTDFrameGenerator.hpp"
+#include "framedecoder/clicpix2_frameDecoder.hpp"
+#include "framedecoder/clicpix2_frameGenerator.hpp"
+
+using namespace caribou;
+
+namespace caribou {
+  namespace {
+    // Register definitions of the CLICTD, defined within the namespace to resolve the register type like the devices do
+    using register_key = dictionary<register_t<>>::key;
+
+    dictionary<register_t<>> clictdRegisters() {
+      dictionary<register_t<>> registers("Registers");
+      registers.add(CLICTD_REGISTERS);
+      return registers;
+    }
+  } // namespace
+} // namespace caribou
+
+namespace {
+
+  // Result of a single benchmark, rates are only reported if the case processes items or bytes
+  struct measurement {
+    std::string name;
+    uint64_t iterations;
+    double seconds;
+    uint64_t items;
+    uint64_t bytes;
+  };
+
+  // Case to be measured: each call performs one iteration and adds the number of processed items and bytes
+  using benchmark_case = std::function<void(uint64_t& items, uint64_t& bytes)>;
+
+  // Sink for results, prevents the compiler from optimizing away the benchmarked code
+  volatile uint64_t sink;
+
+  // Stream buffer discarding all output, used to measure the logger without the cost of a terminal
+  class null_buffer : public std::streambuf {
+  protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+  };
+
+  class benchmark_runner {
+  public:
+    benchmark_runner(double min_time, std::string filter) : _min_time(min_time), _filter(std::move(filter)) {}
+
+    void run(const std::string& name, const benchmark_case& func) {
+      if(!_filter.empty() && name.find(_filter) == std::string::npos) {
+        return;
+      }
+      LOG(INFO) << "Running " << name;
+
+      // Warm up caches and lazily initialized state:
+      uint64_t items = 0, bytes = 0;
+      func(items, bytes);
+
+      // Double the batch size until the minimum time is reached:
+      uint64_t iterations = 0;
+      items = 0;
+      bytes = 0;
+      std::chrono::duration<double> elapsed(0);
+      for(uint64_t batch = 1; elapsed.count() < _min_time; batch *= 2) {
+        auto start = std::chrono::steady_clock::now();
+        for(uint64_t i = 0; i < batch; i++) {
+          func(items, bytes);
+        }
+        elapsed += std::chrono::steady_clock::now() - start;
+        iterations += batch;
+      }
+      _results.push_back({name, iterations, elapsed.count(), items, bytes});
+    }
+
+    void write(std::ostream& out) const {
+      auto now = std::time(nullptr);
+      out << "{\n";
+      out << "  \"context\": {\n";
+      out << "    \"date\": \"" << std::put_time(std::gmtime(&now), "%Y-%m-%dT%H:%M:%SZ") << "\",\n";
+      out << "    \"version\": \"" << PEARY_PROJECT_VERSION << "\",\n";
+      out << "    \"build_time\": \"" << PEARY_BUILD_TIME << "\",\n";
+      out << "    \"min_time\": " << _min_time << ",\n";
+      const char* timing = std::getenv("PEARY_EMULATOR_TIMING");
+      out << "    \"emulator_timing\": \"" << (timing == nullptr ? "" : timing) << "\"\n";
+      out << "  },\n";
+      out << "  \"benchmarks\": [";
+      for(size_t i = 0; i < _results.size(); i++) {
+        const auto& result = _results[i];
+        out << (i == 0 ? "\n" : ",\n");
+        out << "    {\"name\": \"" << result.name << "\", \"iterations\": " << result.iterations
+            << ", \"real_time\": " << result.seconds * 1e9 / static_cast<double>(result.iterations)
+            << ", \"time_unit\": \"ns\"";
+        if(result.items > 0) {
+          out << ", \"items_per_second\": " << static_cast<double>(result.items) / result.seconds;
+        }
+        if(result.bytes > 0) {
+          out << ", \"bytes_per_second\": " << static_cast<double>(result.bytes) / result.seconds;
+        }
+        out << "}";
+      }
+      out << "\n  ]\n}\n";
+    }
+
+  private:
+    double _min_time;
+    std::string _filter;
+    std::vector<measurement> _results;
+  };
+
+  // Read recorded frames, one frame per line with the words separated by whitespace or commas
+  std::vector<std::vector<uint32_t>> readFrames(const std::string& filename) {
+    std::ifstream file(filename);
+    if(!file.is_open()) {
+      throw ConfigInvalid("Cannot open recorded frames \"" + filename + "\"");
+    }
+
+    std::vector<std::vector<uint32_t>> frames;
+    std::string line;
+    while(std::getline(file, line)) {
+      std::replace(line.begin(), line.end(), ',', ' ');
+      std::istringstream words(line);
+      std::vector<uint32_t> frame;
+      std::string word;
+      while(words >> word) {
+        frame.push_back(static_cast<uint32_t>(std::stoul(word, nullptr, 0)));
+      }
+      if(!frame.empty()) {
+        frames.push_back(frame);
+      }
+    }
+    if(frames.empty()) {
+      throw ConfigInvalid("No frames in \"" + filename + "\"");
+    }
+    return frames;
+  }
+
+  Configuration generatorConfig(double occupancy) {
+    Configuration config;
+    config.Set("emulator_occupancy", occupancy);
+    config.Set("emulator_seed", 1);
+    return config;
+  }
+
+  uint64_t words(const std::vector<std::vector<uint32_t>>& frames, size_t frame) {
+    return frames[frame % frames.size()].size() * sizeof(uint32_t);
+  }
+
+  void decoderBenchmarks(benchmark_runner& runner, const std::map<std::string, std::string>& recorded) {
+    const size_t nframes = 16;
+    const std::vector<double> occupancies{0.001, 0.01, 0.1};
+
+    // CLICpix2, the generator follows the readout configuration register of the chip:
+    auto clicpix2 = [&](const std::string& name, bool compression, std::vector<std::vector<uint32_t>> frames) {
+      clicpix2_frameDecoder decoder(compression, compression, {});
+      size_t frame = 0;
+      runner.run(name, [&](uint64_t& items, uint64_t& bytes) {
+        decoder.decode(frames[frame % frames.size()]);
+        bytes += words(frames, frame++);
+        items++;
+      });
+    };
+    for(auto compression : {false, true}) {
+      carboard_emulator::getInstance().setSPIRegister("benchmark", 0x3E, compression ? 0x33 : 0x03);
+      for(auto occupancy : occupancies) {
+        clicpix2_frameGenerator generator(generatorConfig(occupancy), "benchmark");
+        std::vector<std::vector<uint32_t>> frames;
+        for(size_t i = 0; i < nframes; i++) {
+          frames.push_back(generator.frame());
+        }
+        clicpix2("decode/clicpix2/" + std::string(compression ? "compressed" : "uncompressed") + "/occupancy:" +
+                   to_string(occupancy),
+                 compression,
+                 frames);
+      }
+    }
+    for(auto compression : {false, true}) {
+      auto file = recorded.find(compression ? "clicpix2_compressed" : "clicpix2");
+      if(file != recorded.end()) {
+        clicpix2("decode/clicpix2/" + std::string(compression ? "compressed" : "uncompressed") + "/recorded",
+                 compression,
+                 readFrames(file->second));
+      }
+    }
+
+    // CLICTD:
+    auto clictd = [&](const std::string& name, std::vector<std::vector<uint32_t>> frames) {
+      CLICTDFrameDecoder decoder;
+      pearyhits hits;
+      size_t frame = 0;
+      runner.run(name, [&](uint64_t& items, uint64_t& bytes) {
+        decoder.decodeFrame(frames[frame % frames.size()], hits);
+        bytes += words(frames, frame++);
+        items++;
+      });
+    };
+    for(auto occupancy : occupancies) {
+      CLICTDFrameGenerator generator(generatorConfig(occupancy));
+      std::vector<std::vector<uint32_t>> frames;
+      for(size_t i = 0; i < nframes; i++) {
+        frames.push_back(generator.frame());
+      }
+      clictd("decode/clictd/occupancy:" + to_string(occupancy), frames);
+    }
+    auto file = recorded.find("clictd");
+    if(file != recorded.end()) {
+      clictd("decode/clictd/recorded", readFrames(file->second));
+    }
+
+    // ATLASPix hit words, the trigger words of the synthetic events are skipped:
+    auto atlaspix = [&](const std::string& name, std::vector<uint32_t> data) {
+      data.erase(std::remove_if(data.begin(), data.end(), [](uint32_t word) { return (word >> 31) == 0; }), data.end());
+      if(data.empty()) {
+        throw ConfigInvalid("No ATLASPix hit words for " + name);
+      }
+      runner.run(name, [&](uint64_t& items, uint64_t& bytes) {
+        uint64_t tot = 0;
+        for(auto word : data) {
+          tot += decodeHit(word, 1, false).tot;
+        }
+        sink = tot;
+        items += data.size();
+        bytes += data.size() * sizeof(uint32_t);
+      });
+    };
+    ATLASPixGenerator generator(generatorConfig(0.01));
+    std::vector<uint32_t> hits;
+    while(hits.size() < 4096) {
+      auto event = generator.event();
+      hits.insert(hits.end(), event.begin(), event.end());
+    }
+    atlaspix("decode/atlaspix/hits", hits);
+    file = recorded.find("atlaspix");
+    if(file != recorded.end()) {
+      std::vector<uint32_t> data;
+      for(const auto& words : readFrames(file->second)) {
+        data.insert(data.end(), words.begin(), words.end());
+      }
+      atlaspix("decode/atlaspix/recorded", data);
+    }
+  }
+
+  void lfsrBenchmarks(benchmark_runner& runner) {
+    const size_t n = 4096;
+    std::vector<uint16_t> raw(n), decoded(n);
+    for(size_t i = 0; i < n; i++) {
+      raw[i] = static_cast<uint16_t>((i * 2654435761u) >> 16);
+    }
+
+    runner.run("lfsr/lut13", [&](uint64_t& items, uint64_t&) {
+      uint64_t sum = 0;
+      for(auto value : raw) {
+        sum += LFSR::LUT13(value & 0x1fff);
+      }
+      sink = sum;
+      items += n;
+    });
+    runner.run("lfsr/lut8", [&](uint64_t& items, uint64_t&) {
+      uint64_t sum = 0;
+      for(auto value : raw) {
+        sum += LFSR::LUT8(static_cast<uint8_t>(value));
+      }
+      sink = sum;
+      items += n;
+    });
+    runner.run("lfsr/lut5", [&](uint64_t& items, uint64_t&) {
+      uint64_t sum = 0;
+      for(auto value : raw) {
+        sum += LFSR::LUT5(value & 0x1f);
+      }
+      sink = sum;
+      items += n;
+    });
+    for(auto& value : raw) {
+      value &= 0x1fff;
+    }
+    runner.run("lfsr/lut13_batch", [&](uint64_t& items, uint64_t&) {
+      LFSR::LUT13(raw.data(), decoded.data(), n);
+      sink = decoded[n - 1];
+      items += n;
+    });
+  }
+
+  void utilityBenchmarks(benchmark_runner& runner) {
+    // Register lookup by name as done by the devices:
+    auto registers = clictdRegisters();
+    const auto names = registers.getNames();
+    size_t name = 0;
+    runner.run("dictionary/get", [&](uint64_t& items, uint64_t&) {
+      sink = registers.get(names[name++ % names.size()]).address();
+      items++;
+    });
+    runner.run("dictionary/has", [&](uint64_t& items, uint64_t&) {
+      sink = registers.has(names[name++ % names.size()]);
+      items++;
+    });
+
+    // Handles resolved once, as used by the devices in their configuration and readout loops:
+    std::vector<register_key> handles;
+    for(const auto& n : names) {
+      handles.push_back(registers.id(n));
+    }
+    runner.run("dictionary/id", [&](uint64_t& items, uint64_t&) {
+      handles[name % handles.size()] = registers.id(names[name % names.size()]);
+      name++;
+      items++;
+    });
+    runner.run("dictionary/get_handle", [&](uint64_t& items, uint64_t&) {
+      sink = registers.get(handles[name++ % handles.size()]).address();
+      items++;
+    });
+
+    // Command dispatch including the conversion of the arguments and the return value:
+    Dispatcher dispatcher;
+    dispatcher.add("command", std::function<double(int, double, std::string)>([](int a, double b, std::string c) {
+                     return a * b + static_cast<double>(c.size());
+                   }));
+    dispatcher.add("noargs", std::function<void()>([]() { sink = 0; }));
+    const std::vector<std::string> args{"42", "0.5", "vddd"};
+    runner.run("dispatcher/call", [&](uint64_t& items, uint64_t&) {
+      sink = dispatcher.call("command", args).size();
+      items++;
+    });
+    runner.run("dispatcher/call_noargs", [&](uint64_t& items, uint64_t&) {
+      sink = dispatcher.call("noargs", {}).size();
+      items++;
+    });
+
+    // Configuration lookups of present and missing keys:
+    std::istringstream file("[benchmark]\nthreshold = 42\nemulator_occupancy = 0.01\nmatrix = matrix.cfg\n"
+                            "vdda = 1.2,1.8,2.5\n");
+    Configuration config(file, "benchmark");
+    runner.run("configuration/get_int", [&](uint64_t& items, uint64_t&) {
+      sink = static_cast<uint64_t>(config.Get("threshold", 0));
+      items++;
+    });
+    runner.run("configuration/get_double", [&](uint64_t& items, uint64_t&) {
+      sink = static_cast<uint64_t>(config.Get("emulator_occupancy", 0.) * 1000);
+      items++;
+    });
+    runner.run("configuration/get_string", [&](uint64_t& items, uint64_t&) {
+      sink = config.Get("matrix", std::string()).size();
+      items++;
+    });
+    runner.run("configuration/get_vector", [&](uint64_t& items, uint64_t&) {
+      sink = config.Get("vdda", std::vector<double>()).size();
+      items++;
+    });
+    runner.run("configuration/get_default", [&](uint64_t& items, uint64_t&) {
+      sink = static_cast<uint64_t>(config.Get("missing", 1));
+      items++;
+    });
+  }
+
+  void logBenchmarks(benchmark_runner& runner) {
+    // Log to a discarding stream, restore the logging setup afterwards:
+    const auto streams = Log::getStreams();
+    const auto level = Log::getReportingLevel();
+    null_buffer buffer;
+    std::ostream null(&buffer);
+    Log::clearStreams();
+    Log::addStream(null);
+    Log::setReportingLevel(LogLevel::INFO);
+
+    uint64_t i = 0;
+    runner.run("log/message", [&](uint64_t& items, uint64_t&) {
+      LOG(INFO) << "Reading word " << i++ << " from FIFO";
+      items++;
+    });
+    runner.run("log/filtered", [&](uint64_t& items, uint64_t&) {
+      LOG(DEBUG) << "Reading word " << i++ << " from FIFO";
+      items++;
+    });
+
+    Log::clearStreams();
+    for(auto stream : streams) {
+      Log::addStream(*stream);
+    }
+    Log::setReportingLevel(level);
+  }
+
+  // HAL round trips are only run against the CaR board emulator
+  bool emulated() {
+#ifdef INTERFACE_EMULATION
+    return true;
+#else
+    return carboard_emulator::selected();
+#endif
+  }
+
+  void halBenchmarks(benchmark_runner& runner) {
+    caribouHAL<iface_i2c> hal(BUS_I2C2, 0x50);
+
+    uint8_t value = 0;
+    runner.run("hal/i2c_roundtrip", [&](uint64_t& items, uint64_t&) {
+      hal.send(std::pair<uint8_t, uint8_t>(0x10, value++));
+      sink = hal.receive(static_cast<uint8_t>(0x10), 1).front();
+      items++;
+    });
+
+    const memory_map mem(CLICTD_READOUT_BASE_ADDRESS,
+                         CLICTD_READOUT_SHUTTERTIMEOUT_OFFSET,
+                         CLICTD_READOUT_MAP_SIZE,
+                         CLICTD_READOUT_MAP_MASK,
+                         PROT_READ | PROT_WRITE);
+    uint32_t word = 0;
+    runner.run("hal/memory_roundtrip", [&](uint64_t& items, uint64_t&) {
+      hal.writeMemory(mem, word++);
+      sink = hal.readMemory(mem);
+      items++;
+    });
+    auto handle = hal.getMemoryHandle(mem);
+    runner.run("hal/memory_handle_roundtrip", [&](uint64_t& items, uint64_t&) {
+      handle.write(0, word++);
+      sink = handle.read();
+      items++;
+    });
+
+    runner.run("hal/slow_adc", [&](uint64_t& items, uint64_t&) {
+      sink = static_cast<uint64_t>(hal.readSlowADC(VOL_IN_1) * 1000);
+      items++;
+    });
+  }
+} // namespace
+
+int main(int argc, char* argv[]) {
+  // Results go to std::cout, log to std::cerr:
+  Log::addStream(std::cerr);
+  Log::setReportingLevel(LogLevel::WARNING);
+
+  double min_time = 0.5;
+  std::string filter;
+  std::string output;
+  std::map<std::string, std::string> recorded;
+
+  // Quick and hacky cli arguments reading:
+  for(int i = 1; i < argc; i++) {
+    if(!strcmp(argv[i], "-h")) {
+      std::cout << "Help:" << std::endl;
+      std::cout << "-v verbosity        verbosity level, default WARNING" << std::endl;
+      std::cout << "-t seconds          minimum time to run each benchmark, default 0.5" << std::endl;
+      std::cout << "-f filter           only run benchmarks with names containing the filter" << std::endl;
+      std::cout << "-o file             write the JSON results to the file instead of the standard output" << std::endl;
+      std::cout << "-r decoder=file     decode recorded frames in addition to the synthetic ones, one frame per line,"
+                << std::endl;
+      std::cout << "                    decoder is clicpix2, clicpix2_compressed, clictd or atlaspix" << std::endl;
+      return 0;
+    } else if(!strcmp(argv[i], "-v") && i + 1 < argc) {
+      try {
+        Log::setReportingLevel(Log::getLevelFromString(std::string(argv[++i])));
+      } catch(std::invalid_argument& e) {
+        LOG(ERROR) << "Invalid verbosity level \"" << std::string(argv[i]) << "\", ignoring overwrite";
+      }
+    } else if(!strcmp(argv[i], "-t") && i + 1 < argc) {
+      min_time = std::stod(argv[++i]);
+    } else if(!strcmp(argv[i], "-f") && i + 1 < argc) {
+      filter = argv[++i];
+    } else if(!strcmp(argv[i], "-o") && i + 1 < argc) {
+      output = argv[++i];
+    } else if(!strcmp(argv[i], "-r") && i + 1 < argc) {
+      std::string arg(argv[++i]);
+      auto equals = arg.find('=');
+      if(equals == std::string::npos) {
+        LOG(ERROR) << "Invalid recorded frames \"" << arg << "\", expected decoder=file";
+        return 1;
+      }
+      recorded[arg.substr(0, equals)] = arg.substr(equals + 1);
+    } else {
+      LOG(ERROR) << "Unrecognized argument \"" << argv[i] << "\"";
+      return 1;
+    }
+  }
+
+  benchmark_runner runner(min_time, filter);
+  try {
+    decoderBenchmarks(runner, recorded);
+    lfsrBenchmarks(runner);
+    utilityBenchmarks(runner);
+    logBenchmarks(runner);
+    if(emulated()) {
+      halBenchmarks(runner);
+    } else {
+      LOG(WARNING) << "HAL round trips are only benchmarked against the CaR board emulator, set PEARY_EMULATOR to run them";
+    }
+  } catch(caribou::caribouException& e) {
+    LOG(FATAL) << e.what();
+    return 1;
+  }
+
+  if(output.empty()) {
+    runner.write(std::cout);
+  } else {
+    std::ofstream file(output);
+    runner.write(file);
+  }
+  return 0;
+}
@@ -2,6 +2,7 @@
 #include <vector>
 
 #include "Console.hpp"
+#include "carboard/telemetry.hpp"
 #include "pearycli.hpp"
 #include "utils/configuration.hpp"
 #include "utils/log.hpp"
@@ -29,8 +30,12 @@ pearycli::pearycli() : Console("# ") {
   registerCommand("getName", getName, "Print device name", 1, "DEVICE_ID");
   registerCommand("getType", getType, "Print device type", 1, "DEVICE_ID");
   registerCommand("version", version, "Print software and firmware version of the selected device", 1, "DEVICE_ID");
-  registerCommand("init", configure, "Initialize and configure the selected device", 1, "DEVICE_ID");
-  registerCommand("configure", configure, "Initialize and configure the selected device", 1, "DEVICE_ID");
+  registerCommand("init", init, "Initialize and configure the selected device from scratch", 1, "DEVICE_ID");
+  registerCommand("configure",
+                  configure,
+                  "Initialize and configure the selected device, optionally switching to the configuration from CONFIG_FILE",
+                  1,
+                  "DEVICE_ID [CONFIG_FILE]");
   registerCommand("reset", reset, "Send reset signal to the selected device", 1, "DEVICE_ID");
 
   registerCommand("powerOn", powerOn, "Power up the selected device", 1, "DEVICE_ID");
@@ -120,6 +125,17 @@ pearycli::pearycli() : Console("# ") {
                   "Read the voltage from ADC channel CHANNEL_ID via the selected device",
                   2,
                   "CHANNEL_ID[1:8] DEVICE_ID");
+  registerCommand("telemetryStart",
+                  telemetryStart,
+                  "Start sampling the board telemetry at RATE (in Hz), aggregating DECIMATION samples per history record",
+                  1,
+                  "RATE [DECIMATION]");
+  registerCommand("telemetryStop", telemetryStop, "Stop sampling the board telemetry", 0);
+  registerCommand("telemetry",
+                  getTelemetry,
+                  "Print last value, min, max and mean of all board telemetry channels over the last SAMPLES samples",
+                  0,
+                  "[SAMPLES]");
   registerCommand("daqStart", daqStart, "Start DAQ for the selected device", 1, "DEVICE_ID");
   registerCommand("daqStop", daqStop, "Stop DAQ for the selected device", 1, "DEVICE_ID");
   registerCommand("getRawData", getRawData, "Retrieve raw data from the selected device", 1, "DEVICE_ID");
@@ -342,6 +358,21 @@ int pearycli::getType(const std::vector<std::string>& input) {
 int pearycli::configure(const std::vector<std::string>& input) {
   try {
     Device* dev = manager->getDevice(std::stoi(input.at(1)));
+
+    // Switch to the settings for this device from the given configuration file, only changed settings are applied:
+    if(input.size() > 2) {
+      std::ifstream file(input.at(2));
+      if(!file.is_open()) {
+        LOG(ERROR) << "Could not open configuration file \"" << input.at(2) << "\"";
+        return ReturnCode::Error;
+      }
+      caribou::Configuration devconfig(file);
+      if(!devconfig.SetSection(dev->getType())) {
+        LOG(ERROR) << "No configuration found for device " << dev->getType();
+        return ReturnCode::Error;
+      }
+      dev->setConfiguration(devconfig);
+    }
     dev->configure();
   } catch(caribou::caribouException& e) {
     LOG(ERROR) << e.what();
@@ -350,6 +381,17 @@ int pearycli::configure(const std::vector<std::string>& input) {
   return ReturnCode::Ok;
 }
 
+int pearycli::init(const std::vector<std::string>& input) {
+  try {
+    Device* dev = manager->getDevice(std::stoi(input.at(1)));
+    dev->configureFull();
+  } catch(caribou::caribouException& e) {
+    LOG(ERROR) << e.what();
+    return ReturnCode::Error;
+  }
+  return ReturnCode::Ok;
+}
+
 int pearycli::reset(const std::vector<std::string>& input) {
   try {
     Device* dev = manager->getDevice(std::stoi(input.at(1)));
@@ -705,6 +747,37 @@ int pearycli::getADC(const std::vector<std::string>& input) {
   return ReturnCode::Ok;
 }
 
+int pearycli::telemetryStart(const std::vector<std::string>& input) {
+  try {
+    unsigned int decimation = (input.size() > 2 ? static_cast<unsigned int>(std::stoul(input.at(2))) : 10);
+    telemetry::getInstance().start(std::stod(input.at(1)), decimation);
+  } catch(caribou::caribouException& e) {
+    LOG(ERROR) << e.what();
+    return ReturnCode::Error;
+  }
+  return ReturnCode::Ok;
+}
+
+int pearycli::telemetryStop(const std::vector<std::string>&) {
+  telemetry::getInstance().stop();
+  return ReturnCode::Ok;
+}
+
+int pearycli::getTelemetry(const std::vector<std::string>& input) {
+  size_t samples = (input.size() > 1 ? std::stoul(input.at(1)) : 0);
+  std::vector<telemetry_summary> channels = telemetry::getInstance().snapshot(samples);
+  if(channels.empty()) {
+    LOG(WARNING) << "No telemetry samples available";
+    return ReturnCode::Ok;
+  }
+
+  for(const auto& ch : channels) {
+    LOG(INFO) << ch.name << ": " << ch.last << ch.unit << " (min " << ch.window.min << ", max " << ch.window.max
+              << ", mean " << ch.window.mean << " over " << ch.window.samples << " samples)";
+  }
+  return ReturnCode::Ok;
+}
+
 int pearycli::daqStart(const std::vector<std::string>& input) {
   try {
     Device* dev = manager->getDevice(std::stoi(input.at(1)));
@@ -31,6 +31,7 @@ namespace caribou {
     static int getName(const std::vector<std::string>& input);
     static int getType(const std::vector<std::string>& input);
     static int version(const std::vector<std::string>& input);
+    static int init(const std::vector<std::string>& input);
     static int configure(const std::vector<std::string>& input);
     static int reset(const std::vector<std::string>& input);
     static int powerOn(const std::vector<std::string>& input);
@@ -58,6 +59,10 @@ namespace caribou {
 
     static int getADC(const std::vector<std::string>& input);
 
+    static int telemetryStart(const std::vector<std::string>& input);
+    static int telemetryStop(const std::vector<std::string>& input);
+    static int getTelemetry(const std::vector<std::string>& input);
+
     static int daqStart(const std::vector<std::string>& input);
     static int daqStop(const std::vector<std::string>& input);
 
@@ -2,21 +2,37 @@
 /// \date   2018-07-05
 /// \author Moritz Kiehn <msmk@cern.ch>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <arpa/inet.h>
+#include <fcntl.h>
 #include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
-#include <sys/uio.h>
 #include <unistd.h>
 
+#include "carboard/telemetry.hpp"
 #include "device/DeviceManager.hpp"
 #include "utils/configuration.hpp"
+#include "utils/datatypes.hpp"
 #include "utils/exceptions.hpp"
 #include "utils/log.hpp"
 
@@ -24,6 +40,7 @@ using caribou::Device;
 using caribou::DeviceManager;
 using caribou::Log;
 using caribou::LogLevel;
+using caribou::telemetry;
 
 // public definitions needed by clients
 
@@ -38,24 +55,36 @@ enum class Status : uint16_t {
   CommandTooManyArguments = 18,
   CommandInvalidArgument = 19,
   CommandFailure = 20,
+  // unsolicited messages
+  DataFrame = 32,
 };
 
 // global variables to allow cleanup in signal handler
 int server_fd = -1;
-int client_fd = -1;
+int epoll_fd = -1;
+int event_fd = -1;
+std::vector<int> client_fds;
 
 // close any connections and flush logs
 void cleanup() {
-  if(client_fd != -1) {
-    close(client_fd);
-    client_fd = -1;
+  for(int fd : client_fds) {
+    close(fd);
     LOG(DEBUG) << "Closed client connection";
   }
+  client_fds.clear();
   if(server_fd != -1) {
     close(server_fd);
     server_fd = -1;
     LOG(DEBUG) << "Closed server";
   }
+  if(event_fd != -1) {
+    close(event_fd);
+    event_fd = -1;
+  }
+  if(epoll_fd != -1) {
+    close(epoll_fd);
+    epoll_fd = -1;
+  }
   Log::finish();
 }
 
@@ -91,112 +120,285 @@ void configure_signals() {
 }
 
 // -----------------------------------------------------------------------------
-// message framing over streaming connection
+// message framing over non-blocking streaming connections
 
-/// Read a fixed number of bytes into the buffer.
+/// State of a single client connection.
+///
+/// Received data is collected until complete length-encoded messages are
+/// available. Encoded reply messages are queued until the socket accepts them.
+struct Connection {
+  uint64_t id;
+  int fd;
+  std::string peer;
+  // received data, messages before input_offset are already processed
+  std::vector<uint8_t> input;
+  size_t input_offset = 0;
+  // encoded messages, data before output_offset is already written
+  std::string output;
+  size_t output_offset = 0;
+  // number of requests of this connection that are being executed
+  size_t pending = 0;
+  // read and write readiness are currently monitored
+  bool want_read = true;
+  bool want_write = false;
+};
+
+// data read from a connection at once, the remaining data is read after the received requests have been dispatched
+static const size_t MAX_READ_SIZE = 1024 * 1024;
+
+/// Read the currently available data from the connection, up to MAX_READ_SIZE.
 ///
 /// \returns true   on success
 /// \returns false  upon disconnect of the client
-///
-/// \warning The buffer **must** be big enough to receive the requested data
-bool read_fixed_into(int fd, size_t length, void* buffer) {
-  uint8_t* bytes = reinterpret_cast<uint8_t*>(buffer);
-  // keep-alive packages could have zero length payload
-  if(length == 0) {
-    return true;
-  }
-  do {
-    ssize_t ret = read(fd, bytes, length);
-    // unexpected client connection reset is not fatal
-    if((ret == -1) and (errno == ECONNRESET)) {
-      LOG(ERROR) << "Connection reset by client during read";
-      return false;
-    }
-    // any other error is fatal
-    if(ret == -1) {
-      terminate_errno();
+bool read_available(Connection& conn) {
+  // drop data of already processed messages
+  conn.input.erase(conn.input.begin(), conn.input.begin() + conn.input_offset);
+  conn.input_offset = 0;
+
+  uint8_t buffer[64 * 1024];
+  for(size_t total = 0; total < MAX_READ_SIZE;) {
+    ssize_t ret = recv(conn.fd, buffer, sizeof(buffer), 0);
+    if(0 < ret) {
+      conn.input.insert(conn.input.end(), buffer, buffer + ret);
+      total += static_cast<size_t>(ret);
+      continue;
     }
     // regular connection closure
     if(ret == 0) {
       return false;
     }
-    length -= ret;
-    bytes += ret;
-  } while(0 < length);
+    if(errno == EINTR) {
+      continue;
+    }
+    // no more data available for now
+    if((errno == EAGAIN) or (errno == EWOULDBLOCK)) {
+      return true;
+    }
+    // connection errors only affect this client
+    LOG(ERROR) << "Connection error during read: " << std::strerror(errno);
+    return false;
+  }
   return true;
 }
 
-/// Read a length-encoded message into the buffer.
+/// Take the next complete length-encoded message from the received data.
 ///
-/// \returns true   on success
-/// \returns false  upon disconnect of the client
-bool read_msg_into(int fd, std::vector<uint8_t>& buffer) {
+/// \returns true   if a message was available
+/// \returns false  if more data needs to be received first
+bool take_msg(Connection& conn, std::vector<uint8_t>& message) {
+  size_t available = conn.input.size() - conn.input_offset;
   uint32_t len;
 
-  // read message length
-  if(!read_fixed_into(fd, 4, &len)) {
-    // client disconnected
+  // read and decode message length
+  if(available < 4) {
     return false;
   }
-  // decode message length
+  std::memcpy(&len, conn.input.data() + conn.input_offset, 4);
   len = ntohl(len);
-  LOG(DEBUG) << "Request message length=" << len;
 
-  // read message content
-  buffer.resize(len);
-  if(!read_fixed_into(fd, len, buffer.data())) {
-    LOG(ERROR) << "Client disconnected during request";
-    buffer.clear();
+  // wait for the full message content
+  if(available < (4 + static_cast<size_t>(len))) {
     return false;
   }
+  LOG(DEBUG) << "Request message length=" << len;
+
+  auto content = conn.input.begin() + static_cast<std::ptrdiff_t>(conn.input_offset + 4);
+  message.assign(content, content + len);
+  conn.input_offset += 4 + len;
   return true;
 }
 
-/// Write a length-encoded message using multiple buffers as input
-///
-/// \returns true   on success
-/// \returns false  upon disconnect of the client
+/// Encode a length-encoded message using multiple buffers as input
 ///
 /// Each buffer must have a `.data()` and `.size()` member fuctions.
-template <typename... Buffers> bool write_msg(int fd, Buffers&&... buffers) {
+template <typename... Buffers> std::string encode_msg(const Buffers&... buffers) {
   constexpr size_t n = sizeof...(Buffers);
-
-  // fill scatter/gather lists. first element is message length
-  std::array<struct iovec, 1 + n> iov = {
-    {{nullptr, 0}, {((void*)buffers.data()), (buffers.size() * sizeof(*buffers.data()))}...}};
+  const char* parts[n] = {reinterpret_cast<const char*>(buffers.data())...};
+  size_t sizes[n] = {(buffers.size() * sizeof(*buffers.data()))...};
 
   // compute and check total message length
   size_t length = 0;
-  for(size_t i = 1; i < (1 + n); ++i) {
-    length += iov[i].iov_len;
+  for(size_t i = 0; i < n; ++i) {
+    length += sizes[i];
   }
   if(UINT32_MAX < length) {
     terminate_failure("Reply message length > 2^32 - 1");
   }
   LOG(DEBUG) << "Reply message nbuffers=" << n << " total_length=" << length;
 
-  // encoded message length
+  // encoded message length followed by all message parts
   uint32_t encoded_length = htonl(static_cast<uint32_t>(length));
-  iov[0].iov_base = &encoded_length;
-  iov[0].iov_len = 4;
-
-  // write all message parts in a single step
-  ssize_t ret = writev(fd, iov.data(), iov.size());
-  // unexpected client connection reset is not fatal
-  if((ret == -1) and (errno == ECONNRESET)) {
-    LOG(ERROR) << "Connection reset by client during write";
+  std::string message;
+  message.reserve(4 + length);
+  message.append(reinterpret_cast<const char*>(&encoded_length), 4);
+  for(size_t i = 0; i < n; ++i) {
+    message.append(parts[i], sizes[i]);
+  }
+  return message;
+}
+
+/// Write as much of the queued messages as the connection accepts.
+///
+/// \returns true   on success, even if not everything could be written yet
+/// \returns false  upon disconnect of the client
+bool write_available(Connection& conn) {
+  while(conn.output_offset < conn.output.size()) {
+    ssize_t ret =
+      send(conn.fd, conn.output.data() + conn.output_offset, conn.output.size() - conn.output_offset, MSG_NOSIGNAL);
+    if(0 <= ret) {
+      conn.output_offset += ret;
+      continue;
+    }
+    if(errno == EINTR) {
+      continue;
+    }
+    // socket buffer is full, continue once it becomes writable again
+    if((errno == EAGAIN) or (errno == EWOULDBLOCK)) {
+      // drop written data so streaming connections that never fully drain do not grow without limit
+      if(conn.output.size() < 2 * conn.output_offset) {
+        conn.output.erase(0, conn.output_offset);
+        conn.output_offset = 0;
+      }
+      return true;
+    }
+    // connection errors only affect this client
+    LOG(ERROR) << "Connection error during write: " << std::strerror(errno);
     return false;
   }
-  // any other error is fatal
-  if(ret == -1) {
-    terminate_errno();
+  conn.output.clear();
+  conn.output_offset = 0;
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+// serial command execution
+
+/// Execute jobs one after the other on a dedicated thread.
+///
+/// Each device gets its own executor such that slow commands, e.g. I2C
+/// transactions, on one device do not delay requests for other devices.
+class Executor {
+public:
+  // the log level is per thread, use the one of the creating thread
+  Executor()
+      : thread([ this, level = Log::getReportingLevel() ]() {
+          Log::setReportingLevel(level);
+          run();
+        }) {}
+  ~Executor() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop = true;
+    }
+    condition.notify_one();
+    thread.join();
   }
-  if(static_cast<size_t>(ret) != (4 + length)) {
-    terminate_failure("Could not write full message");
+
+  void submit(std::function<void()> job) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      jobs.push_back(std::move(job));
+    }
+    condition.notify_one();
+  }
+
+private:
+  void run() {
+    while(true) {
+      std::function<void()> job;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [this] { return stop or !jobs.empty(); });
+        if(jobs.empty()) {
+          return;
+        }
+        job = std::move(jobs.front());
+        jobs.pop_front();
+      }
+      job();
+    }
+  }
+
+  std::mutex mutex;
+  std::condition_variable condition;
+  std::deque<std::function<void()>> jobs;
+  bool stop = false;
+  // must be initialized last
+  std::thread thread;
+};
+
+/// Ordering point between a global command and the device executors.
+///
+/// The global command is executed once every device executor has reached
+/// the barrier, the device executors resume once it has been released.
+class Barrier {
+public:
+  explicit Barrier(size_t executors) : pending(executors) {}
+
+  void arrive() {
+    std::lock_guard<std::mutex> lock(mutex);
+    pending -= 1;
+    condition.notify_all();
+  }
+  void wait_arrived() {
+    std::unique_lock<std::mutex> lock(mutex);
+    condition.wait(lock, [this] { return pending == 0; });
+  }
+  void release() {
+    std::lock_guard<std::mutex> lock(mutex);
+    released = true;
+    condition.notify_all();
+  }
+  void wait_released() {
+    std::unique_lock<std::mutex> lock(mutex);
+    condition.wait(lock, [this] { return released; });
+  }
+
+private:
+  std::mutex mutex;
+  std::condition_variable condition;
+  size_t pending;
+  bool released = false;
+};
+
+/// Encoded message ready to be sent to a connection
+///
+/// Replies complete the current request of the connection. Data frames and
+/// notices are pushed to subscribed connections independent of requests,
+/// only data frames are subject to flow control.
+struct Completion {
+  enum class Kind { Reply, Frame, Notice };
+  uint64_t connection;
+  std::string message;
+  Kind kind;
+  // source device of data frames
+  size_t device;
+};
+
+// replies posted by the executors, collected by the event loop
+std::mutex completions_mutex;
+std::vector<Completion> completions;
+
+/// Hand a message over to the event loop and wake it up.
+void post_completion(uint64_t connection,
+                     std::string message,
+                     Completion::Kind kind = Completion::Kind::Reply,
+                     size_t device = 0) {
+  {
+    std::lock_guard<std::mutex> lock(completions_mutex);
+    completions.push_back({connection, std::move(message), kind, device});
+  }
+  uint64_t one = 1;
+  if(write(event_fd, &one, sizeof(one)) != sizeof(one)) {
+    LOG(ERROR) << "Failed to notify event loop: " << std::strerror(errno);
   }
-  return true;
 }
 
+// the device manager is shared by all executors
+std::mutex manager_mutex;
+// devices are only ever appended, identifiers below this are valid. readable without waiting for a device being added
+std::atomic<size_t> num_devices{0};
+
 // -----------------------------------------------------------------------------
 // common header and message handling
 
@@ -264,6 +466,219 @@ std::vector<std::string> split(const char* txt, size_t len, char separator) {
   return parts;
 }
 
+// -----------------------------------------------------------------------------
+// binary data encoding, all values in network byte order
+
+void append_u16(std::string& out, uint16_t value) {
+  value = htons(value);
+  out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void append_u32(std::string& out, uint32_t value) {
+  value = htonl(value);
+  out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void append_u64(std::string& out, uint64_t value) {
+  append_u32(out, static_cast<uint32_t>(value >> 32));
+  append_u32(out, static_cast<uint32_t>(value));
+}
+
+/// Encode raw data as a sequence of 32-bit words.
+void encode_raw_data(const std::vector<uint32_t>& data, std::string& out) {
+  out.reserve(out.size() + 4 * data.size());
+  for(uint32_t word : data) {
+    append_u32(out, word);
+  }
+}
+
+/// Encode decoded hits as 16 byte records.
+///
+/// Each record contains column, row, raw pixel word, tot, toa, counter and
+/// flags, with bit 0 of the flags set for the long counter mode.
+void encode_hits(const caribou::pearyhits& hits, std::string& out) {
+  out.reserve(out.size() + 16 * hits.size());
+  for(const auto& hit : hits) {
+    append_u16(out, hit.column);
+    append_u16(out, hit.row);
+    append_u32(out, hit.raw);
+    append_u16(out, hit.tot);
+    append_u16(out, hit.toa);
+    append_u16(out, hit.cnt);
+    append_u16(out, hit.longcnt ? 1 : 0);
+  }
+}
+
+/// Read decoded data, devices without a flat hit decoder only provide the pixel addresses.
+void read_hits(Device& device, caribou::pearyhits& hits) {
+  try {
+    device.getHits(hits);
+  } catch(const caribou::DeviceImplException&) {
+    hits.clear();
+    for(const auto& px : device.getData()) {
+      hits.add(px.first.first, px.first.second, 0);
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+// data streaming
+
+/// Streaming state of a single subscribed connection.
+struct Subscriber {
+  // sequence number of the subscribe request, used for all pushed messages
+  uint16_t sequence;
+  // frames are dropped while more output than this is queued
+  size_t max_backlog;
+  uint64_t sent = 0;
+  uint64_t dropped = 0;
+};
+
+/// Streaming state of a device.
+///
+/// While running, a readout job on the device executor reads one frame and
+/// reschedules itself. Other commands for the device are thus interleaved with
+/// the readout instead of accessing the device concurrently. The entry is
+/// removed once the readout is stopped and no subscribers are left.
+struct Subscription {
+  bool hits = false;
+  bool running = false;
+  uint32_t frame = 0;
+  std::map<uint64_t, Subscriber> subscribers;
+};
+
+// shared between the executors and the event loop
+std::mutex subscriptions_mutex;
+std::map<size_t, Subscription> subscriptions;
+
+static const size_t DEFAULT_MAX_BACKLOG = 16 * 1024 * 1024;
+// wait time of the readout job if the device has no data
+static const useconds_t READOUT_IDLE_US = 1000;
+// frame number and timestamp in front of the frame data
+static const size_t FRAME_HEADER_SIZE = 12;
+
+/// Post a message to all subscribers of a device. Requires the subscriptions lock.
+void push_subscribers(size_t device_id,
+                      const Subscription& sub,
+                      Completion::Kind kind,
+                      Status status,
+                      const std::string& payload) {
+  for(const auto& subscriber : sub.subscribers) {
+    Header header;
+    header.set_sequence(subscriber.second.sequence);
+    header.set_status(status);
+    post_completion(subscriber.first, encode_msg(header, payload), kind, device_id);
+  }
+}
+
+void schedule_readout(Executor& executor, Device& device, size_t device_id);
+
+/// Read a single frame from the device and push it to all subscribers.
+void readout(Executor& executor, Device& device, size_t device_id) {
+  bool hits;
+  {
+    std::lock_guard<std::mutex> lock(subscriptions_mutex);
+    auto it = subscriptions.find(device_id);
+    if(it->second.subscribers.empty()) {
+      LOG(INFO) << "Stopped data streaming for device " << device_id;
+      subscriptions.erase(it);
+      return;
+    }
+    hits = it->second.hits;
+  }
+
+  // frame number and timestamp are filled in once the frame is complete
+  std::string payload(FRAME_HEADER_SIZE, '\0');
+  std::string error;
+  try {
+    if(hits) {
+      // executors are per device, the container can be reused for all frames
+      static thread_local caribou::pearyhits buffer;
+      read_hits(device, buffer);
+      encode_hits(buffer, payload);
+    } else {
+      encode_raw_data(device.getRawData(), payload);
+    }
+  } catch(const caribou::NoDataAvailable&) {
+    // continue polling
+  } catch(const std::exception& e) {
+    error = e.what();
+  }
+  uint64_t timestamp = static_cast<uint64_t>(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+  bool empty = (payload.size() == FRAME_HEADER_SIZE);
+
+  {
+    std::lock_guard<std::mutex> lock(subscriptions_mutex);
+    auto it = subscriptions.find(device_id);
+    Subscription& sub = it->second;
+    if(!error.empty()) {
+      // report the failure to the subscribers, they remain subscribed until they unsubscribe
+      LOG(ERROR) << "Data streaming for device " << device_id << " failed: " << error;
+      push_subscribers(device_id, sub, Completion::Kind::Notice, Status::CommandFailure, error);
+      sub.running = false;
+      if(sub.subscribers.empty()) {
+        subscriptions.erase(it);
+      }
+      return;
+    }
+    if(!empty) {
+      std::string frame_header;
+      append_u32(frame_header, sub.frame++);
+      append_u64(frame_header, timestamp);
+      payload.replace(0, FRAME_HEADER_SIZE, frame_header);
+      push_subscribers(device_id, sub, Completion::Kind::Frame, Status::DataFrame, payload);
+    }
+  }
+
+  if(empty) {
+    usleep(READOUT_IDLE_US);
+  }
+  schedule_readout(executor, device, device_id);
+}
+
+void schedule_readout(Executor& executor, Device& device, size_t device_id) {
+  executor.submit([&executor, &device, device_id]() { readout(executor, device, device_id); });
+}
+
+/// Queue a data frame unless too much output is pending for the connection.
+void queue_frame(Connection& conn, const Completion& frame) {
+  std::lock_guard<std::mutex> lock(subscriptions_mutex);
+  auto sub = subscriptions.find(frame.device);
+  if(sub == subscriptions.end()) {
+    return;
+  }
+  auto it = sub->second.subscribers.find(conn.id);
+  // frames still in flight after unsubscribing are discarded
+  if(it == sub->second.subscribers.end()) {
+    return;
+  }
+  Subscriber& subscriber = it->second;
+  if(subscriber.max_backlog < (conn.output.size() - conn.output_offset + frame.message.size())) {
+    if(subscriber.dropped++ == 0) {
+      LOG(WARNING) << "Client " << conn.peer << " does not keep up with data of device " << frame.device
+                   << ", dropping frames";
+    }
+    return;
+  }
+  subscriber.sent += 1;
+  conn.output += frame.message;
+}
+
+/// Remove all subscriptions of a closed connection.
+void unsubscribe_all(uint64_t connection) {
+  std::lock_guard<std::mutex> lock(subscriptions_mutex);
+  for(auto it = subscriptions.begin(); it != subscriptions.end();) {
+    it->second.subscribers.erase(connection);
+    // running subscriptions are removed by their readout job
+    if(!it->second.running && it->second.subscribers.empty()) {
+      it = subscriptions.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
 // -----------------------------------------------------------------------------
 // command helpers
 
@@ -362,7 +777,7 @@ void do_device_set_current(Device& device, const std::vector<std::string>& args,
 
 void do_device_get_voltage(Device& device, const std::vector<std::string>& args, ReplyBuffer& reply) {
   if(check_num_args(args, 1, reply)) {
-    reply.payload = std::to_string(device.getCurrent(args[0]));
+    reply.payload = std::to_string(device.getVoltage(args[0]));
     reply.set_success();
   }
 }
@@ -389,7 +804,96 @@ void do_device_switch_off(Device& device, const std::vector<std::string>& args,
   }
 }
 
-void do_device(DeviceManager& mgr, const std::string& cmd, const std::vector<std::string>& args, ReplyBuffer& reply) {
+void do_device_get_raw_data(Device& device, ReplyBuffer& reply) {
+  reply.payload.clear();
+  try {
+    encode_raw_data(device.getRawData(), reply.payload);
+  } catch(const caribou::NoDataAvailable&) {
+    // empty payload
+  }
+  reply.set_success();
+}
+
+void do_device_get_data(Device& device, ReplyBuffer& reply) {
+  caribou::pearyhits hits;
+  reply.payload.clear();
+  try {
+    read_hits(device, hits);
+    encode_hits(hits, reply.payload);
+  } catch(const caribou::NoDataAvailable&) {
+    // empty payload
+  }
+  reply.set_success();
+}
+
+void do_device_subscribe(Executor& executor,
+                         Device& device,
+                         size_t device_id,
+                         uint64_t connection,
+                         const std::vector<std::string>& args,
+                         ReplyBuffer& reply) {
+  // second argument is the optional backlog limit in bytes
+  if((args.size() != 2) and !check_num_args(args, 1, reply)) {
+    return;
+  }
+  bool hits;
+  if(args[0] == "raw") {
+    hits = false;
+  } else if(args[0] == "hits") {
+    hits = true;
+  } else {
+    reply.set_status(Status::CommandInvalidArgument);
+    reply.payload = "Unknown data format '" + args[0] + "'";
+    return;
+  }
+  size_t max_backlog = (args.size() == 2) ? std::stoul(args[1]) : DEFAULT_MAX_BACKLOG;
+
+  std::lock_guard<std::mutex> lock(subscriptions_mutex);
+  Subscription& sub = subscriptions[device_id];
+  if(sub.running and (sub.hits != hits)) {
+    reply.set_status(Status::CommandFailure);
+    reply.payload = std::string("Device is already streaming ") + (sub.hits ? "hits" : "raw data");
+    return;
+  }
+  // subscribing again only updates the settings and resets the counters
+  Subscriber& subscriber = sub.subscribers[connection];
+  subscriber.sequence = reply.header.sequence();
+  subscriber.max_backlog = max_backlog;
+  subscriber.sent = 0;
+  subscriber.dropped = 0;
+  if(!sub.running) {
+    sub.hits = hits;
+    sub.running = true;
+    schedule_readout(executor, device, device_id);
+    LOG(INFO) << "Started streaming " << args[0] << " data for device " << device_id;
+  }
+  reply.set_success();
+}
+
+void do_device_unsubscribe(size_t device_id, uint64_t connection, ReplyBuffer& reply) {
+  std::lock_guard<std::mutex> lock(subscriptions_mutex);
+  auto it = subscriptions.find(device_id);
+  if((it == subscriptions.end()) or (it->second.subscribers.count(connection) == 0)) {
+    reply.set_status(Status::CommandFailure);
+    reply.payload = "Not subscribed to device data";
+    return;
+  }
+  // Return the number of sent and dropped frames
+  const Subscriber& subscriber = it->second.subscribers[connection];
+  reply.payload = "sent: " + std::to_string(subscriber.sent) + "\ndropped: " + std::to_string(subscriber.dropped);
+  it->second.subscribers.erase(connection);
+  if(!it->second.running && it->second.subscribers.empty()) {
+    subscriptions.erase(it);
+  }
+  reply.set_success();
+}
+
+void do_device(DeviceManager& mgr,
+               Executor& executor,
+               uint64_t connection,
+               const std::string& cmd,
+               const std::vector<std::string>& args,
+               ReplyBuffer& reply) {
 
   // command format is device.<command> <device_id> <args...>
 
@@ -407,7 +911,10 @@ void do_device(DeviceManager& mgr, const std::string& cmd, const std::vector<std
   // find corresponding device
   Device* device = nullptr;
   try {
-    device = mgr.getDevice(device_id);
+    {
+      std::lock_guard<std::mutex> lock(manager_mutex);
+      device = mgr.getDevice(device_id);
+    }
 
     // reset status here
     reply.set_success();
@@ -429,6 +936,8 @@ void do_device(DeviceManager& mgr, const std::string& cmd, const std::vector<std
       device->reset();
     } else if(device_cmd == "configure") {
       device->configure();
+    } else if(device_cmd == "configure_full") {
+      device->configureFull();
     } else if(device_cmd == "daq_start") {
       device->daqStart();
     } else if(device_cmd == "daq_stop") {
@@ -457,6 +966,14 @@ void do_device(DeviceManager& mgr, const std::string& cmd, const std::vector<std
       do_device_switch_on(*device, device_args, reply);
     } else if(device_cmd == "switch_off") {
       do_device_switch_off(*device, device_args, reply);
+    } else if(device_cmd == "get_raw_data") {
+      do_device_get_raw_data(*device, reply);
+    } else if(device_cmd == "get_data") {
+      do_device_get_data(*device, reply);
+    } else if(device_cmd == "subscribe") {
+      do_device_subscribe(executor, *device, device_id, connection, device_args, reply);
+    } else if(device_cmd == "unsubscribe") {
+      do_device_unsubscribe(device_id, connection, reply);
     } else {
       // try command w/ the dynamic dispatcher
       try {
@@ -484,6 +1001,7 @@ void do_device(DeviceManager& mgr, const std::string& cmd, const std::vector<std
 // global commands
 
 void do_list_devices(DeviceManager& mgr, ReplyBuffer& reply) {
+  std::lock_guard<std::mutex> lock(manager_mutex);
   reply.set_success();
   size_t idx = 0;
   for(Device* dev : mgr.getDevices()) {
@@ -503,7 +1021,9 @@ void do_add_device(DeviceManager& mgr, const std::vector<std::string>& args, Rep
     // TODO how to handle configuration
     caribou::Configuration cfg;
 
+    std::lock_guard<std::mutex> lock(manager_mutex);
     size_t idx = mgr.addDevice(args.front(), cfg);
+    num_devices = mgr.getDevices().size();
     reply.set_success();
     reply.payload = std::to_string(idx);
   }
@@ -514,68 +1034,231 @@ void do_protocol_version(ReplyBuffer& reply) {
   reply.payload = PEARYD_PROTOCOL_VERSION;
 }
 
+// start the board telemetry sampler: rate in Hz, optional decimation
+void do_telemetry_start(const std::vector<std::string>& args, ReplyBuffer& reply) {
+  if(args.empty() or (2 < args.size())) {
+    reply.set_status(args.empty() ? Status::CommandNotEnoughArguments : Status::CommandTooManyArguments);
+    return;
+  }
+  unsigned int decimation = (args.size() == 2) ? std::stoul(args[1]) : 10;
+  telemetry::getInstance().start(std::stod(args[0]), decimation);
+  reply.set_success();
+}
+
+void do_telemetry_stop(const std::vector<std::string>& args, ReplyBuffer& reply) {
+  if(check_num_args(args, 0, reply)) {
+    telemetry::getInstance().stop();
+    reply.set_success();
+  }
+}
+
+// summary of all sampled channels, one line per channel:
+// name, last value, min, max, mean, number of samples, timestamp of the last sample in ns, unit
+void do_telemetry(const std::vector<std::string>& args, ReplyBuffer& reply) {
+  if(1 < args.size()) {
+    reply.set_status(Status::CommandTooManyArguments);
+    return;
+  }
+  size_t samples = args.empty() ? 0 : std::stoul(args[0]);
+
+  std::ostringstream os;
+  os.precision(9);
+  for(const auto& summary : telemetry::getInstance().snapshot(samples)) {
+    os << summary.name << ' ' << summary.last << ' ' << summary.window.min << ' ' << summary.window.max << ' '
+       << summary.window.mean << ' ' << summary.window.samples << ' ' << summary.window.timestamp << ' ' << summary.unit
+       << '\n';
+  }
+  reply.set_success();
+  reply.payload = os.str();
+  if(!reply.payload.empty()) {
+    reply.payload.pop_back();
+  }
+}
+
+// decimated records of one channel, one line per record: timestamp in ns, min, max, mean, number of samples
+void do_telemetry_history(const std::vector<std::string>& args, ReplyBuffer& reply) {
+  if(args.empty() or (2 < args.size())) {
+    reply.set_status(args.empty() ? Status::CommandNotEnoughArguments : Status::CommandTooManyArguments);
+    return;
+  }
+  size_t records = (args.size() == 2) ? std::stoul(args[1]) : 0;
+
+  std::ostringstream os;
+  os.precision(9);
+  for(const auto& record : telemetry::getInstance().history(args[0], records)) {
+    os << record.timestamp << ' ' << record.min << ' ' << record.max << ' ' << record.mean << ' ' << record.samples
+       << '\n';
+  }
+  reply.set_success();
+  reply.payload = os.str();
+  if(!reply.payload.empty()) {
+    reply.payload.pop_back();
+  }
+}
+
 // -----------------------------------------------------------------------------
 // request/reply handling
 
-void process_request(DeviceManager& mgr, const std::vector<uint8_t>& request, ReplyBuffer& reply) {
+/// Unpacked request message
+struct Request {
+  Header header;
+  std::string cmd;
+  std::vector<std::string> args;
+  // commands of a batch request
+  std::vector<Request> batch;
+};
+
+/// Split a command line into command and arguments.
+void parse_command(const char* data, size_t len, Request& request) {
+  request.cmd.assign(data, split_once(data, len, ' '));
+  request.args.clear();
+  // only split arguments if there are actually some available
+  if(request.cmd.size() < len) {
+    size_t start_args = request.cmd.size() + 1; // ignore separator
+    request.args = split(data + start_args, len - start_args, ' ');
+  }
+
+  LOG(DEBUG) << "Received command '" << request.cmd << "'";
+  for(const auto& arg : request.args) {
+    LOG(DEBUG) << "Received argument '" << arg << "'";
+  }
+}
+
+/// Split a batch request into its commands, one per line after the initial `batch` line.
+void parse_batch(const char* data, size_t len, Request& request) {
+  for(const auto& line : split(data, len, '\n')) {
+    // ignore empty lines, e.g. from a trailing newline
+    if(line.empty()) {
+      continue;
+    }
+    Request command;
+    command.header = request.header;
+    parse_command(line.data(), line.size(), command);
+    request.batch.push_back(std::move(command));
+  }
+  LOG(DEBUG) << "Received batch of " << request.batch.size() << " commands";
+}
+
+/// Unpack and check a request message.
+///
+/// \returns true   if the request needs to be executed
+/// \returns false  if the reply is already complete
+bool parse_request(const std::vector<uint8_t>& message, Request& request, ReplyBuffer& reply) {
+  reply.clear();
+
   // request **must** contain at least the header
-  if(request.size() < 4) {
+  if(message.size() < 4) {
     LOG(ERROR) << "Received malformed request, message is too small";
     // no request sequence number is available
     reply.set_sequence(0);
     reply.set_status(Status::MessageInvalid);
     reply.payload = "Message too small";
-    return;
+    return false;
   }
 
   // unpack request header and payload
-  Header request_header(request.data());
-  const char* payload_data = reinterpret_cast<const char*>(request.data() + 4);
-  size_t payload_len = request.size() - 4;
+  request.header = Header(message.data());
+  const char* payload_data = reinterpret_cast<const char*>(message.data() + 4);
+  size_t payload_len = message.size() - 4;
 
-  LOG(DEBUG) << "Request sequence number=" << request_header.sequence();
+  LOG(DEBUG) << "Request sequence number=" << request.header.sequence();
 
   // reply **must** always contain the request sequence number
-  reply.clear();
-  reply.set_sequence(request_header.sequence());
+  reply.set_sequence(request.header.sequence());
 
-  if(request_header.status() != Status::Ok) {
+  if(request.header.status() != Status::Ok) {
     LOG(ERROR) << "Received malformed request, invalid status";
     reply.set_status(Status::MessageInvalid);
     reply.payload = "Status is not Ok";
-    return;
+    return false;
   }
   // empty request is keep-alive that returns no data
   if(payload_len == 0) {
     LOG(INFO) << "Received keep-alive";
     reply.set_success();
-    return;
+    return false;
+  }
+
+  // batch requests contain one command per line
+  size_t first_line = split_once(payload_data, payload_len, '\n');
+  if(std::string(payload_data, first_line) == "batch") {
+    request.cmd = "batch";
+    request.args.clear();
+    if(first_line < payload_len) {
+      parse_batch(payload_data + first_line + 1, payload_len - first_line - 1, request);
+    }
+    // empty batch has an empty list of results
+    return !request.batch.empty();
   }
 
   // split payload into command and arguments
-  std::string cmd(payload_data, split_once(payload_data, payload_len, ' '));
-  std::vector<std::string> args;
-  // only split arguments if there are actually some available
-  if(cmd.size() < payload_len) {
-    size_t start_args = cmd.size() + 1; // ignore separator
-    args = split(payload_data + start_args, payload_len - start_args, ' ');
+  parse_command(payload_data, payload_len, request);
+  return true;
+}
+
+/// Encode the results of a batch request.
+///
+/// Each result consists of the status, the payload length, and the payload.
+std::string encode_batch_results(const std::vector<ReplyBuffer>& results) {
+  std::string payload;
+  for(const auto& result : results) {
+    append_u16(payload, static_cast<uint16_t>(result.header.status()));
+    append_u32(payload, static_cast<uint32_t>(result.payload.size()));
+    payload += result.payload;
   }
+  return payload;
+}
 
-  LOG(DEBUG) << "Received command '" << cmd << "'";
-  for(const auto& arg : args) {
-    LOG(DEBUG) << "Received argument '" << arg << "'";
+/// Executor responsible for a request: per-device commands are serialized per device, everything else is executed on
+/// a common executor.
+///
+/// Commands for unknown devices also run on the common executor, such that executors only exist for added devices and
+/// commands for a device still being added are ordered after the add_device command.
+static const size_t GLOBAL_EXECUTOR = SIZE_MAX;
+size_t select_executor(const Request& request) {
+  if((request.cmd.find("device.") == 0) and !request.args.empty()) {
+    try {
+      size_t device_id = std::stoul(request.args.front());
+      if(device_id < num_devices) {
+        return device_id;
+      }
+    } catch(const std::logic_error&) {
+      // invalid identifiers are reported by the command itself
+    }
   }
+  return GLOBAL_EXECUTOR;
+}
+
+/// Global commands which only query state. They neither change what device commands observe nor depend on their
+/// results, and are executed without waiting for the device executors.
+bool is_query(const Request& request) {
+  return (request.cmd == "list_devices") or (request.cmd == "protocol_version") or (request.cmd == "telemetry") or
+         (request.cmd == "telemetry_history");
+}
+
+void execute_request(
+  DeviceManager& mgr, Executor& executor, uint64_t connection, const Request& request, ReplyBuffer& reply) {
+  const std::string& cmd = request.cmd;
+  const std::vector<std::string>& args = request.args;
 
   // execute commands
   if(cmd.find("device.") == 0) {
     // per-device commands are handled separately
-    do_device(mgr, cmd, args, reply);
+    do_device(mgr, executor, connection, cmd, args, reply);
   } else if(cmd == "list_devices") {
     do_list_devices(mgr, reply);
   } else if(cmd == "add_device") {
     do_add_device(mgr, args, reply);
   } else if(cmd == "protocol_version") {
     do_protocol_version(reply);
+  } else if(cmd == "telemetry") {
+    do_telemetry(args, reply);
+  } else if(cmd == "telemetry_history") {
+    do_telemetry_history(args, reply);
+  } else if(cmd == "telemetry_start") {
+    do_telemetry_start(args, reply);
+  } else if(cmd == "telemetry_stop") {
+    do_telemetry_stop(args, reply);
   } else {
     // everything else is an error
     reply.set_status(Status::CommandUnknown);
@@ -621,6 +1304,14 @@ void parse_args(int argc, char* argv[], uint16_t& port, std::string& verbosity)
   }
 }
 
+// epoll user data for the non-client file descriptors, connections are numbered after these
+static const uint64_t EVENT_SERVER = 0;
+static const uint64_t EVENT_COMPLETION = 1;
+// requests per connection that are executed concurrently, further requests are kept in the input buffer
+static const size_t MAX_PENDING_REQUESTS = 256;
+// unsent output per connection above which no further requests are executed
+static const size_t MAX_PENDING_OUTPUT = 16 * 1024 * 1024;
+
 int main(int argc, char* argv[]) {
   // log to std::cout by default
   Log::addStream(std::cout);
@@ -651,8 +1342,8 @@ int main(int argc, char* argv[]) {
   server_addr.sin_addr.s_addr = htons(INADDR_ANY);
   server_addr.sin_port = htons(arg_port);
 
-  // create tcp/ip socket
-  if((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == -1) {
+  // create non-blocking tcp/ip socket
+  if((server_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1) {
     terminate_errno();
   }
   // avoid error when socket is reused. see also:
@@ -665,49 +1356,276 @@ int main(int argc, char* argv[]) {
   if(bind(server_fd, (struct sockaddr*)&server_addr, server_addrlen) == -1) {
     terminate_errno();
   }
-  // start listening for connections, allow only one client at a time
-  if(listen(server_fd, 1) == -1) {
+  // start listening for connections, multiple clients are served concurrently
+  if(listen(server_fd, SOMAXCONN) == -1) {
     terminate_errno();
   }
   LOG(INFO) << "Listening for connections on " << inet_ntoa(server_addr.sin_addr) << ":" << ntohs(server_addr.sin_port);
 
-  // client loop
-  // only a single client at any time, but multiple connections in series.
-  while(true) {
-    // wait for a client to connect
-    struct sockaddr_in client_addr;
-    socklen_t client_addrlen = sizeof(client_addr);
-
-    client_fd = accept(server_fd, (struct sockaddr*)&client_addr, &client_addrlen);
-    if(client_fd == -1) {
-      LOG(WARNING) << "Failure to accept connection: " << std::strerror(errno);
-      // try again accepting client connections
-      continue;
+  // setup event loop, the event fd is signalled by the executors when replies are available
+  if((epoll_fd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+    terminate_errno();
+  }
+  if((event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1) {
+    terminate_errno();
+  }
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.u64 = EVENT_SERVER;
+  if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_fd, &event) == -1) {
+    terminate_errno();
+  }
+  event.data.u64 = EVENT_COMPLETION;
+  if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, event_fd, &event) == -1) {
+    terminate_errno();
+  }
+
+  // executors are created on demand, one per device and one for global commands
+  std::map<size_t, std::unique_ptr<Executor>> executors;
+  std::map<uint64_t, Connection> connections;
+  uint64_t next_connection = EVENT_COMPLETION + 1;
+
+  auto close_connection = [&](Connection& conn) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn.fd, nullptr);
+    close(conn.fd);
+    client_fds.erase(std::find(client_fds.begin(), client_fds.end(), conn.fd));
+    LOG(INFO) << "Client " << conn.peer << " disconnected";
+    // the connection is destroyed by the erase, do not pass a reference to its identifier
+    uint64_t id = conn.id;
+    unsubscribe_all(id);
+    connections.erase(id);
+  };
+
+  // further requests of a connection are only executed while the client keeps up with collecting the replies
+  auto accepts_requests = [&](const Connection& conn) {
+    return (conn.pending < MAX_PENDING_REQUESTS) and ((conn.output.size() - conn.output_offset) < MAX_PENDING_OUTPUT);
+  };
+
+  // monitor write readiness only while there is queued output. stop reading while no further requests are accepted,
+  // such that a client not waiting for replies cannot make the input buffer grow unbounded
+  auto update_events = [&](Connection& conn) {
+    bool want_read = accepts_requests(conn);
+    bool want_write = (conn.output_offset < conn.output.size());
+    if((want_read != conn.want_read) or (want_write != conn.want_write)) {
+      struct epoll_event ev;
+      ev.events = (want_read ? EPOLLIN : 0) | (want_write ? EPOLLOUT : 0);
+      ev.data.u64 = conn.id;
+      if(epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn.fd, &ev) == -1) {
+        terminate_errno();
+      }
+      conn.want_read = want_read;
+      conn.want_write = want_write;
+    }
+  };
+
+  // the most recent global command, device executors created before it has been executed have to wait for it
+  std::shared_ptr<Barrier> barrier;
+  auto get_executor = [&](size_t key) {
+    std::unique_ptr<Executor>& executor = executors[key];
+    if(!executor) {
+      executor = std::make_unique<Executor>();
+      if(barrier and (key != GLOBAL_EXECUTOR)) {
+        std::shared_ptr<Barrier> previous = barrier;
+        executor->submit([previous]() { previous->wait_released(); });
+      }
     }
-    if(client_addrlen != sizeof(client_addr)) {
-      terminate_failure("Inconsistent sockaddr size");
+    return executor.get();
+  };
+
+  // execute the commands of a request in order and hand the results to the given function. commands for a single
+  // device run on its executor, queries run on the global executor, anything else is a barrier: it runs on the global
+  // executor once all device executors have completed their earlier commands, and later commands for any device wait
+  // for it.
+  auto submit = [&](uint64_t id, const std::vector<Request>& requests, std::function<void(std::vector<ReplyBuffer>&)> done) {
+    size_t key = select_executor(requests.front());
+    bool queries = true;
+    std::vector<Executor*> execs;
+    for(const auto& request : requests) {
+      size_t command_key = select_executor(request);
+      execs.push_back(get_executor(command_key));
+      if(command_key != key) {
+        key = GLOBAL_EXECUTOR;
+      }
+      queries = queries and is_query(request);
     }
-    LOG(INFO) << "Client connected from " << inet_ntoa(client_addr.sin_addr) << ":" << ntohs(client_addr.sin_port);
 
-    // reusable buffers
-    std::vector<uint8_t> request_buffer;
-    ReplyBuffer reply_buffer;
+    auto job = [&mgr, execs, id, requests, done]() {
+      std::vector<ReplyBuffer> replies(requests.size());
+      for(size_t idx = 0; idx < requests.size(); ++idx) {
+        ReplyBuffer& reply = replies[idx];
+        reply.clear();
+        reply.set_sequence(requests[idx].header.sequence());
+        try {
+          // readouts started by a command are scheduled on the executor of its device
+          execute_request(mgr, *execs[idx], id, requests[idx], reply);
+        } catch(const std::exception& e) {
+          LOG(ERROR) << "Command '" << requests[idx].cmd << "' failed: " << e.what();
+          reply.set_status(Status::CommandFailure);
+          reply.payload = e.what();
+        }
+      }
+      done(replies);
+    };
 
-    // request/reply loop until client disconnects.
-    while(true) {
+    if((key != GLOBAL_EXECUTOR) or queries) {
+      execs.front()->submit(job);
+      return;
+    }
 
-      if(!read_msg_into(client_fd, request_buffer)) {
-        break;
+    Executor* global = get_executor(GLOBAL_EXECUTOR);
+    auto next = std::make_shared<Barrier>(executors.size() - 1);
+    for(auto& executor : executors) {
+      if(executor.first != GLOBAL_EXECUTOR) {
+        executor.second->submit([next]() {
+          next->arrive();
+          next->wait_released();
+        });
       }
-      process_request(mgr, request_buffer, reply_buffer);
-      if(!write_msg(client_fd, reply_buffer.header, reply_buffer.payload)) {
-        break;
+    }
+    barrier = next;
+    global->submit([next, job]() {
+      next->wait_arrived();
+      job();
+      next->release();
+    });
+  };
+
+  // hand received requests to the executors. requests are pipelined, commands for the same device are executed in
+  // request order, global commands after all earlier and before all later requests. replies are sent as soon as they
+  // are available and are identified by their sequence number.
+  std::vector<uint8_t> message;
+  auto dispatch = [&](Connection& conn) {
+    while(accepts_requests(conn) && take_msg(conn, message)) {
+      Request request;
+      ReplyBuffer reply;
+      if(!parse_request(message, request, reply)) {
+        conn.output += encode_msg(reply.header, reply.payload);
+        continue;
       }
+
+      conn.pending += 1;
+      uint64_t id = conn.id;
+      if(request.batch.empty()) {
+        submit(id, {request}, [id](std::vector<ReplyBuffer>& results) {
+          post_completion(id, encode_msg(results.front().header, results.front().payload));
+        });
+        continue;
+      }
+
+      // the commands of a batch are executed in order, the reply is sent once the last one is complete
+      Header header = reply.header;
+      submit(id, request.batch, [id, header](std::vector<ReplyBuffer>& results) {
+        post_completion(id, encode_msg(header, encode_batch_results(results)));
+      });
+    }
+  };
+
+  // send queued output and execute requests held back until the client collected earlier replies
+  auto flush = [&](Connection& conn) {
+    if(!write_available(conn)) {
+      return false;
+    }
+    dispatch(conn);
+    if(!write_available(conn)) {
+      return false;
+    }
+    update_events(conn);
+    return true;
+  };
+
+  // event loop
+  std::vector<struct epoll_event> events(64);
+  while(true) {
+    int nevents = epoll_wait(epoll_fd, events.data(), static_cast<int>(events.size()), -1);
+    if(nevents == -1) {
+      if(errno == EINTR) {
+        continue;
+      }
+      terminate_errno();
     }
 
-    close(client_fd);
-    client_fd = -1;
-    LOG(INFO) << "Client disconnected";
+    for(int i = 0; i < nevents; ++i) {
+      uint64_t source = events[i].data.u64;
+
+      if(source == EVENT_SERVER) {
+        // accept all pending client connections
+        while(true) {
+          struct sockaddr_in client_addr;
+          socklen_t client_addrlen = sizeof(client_addr);
+          int client_fd = accept4(server_fd, (struct sockaddr*)&client_addr, &client_addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+          if(client_fd == -1) {
+            if((errno != EAGAIN) and (errno != EWOULDBLOCK)) {
+              LOG(WARNING) << "Failure to accept connection: " << std::strerror(errno);
+            }
+            break;
+          }
+          if(client_addrlen != sizeof(client_addr)) {
+            terminate_failure("Inconsistent sockaddr size");
+          }
+
+          Connection& conn = connections[next_connection];
+          conn.id = next_connection++;
+          conn.fd = client_fd;
+          conn.peer = std::string(inet_ntoa(client_addr.sin_addr)) + ":" + std::to_string(ntohs(client_addr.sin_port));
+          client_fds.push_back(client_fd);
+
+          struct epoll_event ev;
+          ev.events = EPOLLIN;
+          ev.data.u64 = conn.id;
+          if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &ev) == -1) {
+            terminate_errno();
+          }
+          LOG(INFO) << "Client connected from " << conn.peer;
+        }
+
+      } else if(source == EVENT_COMPLETION) {
+        // collect replies from the executors
+        uint64_t count;
+        while(read(event_fd, &count, sizeof(count)) == sizeof(count)) {
+        }
+        std::vector<Completion> completed;
+        {
+          std::lock_guard<std::mutex> lock(completions_mutex);
+          completed.swap(completions);
+        }
+        for(auto& completion : completed) {
+          auto it = connections.find(completion.connection);
+          // client might have disconnected in the meantime
+          if(it == connections.end()) {
+            continue;
+          }
+          Connection& conn = it->second;
+          if(completion.kind == Completion::Kind::Frame) {
+            queue_frame(conn, completion);
+          } else if(completion.kind == Completion::Kind::Notice) {
+            conn.output += completion.message;
+          } else {
+            conn.pending -= 1;
+            conn.output += completion.message;
+          }
+          if(!flush(conn)) {
+            close_connection(conn);
+          }
+        }
+
+      } else {
+        auto it = connections.find(source);
+        if(it == connections.end()) {
+          continue;
+        }
+        Connection& conn = it->second;
+
+        if(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+          if(!read_available(conn)) {
+            close_connection(conn);
+            continue;
+          }
+        }
+        if(!flush(conn)) {
+          close_connection(conn);
+        }
+      }
+    }
   }
 
   cleanup();
@@ -1,5 +1,6 @@
 #include <arpa/inet.h>
 #include <fstream>
+#include <memory>
 #include <signal.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
@@ -9,12 +10,14 @@
 #include "utils/configuration.hpp"
 #include "utils/exceptions.hpp"
 #include "utils/log.hpp"
+#include "utils/runfile.hpp"
 
 using namespace caribou;
 
 caribou::DeviceManager* manager;
 int my_socket;
-std::ofstream myfile;
+std::unique_ptr<runfile_writer> runfile;
+bool runfile_failed;
 unsigned int framecounter;
 std::string configfile;
 caribou::Configuration config;
@@ -372,14 +375,16 @@ bool start_run(std::string rundir, int run_nr, std::string) {
       // dev->daqStart();
       if(dev->getName() == "CLICpix2") {
         mkdir(rundir.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
-        std::string filename = rundir + "/run" + to_string(run_nr) + ".raw";
+        std::string filename = rundir + "/run" + to_string(run_nr) + ".run";
         LOG(INFO) << "Writing data to " << rundir;
-        myfile.open(filename);
-        // myfile << "# pearycli > acquire\n";
-        myfile << "# Software version: " << dev->getVersion() << "\n";
-        myfile << "# Firmware version: " << dev->getFirmwareVersion() << "\n";
-        myfile << "# Register state: " << listVector(dev->getRegisters()) << "\n";
-        myfile << "# Timestamp: " << LOGTIME << "\n";
+        runfile_header header;
+        header.metadata.emplace_back("Device", dev->getName());
+        header.metadata.emplace_back("Software version", dev->getVersion());
+        header.metadata.emplace_back("Firmware version", dev->getFirmwareVersion());
+        header.metadata.emplace_back("Timestamp", LOGTIME);
+        header.registers = dev->getRegisters();
+        runfile = std::make_unique<runfile_writer>(filename, header);
+        runfile_failed = false;
       }
       i++;
     }
@@ -412,13 +417,25 @@ bool stop_run(std::string) {
       LOG(INFO) << "Stopping run for device ID " << i << ": " << d->getName();
       // Stop the DAQ
       d->daqStop();
-      myfile.close();
       i++;
     }
+
+    // Write the frame index and close the run file:
+    if(runfile) {
+      runfile->close();
+      runfile_failed |= !runfile->good();
+      runfile.reset();
+    }
   } catch(caribou::caribouException& e) {
     LOG(ERROR) << e.what();
     return false;
   }
+
+  if(runfile_failed) {
+    LOG(ERROR) << "Run file could not be written completely, data of this run has been lost";
+    runfile_failed = false;
+    return false;
+  }
   return true;
 }
 
@@ -437,10 +454,14 @@ bool getFrame() {
         LOG(WARNING) << e.what() << ", skipping frame.";
         continue;
       }
-      myfile << "===== " << framecounter << " =====\n";
-      for(const auto& px : data) {
-        // myfile << px.first.first << "," << px.first.second << "," << (*px.second) << "\n";
-        myfile << px << "\n";
+      if(runfile) {
+        runfile->write(data, runfile_writer::now());
+        if(!runfile->good()) {
+          LOG(ERROR) << "Failed to write run file, no further data of this run is recorded";
+          runfile.reset();
+          runfile_failed = true;
+          return false;
+        }
       }
       LOG(INFO) << framecounter << " | " << data.size() << " pixel responses";
       framecounter++;
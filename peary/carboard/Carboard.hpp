@@ -73,6 +73,17 @@ const std::intptr_t CARIBOU_PULSER_CHANNEL_OFFSET = 16;
 #define ADDR_DAC_U49 0x4F
 #define ADDR_DAC_U50 0x49
 
+/** SI5345 Registers Addresses
+ *  The upper byte of the 16-bit register address is the page selected via the page register
+ */
+#define REG_CLKGEN_PAGE 0x01
+#define REG_CLKGEN_STATUS 0x0E     // Bit 1 is set while the PLL is not locked
+#define REG_CLKGEN_DESIGN_ID 0x026B // 8 byte user-defined design identifier
+#define REG_CLKGEN_SOFT_CAL 0x0540  // Written with 0x01 at the end of the configuration preamble
+
+// Time the SI5345 needs to complete a running calibration after the configuration preamble, in milliseconds
+#define CLKGEN_PREAMBLE_DELAY_MS 300
+
 /** TMP101 Thermometer Registers Addresses
  */
 #define REG_TEMP_TEMP 0x00
@@ -1,13 +1,17 @@
 #ifndef CARIBOU_HAL_H
 #define CARIBOU_HAL_H
 
+#include <chrono>
 #include <cstdint>
 #include <map>
 #include <string>
+#include <thread>
 #include <tuple>
 #include <vector>
 
 #include "Carboard.hpp"
+#include "shadow.hpp"
+#include "telemetry.hpp"
 #include "utils/constants.hpp"
 #include "utils/exceptions.hpp"
 #include "utils/log.hpp"
@@ -16,6 +20,7 @@
 #include "interfaces/Interface.hpp"
 #include "interfaces/InterfaceManager.hpp"
 
+#include "interfaces/DMA/dma.hpp"
 #include "interfaces/I2C/i2c.hpp"
 #include "interfaces/Memory/memory.hpp"
 
@@ -26,6 +31,9 @@ namespace caribou {
   protected:
     // General reset of the CaR board done
     static bool generalResetDone;
+
+    // Shadow copy of the CaR board peripheral registers
+    static carboard_shadow shadow;
   };
 
   template <typename T> class caribouHAL : public caribouHALbase {
@@ -81,6 +89,9 @@ namespace caribou {
     // Read data from a device containing internal registers
     std::vector<typename T::data_type> receive(const typename T::reg_type reg, const unsigned int length = 1);
 
+    // Read one data word from each of the given registers, combined into as few bus transfers as the interface allows
+    std::vector<typename T::data_type> receive(const std::vector<typename T::reg_type>& regs);
+
     /** Read data from managed device interface
      */
     std::vector<uint8_t> read(uint8_t address, uint8_t length);
@@ -90,6 +101,35 @@ namespace caribou {
     uint32_t readMemory(memory_map mem, size_t offset);
     uint32_t readMemory(memory_map mem);
 
+    /** Read n words from a FIFO port in FPGA memory into the provided buffer
+     *
+     *  All words are read from the same offset, the memory page is only resolved once.
+     */
+    void readMemoryFifo(const memory_map& mem, size_t offset, uint32_t* data, size_t n);
+
+    /** Read a contiguous window of n words from FPGA memory into the provided buffer
+     *
+     *  The offset is incremented by one word for every read, the memory page is only resolved once.
+     */
+    void readMemoryBlock(const memory_map& mem, size_t offset, uint32_t* data, size_t n);
+
+    /** Resolve the memory page and return a handle pointing directly to the register
+     *
+     *  The handle allows repeated access to the register without any further lookup.
+     */
+    memory_handle getMemoryHandle(const memory_map& mem);
+
+    /** Acquire the next completed frame from the DMA ring buffer at the given device path
+     *
+     *  Waits up to timeout milliseconds for the DMA engine to complete a frame. The returned view points directly into
+     *  the ring buffer and has to be handed back via releaseDMAFrame(). An empty view is returned if no frame arrived.
+     */
+    dma_frame readDMAFrame(const std::string& path, unsigned int timeout = 0);
+
+    /** Release a frame acquired via readDMAFrame() and return its buffer to the DMA engine
+     */
+    void releaseDMAFrame(const std::string& path, const dma_frame& frame);
+
     /** Read the temperature from the TMP101 device
      *
      *  Returns temperature in degree Celsius with a precision of 0.0625degC
@@ -137,12 +177,24 @@ namespace caribou {
      */
     void powerCurrentSource(const CURRENT_SOURCE_T source, const bool enable);
 
-    // The method sets SI5345 jitter attenuator/clock multiplier using a table generated by ClockBuilderPro
-    void configureSI5345(SI5345_REG_T const* const regs, const size_t length);
+    /** The method sets SI5345 jitter attenuator/clock multiplier using a table generated by ClockBuilderPro
+     *
+     *  Consecutive registers on the same page are uploaded as auto-increment block writes. A hash of the table is stored in
+     *  the design identifier registers of the chip, the upload is skipped if the chip already holds the same table unless
+     *  it is forced.
+     */
+    void configureSI5345(SI5345_REG_T const* const regs, const size_t length, const bool force = false);
 
     // The method return true when SI5345 jitter attenuator/clock multiplier is locked
     bool isLockedSI5345();
 
+    /** Wait for the SI5345 jitter attenuator/clock multiplier to lock
+     *
+     *  The lock status is polled at a fixed interval, sleeping in between. Returns true if the PLL locked within the timeout,
+     *  the time to lock is reported.
+     */
+    bool waitLockedSI5345(const std::chrono::milliseconds timeout);
+
     // The method sets pulse parameters for an onboard pulser
     void configurePulseParameters(const unsigned channel_mask,
                                   const uint32_t periods,
@@ -182,7 +234,25 @@ namespace caribou {
 
     double readSlowADC(const SLOW_ADC_CHANNEL_T channel);
 
+    /** Board telemetry sampling the power monitors, slow ADC and temperature sensor
+     *
+     *  While the sampler is running, the measurement functions above return its most recent samples instead of accessing
+     *  the I2C buses.
+     */
+    telemetry& getTelemetry() { return telemetry::getInstance(); }
+
+    /** Resynchronize the shadow copy of the CaR board peripheral registers with the hardware
+     *
+     *  Required after the peripherals have been reset or modified outside of this process. The IO expander ports and the
+     *  current monitor configurations are read back, DAC settings are applied again with their next write. This is done as
+     *  part of the general reset of the board.
+     */
+    void resyncPeripherals();
+
   private:
+    // Current LSB of an INA226 monitor, from the cached calibration if available
+    double currentLSB(const i2c_address_t device);
+
     // Access to FPGA memory mapped registers
     memory_map reg_firmware{CARIBOU_CONTROL_BASE_ADDRESS,
                             CARIBOU_FIRMWARE_VERSION_OFFSET,
@@ -243,6 +313,12 @@ namespace caribou {
      */
     void powerDAC(const bool enable, const uint8_t device, const uint8_t address);
 
+    /** Set and clear bits of an output port of the PCA9539 IO expander
+     *
+     *  The read-modify-write cycle is served from the shadow registers, the write is skipped if the port is unchanged.
+     */
+    void updateIOExpander(const uint8_t reg, const uint8_t set, const uint8_t clear);
+
     /** Set current/power monitor
      */
     void setCurrentMonitor(const uint8_t device, const double maxExpectedCurrent);
@@ -35,6 +35,36 @@ namespace caribou {
     return imem.read(mem, offset, 1).front();
   }
 
+  template <typename T>
+  void caribouHAL<T>::readMemoryFifo(const memory_map& mem, size_t offset, uint32_t* data, size_t n) {
+    iface_mem& imem = InterfaceManager::getInterface<iface_mem>(MEM_PATH);
+    imem.readFifo(mem, offset, data, n);
+  }
+
+  template <typename T>
+  void caribouHAL<T>::readMemoryBlock(const memory_map& mem, size_t offset, uint32_t* data, size_t n) {
+    iface_mem& imem = InterfaceManager::getInterface<iface_mem>(MEM_PATH);
+    imem.readBlock(mem, offset, data, n);
+  }
+
+  template <typename T> memory_handle caribouHAL<T>::getMemoryHandle(const memory_map& mem) {
+    iface_mem& imem = InterfaceManager::getInterface<iface_mem>(MEM_PATH);
+    return imem.getHandle(mem);
+  }
+
+  template <typename T> dma_frame caribouHAL<T>::readDMAFrame(const std::string& path, unsigned int timeout) {
+    iface_dma& idma = InterfaceManager::getInterface<iface_dma>(path);
+    if(timeout > 0 && !idma.wait(timeout)) {
+      return dma_frame();
+    }
+    return idma.acquire();
+  }
+
+  template <typename T> void caribouHAL<T>::releaseDMAFrame(const std::string& path, const dma_frame& frame) {
+    iface_dma& idma = InterfaceManager::getInterface<iface_dma>(path);
+    idma.release(frame);
+  }
+
   template <typename T> std::string caribouHAL<T>::getFirmwareVersion() {
 
     const uint32_t firmwareVersion = readMemory(reg_firmware);
@@ -54,11 +84,17 @@ namespace caribou {
   }
 
   template <typename T> void caribouHAL<T>::generalReset() {
+    // The peripherals might have been modified by another process or reset since the shadow has been filled:
+    resyncPeripherals();
+
     // Disable all Voltage Regulators
     LOG(DEBUG) << "Disabling all Voltage regulators";
     iface_i2c& i2c0 = InterfaceManager::getInterface<iface_i2c>(BUS_I2C0);
     i2c0.write(ADDR_IOEXP, 0x2, {0x00, 0x00}); // disable all bits of Port 1-2 (internal register)
     i2c0.write(ADDR_IOEXP, 0x6, {0x00, 0x00}); // set all bits of Port 1-2 in output mode
+    for(const uint8_t reg : {0x02, 0x03, 0x06, 0x07}) {
+      shadow.set(BUS_I2C0, ADDR_IOEXP, reg, 0x00);
+    }
 
     LOG(DEBUG) << "Disabling all current sources";
     powerDAC(false, CUR_1.dacaddress(), CUR_1.dacoutput());
@@ -80,6 +116,66 @@ namespace caribou {
 
   template <typename T> caribouHAL<T>::~caribouHAL() {}
 
+  template <typename T> void caribouHAL<T>::resyncPeripherals() {
+    LOG(DEBUG) << "Resynchronizing CaR board peripheral shadow registers, " << shadow.hits() << " reads served and "
+               << shadow.elided() << " writes elided so far";
+    auto lock = shadow.lock();
+    shadow.invalidate();
+
+    // Read back both output and configuration ports of the IO expander:
+    iface_i2c& i2c0 = InterfaceManager::getInterface<iface_i2c>(BUS_I2C0);
+    for(const uint8_t reg : {0x02, 0x06}) {
+      std::vector<i2c_t> ports = i2c0.read(ADDR_IOEXP, reg, 2);
+      shadow.set(BUS_I2C0, ADDR_IOEXP, reg, ports.at(0));
+      shadow.set(BUS_I2C0, ADDR_IOEXP, reg + 1, ports.at(1));
+    }
+
+    // Read back configuration and calibration of all current monitors in one transaction:
+    iface_i2c& i2c1 = InterfaceManager::getInterface<iface_i2c>(BUS_I2C1);
+    const std::vector<VOLTAGE_REGULATOR_T> regulators = {
+      PWR_OUT_1, PWR_OUT_2, PWR_OUT_3, PWR_OUT_4, PWR_OUT_5, PWR_OUT_6, PWR_OUT_7, PWR_OUT_8};
+    std::vector<i2c_message_t> messages;
+    for(const auto& regulator : regulators) {
+      messages.push_back(i2c_write_msg(regulator.pwrmonitor(), {REG_ADC_CONFIGURATION}));
+      messages.push_back(i2c_read_msg(regulator.pwrmonitor(), 2));
+      messages.push_back(i2c_write_msg(regulator.pwrmonitor(), {REG_ADC_CALIBRATION}));
+      messages.push_back(i2c_read_msg(regulator.pwrmonitor(), 2));
+    }
+    i2c1.transaction(messages);
+
+    for(size_t i = 0; i < regulators.size(); i++) {
+      const i2c_address_t device = regulators[i].pwrmonitor();
+      const std::vector<i2c_t>& conf = messages[4 * i + 1].data;
+      const std::vector<i2c_t>& cal = messages[4 * i + 3].data;
+      const uint16_t cal_value = static_cast<uint16_t>((cal.at(0) << 8) | cal.at(1));
+      shadow.set(BUS_I2C1, device, REG_ADC_CONFIGURATION, static_cast<uint16_t>((conf.at(0) << 8) | conf.at(1)));
+      shadow.set(BUS_I2C1, device, REG_ADC_CALIBRATION, cal_value);
+      // Monitors without calibration are not sampled by the telemetry:
+      telemetry::getInstance().setCurrentMonitor(device,
+                                                 cal_value > 0 ? 0.00512 / (cal_value * CAR_INA226_R_SHUNT) : 0);
+    }
+  }
+
+  template <typename T>
+  void caribouHAL<T>::updateIOExpander(const uint8_t reg, const uint8_t set, const uint8_t clear) {
+    iface_i2c& i2c = InterfaceManager::getInterface<iface_i2c>(BUS_I2C0);
+    auto lock = shadow.lock();
+
+    uint16_t mask;
+    if(!shadow.get(BUS_I2C0, ADDR_IOEXP, reg, mask)) {
+      mask = i2c.read(ADDR_IOEXP, reg, 1).at(0);
+      shadow.set(BUS_I2C0, ADDR_IOEXP, reg, mask);
+    }
+
+    const uint8_t value = static_cast<uint8_t>((mask | set) & ~clear);
+    if(shadow.holds(BUS_I2C0, ADDR_IOEXP, reg, value)) {
+      LOG(DEBUG) << "IO expander port " << to_hex_string(reg) << " unchanged";
+      return;
+    }
+    i2c.write(ADDR_IOEXP, std::make_pair(reg, value));
+    shadow.set(BUS_I2C0, ADDR_IOEXP, reg, value);
+  }
+
   template <typename T> typename T::data_type caribouHAL<T>::send(const typename T::data_type& data) {
     return InterfaceManager::getInterface<T>(_devpath).write(_devaddress, data);
   }
@@ -116,6 +212,11 @@ namespace caribou {
     return InterfaceManager::getInterface<T>(_devpath).read(_devaddress, reg, length);
   }
 
+  template <typename T>
+  std::vector<typename T::data_type> caribouHAL<T>::receive(const std::vector<typename T::reg_type>& regs) {
+    return InterfaceManager::getInterface<T>(_devpath).read(_devaddress, regs);
+  }
+
   template <typename T> uint32_t caribouHAL<T>::getFirmwareRegister(uint16_t) {
     throw FirmwareException("Functionality not implemented.");
   }
@@ -139,6 +240,11 @@ namespace caribou {
     // Two bytes must be read, containing 12bit of temperature information plus 4bit 0.
     // Negative numbers are represented in binary twos complement format.
 
+    double value;
+    if(telemetry::getInstance().latest("temperature", value)) {
+      return value;
+    }
+
     LOG(DEBUG) << "Reading temperature from TMP101";
     iface_i2c& myi2c = InterfaceManager::getInterface<iface_i2c>(BUS_I2C0);
 
@@ -203,24 +309,18 @@ namespace caribou {
 
   template <typename T> void caribouHAL<T>::powerVoltageRegulator(const VOLTAGE_REGULATOR_T regulator, const bool enable) {
 
-    iface_i2c& i2c = InterfaceManager::getInterface<iface_i2c>(BUS_I2C0);
-
     if(enable) {
       LOG(DEBUG) << "Powering up " << regulator.name();
 
       // First power on DAC
       powerDAC(true, regulator.dacaddress(), regulator.dacoutput());
       // Power on the Voltage regulator
-      auto mask = i2c.read(ADDR_IOEXP, 0x03, 1)[0];
-      mask |= 1 << regulator.pwrswitch();
-      i2c.write(ADDR_IOEXP, std::make_pair(0x03, mask));
+      updateIOExpander(0x03, static_cast<uint8_t>(1 << regulator.pwrswitch()), 0);
     } else {
       LOG(DEBUG) << "Powering down " << regulator.name();
 
       // Disable the Volage regulator
-      auto mask = i2c.read(ADDR_IOEXP, 0x03, 1)[0];
-      mask &= ~(1 << regulator.pwrswitch());
-      i2c.write(ADDR_IOEXP, std::make_pair(0x03, mask));
+      updateIOExpander(0x03, 0, static_cast<uint8_t>(1 << regulator.pwrswitch()));
 
       // Disable the DAC
       powerDAC(false, regulator.dacaddress(), regulator.dacoutput());
@@ -242,20 +342,16 @@ namespace caribou {
     setDACVoltage(source.dacaddress(), source.dacoutput(), (current * CAR_VREF_4P0) / 1000);
 
     // set polarisation
-    iface_i2c& i2c = InterfaceManager::getInterface<iface_i2c>(BUS_I2C0);
-    auto mask = i2c.read(ADDR_IOEXP, 0x02, 1)[0];
-
+    const uint8_t bit = static_cast<uint8_t>(1 << source.polswitch());
     if(polarity == CURRENT_SOURCE_POLARITY_T::PULL) {
       LOG(DEBUG) << "Polarity switch (" << to_hex_string(source.polswitch()) << ") set to PULL";
-      mask &= ~(1 << source.polswitch());
+      updateIOExpander(0x02, 0, bit);
     } else if(polarity == CURRENT_SOURCE_POLARITY_T::PUSH) {
       LOG(DEBUG) << "Polarity switch (" << to_hex_string(source.polswitch()) << ") set to PUSH";
-      mask |= 1 << source.polswitch();
+      updateIOExpander(0x02, bit, 0);
     } else {
       throw ConfigInvalid("Invalid polarity setting provided");
     }
-
-    i2c.write(ADDR_IOEXP, std::make_pair(0x02, mask));
   }
 
   template <typename T> void caribouHAL<T>::powerCurrentSource(const CURRENT_SOURCE_T source, const bool enable) {
@@ -295,8 +391,15 @@ namespace caribou {
     // Set DAC and update: combine command with channel via Control&Access byte:
     uint8_t reg = REG_DAC_WRUP_CHANNEL | address;
 
+    auto lock = shadow.lock();
+    if(shadow.holds(BUS_I2C3, device, reg, d_in)) {
+      LOG(DEBUG) << "DAC7678 channel already set";
+      return;
+    }
+
     // Send I2C write command
     myi2c.write(device, reg, command);
+    shadow.set(BUS_I2C3, device, reg, d_in);
   }
 
   template <typename T> void caribouHAL<T>::powerDAC(const bool enable, const uint8_t device, const uint8_t address) {
@@ -316,33 +419,104 @@ namespace caribou {
                            0xFF),
       static_cast<uint8_t>((channel_bits << 4) & 0xFF)};
 
+    // The power state of every channel is shadowed separately:
+    const uint16_t reg = REG_DAC_POWER | address;
+    auto lock = shadow.lock();
+    if(shadow.holds(BUS_I2C3, device, reg, enable)) {
+      LOG(DEBUG) << "DAC7678 channel already powered " << (enable ? "up" : "down");
+      return;
+    }
+
     // Send I2C write command
     myi2c.write(device, REG_DAC_POWER, command);
+    shadow.set(BUS_I2C3, device, reg, enable);
   }
 
-  template <typename T> void caribouHAL<T>::configureSI5345(SI5345_REG_T const* const regs, const size_t length) {
+  template <typename T>
+  void caribouHAL<T>::configureSI5345(SI5345_REG_T const* const regs, const size_t length, const bool force) {
     LOG(DEBUG) << "Configuring SI5345";
 
     iface_i2c& i2c = InterfaceManager::getInterface<iface_i2c>(BUS_I2C0);
-    uint8_t page = regs[0].address >> 8; // first page to be used
 
-    i2c.write(ADDR_CLKGEN, std::make_pair(0x01, page)); // set first page
+    // FNV-1a hash of the register table to identify it on the chip:
+    uint64_t hash = 0xcbf29ce484222325;
+    for(size_t i = 0; i < length; i++) {
+      for(uint8_t byte :
+          {static_cast<uint8_t>(regs[i].address >> 8), static_cast<uint8_t>(regs[i].address), regs[i].value}) {
+        hash = (hash ^ byte) * 0x100000001b3;
+      }
+    }
+    std::vector<i2c_t> hash_bytes;
+    for(size_t i = 0; i < sizeof(hash); i++) {
+      hash_bytes.push_back(static_cast<i2c_t>(hash >> (8 * i)));
+    }
+
+    // Check whether the table has been uploaded before:
+    if(!force) {
+      std::vector<i2c_message_t> check = {
+        i2c_write_msg(ADDR_CLKGEN, {REG_CLKGEN_PAGE, static_cast<i2c_t>(REG_CLKGEN_DESIGN_ID >> 8)}),
+        i2c_write_msg(ADDR_CLKGEN, {static_cast<i2c_t>(REG_CLKGEN_DESIGN_ID & 0xFF)}),
+        i2c_read_msg(ADDR_CLKGEN, hash_bytes.size())};
+      i2c.transaction(check);
+      if(check.back().data == hash_bytes) {
+        LOG(INFO) << "SI5345 already holds the requested configuration, skipping upload";
+        return;
+      }
+    }
+
+    // Collect consecutive registers on the same page in block writes, the register address is incremented by the chip:
+    auto upload = [&](size_t begin, size_t end) {
+      std::vector<i2c_message_t> messages;
+      int page = -1;
+      for(size_t i = begin; i < end; i++) {
+        if(page != static_cast<int>(regs[i].address >> 8)) { // adjust page
+          page = regs[i].address >> 8;
+          messages.push_back(i2c_write_msg(ADDR_CLKGEN, {REG_CLKGEN_PAGE, static_cast<i2c_t>(page)}));
+        } else if(regs[i].address == regs[i - 1].address + 1) {
+          messages.back().data.push_back(regs[i].value);
+          continue;
+        }
+        messages.push_back(i2c_write_msg(ADDR_CLKGEN, {static_cast<i2c_t>(regs[i].address & 0xFF), regs[i].value}));
+      }
+      return messages;
+    };
 
+    // The chip has to complete running calibrations after the preamble of the ClockBuilder tables before the rest follows:
+    size_t preamble = 0;
     for(size_t i = 0; i < length; i++) {
-      if(page != regs[i].address >> 8) { // adjust page
-        page = regs[i].address >> 8;
-        i2c.write(ADDR_CLKGEN, std::make_pair(0x01, page));
+      if(regs[i].address == REG_CLKGEN_SOFT_CAL && regs[i].value == 0x01) {
+        preamble = i + 1;
+        break;
       }
-      i2c.write(ADDR_CLKGEN, std::make_pair(regs[i].address & 0xFF, regs[i].value));
     }
+    if(preamble > 0) {
+      LOG(DEBUG) << "Uploading SI5345 configuration preamble of " << preamble << " registers";
+      std::vector<i2c_message_t> messages = upload(0, preamble);
+      i2c.transaction(messages);
+      mDelay(CLKGEN_PREAMBLE_DELAY_MS);
+    }
+
+    std::vector<i2c_message_t> messages = upload(preamble, length);
+
+    // Store the hash of the table, overwriting the design identifier:
+    std::vector<i2c_t> design_id = {static_cast<i2c_t>(REG_CLKGEN_DESIGN_ID & 0xFF)};
+    design_id.insert(design_id.end(), hash_bytes.begin(), hash_bytes.end());
+    messages.push_back(i2c_write_msg(ADDR_CLKGEN, {REG_CLKGEN_PAGE, static_cast<i2c_t>(REG_CLKGEN_DESIGN_ID >> 8)}));
+    messages.push_back(i2c_write_msg(ADDR_CLKGEN, design_id));
+
+    LOG(DEBUG) << "Uploading " << (length - preamble) << " registers to SI5345 in " << messages.size() << " I2C messages";
+    i2c.transaction(messages);
   }
 
   template <typename T> bool caribouHAL<T>::isLockedSI5345() {
     LOG(DEBUG) << "Checking lock status of SI5345";
 
     iface_i2c& i2c = InterfaceManager::getInterface<iface_i2c>(BUS_I2C0);
-    i2c.write(ADDR_CLKGEN, std::make_pair(0x01, 0x00)); // set first page
-    std::vector<i2c_t> rx = i2c.read(ADDR_CLKGEN, static_cast<uint8_t>(0x0E));
+    std::vector<i2c_message_t> messages = {i2c_write_msg(ADDR_CLKGEN, {REG_CLKGEN_PAGE, 0x00}), // set first page
+                                           i2c_write_msg(ADDR_CLKGEN, {REG_CLKGEN_STATUS}),
+                                           i2c_read_msg(ADDR_CLKGEN, 1)};
+    i2c.transaction(messages);
+    std::vector<i2c_t>& rx = messages.back().data;
     if(rx[0] & 0x2) {
       LOG(DEBUG) << "SI5345 is not locked";
       return false;
@@ -352,6 +526,25 @@ namespace caribou {
     }
   }
 
+  template <typename T> bool caribouHAL<T>::waitLockedSI5345(const std::chrono::milliseconds timeout) {
+    LOG(DEBUG) << "Waiting for SI5345 to lock...";
+
+    const auto start = std::chrono::steady_clock::now();
+    while(true) {
+      const bool locked = isLockedSI5345();
+      const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+      if(locked) {
+        LOG(INFO) << "SI5345 locked after " << elapsed.count() << " ms";
+        return true;
+      }
+      if(elapsed >= timeout) {
+        LOG(WARNING) << "SI5345 not locked after " << elapsed.count() << " ms";
+        return false;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+
   template <typename T>
   void caribouHAL<T>::configurePulser(unsigned channel_mask,
                                       const bool ext_trigger,
@@ -503,7 +696,6 @@ namespace caribou {
     conf |= (0x0 << 3);
     // Operation mode: continuous mesaurement of shunt and bus voltage:
     conf |= 0x7;
-    i2c.write(device, REG_ADC_CONFIGURATION, {static_cast<i2c_t>(conf >> 8), static_cast<i2c_t>(conf & 0xFF)});
 
     // set calibration register
 
@@ -514,11 +706,50 @@ namespace caribou {
     unsigned int cal = static_cast<unsigned int>(0.00512 / (CAR_INA226_R_SHUNT * current_lsb));
     LOG(DEBUG) << "  cal_register = " << static_cast<double>(cal) << " (" << to_hex_string(cal) << ")";
 
-    i2c.write(device, REG_ADC_CALIBRATION, {static_cast<i2c_t>(cal >> 8), static_cast<i2c_t>(cal & 0xFF)});
+    // Write both registers in one transaction unless already configured identically:
+    auto lock = shadow.lock();
+    if(shadow.holds(BUS_I2C1, device, REG_ADC_CONFIGURATION, conf) &&
+       shadow.holds(BUS_I2C1, device, REG_ADC_CALIBRATION, static_cast<uint16_t>(cal))) {
+      LOG(DEBUG) << "  monitor already configured";
+    } else {
+      std::vector<i2c_message_t> messages = {
+        i2c_write_msg(device, {REG_ADC_CONFIGURATION, static_cast<i2c_t>(conf >> 8), static_cast<i2c_t>(conf & 0xFF)}),
+        i2c_write_msg(device, {REG_ADC_CALIBRATION, static_cast<i2c_t>(cal >> 8), static_cast<i2c_t>(cal & 0xFF)})};
+      i2c.transaction(messages);
+      shadow.set(BUS_I2C1, device, REG_ADC_CONFIGURATION, conf);
+      shadow.set(BUS_I2C1, device, REG_ADC_CALIBRATION, static_cast<uint16_t>(cal));
+    }
+
+    // Cache the effective current LSB for conversions and let the board telemetry sample this monitor:
+    telemetry::getInstance().setCurrentMonitor(device, 0.00512 / (cal * CAR_INA226_R_SHUNT));
+  }
+
+  template <typename T> double caribouHAL<T>::currentLSB(const i2c_address_t device) {
+    double current_lsb = telemetry::getInstance().getCurrentLSB(device);
+    if(current_lsb > 0) {
+      return current_lsb;
+    }
+
+    // Monitor has not been configured by this process, read back the calibration register unless known:
+    uint16_t cal;
+    if(!shadow.get(BUS_I2C1, device, REG_ADC_CALIBRATION, cal)) {
+      iface_i2c& i2c = InterfaceManager::getInterface<iface_i2c>(BUS_I2C1);
+      std::vector<i2c_t> cal_v = i2c.read(device, REG_ADC_CALIBRATION, 2);
+      cal = static_cast<uint16_t>((cal_v.at(0) << 8) | cal_v.at(1));
+      shadow.set(BUS_I2C1, device, REG_ADC_CALIBRATION, cal);
+    }
+    current_lsb = static_cast<double>(0.00512) / (cal * CAR_INA226_R_SHUNT);
+    LOG(DEBUG) << "  current_lsb  = " << static_cast<double>(current_lsb * 1e6) << " uA/bit";
+    return current_lsb;
   }
 
   template <typename T> double caribouHAL<T>::measureVoltage(const VOLTAGE_REGULATOR_T regulator) {
 
+    double value;
+    if(telemetry::getInstance().latest(regulator.name() + ".voltage", value)) {
+      return value;
+    }
+
     iface_i2c& i2c = InterfaceManager::getInterface<iface_i2c>(BUS_I2C1);
     const i2c_address_t device = regulator.pwrmonitor();
 
@@ -529,41 +760,47 @@ namespace caribou {
     return (static_cast<unsigned int>(voltage.at(0) << 8) | voltage.at(1)) * 0.00125;
   }
 
-  // FIXME: somtimes it returns dummy values
   template <typename T> double caribouHAL<T>::measureCurrent(const VOLTAGE_REGULATOR_T regulator) {
+
+    double value;
+    if(telemetry::getInstance().latest(regulator.name() + ".current", value)) {
+      return value;
+    }
+
     iface_i2c& i2c = InterfaceManager::getInterface<iface_i2c>(BUS_I2C1);
     const i2c_address_t device = regulator.pwrmonitor();
+    const double current_lsb = currentLSB(device);
     LOG(DEBUG) << "Reading current from INA226 at " << to_hex_string(device);
 
-    // Reading back the calibration register:
-    std::vector<i2c_t> cal_v = i2c.read(device, REG_ADC_CALIBRATION, 2);
-    double current_lsb =
-      static_cast<double>(0.00512) / ((static_cast<uint16_t>(cal_v.at(0) << 8) | cal_v.at(1)) * CAR_INA226_R_SHUNT);
-    LOG(DEBUG) << "  current_lsb  = " << static_cast<double>(current_lsb * 1e6) << " uA/bit";
-
-    // Reading the current register:
+    // INA226: the current register holds a signed value
     std::vector<i2c_t> current_raw = i2c.read(device, REG_ADC_CURRENT, 2);
-    return (static_cast<unsigned int>(current_raw.at(0) << 8) | current_raw.at(1)) * current_lsb;
+    return static_cast<int16_t>((current_raw.at(0) << 8) | current_raw.at(1)) * current_lsb;
   }
 
-  // FIXME: sometimes it return dummy values
   template <typename T> double caribouHAL<T>::measurePower(const VOLTAGE_REGULATOR_T regulator) {
+
+    double value;
+    if(telemetry::getInstance().latest(regulator.name() + ".power", value)) {
+      return value;
+    }
+
     iface_i2c& i2c = InterfaceManager::getInterface<iface_i2c>(BUS_I2C1);
     const i2c_address_t device = regulator.pwrmonitor();
+    const double current_lsb = currentLSB(device);
     LOG(DEBUG) << "Reading power from INA226 at " << to_hex_string(device);
 
-    // Reading back the calibration register:
-    std::vector<i2c_t> cal_v = i2c.read(device, REG_ADC_CALIBRATION, 2);
-    double power_lsb =
-      static_cast<double>(0.00512) / ((static_cast<uint16_t>(cal_v.at(0) << 8) | cal_v.at(1)) * CAR_INA226_R_SHUNT);
-    LOG(DEBUG) << "  power_lsb  = " << static_cast<double>(power_lsb * 1e6) << " uA/bit";
-
-    // Reading the power register:
+    // INA226: the power LSB is 25 times the current LSB
     std::vector<i2c_t> power_raw = i2c.read(device, REG_ADC_POWER, 2);
-    return (static_cast<unsigned int>(power_raw[0] << 8) | power_raw[1]) * power_lsb;
+    return (static_cast<unsigned int>(power_raw.at(0) << 8) | power_raw.at(1)) * 25 * current_lsb;
   }
 
   template <typename T> double caribouHAL<T>::readSlowADC(const SLOW_ADC_CHANNEL_T channel) {
+
+    double value;
+    if(telemetry::getInstance().latest(channel.name(), value)) {
+      return value;
+    }
+
     iface_i2c& i2c = InterfaceManager::getInterface<iface_i2c>(BUS_I2C3);
 
     LOG(DEBUG) << "Sampling channel " << channel.name() << " on pin " << static_cast<int>(channel.channel())
@@ -6,4 +6,5 @@
 namespace caribou {
 
   bool caribouHALbase::generalResetDone = false;
+  carboard_shadow caribouHALbase::shadow;
 }
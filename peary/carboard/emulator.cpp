@@ -0,0 +1,777 @@
+#include "emulator.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <map>
+
+#include "Carboard.hpp"
+#include "utils/exceptions.hpp"
+#include "utils/log.hpp"
+#include "utils/utils.hpp"
+
+using namespace caribou;
+
+namespace {
+
+  /** Behavioral model of an I2C slave
+   *
+   *  Every message of a transfer is handed to the model separately, a repeated start ends the previous message.
+   */
+  class i2c_slave {
+  public:
+    virtual ~i2c_slave() {}
+    virtual void write(const std::vector<uint8_t>& data) = 0;
+    virtual void read(std::vector<uint8_t>& data) = 0;
+  };
+
+  // Register memory with 8 or 16 bit pointer and auto-increment, used for the EEPROM and all slaves without model
+  class memory_slave : public i2c_slave {
+  public:
+    memory_slave(size_t size, bool wide) : _memory(size, 0), _wide(wide) {}
+
+    void write(const std::vector<uint8_t>& data) override {
+      size_t i = 0;
+      if(_wide && data.size() >= 2) {
+        _pointer = static_cast<size_t>((data[0] << 8) | data[1]);
+        i = 2;
+      } else if(!_wide && !data.empty()) {
+        _pointer = data[0];
+        i = 1;
+      }
+      for(; i < data.size(); i++) {
+        _memory[_pointer++ % _memory.size()] = data[i];
+      }
+    }
+
+    void read(std::vector<uint8_t>& data) override {
+      for(auto& byte : data) {
+        byte = _memory[_pointer++ % _memory.size()];
+      }
+    }
+
+  private:
+    std::vector<uint8_t> _memory;
+    bool _wide;
+    size_t _pointer{0};
+  };
+
+  // PCA9539 16 bit IO expander: register pairs for input, output, polarity inversion and configuration
+  class pca9539 : public i2c_slave {
+  public:
+    pca9539() { reset(); }
+
+    void reset() { _regs = {{0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00, 0xFF, 0xFF}}; }
+
+    void write(const std::vector<uint8_t>& data) override {
+      if(data.empty()) {
+        return;
+      }
+      _pointer = data[0] & 0x07;
+      for(size_t i = 1; i < data.size(); i++) {
+        // Input ports are read-only:
+        if(_pointer > 1) {
+          _regs[_pointer] = data[i];
+        }
+        _pointer ^= 1;
+      }
+    }
+
+    void read(std::vector<uint8_t>& data) override {
+      for(auto& byte : data) {
+        if(_pointer < 2) {
+          // Pins configured as output read back the output register, inputs are pulled up:
+          const uint8_t config = _regs[6 + _pointer];
+          byte = static_cast<uint8_t>(((_regs[2 + _pointer] & ~config) | config) ^ _regs[4 + _pointer]);
+        } else {
+          byte = _regs[_pointer];
+        }
+        _pointer ^= 1;
+      }
+    }
+
+    // Level of an output pin, inputs are never driven
+    bool output(unsigned int port, unsigned int bit) const {
+      return !(_regs[6 + port] & (1 << bit)) && (_regs[2 + port] & (1 << bit));
+    }
+
+  private:
+    std::array<uint8_t, 8> _regs;
+    uint8_t _pointer{0};
+  };
+
+  // DAC7678 octal 12 bit DAC with command byte and power-down register
+  class dac7678 : public i2c_slave {
+  public:
+    dac7678() { reset(); }
+
+    void reset() {
+      _input.fill(0);
+      _output.fill(0);
+      _powered.fill(true);
+    }
+
+    void write(const std::vector<uint8_t>& data) override {
+      if(data.empty()) {
+        return;
+      }
+      _command = data[0];
+      if(data.size() < 3) {
+        return;
+      }
+
+      const uint8_t channel = data[0] & 0x0F;
+      const uint16_t word = static_cast<uint16_t>((data[1] << 8) | data[2]);
+      const uint16_t code = word >> 4;
+      switch(data[0] & 0xF0) {
+      case REG_DAC_WRITE_CHANNEL:
+        each(channel, [&](size_t ch) { _input[ch] = code; });
+        break;
+      case REG_DAC_UPDATE_CHANNEL:
+        each(channel, [&](size_t ch) { _output[ch] = _input[ch]; });
+        break;
+      case REG_DAC_LDAC_CHANNEL:
+        each(channel, [&](size_t ch) { _input[ch] = code; });
+        _output = _input;
+        break;
+      case REG_DAC_WRUP_CHANNEL:
+        each(channel, [&](size_t ch) { _input[ch] = _output[ch] = code; });
+        break;
+      case REG_DAC_POWER:
+        // Channels A to H are selected by bits 5 to 12, the power-down mode by bits 13 and 14:
+        for(size_t ch = 0; ch < 8; ch++) {
+          if(word & (1 << (ch + 5))) {
+            _powered[ch] = ((word >> 13) & 0x3) == 0;
+          }
+        }
+        break;
+      case REG_DAC_RESET:
+        reset();
+        break;
+      default:
+        break;
+      }
+    }
+
+    void read(std::vector<uint8_t>& data) override {
+      // Read back the input register of the channel selected by the last command:
+      const uint16_t code = _input[_command & 0x07];
+      for(size_t i = 0; i < data.size(); i++) {
+        data[i] = static_cast<uint8_t>(i % 2 == 0 ? code >> 4 : code << 4);
+      }
+    }
+
+    double voltage(uint8_t channel) const {
+      return _powered.at(channel) ? _output.at(channel) * CAR_VREF_4P0 / 4096 : 0;
+    }
+
+  private:
+    void each(uint8_t channel, const std::function<void(size_t)>& f) {
+      if(channel == REG_DAC_CHANNEL_ALL) {
+        for(size_t ch = 0; ch < 8; ch++) {
+          f(ch);
+        }
+      } else if(channel < 8) {
+        f(channel);
+      }
+    }
+
+    std::array<uint16_t, 8> _input;
+    std::array<uint16_t, 8> _output;
+    std::array<bool, 8> _powered;
+    uint8_t _command{0};
+  };
+
+  // INA226 current and power monitor, measurements are derived from the monitored regulator
+  class ina226 : public i2c_slave {
+  public:
+    ina226(std::function<double()> voltage, std::function<double()> current)
+        : _voltage(std::move(voltage)), _current(std::move(current)) {
+      reset();
+    }
+
+    void reset() {
+      _regs.clear();
+      _regs[REG_ADC_CONFIGURATION] = 0x4127;
+      _regs[REG_ADC_CALIBRATION] = 0x0000;
+      _regs[0x06] = 0x0000;
+      _regs[0x07] = 0x0000;
+      _regs[0xFE] = 0x5449;
+      _regs[0xFF] = 0x2260;
+    }
+
+    void write(const std::vector<uint8_t>& data) override {
+      if(data.empty()) {
+        return;
+      }
+      _pointer = data[0];
+      if(data.size() < 3) {
+        return;
+      }
+      const uint16_t value = static_cast<uint16_t>((data[1] << 8) | data[2]);
+      if(_pointer == REG_ADC_CONFIGURATION && (value & 0x8000)) {
+        reset();
+      } else if(_pointer == REG_ADC_CONFIGURATION || _pointer == REG_ADC_CALIBRATION || _pointer == 0x06 ||
+                _pointer == 0x07) {
+        _regs[_pointer] = value;
+      }
+    }
+
+    void read(std::vector<uint8_t>& data) override {
+      const uint16_t value = get(_pointer);
+      for(size_t i = 0; i < data.size(); i++) {
+        data[i] = static_cast<uint8_t>(i % 2 == 0 ? value >> 8 : value);
+      }
+    }
+
+  private:
+    static uint16_t clamp(double value, double min, double max) {
+      return static_cast<uint16_t>(static_cast<int32_t>(std::round(std::min(std::max(value, min), max))));
+    }
+
+    uint16_t get(uint8_t reg) {
+      const double voltage = _voltage();
+      const double current = _current();
+      const double cal = _regs[REG_ADC_CALIBRATION];
+      // Shunt voltage LSB 2.5uV, bus voltage LSB 1.25mV, current and power scaled by the calibration register:
+      const double shunt = current * CAR_INA226_R_SHUNT / 2.5e-6;
+      const double bus = voltage / 1.25e-3;
+      const double current_reg = shunt * cal / 2048;
+      switch(reg) {
+      case REG_ADC_SHUNT_VOLTAGE:
+        return clamp(shunt, -32768, 32767);
+      case REG_ADC_BUS_VOLTAGE:
+        return clamp(bus, 0, 32767);
+      case REG_ADC_CURRENT:
+        return clamp(current_reg, -32768, 32767);
+      case REG_ADC_POWER:
+        return clamp(std::abs(current_reg) * bus / 20000, 0, 65535);
+      default:
+        return _regs.count(reg) ? _regs[reg] : 0;
+      }
+    }
+
+    std::function<double()> _voltage;
+    std::function<double()> _current;
+    std::map<uint8_t, uint16_t> _regs;
+    uint8_t _pointer{0};
+  };
+
+  // ADS7828 8 channel 12 bit ADC, every conversion is started with a command byte
+  class ads7828 : public i2c_slave {
+  public:
+    explicit ads7828(const std::array<double, 8>& inputs) : _inputs(inputs) {}
+
+    void write(const std::vector<uint8_t>& data) override {
+      if(data.empty()) {
+        return;
+      }
+      // Single-ended channel selection: bits C2 C1 C0 map to channels 0, 2, 4, 6, 1, 3, 5, 7
+      const uint8_t select = (data[0] >> 4) & 0x07;
+      const size_t channel = ((select & 0x4) ? 1 : 0) + 2 * (select & 0x3);
+      double voltage = _inputs[channel];
+      if(!(data[0] & 0x80)) {
+        // Differential mode: difference to the paired channel
+        voltage -= _inputs[channel ^ 1];
+      }
+      _result = static_cast<uint16_t>(std::min(std::max(voltage / CAR_VREF_4P0 * 4096, 0.), 4095.));
+    }
+
+    void read(std::vector<uint8_t>& data) override {
+      for(size_t i = 0; i < data.size(); i++) {
+        data[i] = static_cast<uint8_t>(i % 2 == 0 ? _result >> 8 : _result);
+      }
+    }
+
+  private:
+    const std::array<double, 8>& _inputs;
+    uint16_t _result{0};
+  };
+
+  // TMP101 temperature sensor with pointer register
+  class tmp101 : public i2c_slave {
+  public:
+    explicit tmp101(const double& temperature) : _temperature(temperature) { reset(); }
+
+    void reset() {
+      _config = 0x80;
+      _low = 0x4B00;
+      _high = 0x5000;
+    }
+
+    void write(const std::vector<uint8_t>& data) override {
+      if(data.empty()) {
+        return;
+      }
+      _pointer = data[0] & 0x03;
+      if(_pointer == REG_TEMP_CONF && data.size() >= 2) {
+        _config = data[1];
+      } else if(_pointer != REG_TEMP_TEMP && data.size() >= 3) {
+        (_pointer == REG_TEMP_LOW ? _low : _high) = static_cast<uint16_t>((data[1] << 8) | data[2]);
+      }
+    }
+
+    void read(std::vector<uint8_t>& data) override {
+      uint16_t value;
+      switch(_pointer) {
+      case REG_TEMP_TEMP:
+        value = static_cast<uint16_t>(static_cast<int16_t>(std::lround(_temperature / 0.0625)) << 4);
+        break;
+      case REG_TEMP_CONF:
+        value = static_cast<uint16_t>(_config << 8);
+        break;
+      case REG_TEMP_LOW:
+        value = _low;
+        break;
+      default:
+        value = _high;
+        break;
+      }
+      for(size_t i = 0; i < data.size(); i++) {
+        data[i] = static_cast<uint8_t>(i % 2 == 0 ? value >> 8 : value);
+      }
+    }
+
+  private:
+    const double& _temperature;
+    uint8_t _config;
+    uint16_t _low;
+    uint16_t _high;
+    uint8_t _pointer{0};
+  };
+
+  // SI5345 clock generator with paged register space, loses lock whenever its configuration is written
+  class si5345 : public i2c_slave {
+  public:
+    explicit si5345(const double& lock_ms) : _lock_ms(lock_ms) { reset(); }
+
+    void reset() {
+      _regs.clear();
+      _page = 0;
+      // Part number:
+      _regs[0x0002] = 0x45;
+      _regs[0x0003] = 0x53;
+      _locked_at = std::chrono::steady_clock::now();
+    }
+
+    void write(const std::vector<uint8_t>& data) override {
+      if(data.empty()) {
+        return;
+      }
+      _pointer = data[0];
+      for(size_t i = 1; i < data.size(); i++) {
+        const uint16_t address = static_cast<uint16_t>((_page << 8) | _pointer);
+        if(_pointer == REG_CLKGEN_PAGE) {
+          _page = data[i];
+        } else {
+          _regs[address] = data[i];
+          // The design identifier is user data and does not affect the PLL:
+          if(address < REG_CLKGEN_DESIGN_ID || address >= REG_CLKGEN_DESIGN_ID + 8) {
+            _locked_at = std::chrono::steady_clock::now() +
+                         std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                           std::chrono::duration<double, std::milli>(_lock_ms));
+          }
+        }
+        _pointer++;
+      }
+    }
+
+    void read(std::vector<uint8_t>& data) override {
+      for(auto& byte : data) {
+        const uint16_t address = static_cast<uint16_t>((_page << 8) | _pointer);
+        if(_pointer == REG_CLKGEN_PAGE) {
+          byte = _page;
+        } else if(address == REG_CLKGEN_STATUS) {
+          // Loss of lock is flagged in bit 1:
+          byte = (std::chrono::steady_clock::now() < _locked_at ? 0x02 : 0x00);
+        } else {
+          byte = _regs.count(address) ? _regs[address] : 0;
+        }
+        _pointer++;
+      }
+    }
+
+  private:
+    const double& _lock_ms;
+    std::map<uint16_t, uint8_t> _regs;
+    uint8_t _page{0};
+    uint8_t _pointer{0};
+    std::chrono::steady_clock::time_point _locked_at;
+  };
+
+  const caribou::VOLTAGE_REGULATOR_T* const REGULATORS[] = {
+    &PWR_OUT_1, &PWR_OUT_2, &PWR_OUT_3, &PWR_OUT_4, &PWR_OUT_5, &PWR_OUT_6, &PWR_OUT_7, &PWR_OUT_8};
+
+  const double DEFAULT_LOAD = 10;
+
+  // Busy-wait, sleeping is too coarse for the microsecond delays of single register accesses
+  void delay(double us) {
+    if(us <= 0) {
+      return;
+    }
+    const auto until =
+      std::chrono::steady_clock::now() +
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::micro>(us));
+    while(std::chrono::steady_clock::now() < until) {
+    }
+  }
+
+  bool environment(const char* name, std::string& value) {
+    const char* env = std::getenv(name);
+    if(env == nullptr) {
+      return false;
+    }
+    value = env;
+    return true;
+  }
+
+  void environment(const char* name, double& value) {
+    std::string env;
+    if(!environment(name, env)) {
+      return;
+    }
+    try {
+      value = std::stod(env);
+    } catch(const std::logic_error&) {
+      throw ConfigInvalid("Invalid value \"" + env + "\" for " + name);
+    }
+  }
+
+  // Handles access the emulated registers through the emulator such that memory models and timing apply
+  class emulated_port : public memory_port {
+  public:
+    emulated_port(volatile uint32_t* reg, std::intptr_t address) : _reg(reg), _address(address) {}
+
+    uint32_t read(const size_t offset) override {
+      return carboard_emulator::getInstance().readMemory(_address + static_cast<std::intptr_t>(offset), word(offset));
+    }
+
+    void write(const size_t offset, const uint32_t value) override {
+      carboard_emulator::getInstance().writeMemory(_address + static_cast<std::intptr_t>(offset), word(offset), value);
+    }
+
+  private:
+    volatile uint32_t* word(const size_t offset) const {
+      return reinterpret_cast<volatile uint32_t*>(reinterpret_cast<std::intptr_t>(_reg) + offset);
+    }
+
+    volatile uint32_t* _reg;
+    std::intptr_t _address;
+  };
+} // namespace
+
+struct carboard_emulator::board {
+  board() {
+    inputs.fill(0);
+    loads.fill(DEFAULT_LOAD);
+
+    auto& bus0 = slaves[BUS_I2C0];
+    bus0[ADDR_IOEXP].reset(ioexp = new pca9539());
+    bus0[ADDR_TEMP].reset(temperature_sensor = new tmp101(temperature));
+    bus0[ADDR_CLKGEN].reset(clock = new si5345(lock_ms));
+    bus0[ADDR_EEPROM].reset(new memory_slave(4096, true));
+
+    auto& bus3 = slaves[BUS_I2C3];
+    bus3[ADDR_ADC].reset(new ads7828(inputs));
+    for(const uint8_t address :
+        {ADDR_DAC_U44, ADDR_DAC_U45, ADDR_DAC_U46, ADDR_DAC_U47, ADDR_DAC_U48, ADDR_DAC_U49, ADDR_DAC_U50}) {
+      auto dac = new dac7678();
+      bus3[address].reset(dac);
+      dacs[address] = dac;
+    }
+
+    auto& bus1 = slaves[BUS_I2C1];
+    for(size_t i = 0; i < loads.size(); i++) {
+      auto monitor = new ina226([this, i]() { return voltage(i); }, [this, i]() { return voltage(i) / loads[i]; });
+      bus1[REGULATORS[i]->pwrmonitor()].reset(monitor);
+      monitors.push_back(monitor);
+    }
+  }
+
+  // Output voltage of a regulator: enabled by its power switch, set by the reference voltage from its DAC
+  double voltage(size_t i) const {
+    const auto& regulator = *REGULATORS[i];
+    if(!ioexp->output(1, regulator.pwrswitch())) {
+      return 0;
+    }
+    return std::max(3.6 - dacs.at(regulator.dacaddress())->voltage(regulator.dacoutput()), 0.);
+  }
+
+  i2c_slave& slave(const std::string& bus, uint8_t address) {
+    auto& slot = slaves[bus][address];
+    if(!slot) {
+      LOG(DEBUG) << "Emulating I2C slave " << to_hex_string(address) << " on " << bus << " as plain register memory";
+      slot.reset(new memory_slave(256, false));
+    }
+    return *slot;
+  }
+
+  std::map<std::string, std::map<uint8_t, std::unique_ptr<i2c_slave>>> slaves;
+  pca9539* ioexp;
+  tmp101* temperature_sensor;
+  si5345* clock;
+  std::map<uint8_t, dac7678*> dacs;
+  std::vector<ina226*> monitors;
+
+  std::array<double, 8> inputs;
+  std::array<double, 8> loads;
+  double temperature{25};
+  double lock_ms{0};
+};
+
+emulator_timing emulator_timing::zynq() {
+  emulator_timing timing;
+  // i2c-dev ioctl with start and stop condition, 9 bit clocks per byte at 100kHz
+  timing.i2c_transfer_us = 60;
+  timing.i2c_byte_us = 90;
+  // spidev ioctl, 8 bit clocks at 10MHz
+  timing.spi_transfer_us = 40;
+  timing.spi_byte_us = 0.8;
+  // AXI-lite read or write from the ARM cores through the general purpose port
+  timing.mem_access_ns = 200;
+  timing.si5345_lock_ms = 100;
+  return timing;
+}
+
+carboard_emulator& carboard_emulator::getInstance() {
+  static carboard_emulator instance;
+  return instance;
+}
+
+bool carboard_emulator::selected() {
+  std::string mode;
+  return environment("PEARY_EMULATOR", mode);
+}
+
+bool carboard_emulator::emulatesMemory() {
+#ifdef MEMORY_EMULATION
+  return true;
+#else
+  return selected();
+#endif
+}
+
+carboard_emulator::carboard_emulator() : _board(new board()) {
+  std::string mode;
+  if(environment("PEARY_EMULATOR", mode)) {
+    if(mode == "null") {
+      _stateful = false;
+    } else if(mode != "board") {
+      throw ConfigInvalid("Unknown emulator mode \"" + mode + "\"");
+    }
+  }
+
+  std::string timing;
+  if(environment("PEARY_EMULATOR_TIMING", timing)) {
+    if(timing == "zynq") {
+      _timing = emulator_timing::zynq();
+    } else if(timing != "none") {
+      throw ConfigInvalid("Unknown emulator timing \"" + timing + "\"");
+    }
+  }
+  environment("PEARY_EMULATOR_I2C_TRANSFER_US", _timing.i2c_transfer_us);
+  environment("PEARY_EMULATOR_I2C_BYTE_US", _timing.i2c_byte_us);
+  environment("PEARY_EMULATOR_SPI_TRANSFER_US", _timing.spi_transfer_us);
+  environment("PEARY_EMULATOR_SPI_BYTE_US", _timing.spi_byte_us);
+  environment("PEARY_EMULATOR_MEM_ACCESS_NS", _timing.mem_access_ns);
+  environment("PEARY_EMULATOR_SI5345_LOCK_MS", _timing.si5345_lock_ms);
+  _board->lock_ms = _timing.si5345_lock_ms;
+
+  LOG(INFO) << "Emulating CaR board with " << (_stateful ? "peripheral models" : "null peripherals") << ", I2C "
+            << _timing.i2c_transfer_us << "us/transfer + " << _timing.i2c_byte_us << "us/byte, SPI "
+            << _timing.spi_transfer_us << "us/transfer + " << _timing.spi_byte_us << "us/byte, memory "
+            << _timing.mem_access_ns << "ns/access";
+}
+
+carboard_emulator::~carboard_emulator() {}
+
+void carboard_emulator::setTiming(const emulator_timing& timing) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _timing = timing;
+  _board->lock_ms = timing.si5345_lock_ms;
+}
+
+emulator_timing carboard_emulator::getTiming() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _timing;
+}
+
+void carboard_emulator::reset() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  const double lock_ms = _board->lock_ms;
+  _board.reset(new board());
+  _board->lock_ms = lock_ms;
+  _spi_registers.clear();
+}
+
+void carboard_emulator::i2c(const std::string& bus, std::vector<i2c_message_t>& messages) {
+  size_t bytes = 0;
+  double transfer_us, byte_us;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for(auto& msg : messages) {
+      // Address byte plus data:
+      bytes += 1 + msg.data.size();
+      if(!_stateful) {
+        if(msg.read) {
+          std::fill(msg.data.begin(), msg.data.end(), 0);
+        }
+        continue;
+      }
+
+      i2c_slave& slave = _board->slave(bus, msg.address);
+      if(msg.read) {
+        slave.read(msg.data);
+      } else {
+        slave.write(msg.data);
+      }
+    }
+    transfer_us = _timing.i2c_transfer_us;
+    byte_us = _timing.i2c_byte_us;
+  }
+
+  _i2c_transfers++;
+  _i2c_messages += messages.size();
+  _i2c_bytes += bytes;
+  delay(transfer_us + byte_us * static_cast<double>(bytes));
+}
+
+void carboard_emulator::spi(size_t bytes) {
+  double transfer_us, byte_us;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    transfer_us = _timing.spi_transfer_us;
+    byte_us = _timing.spi_byte_us;
+  }
+
+  _spi_transfers++;
+  _spi_bytes += bytes;
+  delay(transfer_us + byte_us * static_cast<double>(bytes));
+}
+
+void carboard_emulator::memory(size_t words) {
+  double access_ns;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    access_ns = _timing.mem_access_ns;
+  }
+
+  _mem_accesses += words;
+  delay(access_ns * static_cast<double>(words) / 1000);
+}
+
+uint32_t carboard_emulator::readMemory(std::intptr_t address, const volatile uint32_t* reg) {
+  memory(1);
+  if(!_stateful) {
+    return 0;
+  }
+
+  // Models are called without holding the lock, they may take their time to produce data:
+  auto model = findModel(address);
+  return model ? model->read(address, *reg) : *reg;
+}
+
+void carboard_emulator::writeMemory(std::intptr_t address, volatile uint32_t* reg, uint32_t value) {
+  memory(1);
+  if(!_stateful) {
+    return;
+  }
+
+  *reg = value;
+  auto model = findModel(address);
+  if(model) {
+    model->write(address, value);
+  }
+}
+
+std::shared_ptr<memory_port> carboard_emulator::memoryPort(volatile uint32_t* reg, std::intptr_t address) {
+  return std::make_shared<emulated_port>(reg, address);
+}
+
+std::shared_ptr<memory_model> carboard_emulator::findModel(std::intptr_t address) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  auto it = _models.find(address);
+  return it == _models.end() ? std::shared_ptr<memory_model>() : it->second.lock();
+}
+
+void carboard_emulator::attach(const std::shared_ptr<memory_model>& model, const std::vector<std::intptr_t>& addresses) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  for(const auto& address : addresses) {
+    LOG(DEBUG) << "Attaching memory model to register at " << to_hex_string(address);
+    _models[address] = model;
+  }
+}
+
+void carboard_emulator::setSPIRegister(const std::string& device, uint32_t reg, uint32_t value) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _spi_registers[std::make_tuple(device, reg)] = value;
+}
+
+bool carboard_emulator::getSPIRegister(const std::string& device, uint32_t reg, uint32_t& value) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  auto it = _spi_registers.find(std::make_tuple(device, reg));
+  if(it == _spi_registers.end()) {
+    return false;
+  }
+  value = it->second;
+  return true;
+}
+
+void carboard_emulator::setLoad(const std::string& regulator, double resistance) {
+  if(!(resistance > 0)) {
+    throw ConfigInvalid("Load resistance has to be positive");
+  }
+  std::lock_guard<std::mutex> lock(_mutex);
+  for(size_t i = 0; i < _board->loads.size(); i++) {
+    if(REGULATORS[i]->name() == regulator) {
+      _board->loads[i] = resistance;
+      return;
+    }
+  }
+  throw ConfigInvalid("Unknown voltage regulator \"" + regulator + "\"");
+}
+
+void carboard_emulator::setADCInput(unsigned int channel, double voltage) {
+  if(channel < 1 || channel > 8) {
+    throw ConfigInvalid("ADC channel " + std::to_string(channel) + " does not exist");
+  }
+  std::lock_guard<std::mutex> lock(_mutex);
+  _board->inputs[channel - 1] = voltage;
+}
+
+void carboard_emulator::setTemperature(double temperature) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _board->temperature = temperature;
+}
+
+double carboard_emulator::getDACVoltage(uint8_t device, uint8_t channel) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  auto dac = _board->dacs.find(device);
+  if(dac == _board->dacs.end() || channel >= 8) {
+    throw ConfigInvalid("No DAC7678 channel " + std::to_string(channel) + " at " + to_hex_string(device));
+  }
+  return dac->second->voltage(channel);
+}
+
+emulator_statistics carboard_emulator::statistics() const {
+  emulator_statistics stats;
+  stats.i2c_transfers = _i2c_transfers;
+  stats.i2c_messages = _i2c_messages;
+  stats.i2c_bytes = _i2c_bytes;
+  stats.spi_transfers = _spi_transfers;
+  stats.spi_bytes = _spi_bytes;
+  stats.mem_accesses = _mem_accesses;
+  return stats;
+}
+
+void carboard_emulator::resetStatistics() {
+  _i2c_transfers = 0;
+  _i2c_messages = 0;
+  _i2c_bytes = 0;
+  _spi_transfers = 0;
+  _spi_bytes = 0;
+  _mem_accesses = 0;
+}
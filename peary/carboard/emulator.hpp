@@ -0,0 +1,232 @@
+/** Stateful emulator of the CaR board
+ *
+ *  Used by the emulated interfaces in place of the hardware. Builds with the hardware interfaces hand their accesses to
+ *  the emulator as well if PEARY_EMULATOR is set, such that the same binaries run on the CaR board and on any Linux
+ *  machine. The I2C, SPI and memory interfaces can be emulated at runtime, DMA transfers need an emulating build. The
+ *  emulator holds behavioral models of the peripherals on
+ *  the CaR board I2C buses (DAC7678, INA226, PCA9539, ADS7828, TMP101, SI5345 and the board EEPROM) which are coupled like
+ *  on the board: the bus voltage seen by a current monitor follows the DAC setting and the power switch of its regulator.
+ *  Slaves without a model behave as plain register memories. The FPGA memory pages act as register files.
+ *
+ *  Every access is delayed according to a timing model of the i2c-dev, spidev and AXI-lite costs on the Zynq, such that
+ *  the performance of HAL and configuration code can be measured on any Linux machine. The emulator is configured at
+ *  runtime via the environment:
+ *
+ *    PEARY_EMULATOR                   "board" for the stateful models (default), "null" to return zeros for all reads,
+ *                                     selects the emulator in place of the hardware interfaces if set
+ *    PEARY_EMULATOR_TIMING            "none" for no delays (default), "zynq" for the costs measured on the CaR board
+ *    PEARY_EMULATOR_I2C_TRANSFER_US   fixed cost of one I2C transfer (ioctl, start and stop condition)
+ *    PEARY_EMULATOR_I2C_BYTE_US       bus time per transferred byte including address bytes and acknowledge
+ *    PEARY_EMULATOR_SPI_TRANSFER_US   fixed cost of one SPI transfer
+ *    PEARY_EMULATOR_SPI_BYTE_US       bus time per transferred SPI byte
+ *    PEARY_EMULATOR_MEM_ACCESS_NS     cost of one AXI-lite register access
+ *    PEARY_EMULATOR_SI5345_LOCK_MS    time the SI5345 takes to lock after being configured
+ *
+ *  The individual costs override the selected timing preset. Registers of the FPGA logic which do not behave like memory,
+ *  e.g. readout FIFOs, are emulated by memory models attached by the devices. SPI register writes are recorded such that
+ *  the models can follow the configuration of the chip.
+ */
+
+#ifndef CARIBOU_EMULATOR_H
+#define CARIBOU_EMULATOR_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "interfaces/I2C/i2c.hpp"
+#include "interfaces/Memory/memory.hpp"
+
+namespace caribou {
+
+  /** Costs of the emulated bus accesses
+   */
+  struct emulator_timing {
+    double i2c_transfer_us{0};
+    double i2c_byte_us{0};
+    double spi_transfer_us{0};
+    double spi_byte_us{0};
+    double mem_access_ns{0};
+    double si5345_lock_ms{0};
+
+    /**
+     * @brief Costs measured on the CaR board with the Zynq-7000: i2c-dev at 100kHz, spidev at 10MHz and AXI-lite
+     */
+    static emulator_timing zynq();
+  };
+
+  /** Statistics of the emulated bus accesses
+   */
+  struct emulator_statistics {
+    uint64_t i2c_transfers{0};
+    uint64_t i2c_messages{0};
+    uint64_t i2c_bytes{0};
+    uint64_t spi_transfers{0};
+    uint64_t spi_bytes{0};
+    uint64_t mem_accesses{0};
+  };
+
+  /** Model of FPGA logic behind memory mapped registers, e.g. a readout FIFO filled with synthetic detector data
+   */
+  class memory_model {
+  public:
+    virtual ~memory_model() {}
+
+    /**
+     * @brief Value returned for a read of the register at the given physical address
+     * @param stored Content of the emulated register file at this address
+     */
+    virtual uint32_t read(std::intptr_t address, uint32_t stored) = 0;
+
+    /**
+     * @brief Notification of a write to the register at the given physical address, the value is stored in any case
+     */
+    virtual void write(std::intptr_t, uint32_t) {}
+  };
+
+  class carboard_emulator {
+  public:
+    /**
+     * @brief Emulator instance, configured from the environment on first use
+     * @throws ConfigInvalid if the environment holds an invalid configuration
+     */
+    static carboard_emulator& getInstance();
+
+    /**
+     * @brief Check whether the hardware interfaces are to use the emulator, i.e. whether PEARY_EMULATOR is set
+     */
+    static bool selected();
+
+    /**
+     * @brief Check whether the FPGA registers are emulated, by an emulating build or selected via PEARY_EMULATOR
+     *
+     * Devices only attach their memory models if this is the case.
+     */
+    static bool emulatesMemory();
+
+    ~carboard_emulator();
+
+    carboard_emulator(const carboard_emulator&) = delete;
+    carboard_emulator& operator=(const carboard_emulator&) = delete;
+
+    /**
+     * @brief Select between the stateful peripheral models and returning zeros for all reads
+     */
+    void setStateful(bool stateful) { _stateful = stateful; }
+    bool stateful() const { return _stateful; }
+
+    void setTiming(const emulator_timing& timing);
+    emulator_timing getTiming();
+
+    /**
+     * @brief Return all peripherals to their power-on state
+     */
+    void reset();
+
+    /**
+     * @brief Execute a combined I2C transfer on the given bus, read messages are filled with the data of the slaves
+     */
+    void i2c(const std::string& bus, std::vector<i2c_message_t>& messages);
+
+    /**
+     * @brief Account for an SPI transfer of the given number of bytes
+     */
+    void spi(size_t bytes);
+
+    /**
+     * @brief Account for the given number of AXI-lite register accesses
+     */
+    void memory(size_t words);
+
+    /**
+     * @brief Read an emulated FPGA register, served by the attached memory model if any
+     * @param address Physical address of the register
+     * @param reg Storage of the register in the emulated register file
+     */
+    uint32_t readMemory(std::intptr_t address, const volatile uint32_t* reg);
+
+    /**
+     * @brief Write an emulated FPGA register and notify the attached memory model if any
+     */
+    void writeMemory(std::intptr_t address, volatile uint32_t* reg, uint32_t value);
+
+    /**
+     * @brief Port for memory handles to access emulated FPGA registers through the emulator
+     * @param reg Storage of the register in the emulated register file
+     * @param address Physical address of the register
+     */
+    std::shared_ptr<memory_port> memoryPort(volatile uint32_t* reg, std::intptr_t address);
+
+    /**
+     * @brief Attach a memory model to the registers at the given physical addresses
+     *
+     * The emulator only holds a weak reference, the model is detached when its owner releases it.
+     */
+    void attach(const std::shared_ptr<memory_model>& model, const std::vector<std::intptr_t>& addresses);
+
+    /**
+     * @brief Record a register write to the chip attached to an SPI device
+     */
+    void setSPIRegister(const std::string& device, uint32_t reg, uint32_t value);
+
+    /**
+     * @brief Retrieve the last value written to a chip register via SPI
+     * @return False if the register has not been written yet
+     */
+    bool getSPIRegister(const std::string& device, uint32_t reg, uint32_t& value);
+
+    /**
+     * @brief Set the load resistance in Ohm connected to a voltage regulator output, default 10 Ohm
+     */
+    void setLoad(const std::string& regulator, double resistance);
+
+    /**
+     * @brief Set the voltage applied to a slow ADC input, channels are counted from 1
+     */
+    void setADCInput(unsigned int channel, double voltage);
+
+    /**
+     * @brief Set the board temperature reported by the TMP101 in degree Celsius
+     */
+    void setTemperature(double temperature);
+
+    /**
+     * @brief Output voltage of a DAC7678 channel, zero if the channel is powered down
+     */
+    double getDACVoltage(uint8_t device, uint8_t channel);
+
+    emulator_statistics statistics() const;
+    void resetStatistics();
+
+  private:
+    carboard_emulator();
+
+    // Memory model attached to a register, null if there is none or it has been released
+    std::shared_ptr<memory_model> findModel(std::intptr_t address);
+
+    // Peripheral models, memory models and chip registers, only accessed with the mutex held
+    struct board;
+    std::unique_ptr<board> _board;
+    std::map<std::intptr_t, std::weak_ptr<memory_model>> _models;
+    std::map<std::tuple<std::string, uint32_t>, uint32_t> _spi_registers;
+    std::mutex _mutex;
+
+    std::atomic<bool> _stateful{true};
+    emulator_timing _timing;
+
+    std::atomic<uint64_t> _i2c_transfers{0};
+    std::atomic<uint64_t> _i2c_messages{0};
+    std::atomic<uint64_t> _i2c_bytes{0};
+    std::atomic<uint64_t> _spi_transfers{0};
+    std::atomic<uint64_t> _spi_bytes{0};
+    std::atomic<uint64_t> _mem_accesses{0};
+  };
+
+} // namespace caribou
+
+#endif /* CARIBOU_EMULATOR_H */
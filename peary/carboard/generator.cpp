@@ -0,0 +1,61 @@
+#include "generator.hpp"
+
+#include <algorithm>
+#include <unordered_set>
+
+#include "utils/exceptions.hpp"
+
+using namespace caribou;
+
+data_generator::data_generator(const Configuration& config)
+    : _occupancy(config.Get("emulator_occupancy", 0.001)), _rate(config.Get("emulator_rate", 0.)),
+      _random(static_cast<std::mt19937::result_type>(config.Get("emulator_seed", 0))),
+      _start(std::chrono::steady_clock::now()) {
+  if(_occupancy < 0 || _occupancy > 1) {
+    throw ConfigInvalid("Emulator occupancy has to be between 0 and 1");
+  }
+  if(_rate < 0) {
+    throw ConfigInvalid("Emulator rate cannot be negative");
+  }
+}
+
+std::vector<size_t> data_generator::hits(size_t pixels) {
+  std::binomial_distribution<size_t> number(pixels, _occupancy);
+  const size_t n = number(_random);
+
+  std::vector<size_t> hit;
+  hit.reserve(n);
+  if(2 * n > pixels) {
+    // Dense frames: select every pixel with the occupancy
+    std::bernoulli_distribution select(_occupancy);
+    for(size_t i = 0; i < pixels; i++) {
+      if(select(_random)) {
+        hit.push_back(i);
+      }
+    }
+    return hit;
+  }
+
+  // Sparse frames: draw distinct pixels
+  std::uniform_int_distribution<size_t> pixel(0, pixels - 1);
+  std::unordered_set<size_t> drawn;
+  while(drawn.size() < n) {
+    drawn.insert(pixel(_random));
+  }
+  hit.assign(drawn.begin(), drawn.end());
+  std::sort(hit.begin(), hit.end());
+  return hit;
+}
+
+size_t data_generator::due(size_t max) {
+  if(_rate == 0) {
+    _produced += max;
+    return max;
+  }
+
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - _start;
+  const auto available = static_cast<uint64_t>(elapsed.count() * _rate);
+  const size_t n = static_cast<size_t>(std::min<uint64_t>(available - std::min(available, _produced), max));
+  _produced += n;
+  return n;
+}
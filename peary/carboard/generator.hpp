@@ -0,0 +1,61 @@
+/** Base class for synthetic detector data in the emulated readout FIFOs
+ *
+ *  Devices attach a generator to the FIFO registers of their readout firmware when the memory interface is emulated, such
+ *  that the readout and decoding paths can be exercised and timed without a chip. The generators follow the device
+ *  configuration:
+ *
+ *    emulator_occupancy   probability of a pixel to be hit in a frame, default 0.001
+ *    emulator_rate        frames or hits per second made available to the readout, 0 for as many as are read (default)
+ *    emulator_seed        seed of the random numbers, default 0
+ */
+
+#ifndef CARIBOU_GENERATOR_H
+#define CARIBOU_GENERATOR_H
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <vector>
+
+#include "emulator.hpp"
+#include "utils/configuration.hpp"
+
+namespace caribou {
+
+  class data_generator : public memory_model {
+  public:
+    explicit data_generator(const Configuration& config);
+
+  protected:
+    /**
+     * @brief Draw the pixels hit in a frame according to the occupancy
+     * @param pixels Number of pixels of the matrix
+     * @return Sorted indices of the hit pixels
+     */
+    std::vector<size_t> hits(size_t pixels);
+
+    /**
+     * @brief Number of frames or hits which became available since the last call, limited to the given maximum
+     */
+    size_t due(size_t max);
+
+    /**
+     * @brief Random value of the given number of bits
+     */
+    uint32_t random(unsigned int bits) { return static_cast<uint32_t>(_random()) & ((1ull << bits) - 1); }
+
+    // Protects the generator state, reads are issued by readout threads and the command handlers alike
+    std::mutex _mutex;
+
+  private:
+    double _occupancy;
+    double _rate;
+    std::mt19937 _random;
+    std::chrono::steady_clock::time_point _start;
+    uint64_t _produced{0};
+  };
+
+} // namespace caribou
+
+#endif /* CARIBOU_GENERATOR_H */
@@ -0,0 +1,45 @@
+#include "shadow.hpp"
+
+using namespace caribou;
+
+bool carboard_shadow::get(const std::string& bus, uint8_t device, uint16_t reg, uint16_t& value) {
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  auto it = _registers.find(std::make_tuple(bus, device, reg));
+  if(it == _registers.end()) {
+    return false;
+  }
+  value = it->second;
+  _hits++;
+  return true;
+}
+
+void carboard_shadow::set(const std::string& bus, uint8_t device, uint16_t reg, uint16_t value) {
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  _registers[std::make_tuple(bus, device, reg)] = value;
+}
+
+bool carboard_shadow::holds(const std::string& bus, uint8_t device, uint16_t reg, uint16_t value) {
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  auto it = _registers.find(std::make_tuple(bus, device, reg));
+  if(it == _registers.end() || it->second != value) {
+    return false;
+  }
+  _elided++;
+  return true;
+}
+
+void carboard_shadow::invalidate(const std::string& bus, uint8_t device) {
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  for(auto it = _registers.begin(); it != _registers.end();) {
+    if(std::get<0>(it->first) == bus && std::get<1>(it->first) == device) {
+      it = _registers.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void carboard_shadow::invalidate() {
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  _registers.clear();
+}
@@ -0,0 +1,75 @@
+/** Shadow copy of the CaR board peripheral registers
+ *
+ *  The HAL keeps the last value written to or read from every non-volatile peripheral register (IO expander ports, DAC
+ *  channel codes and power states, current monitor configuration and calibration). Writes of values already applied are
+ *  elided and read-modify-write cycles are served from the shadow, such that repeated power cycles of multi-rail devices
+ *  do not cost any I2C traffic for unchanged settings. Volatile registers such as measurement results are never cached.
+ */
+
+#ifndef CARIBOU_SHADOW_H
+#define CARIBOU_SHADOW_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+
+namespace caribou {
+
+  class carboard_shadow {
+  public:
+    /**
+     * @brief Retrieve the cached value of a register
+     * @param bus Path of the I2C bus the peripheral is attached to
+     * @param device I2C address of the peripheral
+     * @param reg Register of the peripheral
+     * @param value Set to the cached value if the register is known
+     * @return True if the register value is known
+     */
+    bool get(const std::string& bus, uint8_t device, uint16_t reg, uint16_t& value);
+
+    /**
+     * @brief Record the value of a register after it has been written or read from the peripheral
+     */
+    void set(const std::string& bus, uint8_t device, uint16_t reg, uint16_t value);
+
+    /**
+     * @brief Check if a register is known to hold the given value already, i.e. a write of this value can be elided
+     */
+    bool holds(const std::string& bus, uint8_t device, uint16_t reg, uint16_t value);
+
+    /**
+     * @brief Forget all cached register values of a peripheral
+     */
+    void invalidate(const std::string& bus, uint8_t device);
+
+    /**
+     * @brief Forget all cached register values, e.g. after a reset of the board
+     */
+    void invalidate();
+
+    /**
+     * @brief Lock the shadow to perform a read-modify-write cycle on a peripheral atomically
+     */
+    std::unique_lock<std::recursive_mutex> lock() { return std::unique_lock<std::recursive_mutex>(_mutex); }
+
+    /**
+     * @brief Number of register reads served from the shadow and number of elided writes
+     */
+    uint64_t hits() const { return _hits; }
+    uint64_t elided() const { return _elided; }
+
+  private:
+    typedef std::tuple<std::string, uint8_t, uint16_t> key_type;
+
+    std::map<key_type, uint16_t> _registers;
+    std::recursive_mutex _mutex;
+    std::atomic<uint64_t> _hits{0};
+    std::atomic<uint64_t> _elided{0};
+  };
+
+} // namespace caribou
+
+#endif /* CARIBOU_SHADOW_H */
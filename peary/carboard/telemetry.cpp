@@ -0,0 +1,369 @@
+#include "telemetry.hpp"
+
+#include <algorithm>
+#include <limits>
+
+#include "Carboard.hpp"
+#include "interfaces/I2C/i2c.hpp"
+#include "interfaces/InterfaceManager.hpp"
+#include "utils/exceptions.hpp"
+#include "utils/log.hpp"
+#include "utils/utils.hpp"
+
+using namespace caribou;
+
+namespace {
+  // Number of raw samples and decimated records kept per channel
+  const size_t RAW_CAPACITY = 1024;
+  const size_t DECIMATED_CAPACITY = 4096;
+
+  // The INA226 averages 16 conversions of 2x140us, sampling faster only returns the same values
+  const double MAX_RATE = 200;
+
+  const caribou::VOLTAGE_REGULATOR_T* const MONITORS[] = {
+    &PWR_OUT_1, &PWR_OUT_2, &PWR_OUT_3, &PWR_OUT_4, &PWR_OUT_5, &PWR_OUT_6, &PWR_OUT_7, &PWR_OUT_8};
+  const caribou::SLOW_ADC_CHANNEL_T* const ADC_CHANNELS[] = {
+    &VOL_IN_1, &VOL_IN_2, &VOL_IN_3, &VOL_IN_4, &VOL_IN_5, &VOL_IN_6, &VOL_IN_7, &VOL_IN_8};
+
+  const size_t NUM_MONITORS = sizeof(MONITORS) / sizeof(MONITORS[0]);
+  const size_t NUM_ADC_CHANNELS = sizeof(ADC_CHANNELS) / sizeof(ADC_CHANNELS[0]);
+
+  // Channel layout: voltage, current and power of every monitor, followed by the ADC channels and the temperature
+  const size_t ADC_OFFSET = 3 * NUM_MONITORS;
+  const size_t TEMPERATURE_OFFSET = ADC_OFFSET + NUM_ADC_CHANNELS;
+
+  // Index of the failure counters per bus
+  enum bus { BUS_MONITORS, BUS_ADC, BUS_TEMPERATURE };
+
+  uint64_t now() {
+    return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+  }
+
+  uint16_t to_uint16(const std::vector<i2c_t>& data) { return static_cast<uint16_t>((data.at(0) << 8) | data.at(1)); }
+
+  // Report the first failure of a bus and its recovery, but not every failed cycle in between
+  void report(unsigned int& failures, const std::string& what, const caribouException* error) {
+    if(error != nullptr) {
+      if(failures++ == 0) {
+        LOG(WARNING) << "Telemetry: failed to sample " << what << ": " << error->what();
+      }
+    } else if(failures > 0) {
+      LOG(INFO) << "Telemetry: sampling " << what << " recovered after " << failures << " failed cycles";
+      failures = 0;
+    }
+  }
+} // namespace
+
+telemetry_ring::telemetry_ring(size_t capacity) {
+  _capacity = 1;
+  while(_capacity < capacity) {
+    _capacity <<= 1;
+  }
+  _mask = _capacity - 1;
+  _slots.reset(new slot[_capacity]);
+}
+
+void telemetry_ring::push(const telemetry_record& record) {
+  const uint64_t head = _head.load(std::memory_order_relaxed);
+  slot& s = _slots[head & _mask];
+  s.timestamp.store(record.timestamp, std::memory_order_relaxed);
+  s.min.store(record.min, std::memory_order_relaxed);
+  s.max.store(record.max, std::memory_order_relaxed);
+  s.mean.store(record.mean, std::memory_order_relaxed);
+  s.samples.store(record.samples, std::memory_order_relaxed);
+  _head.store(head + 1, std::memory_order_release);
+}
+
+std::vector<telemetry_record> telemetry_ring::read(size_t records) const {
+  const uint64_t head = _head.load(std::memory_order_acquire);
+  const uint64_t available = std::min<uint64_t>(head, _capacity);
+  const uint64_t count = (records == 0 ? available : std::min<uint64_t>(records, available));
+
+  std::vector<telemetry_record> result(count);
+  for(uint64_t i = 0; i < count; i++) {
+    const slot& s = _slots[(head - count + i) & _mask];
+    result[i].timestamp = s.timestamp.load(std::memory_order_relaxed);
+    result[i].min = s.min.load(std::memory_order_relaxed);
+    result[i].max = s.max.load(std::memory_order_relaxed);
+    result[i].mean = s.mean.load(std::memory_order_relaxed);
+    result[i].samples = s.samples.load(std::memory_order_relaxed);
+  }
+
+  // Drop the records the producer may have overwritten while copying:
+  std::atomic_thread_fence(std::memory_order_acquire);
+  const uint64_t overwritten = _head.load(std::memory_order_relaxed) - head;
+  result.erase(result.begin(), result.begin() + static_cast<std::ptrdiff_t>(std::min<uint64_t>(overwritten, count)));
+  return result;
+}
+
+telemetry::channel::channel(std::string n, std::string u)
+    : name(std::move(n)), unit(std::move(u)), raw(RAW_CAPACITY), decimated(DECIMATED_CAPACITY) {}
+
+telemetry& telemetry::getInstance() {
+  static telemetry instance;
+  return instance;
+}
+
+telemetry::telemetry() : _current_lsb(new std::atomic<double>[NUM_MONITORS]) {
+  for(size_t i = 0; i < NUM_MONITORS; i++) {
+    _current_lsb[i] = 0;
+    _channels.emplace_back(new channel(MONITORS[i]->name() + ".voltage", "V"));
+    _channels.emplace_back(new channel(MONITORS[i]->name() + ".current", "A"));
+    _channels.emplace_back(new channel(MONITORS[i]->name() + ".power", "W"));
+  }
+  for(const auto adc : ADC_CHANNELS) {
+    _channels.emplace_back(new channel(adc->name(), "V"));
+  }
+  _channels.emplace_back(new channel("temperature", "C"));
+}
+
+telemetry::~telemetry() {
+  stop();
+}
+
+void telemetry::start(double rate, unsigned int decimation) {
+  if(!(rate > 0) || rate > MAX_RATE) {
+    throw ConfigInvalid("Telemetry sampling rate has to be between 0 and " + std::to_string(static_cast<int>(MAX_RATE)) +
+                        " Hz");
+  }
+  if(decimation == 0) {
+    throw ConfigInvalid("Telemetry decimation has to be at least one");
+  }
+
+  stop();
+  _rate = rate;
+  _decimation = decimation;
+  _running = true;
+  _thread = std::thread([ this, level = Log::getReportingLevel() ]() {
+    Log::setReportingLevel(level);
+    run();
+  });
+  LOG(INFO) << "Started board telemetry at " << rate << " Hz, decimation " << decimation;
+}
+
+void telemetry::stop() {
+  if(!_thread.joinable()) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _running = false;
+  }
+  _wakeup.notify_all();
+  _thread.join();
+  LOG(INFO) << "Stopped board telemetry";
+}
+
+void telemetry::setCurrentMonitor(uint8_t address, double current_lsb) {
+  for(size_t i = 0; i < NUM_MONITORS; i++) {
+    if(MONITORS[i]->pwrmonitor() == address) {
+      _current_lsb[i] = current_lsb;
+      return;
+    }
+  }
+}
+
+double telemetry::getCurrentLSB(uint8_t address) const {
+  for(size_t i = 0; i < NUM_MONITORS; i++) {
+    if(MONITORS[i]->pwrmonitor() == address) {
+      return _current_lsb[i];
+    }
+  }
+  return 0;
+}
+
+const telemetry::channel& telemetry::find(const std::string& name) const {
+  for(const auto& ch : _channels) {
+    if(ch->name == name) {
+      return *ch;
+    }
+  }
+  throw ConfigInvalid("Unknown telemetry channel \"" + name + "\"");
+}
+
+bool telemetry::latest(const std::string& name, double& value) const {
+  if(!_running) {
+    return false;
+  }
+
+  for(const auto& ch : _channels) {
+    if(ch->name != name) {
+      continue;
+    }
+    const std::vector<telemetry_record> last = ch->raw.read(1);
+    if(last.empty() || static_cast<double>(now() - last.front().timestamp) > 2e9 / _rate) {
+      return false;
+    }
+    value = last.front().mean;
+    return true;
+  }
+  return false;
+}
+
+std::vector<std::string> telemetry::channels() const {
+  std::vector<std::string> names;
+  for(const auto& ch : _channels) {
+    names.push_back(ch->name);
+  }
+  return names;
+}
+
+std::vector<telemetry_summary> telemetry::snapshot(size_t samples) const {
+  std::vector<telemetry_summary> result;
+  for(const auto& ch : _channels) {
+    const std::vector<telemetry_record> raw = ch->raw.read(samples);
+    if(raw.empty()) {
+      continue;
+    }
+
+    telemetry_summary summary;
+    summary.name = ch->name;
+    summary.unit = ch->unit;
+    summary.last = raw.back().mean;
+    summary.window.timestamp = raw.back().timestamp;
+    summary.window.min = std::numeric_limits<double>::max();
+    summary.window.max = std::numeric_limits<double>::lowest();
+    double sum = 0;
+    for(const auto& sample : raw) {
+      summary.window.min = std::min(summary.window.min, sample.min);
+      summary.window.max = std::max(summary.window.max, sample.max);
+      sum += sample.mean;
+    }
+    summary.window.mean = sum / static_cast<double>(raw.size());
+    summary.window.samples = static_cast<uint32_t>(raw.size());
+    result.push_back(summary);
+  }
+  return result;
+}
+
+std::vector<telemetry_record> telemetry::history(const std::string& name, size_t records) const {
+  return find(name).decimated.read(records);
+}
+
+void telemetry::record(channel& ch, uint64_t timestamp, double value) {
+  ch.raw.push({timestamp, value, value, value, 1});
+
+  telemetry_record& acc = ch.accumulator;
+  if(acc.samples == 0) {
+    acc.min = value;
+    acc.max = value;
+    ch.sum = 0;
+  }
+  acc.timestamp = timestamp;
+  acc.min = std::min(acc.min, value);
+  acc.max = std::max(acc.max, value);
+  ch.sum += value;
+  acc.samples++;
+
+  if(acc.samples >= _decimation) {
+    acc.mean = ch.sum / acc.samples;
+    ch.decimated.push(acc);
+    acc.samples = 0;
+  }
+}
+
+void telemetry::run() {
+  const auto period =
+    std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1 / _rate));
+  auto next = std::chrono::steady_clock::now();
+  uint64_t overruns = 0;
+
+  std::unique_lock<std::mutex> lock(_mutex);
+  while(_running) {
+    lock.unlock();
+    const uint64_t timestamp = now();
+    sampleMonitors(timestamp);
+    sampleADC(timestamp);
+    sampleTemperature(timestamp);
+    lock.lock();
+
+    // Keep a fixed schedule, but do not try to catch up on cycles which took longer than the sampling period:
+    next += period;
+    const auto current = std::chrono::steady_clock::now();
+    if(next < current) {
+      next = current;
+      overruns++;
+    }
+    _wakeup.wait_until(lock, next, [this]() { return !_running; });
+  }
+
+  if(overruns > 0) {
+    LOG(WARNING) << "Telemetry sampling could not keep up with the requested rate " << overruns << " times";
+  }
+}
+
+void telemetry::sampleMonitors(uint64_t timestamp) {
+  // Read bus voltage, current and power of all configured monitors in a single transaction:
+  std::vector<size_t> monitors;
+  std::vector<i2c_message_t> messages;
+  for(size_t i = 0; i < NUM_MONITORS; i++) {
+    if(_current_lsb[i] <= 0) {
+      continue;
+    }
+    const i2c_address_t device = MONITORS[i]->pwrmonitor();
+    monitors.push_back(i);
+    for(const i2c_t reg : {REG_ADC_BUS_VOLTAGE, REG_ADC_CURRENT, REG_ADC_POWER}) {
+      messages.push_back(i2c_write_msg(device, {reg}));
+      messages.push_back(i2c_read_msg(device, 2));
+    }
+  }
+  if(monitors.empty()) {
+    return;
+  }
+
+  try {
+    InterfaceManager::getInterface<iface_i2c>(BUS_I2C1).transaction(messages);
+    report(_failures[BUS_MONITORS], "power monitors", nullptr);
+  } catch(const caribouException& e) {
+    report(_failures[BUS_MONITORS], "power monitors", &e);
+    return;
+  }
+
+  for(size_t m = 0; m < monitors.size(); m++) {
+    const size_t i = monitors[m];
+    const double current_lsb = _current_lsb[i];
+    // INA226: fixed LSB of 1.25mV for the bus voltage, signed current register, power LSB is 25 times the current LSB
+    record(*_channels[3 * i], timestamp, to_uint16(messages[6 * m + 1].data) * 0.00125);
+    record(*_channels[3 * i + 1], timestamp, static_cast<int16_t>(to_uint16(messages[6 * m + 3].data)) * current_lsb);
+    record(*_channels[3 * i + 2], timestamp, to_uint16(messages[6 * m + 5].data) * 25 * current_lsb);
+  }
+}
+
+void telemetry::sampleADC(uint64_t timestamp) {
+  // Convert all channels single-ended with the external reference and the A/D converter kept powered:
+  std::vector<i2c_message_t> messages;
+  for(const auto adc : ADC_CHANNELS) {
+    messages.push_back(i2c_write_msg(ADDR_ADC, {static_cast<i2c_t>(adc->address() ^ 0x80 ^ 0x04)}));
+    messages.push_back(i2c_read_msg(ADDR_ADC, 2));
+  }
+
+  try {
+    InterfaceManager::getInterface<iface_i2c>(BUS_I2C3).transaction(messages);
+    report(_failures[BUS_ADC], "slow ADC", nullptr);
+  } catch(const caribouException& e) {
+    report(_failures[BUS_ADC], "slow ADC", &e);
+    return;
+  }
+
+  for(size_t i = 0; i < NUM_ADC_CHANNELS; i++) {
+    record(*_channels[ADC_OFFSET + i], timestamp, to_uint16(messages[2 * i + 1].data) * CAR_VREF_4P0 / 4096);
+  }
+}
+
+void telemetry::sampleTemperature(uint64_t timestamp) {
+  std::vector<i2c_message_t> messages = {i2c_write_msg(ADDR_TEMP, {REG_TEMP_TEMP}), i2c_read_msg(ADDR_TEMP, 2)};
+
+  try {
+    InterfaceManager::getInterface<iface_i2c>(BUS_I2C0).transaction(messages);
+    report(_failures[BUS_TEMPERATURE], "temperature", nullptr);
+  } catch(const caribouException& e) {
+    report(_failures[BUS_TEMPERATURE], "temperature", &e);
+    return;
+  }
+
+  // TMP101: 12 bit two's complement, left-aligned, 0.0625degC per LSB
+  const int16_t temp = static_cast<int16_t>(to_uint16(messages[1].data));
+  record(*_channels[TEMPERATURE_OFFSET], timestamp, (temp >> 4) * 0.0625);
+}
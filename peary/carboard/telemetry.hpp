@@ -0,0 +1,198 @@
+/** Board telemetry sampler for the CaR board slow control monitors
+ *
+ *  A single sampler thread periodically reads all configured INA226 power monitors, the ADS7828 slow ADC channels and
+ *  the TMP101 temperature sensor. The INA226 monitors run in continuous conversion mode and are converted with the
+ *  calibration cached when the monitor was configured, so every sampling cycle costs one combined I2C transaction per
+ *  bus. Samples are stored per channel in lock-free ring buffers together with min/max/mean decimated records, readers
+ *  obtain snapshots without ever touching the I2C buses.
+ */
+
+#ifndef CARIBOU_TELEMETRY_H
+#define CARIBOU_TELEMETRY_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace caribou {
+
+  /** Aggregated telemetry record
+   *
+   *  Raw samples are stored as records of a single sample with identical min, max and mean.
+   */
+  struct telemetry_record {
+    // Time of the last sample contained in the record, in nanoseconds since epoch
+    uint64_t timestamp{0};
+    double min{0};
+    double max{0};
+    double mean{0};
+    // Number of samples aggregated in this record
+    uint32_t samples{0};
+  };
+
+  /** Summary of one telemetry channel as returned by a snapshot
+   */
+  struct telemetry_summary {
+    std::string name;
+    std::string unit;
+    // Most recent sample
+    double last{0};
+    // Statistics over the requested window of raw samples
+    telemetry_record window;
+  };
+
+  /** Lock-free ring buffer of telemetry records
+   *
+   *  Written by a single producer, read by any number of readers. Readers never block the producer, records which are
+   *  overwritten while being copied are discarded from the result.
+   */
+  class telemetry_ring {
+  public:
+    explicit telemetry_ring(size_t capacity);
+
+    /**
+     * @brief Append a record, overwriting the oldest one if the ring is full. Only to be called by the producer
+     */
+    void push(const telemetry_record& record);
+
+    /**
+     * @brief Copy the most recent records, oldest first
+     * @param records Maximum number of records to be returned, zero for all available records
+     */
+    std::vector<telemetry_record> read(size_t records = 0) const;
+
+    /**
+     * @brief Total number of records pushed since creation
+     */
+    uint64_t pushed() const { return _head.load(std::memory_order_acquire); }
+
+  private:
+    struct slot {
+      std::atomic<uint64_t> timestamp{0};
+      std::atomic<double> min{0};
+      std::atomic<double> max{0};
+      std::atomic<double> mean{0};
+      std::atomic<uint32_t> samples{0};
+    };
+
+    std::unique_ptr<slot[]> _slots;
+    size_t _capacity;
+    size_t _mask;
+    std::atomic<uint64_t> _head{0};
+  };
+
+  /** Board-level telemetry sampler
+   *
+   *  There is one instance per process since all devices share the same CaR board peripherals.
+   */
+  class telemetry {
+  public:
+    static telemetry& getInstance();
+
+    ~telemetry();
+
+    telemetry(const telemetry&) = delete;
+    telemetry& operator=(const telemetry&) = delete;
+
+    /**
+     * @brief Start the sampler thread, restarts it with the new parameters if already running
+     * @param rate Sampling rate in Hz
+     * @param decimation Number of raw samples aggregated into one decimated record
+     * @throws ConfigInvalid if the rate or decimation are out of range
+     */
+    void start(double rate, unsigned int decimation = 10);
+
+    /**
+     * @brief Stop the sampler thread. The recorded samples remain available
+     */
+    void stop();
+
+    bool running() const { return _running; }
+    double rate() const { return _rate; }
+    unsigned int decimation() const { return _decimation; }
+
+    /**
+     * @brief Register the calibration of an INA226 monitor, only configured monitors are sampled
+     * @param address I2C address of the monitor
+     * @param current_lsb Current represented by one LSB of the current register in A
+     */
+    void setCurrentMonitor(uint8_t address, double current_lsb);
+
+    /**
+     * @brief Cached current LSB of an INA226 monitor, zero if the monitor has not been configured by this process
+     */
+    double getCurrentLSB(uint8_t address) const;
+
+    /**
+     * @brief Retrieve the most recent sample of a channel if the sampler is running and the sample is recent
+     * @param name Name of the channel
+     * @param value Set to the sample value if available
+     * @return True if a sample not older than two sampling periods was available
+     */
+    bool latest(const std::string& name, double& value) const;
+
+    /**
+     * @brief Names of all telemetry channels
+     */
+    std::vector<std::string> channels() const;
+
+    /**
+     * @brief Summarize all channels which hold samples
+     * @param samples Number of most recent raw samples the statistics are computed from, zero for all buffered samples
+     */
+    std::vector<telemetry_summary> snapshot(size_t samples = 0) const;
+
+    /**
+     * @brief Retrieve the decimated records of a channel, oldest first
+     * @param name Name of the channel
+     * @param records Maximum number of records, zero for all buffered records
+     * @throws ConfigInvalid if the channel does not exist
+     */
+    std::vector<telemetry_record> history(const std::string& name, size_t records = 0) const;
+
+  private:
+    telemetry();
+
+    struct channel {
+      channel(std::string name, std::string unit);
+
+      std::string name;
+      std::string unit;
+      telemetry_ring raw;
+      telemetry_ring decimated;
+      // Decimation accumulator, only accessed by the sampler thread
+      telemetry_record accumulator;
+      double sum{0};
+    };
+
+    const channel& find(const std::string& name) const;
+    void record(channel& ch, uint64_t timestamp, double value);
+
+    void run();
+    void sampleMonitors(uint64_t timestamp);
+    void sampleADC(uint64_t timestamp);
+    void sampleTemperature(uint64_t timestamp);
+
+    std::vector<std::unique_ptr<channel>> _channels;
+    // Current LSB per INA226 monitor, zero if the monitor is not configured
+    std::unique_ptr<std::atomic<double>[]> _current_lsb;
+
+    std::atomic<bool> _running{false};
+    std::atomic<double> _rate{0};
+    std::atomic<unsigned int> _decimation{10};
+    // Failed sampling cycles per bus, used to report errors only once
+    unsigned int _failures[3]{};
+    std::thread _thread;
+    std::mutex _mutex;
+    std::condition_variable _wakeup;
+  };
+
+} // namespace caribou
+
+#endif /* CARIBOU_TELEMETRY_H */
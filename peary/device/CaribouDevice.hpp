@@ -6,11 +6,15 @@
 #define CARIBOU_MIDDLEWARE_H
 
 #include "Device.hpp"
+#include "interfaces/DMA/dma.hpp"
+#include "interfaces/Memory/memory.hpp"
 #include "utils/configuration.hpp"
 #include "utils/constants.hpp"
 #include "utils/dictionary.hpp"
 
 #include <stdint.h>
+#include <map>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -96,8 +100,28 @@ namespace caribou {
      */
     virtual void daqStop() = 0;
 
+    /** Configure the device with the registers provided in the configuration
+     *
+     *  The configuration is compared against the known state of the device registers and only registers which differ are
+     *  written, such that reconfiguring a device with a configuration changing only a few settings is fast. Registers are
+     *  written in the alphabetical order of their names, fields sharing a physical register are merged into one write at
+     *  the position of the first of them.
+     */
     virtual void configure();
 
+    /** Configure the device without relying on its known state
+     *
+     *  The device is marked as not configured and the register cache is dropped before calling configure(), such that all
+     *  registers are written and devices run their complete initialization sequence.
+     */
+    void configureFull();
+
+    /** Replace the configuration of the device, to be applied with the next call to configure()
+     *
+     *  The register cache settings "register_writeback" and "volatile_registers" are taken from the new configuration.
+     */
+    void setConfiguration(const caribou::Configuration& config);
+
     // Controlling the device
 
     /**
@@ -109,6 +133,78 @@ namespace caribou {
     virtual void setSpecialRegister(std::string, uint32_t){};
     virtual uint32_t getSpecialRegister(std::string) { return 0; };
     uint32_t getRegister(std::string name);
+
+    /** Handle to a register of this device, see getRegisterHandle
+     */
+    using register_handle = typename caribou::dictionary<register_t<typename T::reg_type, typename T::data_type>>::key;
+
+    /** Resolve the given register once and return a handle for repeated access
+     *
+     *  Devices should store handles for registers which are accessed in configuration or readout loops, since every call
+     *  to setRegister/getRegister with a name looks up the register dictionary again.
+     */
+    register_handle getRegisterHandle(std::string name);
+    void setRegister(const register_handle& reg, uint32_t value);
+    uint32_t getRegister(const register_handle& reg);
+
+    /** Collection of register writes submitted to the device at once
+     *
+     *  Writes are collected via set() and only sent with commit(), in the order they were set. All fields sharing one
+     *  physical register are merged into a single write at the position of the first of them, such that masked registers
+     *  are read at most once, and consecutive writes are sent in a single bus transfer. Fields written more than once keep
+     *  the last value. Special registers cannot be merged, they are handed to setSpecialRegister in between after all
+     *  writes set before them have been sent.
+     */
+    class register_transaction {
+    public:
+      void set(const std::string& name, uint32_t value) { set(_device->_registers.id(name), value); }
+      void set(const register_handle& reg, uint32_t value) { _writes.emplace_back(reg, value); }
+
+      /** Number of register writes collected so far
+       */
+      size_t size() const { return _writes.size(); }
+
+      /** Send all collected writes to the device and clear the transaction
+       */
+      void commit();
+
+    private:
+      friend class CaribouDevice;
+      explicit register_transaction(CaribouDevice* device) : _device(device){};
+
+      /** Merge the given writes of regular registers per address and send them in a single transfer
+       */
+      void send(const std::vector<std::pair<register_handle, uint32_t>>& writes);
+
+      CaribouDevice* _device;
+      std::vector<std::pair<register_handle, uint32_t>> _writes;
+    };
+
+    /** Start a new transaction collecting register writes for this device
+     */
+    register_transaction getRegisterTransaction() { return register_transaction(this); }
+
+    /** Write all register values held back by the write-back cache to the device
+     *
+     *  Writes are only held back if enabled via the "register_writeback" configuration key, otherwise every register write
+     *  is passed to the device immediately and this is a no-op.
+     */
+    void flushRegisters();
+
+    /** Drop all cached register values such that they are read from the device again
+     *
+     *  This is required whenever the registers of the chip change without being written by this class, e.g. after a reset.
+     *  Values held back by the write-back cache are discarded.
+     */
+    void invalidateRegisters();
+
+    /** Read back the CaR board peripheral registers shadowed by the HAL
+     *
+     *  Required after the board has been reset or its peripherals have been modified by another process, since writes of
+     *  values the shadow believes to be applied already are skipped.
+     */
+    void resyncPeripherals();
+
     std::vector<std::pair<std::string, uint32_t>> getRegisters();
 
     /** Sending reset signal to the device
@@ -163,6 +259,15 @@ namespace caribou {
     std::vector<uint32_t> getRawData();
     pearydata getData();
 
+    /** Zero-copy raw data readback from the DMA ring buffer configured via the "dma_device" key
+     *
+     *  Returns a view on the next completed frame buffer, waiting up to timeout milliseconds for it. The view stays valid
+     *  until it is handed back via releaseRawDataView(), views have to be released in the order they were obtained.
+     *  Throws caribou::NoDataAvailable if no frame is available.
+     */
+    dma_frame getRawDataView(unsigned int timeout = 0);
+    void releaseRawDataView(const dma_frame& frame);
+
     // Two types:
     //  * trigger based: "events" are returned
     //  * shutter based: "frames" are returned
@@ -176,19 +281,68 @@ namespace caribou {
     uint32_t getMemory(std::string name, size_t offset);
     uint32_t getMemory(std::string name);
 
+    /** Read n words from the FIFO port of the given memory page into the provided buffer
+     *
+     *  This resolves the memory page only once for the full block and should be used for bulk data readout.
+     */
+    void getMemoryFifo(std::string name, uint32_t* data, size_t n);
+
+    /** Read a contiguous window of n words from the given memory page into the provided buffer,
+     *  starting at the given offset
+     */
+    void getMemoryBlock(std::string name, size_t offset, uint32_t* data, size_t n);
+
+    /** Resolve the given memory page once and return a handle for direct access to the register
+     *
+     *  Devices should store handles for registers which are accessed in readout or polling loops, since every call to
+     *  getMemory/setMemory resolves the name and the memory page again.
+     */
+    memory_handle getMemoryHandle(std::string name);
+
   protected:
+    /** Check whether the device has been configured since it was powered, i.e. the device state only needs to be updated
+     *  with settings which differ from the current ones
+     */
+    bool is_configured() const { return _is_configured; }
+
     /**
      * @brief process registers, ingoring sepcial flags
      * @brief reg Register
      * @param value Value of the register to be set
      */
-    void process_register_write(register_t<typename T::reg_type, typename T::data_type> reg, uint32_t value);
+    void process_register_write(const register_t<typename T::reg_type, typename T::data_type>& reg, uint32_t value);
 
     /**
      * @brief process reading from registers, ingoring sepcial flags
      * @param reg Register
      */
-    uint32_t process_register_read(register_t<typename T::reg_type, typename T::data_type> reg);
+    uint32_t process_register_read(const register_t<typename T::reg_type, typename T::data_type>& reg);
+
+    /** Enable the register cache for this device
+     *
+     *  The cache is disabled by default and every register access goes to the device. Devices should only enable it once
+     *  all their registers have been added and audited, with all registers flagged volatile whose content changes without
+     *  being written or whose writes trigger an action. Registers which are not both readable and writable are treated as
+     *  volatile automatically.
+     */
+    void enableRegisterCache();
+
+    /** Exclude the physical register the given register belongs to from the register cache
+     *
+     *  Devices should flag status, counter, FIFO and command registers, whose content changes without being written or
+     *  which trigger an action on every write. Volatile registers are always accessed on the device, and writing them
+     *  first flushes the values held back by the write-back cache in order to preserve the order of the writes.
+     */
+    void setRegisterVolatile(std::string name);
+
+    /** Drop the physical register the given register belongs to from the register cache and return its address
+     */
+    typename T::reg_type uncache_register(const std::string& name);
+
+    /** Read and write a physical register through the register cache
+     */
+    typename T::data_type cached_register_read(typename T::reg_type address);
+    void cached_register_write(typename T::reg_type address, typename T::data_type value);
 
     /** Instance of the Caribou hardware abstraction layer library
      *
@@ -208,6 +362,36 @@ namespace caribou {
      */
     std::map<std::string, typename T::data_type> _register_cache;
 
+    /** Shadow of a physical register of the device
+     *
+     *  The value is valid if it reflects the content of the register, and dirty if it has not been written to the device
+     *  yet.
+     */
+    struct register_shadow {
+      typename T::data_type value;
+      bool valid;
+      bool dirty;
+    };
+
+    /** Shadow copies of the physical registers, indexed by their address
+     */
+    std::map<typename T::reg_type, register_shadow> _register_shadow;
+
+    /** Addresses of registers which are never cached as flagged by the device and by the configuration, and names from the
+     *  configuration still to be resolved to them
+     */
+    std::set<typename T::reg_type> _volatile_registers;
+    std::set<typename T::reg_type> _configured_volatile_registers;
+    std::vector<std::string> _volatile_register_names;
+
+    /** Flag to hold back register writes until flushRegisters is called, only effective with the register cache enabled
+     */
+    bool _register_writeback;
+
+    /** Flag indicating that the device enabled the register cache, all registers are volatile otherwise
+     */
+    bool _register_caching;
+
     /** Periphery dictionary to access CaR components:
      */
     caribou::dictionary<component_t> _periphery;
@@ -216,6 +400,10 @@ namespace caribou {
      */
     caribou::dictionary<memory_map> _memory;
 
+    /** Path of the DMA ring buffer device for raw data readout, empty if not configured
+     */
+    std::string _dma_path;
+
   private:
     /** State indicating powering of the device
      */
@@ -225,10 +413,18 @@ namespace caribou {
      */
     bool _is_configured;
 
+    /** Number of physical register writes issued to the device, writes elided by the register cache are not counted
+     */
+    size_t _register_writes;
+
     /** Switcher function for periphery component (turns them on/off)
      */
     void switchPeripheryComponent(std::string name, bool enable);
 
+    /** Check whether the register at the given address is excluded from the register cache
+     */
+    bool is_volatile_register(typename T::reg_type address);
+
   }; // class CaribouDevice
 
 } // namespace caribou
@@ -12,16 +12,33 @@
 #include "utils/dictionary.hpp"
 #include "utils/log.hpp"
 
+#include <algorithm>
+#include <limits>
+#include <map>
 #include <string>
 
 namespace caribou {
 
   template <typename T>
   CaribouDevice<T>::CaribouDevice(const caribou::Configuration config, std::string devpath, uint32_t devaddr)
-      : Device(config), _hal(nullptr), _config(config), _registers("Registers"), _periphery("Component"),
-        _memory("Memory page"), _is_powered(false), _is_configured(false) {
+      : Device(config), _hal(nullptr), _config(config), _registers("Registers"),
+        _volatile_register_names(config.Get("volatile_registers", std::vector<std::string>())),
+        _register_writeback(config.Get("register_writeback", false)), _register_caching(false), _periphery("Component"),
+        _memory("Memory page"), _dma_path(config.Get("dma_device", std::string())), _is_powered(false),
+        _is_configured(false), _register_writes(0) {
 
     _hal = new caribouHAL<T>(_config.Get("devicepath", devpath), _config.Get("deviceaddress", devaddr));
+
+    // Commands to control the register cache:
+    _dispatcher.add("flushRegisters", &CaribouDevice<T>::flushRegisters, this);
+    _dispatcher.add("invalidateRegisters", &CaribouDevice<T>::invalidateRegisters, this);
+    _dispatcher.add("resyncPeripherals", &CaribouDevice<T>::resyncPeripherals, this);
+
+    // Start sampling the board telemetry if requested, power monitors are included as soon as they are configured:
+    if(_config.Has("telemetry_rate")) {
+      _hal->getTelemetry().start(_config.Get("telemetry_rate", 10.0),
+                                 static_cast<unsigned int>(_config.Get("telemetry_decimation", static_cast<uint64_t>(10))));
+    }
   }
 
   template <typename T> CaribouDevice<T>::~CaribouDevice() { delete _hal; }
@@ -52,6 +69,9 @@ namespace caribou {
       this->powerDown();
       _is_powered = false;
       _is_configured = false;
+
+      // The chip loses its register content:
+      invalidateRegisters();
     }
   }
 
@@ -157,16 +177,20 @@ namespace caribou {
   }
 
   template <typename T> void CaribouDevice<T>::setRegister(std::string name, uint32_t value) {
-
     // Resolve name against register dictionary:
-    register_t<typename T::reg_type, typename T::data_type> reg = _registers.get(name);
+    setRegister(_registers.id(name), value);
+  }
+
+  template <typename T> void CaribouDevice<T>::setRegister(const register_handle& handle, uint32_t value) {
+
+    const auto& reg = _registers.get(handle);
+    const auto& name = _registers.name(handle);
 
     if(!reg.writable()) {
       throw caribou::RegisterTypeMismatch("Trying to write to register with \"nowrite\" flag: " + name);
     }
     if(reg.special()) {
       // Defer to special register treatment function of the derived classes:
-      std::transform(name.begin(), name.end(), name.begin(), ::tolower);
       setSpecialRegister(name, value);
       return;
     }
@@ -179,7 +203,7 @@ namespace caribou {
   }
 
   template <typename T>
-  void CaribouDevice<T>::process_register_write(register_t<typename T::reg_type, typename T::data_type> reg,
+  void CaribouDevice<T>::process_register_write(const register_t<typename T::reg_type, typename T::data_type>& reg,
                                                 uint32_t value) {
 
     typename T::data_type regval = static_cast<typename T::data_type>(value);
@@ -189,7 +213,7 @@ namespace caribou {
       // We need to read the register in order to preserve the nonaffected bits:
       LOG(DEBUG) << "Reg. mask:   " << to_bit_string(reg.mask());
       LOG(DEBUG) << "Shift by:    " << static_cast<int>(reg.shift());
-      typename T::data_type current_reg = _hal->receive(reg.address()).front();
+      typename T::data_type current_reg = cached_register_read(reg.address());
       LOG(DEBUG) << "new_val    = " << to_bit_string(regval);
       LOG(DEBUG) << "value (sh) = " << to_bit_string(static_cast<typename T::data_type>(regval << reg.shift()));
       LOG(DEBUG) << "curr_val   = " << to_bit_string(current_reg);
@@ -200,18 +224,269 @@ namespace caribou {
     }
 
     LOG(DEBUG) << "Register value to be set: " << to_hex_string(regval);
-    _hal->send(std::make_pair(reg.address(), regval));
+    cached_register_write(reg.address(), regval);
+  }
+
+  template <typename T> bool CaribouDevice<T>::is_volatile_register(typename T::reg_type address) {
+    // Resolve the volatile registers from the configuration once all registers have been defined by the device:
+    if(!_volatile_register_names.empty()) {
+      std::vector<std::string> names;
+      names.swap(_volatile_register_names);
+      for(const auto& name : names) {
+        _configured_volatile_registers.insert(uncache_register(name));
+      }
+    }
+    return !_register_caching || _volatile_registers.find(address) != _volatile_registers.end() ||
+           _configured_volatile_registers.find(address) != _configured_volatile_registers.end();
+  }
+
+  template <typename T> void CaribouDevice<T>::enableRegisterCache() {
+    // Registers which cannot be both read and written are status or command registers:
+    for(const auto& name : _registers.getNames()) {
+      const auto& reg = _registers.get(name);
+      if(!reg.special() && (!reg.readable() || !reg.writable())) {
+        setRegisterVolatile(name);
+      }
+    }
+    LOG(DEBUG) << "Register cache enabled, " << _volatile_registers.size() << " volatile registers";
+    _register_caching = true;
+  }
+
+  template <typename T> void CaribouDevice<T>::setRegisterVolatile(std::string name) {
+    _volatile_registers.insert(uncache_register(name));
+  }
+
+  template <typename T> typename T::reg_type CaribouDevice<T>::uncache_register(const std::string& name) {
+    auto address = _registers.get(name).address();
+    LOG(DEBUG) << "Excluding register " << to_hex_string(address) << " (" << name << ") from the register cache";
+
+    // Write a value held back for this register before dropping it:
+    flushRegisters();
+    _register_shadow.erase(address);
+    return address;
+  }
+
+  template <typename T> typename T::data_type CaribouDevice<T>::cached_register_read(typename T::reg_type address) {
+    if(is_volatile_register(address)) {
+      return _hal->receive(address).front();
+    }
+
+    auto& shadow = _register_shadow[address];
+    if(shadow.valid) {
+      LOG(DEBUG) << "Register " << to_hex_string(address) << " read from cache: " << to_hex_string(shadow.value);
+    } else {
+      shadow.value = _hal->receive(address).front();
+      shadow.valid = true;
+      shadow.dirty = false;
+    }
+    return shadow.value;
+  }
+
+  template <typename T>
+  void CaribouDevice<T>::cached_register_write(typename T::reg_type address, typename T::data_type value) {
+    if(is_volatile_register(address)) {
+      // Values held back have to reach the device first, the write might trigger an action depending on them:
+      flushRegisters();
+      _hal->send(std::make_pair(address, value));
+      _register_writes++;
+      return;
+    }
+
+    // The register is known to hold this value already:
+    auto& shadow = _register_shadow[address];
+    if(shadow.valid && shadow.value == value) {
+      LOG(DEBUG) << "Register " << to_hex_string(address) << " unchanged, write elided";
+      return;
+    }
+
+    if(!_register_writeback) {
+      _hal->send(std::make_pair(address, value));
+    }
+    shadow = register_shadow{value, true, _register_writeback};
+    _register_writes++;
+  }
+
+  template <typename T> void CaribouDevice<T>::flushRegisters() {
+    if(!_register_writeback) {
+      return;
+    }
+
+    std::vector<std::pair<typename T::reg_type, typename T::data_type>> dirty;
+    for(const auto& shadow : _register_shadow) {
+      if(shadow.second.dirty) {
+        dirty.emplace_back(shadow.first, shadow.second.value);
+      }
+    }
+    if(dirty.empty()) {
+      return;
+    }
+
+    LOG(DEBUG) << "Flushing " << dirty.size() << " cached registers to the device";
+    _hal->send(dirty);
+    for(auto& shadow : _register_shadow) {
+      shadow.second.dirty = false;
+    }
+  }
+
+  template <typename T> void CaribouDevice<T>::resyncPeripherals() { _hal->resyncPeripherals(); }
+
+  template <typename T> void CaribouDevice<T>::invalidateRegisters() {
+    auto discarded = std::count_if(_register_shadow.begin(), _register_shadow.end(), [](const auto& shadow) {
+      return shadow.second.dirty;
+    });
+    if(discarded > 0) {
+      LOG(WARNING) << "Discarding " << discarded << " register values which have not been written to the device";
+    }
+    _register_shadow.clear();
+  }
+
+  template <typename T> void CaribouDevice<T>::register_transaction::commit() {
+    auto writes = std::move(_writes);
+    _writes.clear();
+
+    for(const auto& write : writes) {
+      if(!_device->_registers.get(write.first).writable()) {
+        throw caribou::RegisterTypeMismatch("Trying to write to register with \"nowrite\" flag: " +
+                                            _device->_registers.name(write.first));
+      }
+    }
+
+    // Writes are sent in the order they were set, special registers send all writes set before them first:
+    std::vector<std::pair<register_handle, uint32_t>> regular;
+    for(const auto& write : writes) {
+      if(!_device->_registers.get(write.first).special()) {
+        regular.push_back(write);
+        continue;
+      }
+      send(regular);
+      regular.clear();
+
+      // Defer to special register treatment function of the derived classes:
+      _device->setSpecialRegister(_device->_registers.name(write.first), write.second);
+    }
+    send(regular);
+  }
+
+  template <typename T>
+  void CaribouDevice<T>::register_transaction::send(const std::vector<std::pair<register_handle, uint32_t>>& writes) {
+    using data_type = typename T::data_type;
+
+    // Merge all fields per physical register, registers are ordered by the first of their fields:
+    std::vector<typename T::reg_type> order;
+    std::map<typename T::reg_type, std::pair<data_type, data_type>> registers;
+    for(const auto& write : writes) {
+      const auto& reg = _device->_registers.get(write.first);
+      LOG(DEBUG) << "Register to be set: " << _device->_registers.name(write.first) << " ("
+                 << to_hex_string(reg.address()) << ")";
+      if(registers.find(reg.address()) == registers.end()) {
+        order.push_back(reg.address());
+      }
+      auto& merged = registers[reg.address()];
+      data_type bits = static_cast<data_type>(static_cast<data_type>(write.second) << reg.shift()) & reg.mask();
+      merged.first |= reg.mask();
+      merged.second = static_cast<data_type>((merged.second & ~reg.mask()) | bits);
+    }
+
+    std::vector<std::pair<typename T::reg_type, data_type>> burst;
+    burst.reserve(registers.size());
+    bool barrier = false;
+    for(const auto& address : order) {
+      const auto& merged = registers[address];
+      data_type regval = merged.second;
+
+      // Registers not covered by the fields are read in order to preserve the nonaffected bits:
+      if(merged.first < std::numeric_limits<data_type>::max()) {
+        data_type current_reg = _device->cached_register_read(address);
+        regval = static_cast<data_type>((current_reg & ~merged.first) | regval);
+      }
+      LOG(DEBUG) << "Register " << to_hex_string(address) << " value to be set: " << to_hex_string(regval);
+
+      if(_device->is_volatile_register(address)) {
+        barrier = true;
+      } else {
+        // The register is known to hold this value already:
+        auto shadow = _device->_register_shadow.find(address);
+        if(shadow != _device->_register_shadow.end() && shadow->second.valid && shadow->second.value == regval) {
+          LOG(DEBUG) << "Register " << to_hex_string(address) << " unchanged, write elided";
+          continue;
+        }
+        if(_device->_register_writeback) {
+          _device->_register_shadow[address] = register_shadow{regval, true, true};
+          _device->_register_writes++;
+          continue;
+        }
+      }
+      burst.emplace_back(address, regval);
+    }
+
+    if(!burst.empty()) {
+      // Values held back have to reach the device before volatile registers are written:
+      if(barrier) {
+        _device->flushRegisters();
+      }
+      _device->_hal->send(burst);
+      _device->_register_writes += burst.size();
+      for(const auto& reg : burst) {
+        if(!_device->is_volatile_register(reg.first)) {
+          _device->_register_shadow[reg.first] = register_shadow{reg.second, true, false};
+        }
+      }
+    }
+
+    // Cache the current values of the registers written:
+    for(const auto& write : writes) {
+      _device->_register_cache[_device->_registers.name(write.first)] = write.second;
+    }
   }
 
   template <typename T> std::vector<std::pair<std::string, uint32_t>> CaribouDevice<T>::getRegisters() {
 
     std::vector<std::pair<std::string, uint32_t>> regvalues;
-
-    // Retrieve all registers from the device:
     std::vector<std::string> regs = _registers.getNames();
+
+    // Values held back have to be written first such that the snapshot reflects the device:
+    flushRegisters();
+
+    // Read every physical register holding readable fields only once, in as few bus transfers as possible:
+    std::vector<typename T::reg_type> addresses;
+    for(const auto& r : regs) {
+      const auto& reg = _registers.get(_registers.id(r));
+      if(reg.readable() && !reg.special()) {
+        addresses.push_back(reg.address());
+      }
+    }
+    std::sort(addresses.begin(), addresses.end());
+    addresses.erase(std::unique(addresses.begin(), addresses.end()), addresses.end());
+
+    std::map<typename T::reg_type, typename T::data_type> snapshot;
+    if(!addresses.empty()) {
+      try {
+        auto values = _hal->receive(addresses);
+        for(size_t i = 0; i < addresses.size() && i < values.size(); i++) {
+          snapshot[addresses[i]] = values[i];
+          // Refresh the register cache with the values just read:
+          if(!is_volatile_register(addresses[i])) {
+            _register_shadow[addresses[i]] = register_shadow{values[i], true, false};
+          }
+        }
+      } catch(CommunicationError& e) {
+        // Reading might have modified the registers (see the SPI read workaround), they must not be read again:
+        LOG(ERROR) << "Failed to retrieve register snapshot: " << e.what();
+        throw;
+      }
+    }
+
+    // Derive all named registers from the snapshot, special registers are retrieved by the derived classes:
     for(auto r : regs) {
       try {
-        regvalues.push_back(std::make_pair(r, this->getRegister(r)));
+        auto handle = _registers.id(r);
+        const auto& reg = _registers.get(handle);
+        auto value = (reg.special() ? snapshot.end() : snapshot.find(reg.address()));
+        if(value != snapshot.end()) {
+          regvalues.push_back(std::make_pair(r, static_cast<uint32_t>((value->second & reg.mask()) >> reg.shift())));
+        } else {
+          regvalues.push_back(std::make_pair(r, this->getRegister(handle)));
+        }
         LOG(DEBUG) << "Retrieved register \"" << r << "\" = " << static_cast<int>(regvalues.back().second) << " ("
                    << to_hex_string(regvalues.back().second) << ")";
       } catch(RegisterTypeMismatch& e) {
@@ -225,9 +500,14 @@ namespace caribou {
   }
 
   template <typename T> uint32_t CaribouDevice<T>::getRegister(std::string name) {
-
     // Resolve name against register dictionary:
-    register_t<typename T::reg_type, typename T::data_type> reg = _registers.get(name);
+    return getRegister(_registers.id(name));
+  }
+
+  template <typename T> uint32_t CaribouDevice<T>::getRegister(const register_handle& handle) {
+
+    const auto& reg = _registers.get(handle);
+    const auto& name = _registers.name(handle);
 
     if(!reg.readable()) {
       // This register cannot be read back from the device:
@@ -235,7 +515,6 @@ namespace caribou {
     }
     if(reg.special()) {
       // Defer to special register treatment function of the derived classes:
-      std::transform(name.begin(), name.end(), name.begin(), ::tolower);
       return getSpecialRegister(name);
     }
 
@@ -244,9 +523,14 @@ namespace caribou {
   }
 
   template <typename T>
-  uint32_t CaribouDevice<T>::process_register_read(register_t<typename T::reg_type, typename T::data_type> reg) {
+  typename CaribouDevice<T>::register_handle CaribouDevice<T>::getRegisterHandle(std::string name) {
+    return _registers.id(name);
+  }
 
-    typename T::data_type regval = _hal->receive(reg.address()).front();
+  template <typename T>
+  uint32_t CaribouDevice<T>::process_register_read(const register_t<typename T::reg_type, typename T::data_type>& reg) {
+
+    typename T::data_type regval = cached_register_read(reg.address());
     LOG(DEBUG) << "raw value  = " << to_bit_string(regval);
     LOG(DEBUG) << "masked val = " << to_bit_string(static_cast<typename T::data_type>(regval & reg.mask()));
     LOG(DEBUG) << "shifted val = " << static_cast<int>((regval & reg.mask()) >> reg.shift());
@@ -262,8 +546,31 @@ namespace caribou {
 
   // Data return functions, for raw or decoded data
   template <typename T> std::vector<uint32_t> CaribouDevice<T>::getRawData() {
-    LOG(FATAL) << "Raw data readback not implemented for this device";
-    throw caribou::DeviceImplException("Raw data readback not implemented for this device");
+    if(_dma_path.empty()) {
+      LOG(FATAL) << "Raw data readback not implemented for this device";
+      throw caribou::DeviceImplException("Raw data readback not implemented for this device");
+    }
+
+    dma_frame frame = getRawDataView();
+    std::vector<uint32_t> data(frame.begin(), frame.end());
+    releaseRawDataView(frame);
+    return data;
+  }
+
+  template <typename T> dma_frame CaribouDevice<T>::getRawDataView(unsigned int timeout) {
+    if(_dma_path.empty()) {
+      throw caribou::ConfigMissingKey("Key \"dma_device\" not found");
+    }
+
+    dma_frame frame = _hal->readDMAFrame(_dma_path, timeout);
+    if(frame.data() == nullptr) {
+      throw caribou::NoDataAvailable();
+    }
+    return frame;
+  }
+
+  template <typename T> void CaribouDevice<T>::releaseRawDataView(const dma_frame& frame) {
+    _hal->releaseDMAFrame(_dma_path, frame);
   }
 
   template <typename T> pearydata CaribouDevice<T>::getData() {
@@ -278,22 +585,78 @@ namespace caribou {
       return;
     }
 
-    // Set all registers provided in the configuratio file, skip those which are not set:
-    std::vector<std::string> dacs = _registers.getNames();
+    // Desired state of all registers provided in the configuration file, skip those which are not set:
+    std::vector<std::pair<register_handle, uint32_t>> desired;
+    for(const auto& name : _registers.getNames()) {
+      if(!_config.Has(name)) {
+        LOG(DEBUG) << "Could not find key \"" << name << "\" in the configuration, skipping.";
+        continue;
+      }
+      desired.emplace_back(_registers.id(name), _config.Get<uint32_t>(name));
+    }
+
+    // Only registers which differ from the known state of the device are written, fields sharing an address are merged:
+    std::vector<std::pair<register_handle, uint32_t>> changed;
+    auto transaction = getRegisterTransaction();
     LOG(INFO) << "Setting registers from configuration:";
-    for(auto i : dacs) {
-      try {
-        uint32_t value = _config.Get<uint32_t>(i);
-        this->setRegister(i, value);
-        LOG(INFO) << "Set register \"" << i << "\" = " << static_cast<int>(value) << " (" << to_hex_string(value) << ")";
-      } catch(ConfigMissingKey& e) {
-        LOG(DEBUG) << "Could not find key \"" << i << "\" in the configuration, skipping.";
+    for(const auto& d : desired) {
+      const auto& reg = _registers.get(d.first);
+
+      // Special registers are composed by the derived classes, they have changed if any of their writes was not elided.
+      // All registers before them are written first to keep the order of the configuration sequence:
+      if(reg.special()) {
+        transaction.commit();
+        auto writes = _register_writes;
+        setRegister(d.first, d.second);
+        if(_register_writes != writes) {
+          changed.push_back(d);
+        }
+        continue;
+      }
+
+      auto shadow = _register_shadow.find(reg.address());
+      if(reg.writable() && !is_volatile_register(reg.address()) && shadow != _register_shadow.end() &&
+         shadow->second.valid && static_cast<uint32_t>((shadow->second.value & reg.mask()) >> reg.shift()) == d.second) {
+        LOG(DEBUG) << "Register \"" << _registers.name(d.first) << "\" unchanged";
+        continue;
       }
+      transaction.set(d.first, d.second);
+      changed.push_back(d);
     }
+    transaction.commit();
+
+    // Values held back are written as well:
+    flushRegisters();
+    for(const auto& i : changed) {
+      LOG(INFO) << "Set register \"" << _registers.name(i.first) << "\" = " << static_cast<int>(i.second) << " ("
+                << to_hex_string(i.second) << ")";
+    }
+    LOG(INFO) << changed.size() << " of " << desired.size() << " registers from the configuration changed";
 
     _is_configured = true;
   }
 
+  template <typename T> void CaribouDevice<T>::configureFull() {
+    LOG(INFO) << "Configuring device " << getName() << " from scratch";
+
+    // Forget everything known about the state of the device:
+    _is_configured = false;
+    invalidateRegisters();
+    configure();
+  }
+
+  template <typename T> void CaribouDevice<T>::setConfiguration(const caribou::Configuration& config) {
+    LOG(INFO) << "Replacing configuration of device " << getName();
+
+    // Values held back belong to the old configuration and have to be written before changing the cache settings:
+    flushRegisters();
+    _config = config;
+
+    _register_writeback = _config.Get("register_writeback", false);
+    _configured_volatile_registers.clear();
+    _volatile_register_names = _config.Get("volatile_registers", std::vector<std::string>());
+  }
+
   template <typename T> void CaribouDevice<T>::setMemory(std::string name, size_t offset, uint32_t value) {
     _hal->writeMemory(_memory.get(name), offset, value);
   }
@@ -310,6 +673,18 @@ namespace caribou {
     return _hal->readMemory(_memory.get(name));
   }
 
+  template <typename T> void CaribouDevice<T>::getMemoryFifo(std::string name, uint32_t* data, size_t n) {
+    _hal->readMemoryFifo(_memory.get(name), 0, data, n);
+  }
+
+  template <typename T> void CaribouDevice<T>::getMemoryBlock(std::string name, size_t offset, uint32_t* data, size_t n) {
+    _hal->readMemoryBlock(_memory.get(name), offset, data, n);
+  }
+
+  template <typename T> memory_handle CaribouDevice<T>::getMemoryHandle(std::string name) {
+    return _hal->getMemoryHandle(_memory.get(name));
+  }
+
   template <typename T> std::vector<std::string> CaribouDevice<T>::listRegisters() { return _registers.getNames(); }
 
   template <typename T> std::vector<std::pair<std::string, std::string>> CaribouDevice<T>::listComponents() {
@@ -31,6 +31,18 @@ std::string Device::getVersion() {
   return std::string(PACKAGE_STRING);
 }
 
+void Device::getHits(pearyhits&) {
+  throw caribou::DeviceImplException("Hit data readback not implemented for this device");
+}
+
+void Device::configureFull() {
+  configure();
+}
+
+void Device::setConfiguration(const caribou::Configuration&) {
+  throw caribou::DeviceImplException("Replacing the configuration is not implemented for this device");
+}
+
 std::vector<std::pair<std::string, std::size_t>> Device::listCommands() {
   return _dispatcher.commands();
 }
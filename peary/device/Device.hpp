@@ -111,6 +111,17 @@ namespace caribou {
      */
     virtual pearydata getData() = 0;
 
+    /**
+     * @brief Retrieve decoded data from the device into a flat hit container.
+     *
+     * Same as getData(), but the hits are stored in a caribou::pearyhits container instead of a map of pixel objects. The
+     * container is cleared before filling and can be reused between calls, this avoids any per-hit allocation and should be
+     * preferred for high-rate readout. Devices not implementing this method throw a caribou::DeviceImplException.
+     *
+     * @param hits Container to be filled with the decoded detector data
+     */
+    virtual void getHits(pearyhits& hits);
+
     /**
      * @brief Configure the device
      *
@@ -121,6 +132,25 @@ namespace caribou {
      */
     virtual void configure() = 0;
 
+    /**
+     * @brief Configure the device from scratch
+     *
+     * Devices may skip steps of configure() for settings they are known to hold already. This brings the device back to a
+     * known state and applies all settings of the configuration, e.g. to recover a misbehaving chip. Devices without
+     * such shortcuts simply call configure().
+     */
+    virtual void configureFull();
+
+    /**
+     * @brief Replace the configuration of the device
+     *
+     * The new configuration is applied with the next call to configure(). Devices which have been configured before only
+     * write the settings which differ from their current state, which makes switching between similar configurations fast.
+     *
+     * @param config Configuration object
+     */
+    virtual void setConfiguration(const caribou::Configuration& config);
+
     /**
      * @brief Set register on the device
      *
@@ -152,10 +182,11 @@ namespace caribou {
     /**
      * @brief Get list of all readable registers with their current values
      *
-     * This method internally calls device::getRegister for every known register of the device. Only readable registers are
-     * returned and no exception is thrown when attempting to read write-only registers.
+     * Only readable registers are returned and no exception is thrown when attempting to read write-only registers.
+     * Implementations should read every physical register only once, even if it holds several named registers.
      *
      * @returns Vector with pairs of register name and value
+     * @throws CommunicationError if the registers could not be read from the device
      */
     virtual std::vector<std::pair<std::string, uint32_t>> getRegisters() = 0;
 
@@ -0,0 +1,140 @@
+/**
+ * Caribou DMA interface class implementation
+ */
+
+#include <atomic>
+#include <fcntl.h>
+#include <fstream>
+#include <poll.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "utils/log.hpp"
+#include "utils/utils.hpp"
+
+#include "dma.hpp"
+
+using namespace caribou;
+
+iface_dma::iface_dma(std::string const& device_path)
+    : Interface(device_path), _fd(-1), _region(nullptr), _region_size(0), _header(nullptr), _lengths(nullptr),
+      _acquired(0) {
+
+  _fd = open(device_path.c_str(), O_RDWR | O_SYNC);
+  if(_fd == -1) {
+    throw DeviceException("Can't open DMA device " + device_path);
+  }
+
+  // The size of the buffer region is exported by the UIO module via sysfs:
+  std::string name = device_path.substr(device_path.find_last_of('/') + 1);
+  std::ifstream sysfs("/sys/class/uio/" + name + "/maps/map0/size");
+  if(!sysfs || !(sysfs >> std::hex >> _region_size) || _region_size <= DMA_RING_DATA_OFFSET) {
+    close(_fd);
+    throw DeviceException("Can't determine size of DMA buffer region of " + device_path);
+  }
+
+  _region = mmap(nullptr, _region_size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+  if(_region == MAP_FAILED) {
+    close(_fd);
+    throw DeviceException("Can't map DMA buffer region of " + device_path);
+  }
+
+  _header = reinterpret_cast<volatile dma_ring_header*>(_region);
+  _lengths = reinterpret_cast<volatile uint32_t*>(reinterpret_cast<std::intptr_t>(_region) + sizeof(dma_ring_header));
+
+  // Check the ring layout announced by the kernel against the mapped region:
+  const uint32_t slots = _header->slots;
+  const uint32_t slot_size = _header->slot_size;
+  if(slots == 0 || slot_size % sizeof(uint32_t) != 0 ||
+     sizeof(dma_ring_header) + slots * sizeof(uint32_t) > DMA_RING_DATA_OFFSET ||
+     DMA_RING_DATA_OFFSET + static_cast<std::size_t>(slots) * slot_size > _region_size) {
+    munmap(_region, _region_size);
+    close(_fd);
+    throw DeviceException("Invalid DMA ring layout at " + device_path + ": " + std::to_string(slots) + " slots of " +
+                          std::to_string(slot_size) + " bytes in region of " + std::to_string(_region_size) + " bytes");
+  }
+
+  // Start reading behind the last frame released by a previous consumer:
+  _acquired = _header->consumer;
+  LOG(TRACE) << "Opened DMA device at " << device_path << " with " << slots << " slots of " << slot_size << " bytes";
+}
+
+iface_dma::~iface_dma() {
+  if(munmap(_region, _region_size) == -1) {
+    LOG(FATAL) << "Can't unmap DMA buffer region from user space.";
+  }
+  close(_fd);
+}
+
+size_t iface_dma::available() {
+  std::lock_guard<std::mutex> lock(mutex);
+  const uint32_t producer = _header->producer;
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return producer - _acquired;
+}
+
+bool iface_dma::wait(const unsigned int timeout) {
+  if(available() > 0) {
+    return true;
+  }
+
+  // Re-enable the interrupt and wait for the DMA engine to signal a completed frame:
+  uint32_t enable = 1;
+  if(::write(_fd, &enable, sizeof(enable)) != sizeof(enable)) {
+    throw CommunicationError("Failed to enable interrupt of DMA device " + devicePath());
+  }
+
+  struct pollfd pfd = {_fd, POLLIN, 0};
+  int ret = poll(&pfd, 1, static_cast<int>(timeout));
+  if(ret < 0) {
+    throw CommunicationError("Failed to wait for DMA device " + devicePath());
+  } else if(ret > 0) {
+    uint32_t count;
+    if(::read(_fd, &count, sizeof(count)) != sizeof(count)) {
+      throw CommunicationError("Failed to read interrupt count of DMA device " + devicePath());
+    }
+  }
+
+  return available() > 0;
+}
+
+dma_frame iface_dma::acquire() {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  const uint32_t producer = _header->producer;
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if(producer == _acquired) {
+    return dma_frame();
+  }
+
+  const uint32_t slot = _acquired % _header->slots;
+  const std::size_t max_words = _header->slot_size / sizeof(uint32_t);
+  std::size_t words = _lengths[slot];
+  if(words > max_words) {
+    LOG(WARNING) << "DMA frame " << _acquired << " reports " << words << " words, truncating to slot size";
+    words = max_words;
+  }
+
+  const uint32_t* data = reinterpret_cast<const uint32_t*>(reinterpret_cast<std::intptr_t>(_region) +
+                                                           DMA_RING_DATA_OFFSET + slot * _header->slot_size);
+  LOG(TRACE) << "Acquired DMA frame " << _acquired << " from slot " << slot << " with " << words << " words";
+  return dma_frame(data, words, _acquired++);
+}
+
+void iface_dma::release(const dma_frame& frame) {
+  if(frame.data() == nullptr) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  const uint32_t consumer = _header->consumer;
+  if(frame.sequence() != consumer) {
+    throw CommunicationError("DMA frame " + std::to_string(frame.sequence()) + " released out of order, expected " +
+                             std::to_string(consumer));
+  }
+
+  // Make sure all reads from the slot are done before handing it back to the DMA engine:
+  std::atomic_thread_fence(std::memory_order_release);
+  _header->consumer = consumer + 1;
+  LOG(TRACE) << "Released DMA frame " << frame.sequence();
+}
@@ -0,0 +1,147 @@
+#ifndef CARIBOU_HAL_DMA_HPP
+#define CARIBOU_HAL_DMA_HPP
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "interfaces/Interface.hpp"
+#include "interfaces/InterfaceManager.hpp"
+#include "utils/exceptions.hpp"
+
+namespace caribou {
+
+  /** Layout of the DMA ring buffer region
+   *
+   *  The region exported by the kernel (UIO map 0) starts with a control page holding the ring header, followed by the
+   *  frame buffer slots:
+   *  - producer:  number of frames completed by the DMA engine, written by firmware/kernel
+   *  - consumer:  number of frames released by the software, written by peary
+   *  - slots:     number of frame buffer slots in the ring
+   *  - slot_size: size of each slot in bytes
+   *  - length:    one word per slot holding the number of valid 32bit words in the slot
+   *
+   *  Producer and consumer are free-running counters, the slot of a frame is given by the counter modulo the number of
+   *  slots. The first slot starts at DMA_RING_DATA_OFFSET from the beginning of the region.
+   */
+  struct dma_ring_header {
+    uint32_t producer;
+    uint32_t consumer;
+    uint32_t slots;
+    uint32_t slot_size;
+  };
+
+  const std::size_t DMA_RING_DATA_OFFSET = 4096;
+
+  /** Zero-copy view on one completed frame buffer of a DMA ring
+   *
+   *  The view points directly into the mapped ring buffer and stays valid until it is released via the interface it was
+   *  acquired from. Views have to be released in the order they have been acquired.
+   */
+  class dma_frame {
+  public:
+    dma_frame() : _data(nullptr), _size(0), _sequence(0){};
+
+    const uint32_t* data() const { return _data; }
+    size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+
+    const uint32_t* begin() const { return _data; }
+    const uint32_t* end() const { return _data + _size; }
+    uint32_t operator[](const size_t i) const { return _data[i]; }
+
+    /** Position of this frame in the ring, counting all frames produced since the ring was set up
+     */
+    uint32_t sequence() const { return _sequence; }
+
+  private:
+    dma_frame(const uint32_t* data, const size_t size, const uint32_t sequence)
+        : _data(data), _size(size), _sequence(sequence){};
+
+    const uint32_t* _data;
+    size_t _size;
+    uint32_t _sequence;
+
+    friend class iface_dma;
+  };
+
+  /**
+   * @ingroup Interfaces
+   * @brief DMA ring buffer interface via the Kernel UIO module
+   *
+   * Frame buffers filled by the FPGA DMA engine are exposed as zero-copy views into the UIO buffer region. The interface
+   * emulator replays recorded captures (binary run files or peary raw text files with "=====" frame separators) into an
+   * in-memory ring.
+   */
+  class iface_dma : public Interface<uint32_t, uint32_t, uint32_t> {
+
+  private:
+    /**
+     * @brief Private constructor, only to be created by the interface manager. Opens and maps the UIO buffer region
+     * @param device_path Path of the UIO device, e.g. /dev/uio0
+     * @throws DeviceException if the device cannot be opened or the ring layout is invalid
+     */
+    iface_dma(std::string const& device_path);
+
+    /**
+     * @brief Destructor unmaps the ring buffer region and closes the file handle
+     */
+    virtual ~iface_dma();
+
+    // File descriptor of the UIO device
+    int _fd;
+
+    // Mapped ring buffer region
+    void* _region;
+    size_t _region_size;
+
+    // Ring header and per-slot length words inside the mapped region
+    volatile dma_ring_header* _header;
+    volatile uint32_t* _lengths;
+
+    // Number of frames handed out to the caller so far
+    uint32_t _acquired;
+
+    // Protects access to the ring indices
+    std::mutex mutex;
+
+    template <typename T> friend class caribouHAL;
+
+  private:
+    /**
+     * @brief Number of completed frames which have not been acquired yet
+     */
+    size_t available();
+
+    /**
+     * @brief Wait for the DMA engine to complete a frame
+     * @param timeout Maximum time to wait in milliseconds
+     * @return True if a frame is available for acquisition
+     */
+    bool wait(const unsigned int timeout);
+
+    /**
+     * @brief Acquire the next completed frame buffer
+     * @return View on the frame buffer, or an empty view if no frame is available
+     */
+    dma_frame acquire();
+
+    /**
+     * @brief Release a frame buffer and return its slot to the DMA engine
+     * @param frame View on the frame to be released, empty views are ignored
+     * @throws CommunicationError if the frame is released out of order
+     */
+    void release(const dma_frame& frame);
+
+    // Remove default constructor
+    iface_dma() = delete;
+
+    // only this function can create the interface
+    friend iface_dma& InterfaceManager::getInterface<iface_dma>(std::string const&);
+  };
+
+} // namespace caribou
+
+#endif /* CARIBOU_HAL_DMA_HPP */
@@ -0,0 +1,182 @@
+/**
+ * Caribou DMA interface class emulator
+ *
+ * Replays a recorded capture file into an in-memory ring buffer with the same layout as the one exported by the kernel.
+ * Captures can be binary run files as written by pearysrv or raw text files with frames separated by "=====" lines.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <map>
+
+#include "utils/log.hpp"
+#include "utils/runfile.hpp"
+#include "utils/utils.hpp"
+
+#include "dma.hpp"
+
+using namespace caribou;
+
+namespace {
+  const uint32_t EMULATED_SLOTS = 16;
+  const uint32_t EMULATED_SLOT_SIZE = 256 * 1024;
+
+  // Capture file replayed by an emulated interface, either as text file or as binary run file
+  struct capture {
+    std::ifstream text;
+    std::unique_ptr<runfile_reader> run;
+  };
+
+  // Captures of all emulated interfaces, kept here since the interface class is shared with the hardware implementation
+  std::mutex captures_mutex;
+  std::map<const iface_dma*, capture> captures;
+
+  capture& capture_of(const iface_dma* dma) {
+    std::lock_guard<std::mutex> lock(captures_mutex);
+    return captures[dma];
+  }
+
+  // Read the next frame from the capture file into the given slot, returns false if the capture is exhausted
+  bool replay(std::ifstream& capture, uint32_t* slot, volatile uint32_t* length) {
+    std::string line;
+
+    // Skip everything up to the next frame header:
+    while(std::getline(capture, line)) {
+      if(line.compare(0, 5, "=====") == 0) {
+        break;
+      }
+    }
+    if(!capture) {
+      return false;
+    }
+
+    size_t words = 0;
+    bool truncated = false;
+    while(capture.peek() != '=' && std::getline(capture, line)) {
+      // Skip empty lines, headers and timestamps:
+      if(line.empty() || line[0] == '#' || line.find(':') != std::string::npos) {
+        continue;
+      }
+      if(words >= EMULATED_SLOT_SIZE / sizeof(uint32_t)) {
+        truncated = true;
+        continue;
+      }
+      try {
+        slot[words++] = static_cast<uint32_t>(std::stoul(line, nullptr, 0));
+      } catch(std::logic_error&) {
+        LOG(WARNING) << "DMA/emu Skipping invalid capture line \"" << line << "\"";
+      }
+    }
+    if(truncated) {
+      LOG(WARNING) << "DMA/emu Captured frame exceeds slot size, truncating to " << words << " words";
+    }
+
+    *length = static_cast<uint32_t>(words);
+    return true;
+  }
+
+  // Read the next frame record from the run file into the given slot, returns false if the run file is exhausted
+  bool replay(runfile_reader& run, runfile_frame& frame, uint32_t* slot, volatile uint32_t* length) {
+    if(!run.read(frame)) {
+      return false;
+    }
+
+    size_t words = frame.data.size();
+    if(words > EMULATED_SLOT_SIZE / sizeof(uint32_t)) {
+      words = EMULATED_SLOT_SIZE / sizeof(uint32_t);
+      LOG(WARNING) << "DMA/emu Captured frame exceeds slot size, truncating to " << words << " words";
+    }
+    std::copy(frame.data.begin(), frame.data.begin() + static_cast<std::ptrdiff_t>(words), slot);
+
+    *length = static_cast<uint32_t>(words);
+    return true;
+  }
+} // namespace
+
+iface_dma::iface_dma(std::string const& device_path)
+    : Interface(device_path), _fd(-1), _region(nullptr), _region_size(0), _header(nullptr), _lengths(nullptr),
+      _acquired(0) {
+
+  _region_size = DMA_RING_DATA_OFFSET + static_cast<std::size_t>(EMULATED_SLOTS) * EMULATED_SLOT_SIZE;
+  _region = new uint8_t[_region_size]();
+  _header = reinterpret_cast<volatile dma_ring_header*>(_region);
+  _lengths = reinterpret_cast<volatile uint32_t*>(reinterpret_cast<std::intptr_t>(_region) + sizeof(dma_ring_header));
+  _header->slots = EMULATED_SLOTS;
+  _header->slot_size = EMULATED_SLOT_SIZE;
+
+  capture& cap = capture_of(this);
+  if(runfile_reader::isRunfile(device_path)) {
+    try {
+      cap.run = std::make_unique<runfile_reader>(device_path);
+      LOG(DEBUG) << "DMA/emu Replaying run file with " << cap.run->frames() << " frames";
+    } catch(DataException& e) {
+      LOG(WARNING) << "DMA/emu Could not read run file " << device_path << ": " << e.what() << ", ring will stay empty";
+    }
+  } else {
+    cap.text.open(device_path);
+    if(!cap.text.is_open()) {
+      LOG(WARNING) << "DMA/emu Could not open capture file " << device_path << ", ring will stay empty";
+    }
+  }
+  LOG(TRACE) << "Opened emulated DMA device at " << device_path;
+}
+
+iface_dma::~iface_dma() {
+  delete[] reinterpret_cast<uint8_t*>(_region);
+
+  std::lock_guard<std::mutex> lock(captures_mutex);
+  captures.erase(this);
+}
+
+size_t iface_dma::available() {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  // Play the role of the DMA engine and fill all free slots from the capture:
+  capture& cap = capture_of(this);
+  runfile_frame frame;
+  while((cap.run || cap.text.good()) && _header->producer - _header->consumer < _header->slots) {
+    const uint32_t slot = _header->producer % _header->slots;
+    uint32_t* data = reinterpret_cast<uint32_t*>(reinterpret_cast<std::intptr_t>(_region) + DMA_RING_DATA_OFFSET +
+                                                 slot * _header->slot_size);
+    if(!(cap.run ? replay(*cap.run, frame, data, &_lengths[slot]) : replay(cap.text, data, &_lengths[slot]))) {
+      break;
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    _header->producer = _header->producer + 1;
+  }
+
+  return _header->producer - _acquired;
+}
+
+bool iface_dma::wait(const unsigned int) {
+  return available() > 0;
+}
+
+dma_frame iface_dma::acquire() {
+  if(available() == 0) {
+    return dma_frame();
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  const uint32_t slot = _acquired % _header->slots;
+  const uint32_t* data = reinterpret_cast<const uint32_t*>(reinterpret_cast<std::intptr_t>(_region) +
+                                                           DMA_RING_DATA_OFFSET + slot * _header->slot_size);
+  LOG(TRACE) << "DMA/emu Acquired frame " << _acquired << " from slot " << slot << " with " << _lengths[slot] << " words";
+  return dma_frame(data, _lengths[slot], _acquired++);
+}
+
+void iface_dma::release(const dma_frame& frame) {
+  if(frame.data() == nullptr) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  const uint32_t consumer = _header->consumer;
+  if(frame.sequence() != consumer) {
+    throw CommunicationError("DMA frame " + std::to_string(frame.sequence()) + " released out of order, expected " +
+                             std::to_string(consumer));
+  }
+  _header->consumer = consumer + 1;
+  LOG(TRACE) << "DMA/emu Released frame " << frame.sequence();
+}
@@ -2,9 +2,11 @@
  * Caribou I2C interface emulator
  */
 
+#include <algorithm>
 #include <cerrno>
 #include <cstring>
 
+#include "carboard/emulator.hpp"
 #include "utils/log.hpp"
 #include "utils/utils.hpp"
 
@@ -19,9 +21,29 @@ iface_i2c::iface_i2c(std::string const& device_path) : Interface(device_path) {
 iface_i2c::~iface_i2c() {}
 
 void iface_i2c::setAddress(i2c_address_t const address) {
+  if(currentAddress == address) {
+    return;
+  }
+  currentAddress = address;
   LOG(TRACE) << "Talking to I2C slave at address " << to_hex_string(address);
 }
 
+void iface_i2c::transfer(std::vector<i2c_message_t>& messages) {
+  carboard_emulator::getInstance().i2c(devicePath(), messages);
+}
+
+void iface_i2c::transaction(std::vector<i2c_message_t>& messages) {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  for(const auto& msg : messages) {
+    LOG(TRACE) << "I2C/emu (" << devicePath() << ") address " << to_hex_string(msg.address) << ": "
+               << (msg.read ? "Reading " + std::to_string(msg.data.size()) + " bytes"
+                            : "Writing data \"" + listVector(msg.data, ", ", true) + "\"");
+  }
+
+  transfer(messages);
+}
+
 i2c_t iface_i2c::write(const i2c_t& address, const i2c_t& data) {
   std::lock_guard<std::mutex> lock(mutex);
 
@@ -30,6 +52,8 @@ i2c_t iface_i2c::write(const i2c_t& address, const i2c_t& data) {
   LOG(TRACE) << "I2C/emu (" << devicePath() << ") address " << to_hex_string(address) << ": Writing data \""
              << to_hex_string(data) << "\"";
 
+  std::vector<i2c_message_t> messages = {i2c_write_msg(address, {data})};
+  transfer(messages);
   return 0;
 }
 
@@ -42,9 +66,30 @@ std::pair<i2c_reg_t, i2c_t> iface_i2c::write(const i2c_t& address, const std::pa
   LOG(TRACE) << "I2C/emu (" << devicePath() << ") address " << to_hex_string(address) << ": Register "
              << to_hex_string(data.first) << " Writing data \"" << to_hex_string(data.second) << "\"";
 
+  std::vector<i2c_message_t> messages = {i2c_write_msg(address, {data.first, data.second})};
+  transfer(messages);
   return std::make_pair(0, 0);
 }
 
+std::vector<std::pair<i2c_reg_t, i2c_t>> iface_i2c::write(const i2c_t& address,
+                                                          const std::vector<std::pair<i2c_reg_t, i2c_t>>& data) {
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  setAddress(address);
+
+  for(const auto& reg : data) {
+    LOG(TRACE) << "I2C/emu (" << devicePath() << ") address " << to_hex_string(address) << ": Register "
+               << to_hex_string(reg.first) << " Writing data \"" << to_hex_string(reg.second) << "\"";
+
+    // Every register is written with a separate transfer:
+    std::vector<i2c_message_t> messages = {i2c_write_msg(address, {reg.first, reg.second})};
+    transfer(messages);
+  }
+
+  return std::vector<std::pair<i2c_reg_t, i2c_t>>();
+}
+
 std::vector<i2c_t> iface_i2c::write(const i2c_t& address, const i2c_t& reg, const std::vector<i2c_t>& data) {
 
   std::lock_guard<std::mutex> lock(mutex);
@@ -54,6 +99,9 @@ std::vector<i2c_t> iface_i2c::write(const i2c_t& address, const i2c_t& reg, cons
   LOG(TRACE) << "I2C/emu (" << devicePath() << ") address " << to_hex_string(address) << ": Register " << to_hex_string(reg)
              << "\n\t Writing block data: \"" << listVector(data, ", ", true) << "\"";
 
+  std::vector<i2c_message_t> messages = {i2c_write_msg(address, {reg})};
+  messages.front().data.insert(messages.front().data.end(), data.begin(), data.end());
+  transfer(messages);
   return std::vector<i2c_t>();
 }
 
@@ -66,7 +114,9 @@ std::vector<i2c_t> iface_i2c::read(const i2c_t& address, const unsigned int leng
 
   setAddress(address);
 
-  data.resize(1);
+  std::vector<i2c_message_t> messages = {i2c_read_msg(address, 1)};
+  transfer(messages);
+  data = std::move(messages.front().data);
 
   LOG(TRACE) << "I2C/emu (" << devicePath() << ") address " << to_hex_string(address) << ": Read data \""
              << to_hex_string(data[0]) << "\"";
@@ -81,7 +131,9 @@ std::vector<i2c_t> iface_i2c::read(const i2c_t& address, const i2c_t reg, const
 
   setAddress(address);
 
-  data.resize(length);
+  std::vector<i2c_message_t> messages = {i2c_write_msg(address, {reg}), i2c_read_msg(address, length)};
+  transfer(messages);
+  data = std::move(messages.back().data);
 
   LOG(TRACE) << "I2C/emu (" << devicePath() << ") address " << to_hex_string(address) << ": Register " << to_hex_string(reg)
              << "\n\t Read block data \"" << listVector(data, ", ", true) << "\"";
@@ -89,10 +141,55 @@ std::vector<i2c_t> iface_i2c::read(const i2c_t& address, const i2c_t reg, const
   return data;
 }
 
-std::vector<i2c_t> iface_i2c::wordwrite(const i2c_t&, const uint16_t&, const std::vector<i2c_t>&) {
-  return std::vector<i2c_t>();
+std::vector<i2c_t> iface_i2c::read(const i2c_address_t& address, const std::vector<i2c_reg_t>& regs) {
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  // Register address followed by a repeated-start read for every register, combined into a single transaction
+  std::vector<i2c_message_t> messages;
+  messages.reserve(2 * regs.size());
+  for(const auto& reg : regs) {
+    messages.push_back(i2c_write_msg(address, {reg}));
+    messages.push_back(i2c_read_msg(address, 1));
+  }
+  transfer(messages);
+
+  std::vector<i2c_t> data;
+  data.reserve(regs.size());
+  for(size_t i = 0; i < regs.size(); i++) {
+    data.push_back(messages[2 * i + 1].data.front());
+  }
+
+  LOG(TRACE) << "I2C/emu (" << devicePath() << ") address " << to_hex_string(address) << ": Registers \""
+             << listVector(regs, ", ", true) << "\"\n\t Read data \"" << listVector(data, ", ", true) << "\"";
+  return data;
 }
 
-std::vector<i2c_t> iface_i2c::wordread(const i2c_t&, const uint16_t, const unsigned int) {
+std::vector<i2c_t> iface_i2c::wordwrite(const i2c_t& address, const uint16_t& reg, const std::vector<i2c_t>& data) {
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  LOG(TRACE) << "I2C/emu (" << devicePath() << ") address " << to_hex_string(address) << ": Register " << to_hex_string(reg)
+             << "\n\t Writing block data: \"" << listVector(data, ", ", true) << "\"";
+
+  std::vector<i2c_message_t> messages = {
+    i2c_write_msg(address, {static_cast<i2c_t>(reg >> 8), static_cast<i2c_t>(reg & 0xFF)})};
+  messages.front().data.insert(messages.front().data.end(), data.begin(), data.end());
+  transfer(messages);
   return std::vector<i2c_t>();
 }
+
+std::vector<i2c_t> iface_i2c::wordread(const i2c_t& address, const uint16_t reg, const unsigned int length) {
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  std::vector<i2c_message_t> messages = {
+    i2c_write_msg(address, {static_cast<i2c_t>(reg >> 8), static_cast<i2c_t>(reg & 0xFF)}), i2c_read_msg(address, length)};
+  transfer(messages);
+  std::vector<i2c_t> data = std::move(messages.back().data);
+
+  LOG(TRACE) << "I2C/emu (" << devicePath() << ") address " << to_hex_string(address) << ": Register " << to_hex_string(reg)
+             << "\n\t Read block data \"" << listVector(data, ", ", true) << "\"";
+
+  return data;
+}
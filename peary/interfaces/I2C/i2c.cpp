@@ -2,6 +2,7 @@
  * Caribou I2C interface class implementation
  */
 
+#include <algorithm>
 #include <cerrno>
 #include <cstring>
 
@@ -16,6 +17,12 @@
 #include <linux/i2c-dev.h>
 #endif
 
+// Kernel headers only declare the I2C_RDWR message structure in linux/i2c.h, the i2c-tools header defines it itself
+#ifndef I2C_M_RD
+#include <linux/i2c.h>
+#endif
+
+#include "carboard/emulator.hpp"
 #include "utils/log.hpp"
 #include "utils/utils.hpp"
 
@@ -23,7 +30,13 @@
 
 using namespace caribou;
 
-iface_i2c::iface_i2c(std::string const& device_path) : Interface(device_path), i2cDesc() {
+iface_i2c::iface_i2c(std::string const& device_path) : Interface(device_path), i2cDesc(-1) {
+  if(carboard_emulator::selected()) {
+    emulated = true;
+    LOG(TRACE) << "Emulating I2C device at " << device_path;
+    return;
+  }
+
   if((i2cDesc = open(devicePath().c_str(), O_RDWR)) < 0) {
     throw DeviceException("Open " + device_path + " device failed. " + std::strerror(i2cDesc));
   }
@@ -31,17 +44,71 @@ iface_i2c::iface_i2c(std::string const& device_path) : Interface(device_path), i
 }
 
 iface_i2c::~iface_i2c() {
-  close(i2cDesc);
+  if(!emulated) {
+    close(i2cDesc);
+  }
 }
 
 void iface_i2c::setAddress(i2c_address_t const address) {
-  if(ioctl(i2cDesc, I2C_SLAVE, address) < 0)
+  if(currentAddress == address) {
+    return;
+  }
+
+  if(!emulated && ioctl(i2cDesc, I2C_SLAVE, address) < 0) {
+    currentAddress = -1;
     throw CommunicationError("Failed to acquire bus access and/or talk to slave (" + to_hex_string(address) + ") on " +
                              devicePath() + ": " + std::strerror(errno));
+  }
+  currentAddress = address;
 
   LOG(TRACE) << "Talking to I2C slave at address " << to_hex_string(address);
 }
 
+void iface_i2c::transfer(std::vector<i2c_message_t>& messages) {
+  if(emulated) {
+    carboard_emulator::getInstance().i2c(devicePath(), messages);
+    return;
+  }
+
+  std::vector<struct i2c_msg> msgs(messages.size());
+  for(size_t i = 0; i < messages.size(); i++) {
+    msgs[i].addr = messages[i].address;
+    msgs[i].flags = messages[i].read ? I2C_M_RD : 0;
+    msgs[i].len = static_cast<uint16_t>(messages[i].data.size());
+    msgs[i].buf = messages[i].data.data();
+  }
+
+  // The kernel limits the number of messages per call
+  for(size_t first = 0; first < msgs.size(); first += I2C_RDWR_IOCTL_MAX_MSGS) {
+    struct i2c_rdwr_ioctl_data rdwr;
+    rdwr.msgs = &msgs[first];
+    rdwr.nmsgs = static_cast<uint32_t>(std::min<size_t>(msgs.size() - first, I2C_RDWR_IOCTL_MAX_MSGS));
+    if(ioctl(i2cDesc, I2C_RDWR, &rdwr) < 0) {
+      throw CommunicationError("Failed I2C transaction with slave (" + to_hex_string(messages[first].address) + ") on " +
+                               devicePath() + ": " + std::strerror(errno));
+    }
+  }
+}
+
+void iface_i2c::transaction(std::vector<i2c_message_t>& messages) {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  for(const auto& msg : messages) {
+    LOG(TRACE) << "I2C (" << devicePath() << ") address " << to_hex_string(msg.address) << ": "
+               << (msg.read ? "Reading " + std::to_string(msg.data.size()) + " bytes"
+                            : "Writing data \"" + listVector(msg.data, ", ", true) + "\"");
+  }
+
+  transfer(messages);
+
+  for(const auto& msg : messages) {
+    if(msg.read) {
+      LOG(TRACE) << "I2C (" << devicePath() << ") address " << to_hex_string(msg.address) << ": Read data \""
+                 << listVector(msg.data, ", ", true) << "\"";
+    }
+  }
+}
+
 i2c_t iface_i2c::write(const i2c_address_t& address, const i2c_t& data) {
   std::lock_guard<std::mutex> lock(mutex);
 
@@ -50,7 +117,10 @@ i2c_t iface_i2c::write(const i2c_address_t& address, const i2c_t& data) {
   LOG(TRACE) << "I2C (" << devicePath() << ") address " << to_hex_string(address) << ": Writing data \""
              << to_hex_string(data) << "\"";
 
-  if(i2c_smbus_write_byte(i2cDesc, data))
+  if(emulated) {
+    std::vector<i2c_message_t> messages = {i2c_write_msg(address, {data})};
+    transfer(messages);
+  } else if(i2c_smbus_write_byte(i2cDesc, data))
     throw CommunicationError("Failed to write slave (" + to_hex_string(address) + ") on " + devicePath() + ": " +
                              std::strerror(errno));
 
@@ -61,30 +131,45 @@ std::pair<i2c_reg_t, i2c_t> iface_i2c::write(const i2c_address_t& address, const
 
   std::lock_guard<std::mutex> lock(mutex);
 
-  setAddress(address);
-
   LOG(TRACE) << "I2C (" << devicePath() << ") address " << to_hex_string(address) << ": Register "
              << to_hex_string(data.first) << " Writing data \"" << to_hex_string(data.second) << "\"";
 
-  if(i2c_smbus_write_byte_data(i2cDesc, data.first, data.second))
-    throw CommunicationError("Failed to write slave (" + to_hex_string(address) + ") on " + devicePath() + ": " +
-                             std::strerror(errno));
+  std::vector<i2c_message_t> messages = {i2c_write_msg(address, {data.first, data.second})};
+  transfer(messages);
 
   return std::make_pair(0, 0);
 }
 
-std::vector<i2c_t> iface_i2c::write(const i2c_address_t& address, const i2c_t& reg, const std::vector<i2c_t>& data) {
+std::vector<std::pair<i2c_reg_t, i2c_t>> iface_i2c::write(const i2c_address_t& address,
+                                                          const std::vector<std::pair<i2c_reg_t, i2c_t>>& data) {
 
   std::lock_guard<std::mutex> lock(mutex);
 
-  setAddress(address);
+  std::vector<i2c_message_t> messages;
+  messages.reserve(data.size());
+  for(const auto& reg : data) {
+    LOG(TRACE) << "I2C (" << devicePath() << ") address " << to_hex_string(address) << ": Register "
+               << to_hex_string(reg.first) << " Writing data \"" << to_hex_string(reg.second) << "\"";
+    messages.push_back(i2c_write_msg(address, {reg.first, reg.second}));
+  }
+  transfer(messages);
+
+  return std::vector<std::pair<i2c_reg_t, i2c_t>>();
+}
+
+std::vector<i2c_t> iface_i2c::write(const i2c_address_t& address, const i2c_t& reg, const std::vector<i2c_t>& data) {
+
+  std::lock_guard<std::mutex> lock(mutex);
 
   LOG(TRACE) << "I2C (" << devicePath() << ") address " << to_hex_string(address) << ": Register " << to_hex_string(reg)
              << "\n\t Writing block data: \"" << listVector(data, ", ", true) << "\"";
 
-  if(i2c_smbus_write_i2c_block_data(i2cDesc, reg, data.size(), data.data()))
-    throw CommunicationError("Failed to block write slave (" + to_hex_string(address) + ") on " + devicePath() + ": " +
-                             std::strerror(errno));
+  std::vector<i2c_t> buffer;
+  buffer.reserve(data.size() + 1);
+  buffer.push_back(reg);
+  buffer.insert(buffer.end(), data.begin(), data.end());
+  std::vector<i2c_message_t> messages = {i2c_write_msg(address, std::move(buffer))};
+  transfer(messages);
 
   return std::vector<i2c_t>();
 }
@@ -99,7 +184,13 @@ std::vector<i2c_t> iface_i2c::read(const i2c_address_t& address, const unsigned
 
   setAddress(address);
 
-  temp = i2c_smbus_read_byte(i2cDesc);
+  if(emulated) {
+    std::vector<i2c_message_t> messages = {i2c_read_msg(address, 1)};
+    transfer(messages);
+    temp = messages.front().data.front();
+  } else {
+    temp = i2c_smbus_read_byte(i2cDesc);
+  }
   if(temp < 0)
     throw CommunicationError("Failed to read slave (" + to_hex_string(address) + ") on " + devicePath() + ": " +
                              std::strerror(errno));
@@ -114,24 +205,71 @@ std::vector<i2c_t> iface_i2c::read(const i2c_address_t& address, const unsigned
 std::vector<i2c_t> iface_i2c::read(const i2c_address_t& address, const i2c_reg_t reg, const unsigned int length) {
 
   std::lock_guard<std::mutex> lock(mutex);
-  std::vector<i2c_t> data;
 
-  setAddress(address);
-
-  data.resize(length);
-  if(i2c_smbus_read_i2c_block_data(i2cDesc, reg, length, data.data()) != length)
-    throw CommunicationError("Failed to read slave (" + to_hex_string(address) + ") on " + devicePath() + ": " +
-                             std::strerror(errno));
+  // Register address followed by a repeated-start read
+  std::vector<i2c_message_t> messages = {i2c_write_msg(address, {reg}), i2c_read_msg(address, length)};
+  transfer(messages);
+  std::vector<i2c_t>& data = messages.back().data;
 
   LOG(TRACE) << "I2C (" << devicePath() << ") address " << to_hex_string(address) << ": Register " << to_hex_string(reg)
              << "\n\t Read block data \"" << listVector(data, ", ", true) << "\"";
   return data;
 }
 
-std::vector<i2c_t> iface_i2c::wordwrite(const i2c_address_t&, const uint16_t&, const std::vector<i2c_t>&) {
-  return std::vector<i2c_t>();
+std::vector<i2c_t> iface_i2c::read(const i2c_address_t& address, const std::vector<i2c_reg_t>& regs) {
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  // Register address followed by a repeated-start read for every register, combined into a single transaction
+  std::vector<i2c_message_t> messages;
+  messages.reserve(2 * regs.size());
+  for(const auto& reg : regs) {
+    messages.push_back(i2c_write_msg(address, {reg}));
+    messages.push_back(i2c_read_msg(address, 1));
+  }
+  transfer(messages);
+
+  std::vector<i2c_t> data;
+  data.reserve(regs.size());
+  for(size_t i = 0; i < regs.size(); i++) {
+    data.push_back(messages[2 * i + 1].data.front());
+  }
+
+  LOG(TRACE) << "I2C (" << devicePath() << ") address " << to_hex_string(address) << ": Registers \""
+             << listVector(regs, ", ", true) << "\"\n\t Read data \"" << listVector(data, ", ", true) << "\"";
+  return data;
 }
 
-std::vector<i2c_t> iface_i2c::wordread(const i2c_address_t&, const uint16_t, const unsigned int) {
+std::vector<i2c_t> iface_i2c::wordwrite(const i2c_address_t& address, const uint16_t& reg, const std::vector<i2c_t>& data) {
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  LOG(TRACE) << "I2C (" << devicePath() << ") address " << to_hex_string(address) << ": Register " << to_hex_string(reg)
+             << "\n\t Writing block data: \"" << listVector(data, ", ", true) << "\"";
+
+  // Register address is sent MSB first
+  std::vector<i2c_t> buffer;
+  buffer.reserve(data.size() + 2);
+  buffer.push_back(static_cast<i2c_t>(reg >> 8));
+  buffer.push_back(static_cast<i2c_t>(reg & 0xFF));
+  buffer.insert(buffer.end(), data.begin(), data.end());
+  std::vector<i2c_message_t> messages = {i2c_write_msg(address, std::move(buffer))};
+  transfer(messages);
+
   return std::vector<i2c_t>();
 }
+
+std::vector<i2c_t> iface_i2c::wordread(const i2c_address_t& address, const uint16_t reg, const unsigned int length) {
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  // Register address MSB first, followed by a repeated-start read
+  std::vector<i2c_message_t> messages = {
+    i2c_write_msg(address, {static_cast<i2c_t>(reg >> 8), static_cast<i2c_t>(reg & 0xFF)}),
+    i2c_read_msg(address, length)};
+  transfer(messages);
+
+  LOG(TRACE) << "I2C (" << devicePath() << ") address " << to_hex_string(address) << ": Register " << to_hex_string(reg)
+             << "\n\t Read block data \"" << listVector(messages.back().data, ", ", true) << "\"";
+  return messages.back().data;
+}
@@ -14,6 +14,31 @@ namespace caribou {
   typedef uint8_t i2c_t;
   typedef uint8_t i2c_reg_t;
 
+  /**
+   * @brief Single message of a combined I2C transaction
+   *
+   * Write messages send the contained data to the slave, read messages receive as many bytes as the data vector holds.
+   */
+  struct i2c_message_t {
+    i2c_address_t address;
+    bool read;
+    std::vector<i2c_t> data;
+  };
+
+  /**
+   * @brief Create a message writing the given data to the slave
+   */
+  inline i2c_message_t i2c_write_msg(const i2c_address_t address, std::vector<i2c_t> data) {
+    return {address, false, std::move(data)};
+  }
+
+  /**
+   * @brief Create a message reading the given number of bytes from the slave
+   */
+  inline i2c_message_t i2c_read_msg(const i2c_address_t address, const unsigned int length) {
+    return {address, true, std::vector<i2c_t>(length)};
+  }
+
   /**
    * @ingroup Interfaces
    * @brief I2C interface via Kernel I2C module
@@ -38,15 +63,28 @@ namespace caribou {
     ~iface_i2c();
 
     /**
-     * @brief Sets endpoint address before communication
+     * @brief Sets endpoint address before communication, nothing is done if the address did not change
      * @param address I2C address to address
      * @throws CommunicationError if device cannot be contacted
      */
     inline void setAddress(i2c_address_t const address);
 
+    /**
+     * @brief Execute messages as combined transaction, requires the bus lock
+     * @param messages Messages to be transferred, read messages are filled with the received data
+     * @throws CommunicationError if the transfer failed
+     */
+    void transfer(std::vector<i2c_message_t>& messages);
+
     // File descriptor for the I2C module
     int i2cDesc;
 
+    // Slave address currently selected for SMBus transfers, -1 if none
+    int currentAddress{-1};
+
+    // Set if the CaR board emulator has been selected at runtime in place of the I2C module
+    bool emulated{false};
+
     // Protects access to the bus
     std::mutex mutex;
 
@@ -57,11 +95,27 @@ namespace caribou {
     i2c_t write(const i2c_address_t& address, const i2c_t& data);
     std::pair<i2c_reg_t, i2c_t> write(const i2c_address_t& address, const std::pair<i2c_reg_t, i2c_t>& data);
     std::vector<i2c_t> write(const i2c_address_t& address, const i2c_reg_t& reg, const std::vector<i2c_t>& data);
+    // all registers are written in a single transaction
+    std::vector<std::pair<i2c_reg_t, i2c_t>> write(const i2c_address_t& address,
+                                                   const std::vector<std::pair<i2c_reg_t, i2c_t>>& data);
 
     // length must be 1
     std::vector<i2c_t> read(const i2c_address_t& address, const unsigned int length = 1);
-    // length must be 32
+    // register address write followed by a repeated-start read of arbitrary length
     std::vector<i2c_t> read(const i2c_address_t& address, const i2c_reg_t reg, const unsigned int length = 32);
+    // one byte from each of the registers, all register reads are performed in a single transaction
+    std::vector<i2c_t> read(const i2c_address_t& address, const std::vector<i2c_reg_t>& regs);
+
+    /**
+     * @brief Execute several write and read messages to one or more slaves as a single combined transaction
+     *
+     * Messages are separated by repeated start conditions, the bus is only released after the last message. Transactions
+     * with more messages than the kernel accepts at once are split into several transfers.
+     *
+     * @param messages Messages to be transferred, read messages are filled with the received data
+     * @throws CommunicationError if the transfer failed
+     */
+    void transaction(std::vector<i2c_message_t>& messages);
 
   private:
     // Special functions to read/write to devices with up to 16bit register
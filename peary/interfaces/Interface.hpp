@@ -78,6 +78,12 @@ namespace caribou {
     virtual std::vector<DATA_T> read(const ADDRESS_T&, const REG_T, const unsigned int = 1) {
       throw CommunicationError("Functionality not provided by this interface");
     };
+
+    // Read one data word from each of the given registers of the device
+    // The reads should be combined into as few bus transfers as the interface allows.
+    virtual std::vector<DATA_T> read(const ADDRESS_T&, const std::vector<REG_T>&) {
+      throw CommunicationError("Functionality not provided by this interface");
+    };
   };
 
 } // namespace caribou
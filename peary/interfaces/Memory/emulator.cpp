@@ -2,6 +2,9 @@
  * Caribou Memory interface class emulator
  */
 
+#include <memory>
+
+#include "carboard/emulator.hpp"
 #include "utils/log.hpp"
 #include "utils/utils.hpp"
 
@@ -9,28 +12,101 @@
 
 using namespace caribou;
 
+namespace {
+  // Emulated register, the access has to stay within the emulated page:
+  volatile uint32_t* registerAt(void* base, const memory_map& mem, const size_t offset, const size_t n) {
+    const std::size_t end = (mem.getBaseAddress() & mem.getMask()) + mem.getOffset() + offset + n * sizeof(uint32_t);
+    if(end > mem.getSize()) {
+      throw CommunicationError("Access of " + std::to_string(n) + " words at offset " + to_hex_string(offset) +
+                               " exceeds the mapped page of size " + to_hex_string(mem.getSize()));
+    }
+    return reinterpret_cast<volatile uint32_t*>(reinterpret_cast<std::intptr_t>(base) + mem.getOffset() + offset);
+  }
+
+  // Physical address of a register, memory models are attached by address
+  std::intptr_t physicalAddress(const memory_map& mem, const size_t offset) {
+    return mem.getBaseAddress() + mem.getOffset() + static_cast<std::intptr_t>(offset);
+  }
+} // namespace
+
 iface_mem::iface_mem(std::string const& device_path) : Interface(device_path), _memfd(), _mappedMemory() {
   LOG(TRACE) << "Opened emulated memory device at " << device_path;
 }
 
-iface_mem::~iface_mem() {}
+iface_mem::~iface_mem() {
+  // Release the emulated memory pages:
+  for(auto& mem : _mappedMemory) {
+    delete[] reinterpret_cast<uint8_t*>(reinterpret_cast<std::intptr_t>(mem.second) -
+                                        (mem.first.getBaseAddress() & mem.first.getMask()));
+  }
+}
 
 std::pair<size_t, uint32_t> iface_mem::write(const memory_map& mem, const std::pair<size_t, uint32_t>& dest) {
   LOG(TRACE) << "MEM/emu Writing to mapped memory at " << std::hex << mem.getBaseAddress() << ", offset " << dest.first
              << std::dec << ": " << dest.second;
+  carboard_emulator::getInstance().writeMemory(
+    physicalAddress(mem, dest.first), registerAt(mapMemory(mem), mem, dest.first, 1), dest.second);
   return std::pair<size_t, uint32_t>();
 }
 
 uint32_t iface_mem::readWord(const memory_map& mem, const size_t offset) {
   LOG(TRACE) << "MEM/emu Reading from mapped memory at " << std::hex << mem.getBaseAddress() << ", offset " << offset
              << std::dec;
-  return 0;
+  return carboard_emulator::getInstance().readMemory(physicalAddress(mem, offset),
+                                                     registerAt(mapMemory(mem), mem, offset, 1));
 }
 
 std::vector<uint32_t> iface_mem::read(const memory_map& mem, const size_t offset, const unsigned int n) {
-  std::vector<uint32_t> values;
-  for(unsigned int i = 0; i < n; i++) {
-    values.push_back(this->readWord(mem, offset));
-  }
+  std::vector<uint32_t> values(n);
+  readFifo(mem, offset, values.data(), values.size());
   return values;
 }
+
+void iface_mem::readFifo(const memory_map& mem, const size_t offset, uint32_t* buffer, const size_t n) {
+  LOG(TRACE) << "MEM/emu Reading " << n << " words from FIFO in mapped memory at " << std::hex << mem.getBaseAddress()
+             << ", offset " << offset << std::dec;
+  carboard_emulator& emulator = carboard_emulator::getInstance();
+  const volatile uint32_t* reg = registerAt(mapMemory(mem), mem, offset, 1);
+  for(size_t i = 0; i < n; i++) {
+    buffer[i] = emulator.readMemory(physicalAddress(mem, offset), reg);
+  }
+}
+
+void iface_mem::readBlock(const memory_map& mem, const size_t offset, uint32_t* buffer, const size_t n) {
+  LOG(TRACE) << "MEM/emu Reading block of " << n << " words from mapped memory at " << std::hex << mem.getBaseAddress()
+             << ", offset " << offset << std::dec;
+  carboard_emulator& emulator = carboard_emulator::getInstance();
+  const volatile uint32_t* reg = registerAt(mapMemory(mem), mem, offset, n);
+  for(size_t i = 0; i < n; i++) {
+    buffer[i] = emulator.readMemory(physicalAddress(mem, offset + i * sizeof(uint32_t)), reg + i);
+  }
+}
+
+memory_handle iface_mem::getHandle(const memory_map& mem) {
+  const std::size_t start = (mem.getBaseAddress() & mem.getMask()) + mem.getOffset();
+  if(start + sizeof(uint32_t) > mem.getSize()) {
+    throw CommunicationError("Register offset " + to_hex_string(mem.getOffset()) + " outside of mapped page of size " +
+                             to_hex_string(mem.getSize()));
+  }
+
+  volatile uint32_t* reg =
+    reinterpret_cast<volatile uint32_t*>(reinterpret_cast<std::intptr_t>(mapMemory(mem)) + mem.getOffset());
+  return memory_handle(
+    reg, mem.getSize() - start, mem.writable(), carboard_emulator::getInstance().memoryPort(reg, physicalAddress(mem, 0)));
+}
+
+void* iface_mem::mapMemory(const memory_map& page) {
+
+  auto mapped = _mappedMemory.find(page);
+  if(mapped != _mappedMemory.end()) {
+    return mapped->second;
+  }
+
+  // Handles need real storage to point to, back each emulated page with zero-initialized memory:
+  LOG(TRACE) << "MEM/emu Allocating emulated memory page at " << std::hex << page.getBaseAddress() << std::dec;
+  uint8_t* map_base = new uint8_t[page.getSize()]();
+  void* base_pointer = reinterpret_cast<void*>(reinterpret_cast<std::intptr_t>(map_base) +
+                                               (page.getBaseAddress() & page.getMask()));
+  _mappedMemory[page] = base_pointer;
+  return base_pointer;
+}
@@ -2,6 +2,7 @@
  * Caribou Memory interface class implementation
  */
 
+#include "carboard/emulator.hpp"
 #include "utils/log.hpp"
 #include "utils/utils.hpp"
 
@@ -9,8 +10,21 @@
 
 using namespace caribou;
 
+namespace {
+  // Physical address of a register, memory models of the emulator are attached by address
+  std::intptr_t physicalAddress(const memory_map& mem, const size_t offset) {
+    return mem.getBaseAddress() + mem.getOffset() + static_cast<std::intptr_t>(offset);
+  }
+} // namespace
+
 iface_mem::iface_mem(std::string const& device_path) : Interface(device_path), _memfd(-1), _mappedMemory() {
 
+  if(carboard_emulator::selected()) {
+    _emulated = true;
+    LOG(TRACE) << "Emulating memory device at " << device_path;
+    return;
+  }
+
   // Get access to FPGA memory mapped registers
   _memfd = open(device_path.c_str(), O_RDWR | O_SYNC);
 
@@ -22,6 +36,15 @@ iface_mem::iface_mem(std::string const& device_path) : Interface(device_path), _
 }
 
 iface_mem::~iface_mem() {
+  // Release the emulated memory pages:
+  if(_emulated) {
+    for(auto& mem : _mappedMemory) {
+      delete[] reinterpret_cast<uint8_t*>(reinterpret_cast<std::intptr_t>(mem.second) -
+                                          (mem.first.getBaseAddress() & mem.first.getMask()));
+    }
+    return;
+  }
+
   // Unmap all mapped memory pages:
   for(auto& mem : _mappedMemory) {
     LOG(TRACE) << "Unmapping memory at " << std::hex << mem.first.getBaseAddress() << std::dec;
@@ -38,51 +61,121 @@ std::pair<size_t, uint32_t> iface_mem::write(const memory_map& mem, const std::p
              << dest.first << std::dec << ": " << dest.second;
   volatile uint32_t* reg =
     reinterpret_cast<volatile uint32_t*>(reinterpret_cast<std::intptr_t>(mapMemory(mem)) + mem.getOffset() + dest.first);
-  *reg = dest.second;
+  if(_emulated) {
+    carboard_emulator::getInstance().writeMemory(physicalAddress(mem, dest.first), reg, dest.second);
+  } else {
+    *reg = dest.second;
+  }
   return std::pair<size_t, uint32_t>();
 }
 
 uint32_t iface_mem::readWord(const memory_map& mem, const size_t offset) {
   volatile uint32_t* reg =
     reinterpret_cast<volatile uint32_t*>(reinterpret_cast<std::intptr_t>(mapMemory(mem)) + mem.getOffset() + offset);
-  uint32_t value = *reg;
+  uint32_t value = _emulated ? carboard_emulator::getInstance().readMemory(physicalAddress(mem, offset), reg) : *reg;
   LOG(TRACE) << "Reading from mapped memory at 0x" << std::hex << mem.getBaseAddress() << "+" << mem.getOffset()
              << ", offset " << offset << std::dec << ": " << value;
   return value;
 }
 
 std::vector<uint32_t> iface_mem::read(const memory_map& mem, const size_t offset, const unsigned int n) {
-  std::vector<uint32_t> values;
-  for(unsigned int i = 0; i < n; i++) {
-    values.push_back(this->readWord(mem, offset));
-  }
+  std::vector<uint32_t> values(n);
+  readFifo(mem, offset, values.data(), values.size());
   return values;
 }
 
-void* iface_mem::mapMemory(const memory_map& page) {
+void iface_mem::readFifo(const memory_map& mem, const size_t offset, uint32_t* buffer, const size_t n) {
+  volatile uint32_t* reg =
+    reinterpret_cast<volatile uint32_t*>(reinterpret_cast<std::intptr_t>(mapMemory(mem)) + mem.getOffset() + offset);
+  if(_emulated) {
+    carboard_emulator& emulator = carboard_emulator::getInstance();
+    for(size_t i = 0; i < n; i++) {
+      buffer[i] = emulator.readMemory(physicalAddress(mem, offset), reg);
+    }
+  } else {
+    for(size_t i = 0; i < n; i++) {
+      buffer[i] = *reg;
+    }
+  }
+  LOG(TRACE) << "Read " << n << " words from FIFO in mapped memory at 0x" << std::hex << mem.getBaseAddress() << "+"
+             << mem.getOffset() << ", offset " << offset << std::dec;
+}
 
-  // Check if this memory page is already mapped and return the pointer:
-  LOG(TRACE) << "Returning mapped memory at 0x" << std::hex << page.getBaseAddress() << "+" << page.getOffset() << std::dec;
-  try {
-    return _mappedMemory.at(page);
+void iface_mem::readBlock(const memory_map& mem, const size_t offset, uint32_t* buffer, const size_t n) {
+  // The window has to stay within the mapped page:
+  const std::size_t end = (mem.getBaseAddress() & mem.getMask()) + mem.getOffset() + offset + n * sizeof(uint32_t);
+  if(end > mem.getSize()) {
+    throw CommunicationError("Memory block of " + std::to_string(n) + " words at offset " + to_hex_string(offset) +
+                             " exceeds the mapped page of size " + to_hex_string(mem.getSize()));
   }
-  // Otherwise newly map it and return the reference:
-  catch(const std::out_of_range& oor) {
-    LOG(TRACE) << "Memory was not yet mapped, mapping...";
-    // Map one page of memory into user space such that the device is in that page, but it may not
-    // be at the start of the page.
-    void* map_base = mmap(0, page.getSize(), page.getFlags(), MAP_SHARED, _memfd, page.getBaseAddress() & ~page.getMask());
-    if(map_base == (void*)-1) {
-      throw DeviceException("Can't map the memory to user space.\n");
+
+  volatile uint32_t* reg =
+    reinterpret_cast<volatile uint32_t*>(reinterpret_cast<std::intptr_t>(mapMemory(mem)) + mem.getOffset() + offset);
+  if(_emulated) {
+    carboard_emulator& emulator = carboard_emulator::getInstance();
+    for(size_t i = 0; i < n; i++) {
+      buffer[i] = emulator.readMemory(physicalAddress(mem, offset + i * sizeof(uint32_t)), reg + i);
+    }
+  } else {
+    for(size_t i = 0; i < n; i++) {
+      buffer[i] = reg[i];
     }
+  }
+  LOG(TRACE) << "Read block of " << n << " words from mapped memory at 0x" << std::hex << mem.getBaseAddress() << "+"
+             << mem.getOffset() << ", offset " << offset << std::dec;
+}
+
+memory_handle iface_mem::getHandle(const memory_map& mem) {
+  const std::size_t start = (mem.getBaseAddress() & mem.getMask()) + mem.getOffset();
+  if(start + sizeof(uint32_t) > mem.getSize()) {
+    throw CommunicationError("Register offset " + to_hex_string(mem.getOffset()) + " outside of mapped page of size " +
+                             to_hex_string(mem.getSize()));
+  }
 
-    // get the address of the device in user space which will be an offset from the base
-    // that was mapped as memory is mapped at the start of a page
-    void* base_pointer =
-      reinterpret_cast<void*>(reinterpret_cast<std::intptr_t>(map_base) + (page.getBaseAddress() & page.getMask()));
+  volatile uint32_t* reg =
+    reinterpret_cast<volatile uint32_t*>(reinterpret_cast<std::intptr_t>(mapMemory(mem)) + mem.getOffset());
+  if(_emulated) {
+    return memory_handle(reg,
+                         mem.getSize() - start,
+                         mem.writable(),
+                         carboard_emulator::getInstance().memoryPort(reg, physicalAddress(mem, 0)));
+  }
+  return memory_handle(reg, mem.getSize() - start, mem.writable());
+}
 
-    // Store the mapped memory, so we can unmap it later:
+void* iface_mem::mapMemory(const memory_map& page) {
+
+  // Check if this memory page is already mapped and return the pointer:
+  auto mapped = _mappedMemory.find(page);
+  if(mapped != _mappedMemory.end()) {
+    return mapped->second;
+  }
+
+  // Emulated pages are backed by zero-initialized memory:
+  if(_emulated) {
+    LOG(TRACE) << "Allocating emulated memory page at 0x" << std::hex << page.getBaseAddress() << std::dec;
+    uint8_t* map_base = new uint8_t[page.getSize()]();
+    void* base_pointer = reinterpret_cast<void*>(reinterpret_cast<std::intptr_t>(map_base) +
+                                                 (page.getBaseAddress() & page.getMask()));
     _mappedMemory[page] = base_pointer;
     return base_pointer;
   }
+
+  // Otherwise newly map it and return the reference:
+  LOG(TRACE) << "Memory at 0x" << std::hex << page.getBaseAddress() << std::dec << " was not yet mapped, mapping...";
+  // Map one page of memory into user space such that the device is in that page, but it may not
+  // be at the start of the page.
+  void* map_base = mmap(0, page.getSize(), page.getFlags(), MAP_SHARED, _memfd, page.getBaseAddress() & ~page.getMask());
+  if(map_base == (void*)-1) {
+    throw DeviceException("Can't map the memory to user space.\n");
+  }
+
+  // get the address of the device in user space which will be an offset from the base
+  // that was mapped as memory is mapped at the start of a page
+  void* base_pointer =
+    reinterpret_cast<void*>(reinterpret_cast<std::intptr_t>(map_base) + (page.getBaseAddress() & page.getMask()));
+
+  // Store the mapped memory, so we can unmap it later:
+  _mappedMemory[page] = base_pointer;
+  return base_pointer;
 }
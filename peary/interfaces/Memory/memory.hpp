@@ -3,6 +3,7 @@
 
 #include <cstdint>
 #include <fcntl.h>
+#include <memory>
 #include <mutex>
 #include <stdio.h>
 #include <string>
@@ -13,9 +14,115 @@
 #include "interfaces/InterfaceManager.hpp"
 #include "utils/datatypes.hpp"
 #include "utils/exceptions.hpp"
+#include "utils/utils.hpp"
 
 namespace caribou {
 
+  /** Register which is not accessed through a pointer into mapped memory, used by the CaR board emulator
+   */
+  class memory_port {
+  public:
+    virtual ~memory_port() {}
+    virtual uint32_t read(const size_t offset) = 0;
+    virtual void write(const size_t offset, const uint32_t value) = 0;
+  };
+
+  /** Pre-resolved handle to a memory mapped FPGA register
+   *
+   *  The handle holds a direct pointer into the mapped memory page together with the number of bytes accessible from the
+   *  register to the end of the page. Accessing the register through the handle does not involve any name lookup or
+   *  interface call, so handles should be used in readout and polling loops. Handles remain valid for the lifetime of the
+   *  memory interface which created them. Only with emulated memory, registers are accessed through the emulator instead.
+   */
+  class memory_handle {
+  public:
+    memory_handle() : _reg(nullptr), _size(0), _writable(false){};
+
+    /** Read the register the handle points to
+     */
+    uint32_t read() const {
+      if(_port) {
+        return _port->read(0);
+      }
+      return *_reg;
+    }
+
+    /** Read the word at the given byte offset from the register
+     *
+     *  It can throw CommunicationError if the offset lies outside the mapped page.
+     */
+    uint32_t read(const size_t offset) const {
+      volatile uint32_t* reg = address(offset);
+      if(_port) {
+        return _port->read(offset);
+      }
+      return *reg;
+    }
+
+    /** Read n words from the register into the provided buffer, treating it as a FIFO port
+     */
+    void read(uint32_t* buffer, const size_t n) const {
+      if(_port) {
+        for(size_t i = 0; i < n; i++) {
+          buffer[i] = _port->read(0);
+        }
+        return;
+      }
+      for(size_t i = 0; i < n; i++) {
+        buffer[i] = *_reg;
+      }
+    }
+
+    /** Write to the register the handle points to
+     *
+     *  It can throw CommunicationError if the memory page has not been mapped writable.
+     */
+    void write(const uint32_t value) const { write(0, value); }
+
+    /** Write to the word at the given byte offset from the register
+     *
+     *  It can throw CommunicationError if the offset lies outside the mapped page or if the page is not writable.
+     */
+    void write(const size_t offset, const uint32_t value) const {
+      if(!_writable) {
+        throw CommunicationError("Memory page is not mapped writable");
+      }
+      volatile uint32_t* reg = address(offset);
+      if(_port) {
+        _port->write(offset, value);
+        return;
+      }
+      *reg = value;
+    }
+
+    /** Number of bytes accessible from the register to the end of the mapped page
+     */
+    size_t size() const { return _size; }
+    bool writable() const { return _writable; }
+    bool valid() const { return _reg != nullptr; }
+
+  private:
+    memory_handle(volatile uint32_t* reg, const size_t size, const bool writable)
+        : _reg(reg), _size(size), _writable(writable){};
+    memory_handle(volatile uint32_t* reg, const size_t size, const bool writable, std::shared_ptr<memory_port> port)
+        : _reg(reg), _size(size), _writable(writable), _port(std::move(port)){};
+
+    volatile uint32_t* address(const size_t offset) const {
+      if(offset + sizeof(uint32_t) > _size) {
+        throw CommunicationError("Memory offset " + to_hex_string(offset) + " outside of mapped page");
+      }
+      return reinterpret_cast<volatile uint32_t*>(reinterpret_cast<std::intptr_t>(_reg) + offset);
+    }
+
+    volatile uint32_t* _reg;
+    size_t _size;
+    bool _writable;
+    // Set if the register has to be accessed through the interface
+    std::shared_ptr<memory_port> _port;
+
+    friend class iface_mem;
+  };
+
   class iface_mem : public Interface<memory_map, size_t, uint32_t> {
 
   private:
@@ -32,6 +139,9 @@ namespace caribou {
     // Buffer
     std::map<memory_map, void*> _mappedMemory;
 
+    // Set if the CaR board emulator has been selected at runtime in place of the FPGA
+    bool _emulated{false};
+
     // Protects access to the bus
     std::mutex mutex;
 
@@ -43,6 +153,25 @@ namespace caribou {
     uint32_t readWord(const memory_map&, const size_t);
     std::vector<uint32_t> read(const memory_map&, const size_t, const unsigned int);
 
+    /* Read n words from a FIFO port into the caller-provided buffer
+     *
+     * The memory page is resolved once and all words are read from the same offset.
+     */
+    void readFifo(const memory_map&, const size_t offset, uint32_t* buffer, const size_t n);
+
+    /* Read a contiguous window of n words into the caller-provided buffer
+     *
+     * The memory page is resolved once and the offset is incremented by one word per read.
+     * It can throw CommunicationError if the window exceeds the mapped page.
+     */
+    void readBlock(const memory_map&, const size_t offset, uint32_t* buffer, const size_t n);
+
+    /* Resolve the memory page and return a handle pointing directly to the register
+     *
+     * It can throw CommunicationError if the register offset lies outside the mapped page.
+     */
+    memory_handle getHandle(const memory_map&);
+
     void* mapMemory(const memory_map&);
 
     // Remove default constructor
@@ -7,6 +7,7 @@
 #include <utility>
 
 #include "spi.hpp"
+#include "carboard/emulator.hpp"
 #include "utils/log.hpp"
 #include "utils/utils.hpp"
 
@@ -29,6 +30,9 @@ std::pair<spi_reg_t, spi_t> iface_spi::write(const spi_address_t& address, const
              << to_hex_string(data.first) << " Wrote data \"" << to_hex_string(data.second) << "\" Read data \""
              << to_hex_string(rx.second) << "\"";
 
+  carboard_emulator& emulator = carboard_emulator::getInstance();
+  emulator.setSPIRegister(devicePath(), data.first, data.second);
+  emulator.spi(sizeof(spi_reg_t) + sizeof(spi_t));
   return rx;
 }
 
@@ -87,10 +91,48 @@ std::vector<std::pair<spi_reg_t, spi_t>> iface_spi::write(const spi_address_t& a
              << "\n\t Wrote block data (Reg: data): \"" << listVector(data, ", ", true)
              << "\"\n\t Read  block data (Reg: data): \"" << listVector(rx, ", ", true) << "\"";
 
+  carboard_emulator& emulator = carboard_emulator::getInstance();
+  for(const auto& reg : data) {
+    emulator.setSPIRegister(devicePath(), reg.first, reg.second);
+  }
+  emulator.spi(_data.size());
   return rx;
 }
 
 std::vector<spi_t> iface_spi::read(const spi_address_t& address, const spi_reg_t reg, const unsigned int length) {
-  std::vector<spi_t> rx(length);
-  return write(address, reg, rx);
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  // Reads return the value last written to the register:
+  carboard_emulator& emulator = carboard_emulator::getInstance();
+  uint32_t value = 0;
+  emulator.getSPIRegister(devicePath(), reg, value);
+  std::vector<spi_t> rx(length, static_cast<spi_t>(value));
+  emulator.spi((sizeof(spi_reg_t) + sizeof(spi_t)) * length);
+
+  LOG(TRACE) << "SPI/emu (" << devicePath() << ") address " << to_hex_string(address) << ": Register "
+             << to_hex_string(reg) << " Read data \"" << listVector(rx, ", ", true) << "\"";
+
+  return rx;
+}
+
+std::vector<spi_t> iface_spi::read(const spi_address_t& address, const std::vector<spi_reg_t>& regs) {
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  // Reads return the values last written to the registers, all registers are read in a single transfer:
+  carboard_emulator& emulator = carboard_emulator::getInstance();
+  std::vector<spi_t> rx;
+  rx.reserve(regs.size());
+  for(const auto& reg : regs) {
+    uint32_t value = 0;
+    emulator.getSPIRegister(devicePath(), reg, value);
+    rx.push_back(static_cast<spi_t>(value));
+  }
+  emulator.spi((sizeof(spi_reg_t) + sizeof(spi_t)) * regs.size());
+
+  LOG(TRACE) << "SPI/emu (" << devicePath() << ") address " << to_hex_string(address) << ": Registers \""
+             << listVector(regs, ", ", true) << "\" Read data \"" << listVector(rx, ", ", true) << "\"";
+
+  return rx;
 }
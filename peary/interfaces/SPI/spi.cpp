@@ -13,14 +13,21 @@
 #include <unistd.h>
 
 #include "spi.hpp"
+#include "carboard/emulator.hpp"
 #include "utils/log.hpp"
 #include "utils/utils.hpp"
 
 using namespace caribou;
 
-iface_spi::iface_spi(std::string const& device_path) : Interface(device_path), spiDesc() {
+iface_spi::iface_spi(std::string const& device_path) : Interface(device_path), spiDesc(-1) {
   std::lock_guard<std::mutex> lock(mutex);
 
+  if(carboard_emulator::selected()) {
+    emulated = true;
+    LOG(TRACE) << "Emulating SPI device at " << device_path;
+    return;
+  }
+
   // Open device
   if((spiDesc = open(devicePath().c_str(), O_RDWR)) < 0) {
     throw DeviceException("Open " + device_path + " device failed. " + std::strerror(spiDesc));
@@ -35,12 +42,36 @@ iface_spi::iface_spi(std::string const& device_path) : Interface(device_path), s
 }
 
 iface_spi::~iface_spi() {
-  close(spiDesc);
+  if(!emulated) {
+    close(spiDesc);
+  }
+}
+
+std::vector<std::pair<spi_reg_t, spi_t>> iface_spi::emulate(const std::vector<std::pair<spi_reg_t, spi_t>>& data,
+                                                            const size_t bytes) {
+  carboard_emulator& emulator = carboard_emulator::getInstance();
+  std::vector<std::pair<spi_reg_t, spi_t>> rx;
+  rx.reserve(data.size());
+  for(const auto& reg : data) {
+    uint32_t value = 0;
+    emulator.getSPIRegister(devicePath(), reg.first, value);
+    emulator.setSPIRegister(devicePath(), reg.first, reg.second);
+    rx.push_back(std::make_pair(reg.first, static_cast<spi_t>(value)));
+  }
+  emulator.spi(bytes);
+  return rx;
 }
 
 std::pair<spi_reg_t, spi_t> iface_spi::write(const spi_address_t&, const std::pair<spi_reg_t, spi_t>& data) {
 
   std::lock_guard<std::mutex> lock(mutex);
+  if(emulated) {
+    std::pair<spi_reg_t, spi_t> rx = emulate({data}, sizeof(spi_reg_t) + sizeof(spi_t)).front();
+    LOG(TRACE) << "SPI/emu device " << devicePath() << ": Register " << to_hex_string(data.first) << " Wrote data \""
+               << to_hex_string(data.second) << "\" Read data \"" << to_hex_string(rx.second) << "\"";
+    return rx;
+  }
+
   std::array<uint8_t, sizeof(spi_reg_t) + sizeof(spi_t)> _data;
 
   std::memcpy(_data.data(), &data.second, sizeof(spi_t));
@@ -86,6 +117,13 @@ std::vector<std::pair<spi_reg_t, spi_t>> iface_spi::write(const spi_address_t&,
                                                           const std::vector<std::pair<spi_reg_t, spi_t>>& data) {
 
   std::lock_guard<std::mutex> lock(mutex);
+  if(emulated) {
+    std::vector<std::pair<spi_reg_t, spi_t>> rx = emulate(data, (sizeof(spi_reg_t) + sizeof(spi_t)) * data.size());
+    LOG(TRACE) << "SPI/emu device " << devicePath() << ": \n\t Wrote block data (Reg: data): \""
+               << listVector(data, ", ", true) << "\"\n\t Read  block data (Reg: data): \"" << listVector(rx, ", ", true)
+               << "\"";
+    return rx;
+  }
 
   std::vector<uint8_t> _data((sizeof(spi_reg_t) + sizeof(spi_t)) * data.size());
   std::unique_ptr<spi_ioc_transfer[]> tr(new spi_ioc_transfer[data.size()]());
@@ -144,3 +182,38 @@ std::vector<spi_t> iface_spi::read(const spi_address_t& address, const spi_reg_t
 
   return data;
 }
+
+std::vector<spi_t> iface_spi::read(const spi_address_t& address, const std::vector<spi_reg_t>& regs) {
+  // Same workaround as for single registers, but each transfer writes back the value of the previous register together
+  // with reading the next one. Only one register at a time holds "0" instead of its value.
+  std::vector<spi_t> values;
+  if(regs.empty()) {
+    return values;
+  }
+  values.reserve(regs.size());
+  for(size_t i = 0; i <= regs.size(); i++) {
+    std::vector<std::pair<spi_reg_t, spi_t>> data;
+    if(i > 0) {
+      data.push_back(std::make_pair(regs[i - 1], values.back()));
+    }
+    if(i < regs.size()) {
+      data.push_back(std::make_pair(regs[i], spi_t()));
+    }
+
+    std::vector<std::pair<spi_reg_t, spi_t>> rx;
+    try {
+      rx = write(address, data);
+    } catch(CommunicationError& e) {
+      if(i == 0) {
+        throw;
+      }
+      throw CommunicationError("Failed to restore register " + to_hex_string(regs[i - 1]) + " after reading it: " +
+                               e.what());
+    }
+    if(i < regs.size()) {
+      values.push_back(rx.back().second);
+    }
+  }
+
+  return values;
+}
@@ -30,6 +30,9 @@ namespace caribou {
     // Descriptor of the device
     int spiDesc;
 
+    // Set if the CaR board emulator has been selected at runtime in place of the device
+    bool emulated{false};
+
     // Protects access to the bus
     std::mutex mutex;
 
@@ -49,6 +52,15 @@ namespace caribou {
     std::vector<std::pair<spi_reg_t, spi_t>> write(const spi_address_t& address,
                                                    const std::vector<std::pair<spi_reg_t, spi_t>>& data);
     std::vector<spi_t> read(const spi_address_t& address, const spi_reg_t reg, const unsigned int length = 1);
+    std::vector<spi_t> read(const spi_address_t& address, const std::vector<spi_reg_t>& regs);
+
+    /* Exchange the register words with the chip emulated by the CaR board emulator, requires the bus lock
+     *
+     * Every word returns the previous value of its register like the chip does, the transfer is accounted with the
+     * given number of bytes.
+     */
+    std::vector<std::pair<spi_reg_t, spi_t>> emulate(const std::vector<std::pair<spi_reg_t, spi_t>>& data,
+                                                     const size_t bytes);
 
     // Unused constructor
     iface_spi() = delete;
@@ -7,6 +7,7 @@
 #include <utility>
 
 #include "spi_CLICpix2.hpp"
+#include "carboard/emulator.hpp"
 #include "utils/log.hpp"
 #include "utils/utils.hpp"
 
@@ -23,6 +24,9 @@ std::pair<spi_reg_t, spi_t> iface_spi_CLICpix2::write(const spi_address_t& addre
              << to_hex_string(data.first) << " Wrote data \"" << to_hex_string(data.second) << "\" Read data \""
              << to_hex_string(rx.second) << "\"";
 
+  carboard_emulator& emulator = carboard_emulator::getInstance();
+  emulator.setSPIRegister(devicePath(), data.first, data.second);
+  emulator.spi(sizeof(spi_reg_t) + sizeof(spi_t));
   return rx;
 }
 
@@ -63,5 +67,10 @@ std::vector<std::pair<spi_reg_t, spi_t>> iface_spi_CLICpix2::write(const spi_add
              << "\n\t Wrote block data (Reg: data): \"" << listVector(data, ", ", true)
              << "\"\n\t Read  block data (Reg: data): \"" << listVector(rx, ", ", true) << "\"";
 
+  carboard_emulator& emulator = carboard_emulator::getInstance();
+  for(const auto& reg : data) {
+    emulator.setSPIRegister(devicePath(), reg.first, reg.second);
+  }
+  emulator.spi(_data.size());
   return rx;
 }
@@ -21,6 +21,12 @@ using namespace caribou;
 std::pair<spi_reg_t, spi_t> iface_spi_CLICpix2::write(const spi_address_t&, const std::pair<spi_reg_t, spi_t>& data) {
 
   std::lock_guard<std::mutex> lock(mutex);
+  if(emulated) {
+    std::pair<spi_reg_t, spi_t> rx = emulate({data}, 2 * (sizeof(spi_reg_t) + sizeof(spi_t))).front();
+    LOG(TRACE) << "SPI/CP2/emu device " << devicePath() << ": Register " << to_hex_string(data.first) << " Wrote data \""
+               << to_hex_string(data.second) << "\" Read data \"" << to_hex_string(rx.second) << "\"";
+    return rx;
+  }
   std::array<uint8_t, 2 * (sizeof(spi_reg_t) + sizeof(spi_t))> _data;
 
   std::memcpy(_data.data(), &data.second, sizeof(spi_t));
@@ -51,6 +57,13 @@ std::vector<std::pair<spi_reg_t, spi_t>> iface_spi_CLICpix2::write(const spi_add
                                                                    const std::vector<std::pair<spi_reg_t, spi_t>>& data) {
 
   std::lock_guard<std::mutex> lock(mutex);
+  if(emulated) {
+    std::vector<std::pair<spi_reg_t, spi_t>> rx = emulate(data, 2 * (sizeof(spi_reg_t) + sizeof(spi_t)) * data.size());
+    LOG(TRACE) << "SPI/CP2/emu device " << devicePath() << ": \n\t Wrote block data (Reg: data): \""
+               << listVector(data, ", ", true) << "\"\n\t Read  block data (Reg: data): \"" << listVector(rx, ", ", true)
+               << "\"";
+    return rx;
+  }
 
   std::vector<uint8_t> _data(2 * (sizeof(spi_reg_t) + sizeof(spi_t)) * data.size(), 0);
   std::unique_ptr<spi_ioc_transfer[]> tr(new spi_ioc_transfer[data.size()]());
@@ -0,0 +1,174 @@
+#include "asyncwriter.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <unistd.h>
+
+#include "exceptions.hpp"
+#include "log.hpp"
+
+using namespace caribou;
+
+namespace {
+  // Time the writer thread waits for a full block to be buffered before writing a partial block anyway
+  const std::chrono::milliseconds WRITER_FLUSH_TIMEOUT(100);
+
+  // Head position the writer thread waits for while it is not waiting at all
+  const size_t WRITER_AWAKE = std::numeric_limits<size_t>::max();
+} // namespace
+
+async_writer::sync_policy async_writer::getSyncPolicy(const std::string& name) {
+  if(name == "never") {
+    return sync_policy::never;
+  } else if(name == "block") {
+    return sync_policy::block;
+  } else if(name == "close") {
+    return sync_policy::close;
+  }
+  throw ConfigInvalid("Unknown sync policy \"" + name + "\"");
+}
+
+async_writer::async_writer(const std::string& filename, sync_policy policy, size_t buffer_size, size_t block_size)
+    : _policy(policy), _wake_at(WRITER_AWAKE) {
+  size_t size = 1;
+  while(size < buffer_size) {
+    size <<= 1;
+  }
+  _ring.resize(size);
+  _mask = size - 1;
+  _block_size = std::min(std::max<size_t>(block_size, 1), size / 2);
+
+  _fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if(_fd < 0) {
+    throw DataException("Could not open \"" + filename + "\" for writing: " + std::strerror(errno));
+  }
+
+  _thread = std::thread(&async_writer::run, this);
+  LOG(DEBUG) << "Opened " << filename << " for asynchronous writing with " << size << " bytes buffer";
+}
+
+async_writer::~async_writer() {
+  close();
+}
+
+void async_writer::write(const void* data, size_t size) {
+  if(_closing) {
+    throw DataException("Writing to a file which has been closed already");
+  }
+
+  const char* src = static_cast<const char*>(data);
+  size_t head = _head.load(std::memory_order_relaxed);
+  bool stalled = false;
+
+  while(size > 0) {
+    const size_t space = _ring.size() - (head - _tail.load(std::memory_order_acquire));
+    if(space == 0) {
+      // Ring buffer is full, wait for the writer thread:
+      if(!stalled) {
+        stalled = true;
+        _stalls++;
+      }
+      std::this_thread::yield();
+      continue;
+    }
+
+    // Copy as much as fits, in up to two parts if the ring wraps around:
+    const size_t chunk = std::min(size, space);
+    const size_t offset = head & _mask;
+    const size_t first = std::min(chunk, _ring.size() - offset);
+    std::memcpy(&_ring[offset], src, first);
+    std::memcpy(&_ring[0], src + first, chunk - first);
+
+    head += chunk;
+    src += chunk;
+    size -= chunk;
+    _head.store(head);
+
+    // Wake up the writer thread if it waits for this data, the lock ensures it is either waiting or sees the new head:
+    if(head >= _wake_at) {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _condition.notify_one();
+    }
+  }
+}
+
+void async_writer::close() {
+  if(!_thread.joinable()) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _closing = true;
+  }
+  _condition.notify_one();
+  _thread.join();
+
+  if(_policy != sync_policy::never && ::fsync(_fd) != 0) {
+    LOG(ERROR) << "Failed to synchronize written data: " << std::strerror(errno);
+    _failed = true;
+  }
+  if(::close(_fd) != 0) {
+    LOG(ERROR) << "Failed to close file: " << std::strerror(errno);
+    _failed = true;
+  }
+
+  if(_stalls > 0) {
+    LOG(WARNING) << "Writer buffer was full " << _stalls << " times, data taking had to wait for the disk";
+  }
+}
+
+void async_writer::run() {
+  size_t tail = _tail.load(std::memory_order_relaxed);
+
+  while(true) {
+    {
+      // Wait for data, then for a full block unless closing or the data has been waiting for a while:
+      std::unique_lock<std::mutex> lock(_mutex);
+      _wake_at = tail + 1;
+      _condition.wait(lock, [&]() { return _closing || _head != tail; });
+      _wake_at = tail + _block_size;
+      _condition.wait_for(lock, WRITER_FLUSH_TIMEOUT, [&]() { return _closing || _head - tail >= _block_size; });
+      _wake_at = WRITER_AWAKE;
+    }
+
+    size_t available = _head.load(std::memory_order_acquire) - tail;
+    if(available == 0) {
+      break;
+    }
+
+    // Write full blocks, and all buffered data if less than a block was collected in time:
+    const bool flush = available < _block_size;
+    while(available >= _block_size || (flush && available > 0)) {
+      // Write one contiguous part of the ring:
+      const size_t offset = tail & _mask;
+      const size_t size = std::min({available, _block_size, _ring.size() - offset});
+      size_t written = 0;
+      while(!_failed && written < size) {
+        const ssize_t ret = ::write(_fd, &_ring[offset + written], size - written);
+        if(ret < 0) {
+          if(errno == EINTR) {
+            continue;
+          }
+          // Keep draining the buffer to not block the producer, but drop the data:
+          LOG(ERROR) << "Failed to write data: " << std::strerror(errno) << ", discarding further data";
+          _failed = true;
+          break;
+        }
+        written += static_cast<size_t>(ret);
+      }
+      if(!_failed && _policy == sync_policy::block && ::fsync(_fd) != 0) {
+        LOG(ERROR) << "Failed to synchronize written data: " << std::strerror(errno) << ", discarding further data";
+        _failed = true;
+      }
+
+      tail += size;
+      available -= size;
+      _tail.store(tail, std::memory_order_release);
+    }
+  }
+}
@@ -0,0 +1,108 @@
+/** Asynchronous buffered file writer
+ *
+ *  Data written by a single producer (usually a DAQ thread) is copied into a lock-free ring buffer and written to disk
+ *  in large blocks by a dedicated writer thread, such that the producer never waits for the storage device as long as the
+ *  ring has free space.
+ */
+
+#ifndef CARIBOU_ASYNCWRITER_H
+#define CARIBOU_ASYNCWRITER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace caribou {
+
+  class async_writer {
+  public:
+    /** Policy for synchronizing the written data to the storage device
+     *
+     *  - never: leave it to the operating system
+     *  - block: call fsync() after every block written
+     *  - close: call fsync() once when closing the file
+     */
+    enum class sync_policy { never, block, close };
+
+    /**
+     * @brief Convert the name of a sync policy ("never", "block", "close") as used in configuration files
+     * @throws ConfigInvalid if the name is unknown
+     */
+    static sync_policy getSyncPolicy(const std::string& name);
+
+    /**
+     * @brief Open the output file and start the writer thread
+     * @param filename Path of the file to be written, existing files are overwritten
+     * @param policy Synchronization policy for the written data
+     * @param buffer_size Size of the ring buffer in bytes, rounded up to a power of two
+     * @param block_size Amount of data the writer thread collects before writing it
+     * @throws DataException if the file cannot be opened for writing
+     */
+    async_writer(const std::string& filename,
+                 sync_policy policy = sync_policy::close,
+                 size_t buffer_size = 16 * 1024 * 1024,
+                 size_t block_size = 1024 * 1024);
+
+    /**
+     * @brief Destructor drains the buffer and closes the file if not done yet
+     */
+    ~async_writer();
+
+    async_writer(const async_writer&) = delete;
+    async_writer& operator=(const async_writer&) = delete;
+
+    /**
+     * @brief Append data to the file. Only waits for the writer thread if the ring buffer is full
+     * @param data Pointer to the data
+     * @param size Number of bytes
+     * @throws DataException if the file has been closed already
+     */
+    void write(const void* data, size_t size);
+    void write(const std::string& data) { write(data.data(), data.size()); }
+
+    /**
+     * @brief Write all buffered data, synchronize according to the policy and close the file
+     */
+    void close();
+
+    /**
+     * @brief Number of write calls which had to wait for free space in the ring buffer
+     */
+    uint64_t stalls() const { return _stalls; }
+
+    /**
+     * @brief False if writing, synchronizing or closing the file failed, the data written since then is lost
+     */
+    bool good() const { return !_failed; }
+
+  private:
+    void run();
+
+    int _fd;
+    sync_policy _policy;
+    size_t _block_size;
+
+    // Ring buffer with free-running positions, the head is advanced by the producer, the tail by the writer thread
+    std::vector<char> _ring;
+    size_t _mask;
+    std::atomic<size_t> _head{0};
+    std::atomic<size_t> _tail{0};
+
+    std::atomic<bool> _closing{false};
+    std::atomic<bool> _failed{false};
+    std::atomic<uint64_t> _stalls{0};
+    std::thread _thread;
+
+    // The writer thread sleeps on the condition until the head reaches the position it waits for
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    std::atomic<size_t> _wake_at;
+  };
+
+} // namespace caribou
+
+#endif /* CARIBOU_ASYNCWRITER_H */
@@ -4,13 +4,16 @@
 #ifndef CARIBOU_DATATYPES_H
 #define CARIBOU_DATATYPES_H
 
+#include <algorithm>
 #include <iostream>
 #include <limits>
 #include <map>
 #include <memory>
+#include <numeric>
 #include <strings.h>
 #include <sys/mman.h>
 #include <tuple>
+#include <vector>
 
 namespace caribou {
 
@@ -63,6 +66,168 @@ namespace caribou {
    */
   typedef std::map<std::pair<uint16_t, uint16_t>, std::unique_ptr<pixel>> pearydata;
 
+  /** Flat hit container returned by the peary device interface
+   *
+   *  Stores pixel hits as separate arrays (struct of arrays) of column, row, raw pixel word and the decoded fields. Hits are
+   *  appended without any per-hit allocation, the container can be reused for subsequent frames by calling clear(), which
+   *  keeps the reserved memory. Hits are kept in insertion order, sort() orders them by pixel (column first, then row) as
+   *  the pearydata map does.
+   */
+  class pearyhits {
+  public:
+    /** Single hit as returned when accessing or iterating the container
+     */
+    struct hit {
+      uint16_t column;
+      uint16_t row;
+      uint32_t raw;
+      uint16_t tot;
+      uint16_t toa;
+      uint16_t cnt;
+      bool longcnt;
+    };
+
+    class const_iterator {
+    public:
+      const_iterator(const pearyhits* hits, size_t index) : _hits(hits), _index(index){};
+      hit operator*() const { return (*_hits)[_index]; }
+      const_iterator& operator++() {
+        ++_index;
+        return *this;
+      }
+      bool operator==(const const_iterator& other) const { return _index == other._index; }
+      bool operator!=(const const_iterator& other) const { return _index != other._index; }
+
+    private:
+      const pearyhits* _hits;
+      size_t _index;
+    };
+
+    void reserve(size_t n) {
+      _column.reserve(n);
+      _row.reserve(n);
+      _raw.reserve(n);
+      _tot.reserve(n);
+      _toa.reserve(n);
+      _cnt.reserve(n);
+      _longcnt.reserve(n);
+    }
+
+    /** Remove all hits but keep the allocated memory for reuse
+     */
+    void clear() {
+      _column.clear();
+      _row.clear();
+      _raw.clear();
+      _tot.clear();
+      _toa.clear();
+      _cnt.clear();
+      _longcnt.clear();
+      _sorted = true;
+    }
+
+    size_t size() const { return _column.size(); }
+    bool empty() const { return _column.empty(); }
+
+    void add(uint16_t column,
+             uint16_t row,
+             uint32_t raw,
+             uint16_t tot = 0,
+             uint16_t toa = 0,
+             uint16_t cnt = 0,
+             bool longcnt = false) {
+      if(!_column.empty() && key(_column.size() - 1) >= (static_cast<uint32_t>(column) << 16 | row)) {
+        _sorted = false;
+      }
+      _column.push_back(column);
+      _row.push_back(row);
+      _raw.push_back(raw);
+      _tot.push_back(tot);
+      _toa.push_back(toa);
+      _cnt.push_back(cnt);
+      _longcnt.push_back(longcnt);
+    }
+
+    hit operator[](size_t i) const {
+      return hit{_column[i], _row[i], _raw[i], _tot[i], _toa[i], _cnt[i], static_cast<bool>(_longcnt[i])};
+    }
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, size()); }
+
+    /// @{
+    /**
+     * @brief Direct access to the individual columns of the container
+     */
+    const std::vector<uint16_t>& columns() const { return _column; }
+    const std::vector<uint16_t>& rows() const { return _row; }
+    const std::vector<uint32_t>& raw() const { return _raw; }
+    const std::vector<uint16_t>& tot() const { return _tot; }
+    const std::vector<uint16_t>& toa() const { return _toa; }
+    const std::vector<uint16_t>& cnt() const { return _cnt; }
+    /// @}
+
+    /// @{
+    /**
+     * @brief Mutable access to the decoded fields, e.g. for decoding all hits of a frame in one go. The number of entries
+     * must not be changed.
+     */
+    uint16_t* tot() { return _tot.data(); }
+    uint16_t* toa() { return _toa.data(); }
+    uint16_t* cnt() { return _cnt.data(); }
+    /// @}
+
+    /** Order hits by pixel address, column first and row second. Does nothing if the hits are already ordered.
+     */
+    void sort() {
+      if(_sorted) {
+        return;
+      }
+      _order.resize(size());
+      std::iota(_order.begin(), _order.end(), 0);
+      std::sort(_order.begin(), _order.end(), [this](size_t a, size_t b) { return key(a) < key(b); });
+      permute(_column);
+      permute(_row);
+      permute(_raw);
+      permute(_tot);
+      permute(_toa);
+      permute(_cnt);
+      permute(_longcnt);
+      _sorted = true;
+    }
+
+    /** Convert to the pearydata map, the provided function creates the device-specific pixel object for every hit
+     */
+    template <typename F> pearydata toPearydata(F make_pixel) const {
+      pearydata data;
+      for(size_t i = 0; i < size(); i++) {
+        data[std::make_pair(_column[i], _row[i])] = make_pixel((*this)[i]);
+      }
+      return data;
+    }
+
+  private:
+    uint32_t key(size_t i) const { return static_cast<uint32_t>(_column[i]) << 16 | _row[i]; }
+
+    template <typename V> void permute(std::vector<V>& values) {
+      std::vector<V> sorted(values.size());
+      for(size_t i = 0; i < _order.size(); i++) {
+        sorted[i] = values[_order[i]];
+      }
+      values.swap(sorted);
+    }
+
+    std::vector<uint16_t> _column;
+    std::vector<uint16_t> _row;
+    std::vector<uint32_t> _raw;
+    std::vector<uint16_t> _tot;
+    std::vector<uint16_t> _toa;
+    std::vector<uint16_t> _cnt;
+    std::vector<uint8_t> _longcnt;
+    std::vector<size_t> _order;
+    bool _sorted{true};
+  };
+
   /** class to store a register configuration
    *
    *  @param address Address of the register in question
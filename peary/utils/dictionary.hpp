@@ -4,8 +4,10 @@
 #include <algorithm>
 #include <initializer_list>
 #include <iostream>
+#include <limits>
 #include <map>
 #include <memory>
+#include <unordered_map>
 #include <vector>
 
 #include "constants.hpp"
@@ -23,12 +25,32 @@ namespace caribou {
     dictionary(const std::string& title) : _title(title){};
     virtual ~dictionary(){};
 
+    /**
+     * @brief Handle to an element, resolved once by name
+     *
+     * Handles index the elements directly and stay valid for the lifetime of the dictionary they were obtained from.
+     */
+    class key {
+      friend class dictionary;
+
+    public:
+      key() : _index(std::numeric_limits<size_t>::max()){};
+
+    private:
+      explicit key(size_t index) : _index(index){};
+      size_t _index;
+    };
+
     // Register new element:
     template <class C> void add(std::string name, const C elem) {
       std::transform(name.begin(), name.end(), name.begin(), ::tolower);
       auto ptr = std::make_shared<C>(elem);
       try {
-        _elements.insert(std::make_pair(name, std::dynamic_pointer_cast<T>(ptr)));
+        // As for a map, the first element registered with a given name is kept:
+        if(_index.emplace(name, _elements.size()).second) {
+          _elements.push_back(std::dynamic_pointer_cast<T>(ptr));
+          _names.push_back(name);
+        }
       } catch(...) {
         throw ConfigInvalid("Cannot insert " + _title + " with name \"" + name + "\" into dictionary");
       }
@@ -39,50 +61,65 @@ namespace caribou {
         add(i.first, i.second);
     }
 
-    // Return register config for the name in question:
-    T get(std::string name) const {
+    // Resolve the name to a handle for repeated lookups:
+    key id(std::string name) const {
       std::transform(name.begin(), name.end(), name.begin(), ::tolower);
-      try {
-        return (*_elements.at(name));
-      } catch(...) {
+      auto it = _index.find(name);
+      if(it == _index.end()) {
         throw ConfigInvalid(_title + " name \"" + name + "\" unknown");
       }
+      return key(it->second);
+    }
+
+    // Return element and its (lower-case) name for a handle:
+    const T& get(const key& id) const {
+      if(id._index >= _elements.size()) {
+        throw ConfigInvalid("Invalid " + _title + " handle");
+      }
+      return *_elements[id._index];
     }
+    const std::string& name(const key& id) const {
+      if(id._index >= _names.size()) {
+        throw ConfigInvalid("Invalid " + _title + " handle");
+      }
+      return _names[id._index];
+    }
+
+    // Return register config for the name in question:
+    T get(std::string name) const { return get(id(name)); }
 
     // Return shared pointer to component config for the name in question:
     template <typename C> std::shared_ptr<C> get(std::string name) const {
-      try {
-        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
-        std::shared_ptr<T> ptr = _elements.at(name);
-        if(std::dynamic_pointer_cast<C>(ptr)) {
-          return std::dynamic_pointer_cast<C>(ptr);
-        } else {
-          throw ConfigInvalid(_title + " cannot be cast");
-        }
-      } catch(...) {
-        throw ConfigInvalid(_title + " name \"" + name + "\" unknown");
+      std::shared_ptr<T> ptr = _elements[id(name)._index];
+      if(std::dynamic_pointer_cast<C>(ptr)) {
+        return std::dynamic_pointer_cast<C>(ptr);
+      } else {
+        throw ConfigInvalid(_title + " cannot be cast");
       }
     }
 
     // Check if register entry exists
     bool has(std::string name) const {
       std::transform(name.begin(), name.end(), name.begin(), ::tolower);
-      return !(_elements.find(name) == _elements.end());
+      return !(_index.find(name) == _index.end());
     }
 
     // Return all register names:
     std::vector<std::string> getNames() const {
-      std::vector<std::string> names;
-      for(auto element : _elements) {
-        names.push_back(element.first);
-      }
+      std::vector<std::string> names(_names);
+      std::sort(names.begin(), names.end());
       return names;
     }
 
   private:
-    /** Map fo human-readable names for periphery components
+    /** Elements and their names in order of registration, indexed by the handles
+     */
+    std::vector<std::shared_ptr<T>> _elements;
+    std::vector<std::string> _names;
+
+    /** Hash map of human-readable names for the elements
      */
-    std::map<std::string, std::shared_ptr<T>> _elements;
+    std::unordered_map<std::string, size_t> _index;
     std::string _title;
   };
 
@@ -1,5 +1,14 @@
 #include "lfsr.hpp"
 
+#include <array>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define LFSR_AVX2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 using namespace caribou;
 
 uint16_t LFSR::LUT13(uint16_t val) {
@@ -14,6 +23,87 @@ uint8_t LFSR::LUT5(uint8_t val) {
   return lfsr5_lut[val];
 }
 
+namespace {
+  // Lookup tables covering the full input range with 32bit entries as required for gathers. The all-ones state is not
+  // part of the XNOR LFSR sequence and decodes to zero.
+  template <size_t N, typename T> std::array<uint32_t, N> widen(const T* lut) {
+    std::array<uint32_t, N> table{};
+    for(size_t i = 0; i < N - 1; i++) {
+      table[i] = lut[i];
+    }
+    return table;
+  }
+
+  template <size_t N> void lookup(const uint32_t* table, const uint16_t* raw, uint16_t* decoded, size_t n) {
+    for(size_t i = 0; i < n; i++) {
+      decoded[i] = static_cast<uint16_t>(table[raw[i] & (N - 1)]);
+    }
+  }
+
+#ifdef LFSR_AVX2
+  // Decode eight values per iteration using 32bit gathers
+  template <size_t N>
+  __attribute__((target("avx2"))) void
+  lookup_avx2(const uint32_t* table, const uint16_t* raw, uint16_t* decoded, size_t n) {
+    const __m256i mask = _mm256_set1_epi32(N - 1);
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8) {
+      __m256i index = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(raw + i)));
+      __m256i values = _mm256_i32gather_epi32(reinterpret_cast<const int*>(table), _mm256_and_si256(index, mask), 4);
+      // Pack the 32bit results back to 16bit, restoring the lane order:
+      __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(values, values), 0xd8);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(decoded + i), _mm256_castsi256_si128(packed));
+    }
+    lookup<N>(table, raw + i, decoded + i, n - i);
+  }
+
+  bool has_avx2() {
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+  }
+#endif
+
+  template <size_t N> void batch(const uint32_t* table, const uint16_t* raw, uint16_t* decoded, size_t n) {
+#ifdef LFSR_AVX2
+    if(has_avx2()) {
+      return lookup_avx2<N>(table, raw, decoded, n);
+    }
+#endif
+    lookup<N>(table, raw, decoded, n);
+  }
+} // namespace
+
+void LFSR::LUT13(const uint16_t* raw, uint16_t* decoded, size_t n) {
+  static const auto table = widen<8192>(lfsr13_lut);
+  batch<8192>(table.data(), raw, decoded, n);
+}
+
+void LFSR::LUT8(const uint16_t* raw, uint16_t* decoded, size_t n) {
+  static const auto table = widen<256>(lfsr8_lut);
+  batch<256>(table.data(), raw, decoded, n);
+}
+
+void LFSR::LUT5(const uint16_t* raw, uint16_t* decoded, size_t n) {
+  static const auto table = widen<32>(lfsr5_lut);
+#if defined(__ARM_NEON)
+  // The full 5-bit table fits into four NEON registers, decode eight values per table lookup
+  uint8_t bytes[32];
+  for(size_t i = 0; i < 32; i++) {
+    bytes[i] = static_cast<uint8_t>(table[i]);
+  }
+  const uint8x8x4_t lut = {{vld1_u8(bytes), vld1_u8(bytes + 8), vld1_u8(bytes + 16), vld1_u8(bytes + 24)}};
+  const uint16x8_t mask = vdupq_n_u16(0x1f);
+  size_t i = 0;
+  for(; i + 8 <= n; i += 8) {
+    uint8x8_t index = vmovn_u16(vandq_u16(vld1q_u16(raw + i), mask));
+    vst1q_u16(decoded + i, vmovl_u8(vtbl4_u8(lut, index)));
+  }
+  lookup<32>(table.data(), raw + i, decoded + i, n - i);
+#else
+  batch<32>(table.data(), raw, decoded, n);
+#endif
+}
+
 // Lookup Table for 5-bit XNOR LFSR counters
 const uint8_t LFSR::lfsr5_lut[31] = {0,  1,  11, 2,  8,  12, 27, 3,  9,  25, 13, 15, 28, 22, 4, 17,
                                      30, 10, 7,  26, 24, 14, 21, 16, 29, 6,  23, 20, 5,  19, 18};
@@ -5,6 +5,7 @@
 #ifndef CARIBOU_LFSR_H
 #define CARIBOU_LFSR_H
 
+#include <cstddef>
 #include <cstdint>
 
 namespace caribou {
@@ -26,6 +27,16 @@ namespace caribou {
      */
     static uint8_t LUT5(uint8_t);
 
+    /**
+     * Batch decoding of n raw 13-bit, 8-bit or 5-bit XNOR LFSR counter values. Input and output arrays may be identical.
+     *
+     * These should be used when decoding full frames. Vectorized lookups are used where available: AVX2 gathers on x86
+     * CPUs supporting them (selected at runtime), NEON table lookups for the 5-bit counters on ARM.
+     */
+    static void LUT13(const uint16_t* raw, uint16_t* decoded, size_t n);
+    static void LUT8(const uint16_t* raw, uint16_t* decoded, size_t n);
+    static void LUT5(const uint16_t* raw, uint16_t* decoded, size_t n);
+
   private:
     static const uint16_t lfsr13_lut[8191];
     static const uint8_t lfsr8_lut[255];
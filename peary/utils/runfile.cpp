@@ -0,0 +1,244 @@
+#include "runfile.hpp"
+
+#include <chrono>
+#include <cstring>
+
+#include "exceptions.hpp"
+#include "log.hpp"
+
+using namespace caribou;
+
+namespace {
+  const char FILE_MAGIC[8] = {'P', 'E', 'A', 'R', 'Y', 'R', 'U', 'N'};
+  const char INDEX_MAGIC[8] = {'P', 'E', 'A', 'R', 'Y', 'I', 'D', 'X'};
+  const uint32_t FORMAT_VERSION = 1;
+
+  // Markers in front of frame records and the frame index, reading "FRME" and "INDX" in the file
+  const uint32_t RECORD_MARKER = 0x454d5246;
+  const uint32_t INDEX_MARKER = 0x58444e49;
+
+  // Size of record header (marker, number of words, timestamp) and trailer (index offset, magic)
+  const uint64_t RECORD_HEADER_SIZE = 2 * sizeof(uint32_t) + sizeof(uint64_t);
+  const uint64_t TRAILER_SIZE = sizeof(uint64_t) + sizeof(INDEX_MAGIC);
+
+  template <typename T> void put(async_writer& file, const T value) { file.write(&value, sizeof(T)); }
+
+  void put(async_writer& file, const std::string& value) {
+    put(file, static_cast<uint32_t>(value.size()));
+    file.write(value);
+  }
+
+  template <typename T> T get(std::ifstream& file) {
+    T value{};
+    if(!file.read(reinterpret_cast<char*>(&value), sizeof(T))) {
+      throw DataCorrupt("Unexpected end of run file");
+    }
+    return value;
+  }
+
+  std::string get_string(std::ifstream& file, const uint64_t limit) {
+    const uint32_t length = get<uint32_t>(file);
+    if(length > limit) {
+      throw DataCorrupt("Invalid string length " + std::to_string(length) + " in run file header");
+    }
+    std::string value(length, '\0');
+    if(!file.read(&value[0], length)) {
+      throw DataCorrupt("Unexpected end of run file");
+    }
+    return value;
+  }
+} // namespace
+
+std::string runfile_header::get(const std::string& key, const std::string& def) const {
+  for(const auto& entry : metadata) {
+    if(entry.first == key) {
+      return entry.second;
+    }
+  }
+  return def;
+}
+
+uint32_t runfile_header::getRegister(const std::string& name, uint32_t def) const {
+  for(const auto& reg : registers) {
+    if(reg.first == name) {
+      return reg.second;
+    }
+  }
+  return def;
+}
+
+runfile_writer::runfile_writer(const std::string& filename,
+                               const runfile_header& header,
+                               async_writer::sync_policy policy)
+    : _file(filename, policy) {
+
+  _file.write(FILE_MAGIC, sizeof(FILE_MAGIC));
+  put(_file, FORMAT_VERSION);
+  put(_file, static_cast<uint32_t>(header.metadata.size()));
+  _position = sizeof(FILE_MAGIC) + 2 * sizeof(uint32_t);
+  for(const auto& entry : header.metadata) {
+    put(_file, entry.first);
+    put(_file, entry.second);
+    _position += 2 * sizeof(uint32_t) + entry.first.size() + entry.second.size();
+  }
+  put(_file, static_cast<uint32_t>(header.registers.size()));
+  _position += sizeof(uint32_t);
+  for(const auto& reg : header.registers) {
+    put(_file, reg.first);
+    put(_file, reg.second);
+    _position += 2 * sizeof(uint32_t) + reg.first.size();
+  }
+  LOG(DEBUG) << "Opened run file " << filename << ", header size " << _position << " bytes";
+}
+
+runfile_writer::~runfile_writer() {
+  close();
+}
+
+void runfile_writer::write(const uint32_t* data, size_t words, uint64_t timestamp) {
+  _index.push_back(_position);
+  put(_file, RECORD_MARKER);
+  put(_file, static_cast<uint32_t>(words));
+  put(_file, timestamp);
+  _file.write(data, words * sizeof(uint32_t));
+  _position += RECORD_HEADER_SIZE + words * sizeof(uint32_t);
+}
+
+uint64_t runfile_writer::now() {
+  return static_cast<uint64_t>(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+void runfile_writer::close() {
+  if(!_open) {
+    return;
+  }
+  _open = false;
+
+  put(_file, INDEX_MARKER);
+  put(_file, static_cast<uint32_t>(0));
+  put(_file, static_cast<uint64_t>(_index.size()));
+  _file.write(_index.data(), _index.size() * sizeof(uint64_t));
+  put(_file, _position);
+  _file.write(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+  _file.close();
+  LOG(DEBUG) << "Closed run file with " << _index.size() << " frames";
+}
+
+bool runfile_reader::isRunfile(const std::string& filename) {
+  std::ifstream file(filename, std::ios::in | std::ios::binary);
+  char magic[sizeof(FILE_MAGIC)];
+  return file.read(magic, sizeof(magic)) && memcmp(magic, FILE_MAGIC, sizeof(magic)) == 0;
+}
+
+runfile_reader::runfile_reader(const std::string& filename) {
+  _file.open(filename, std::ios::in | std::ios::binary);
+  if(!_file.is_open()) {
+    throw DataException("Could not open run file \"" + filename + "\"");
+  }
+
+  _file.seekg(0, std::ios::end);
+  const uint64_t size = static_cast<uint64_t>(_file.tellg());
+  _file.seekg(0, std::ios::beg);
+  _size = size;
+
+  // Read the file header:
+  char magic[sizeof(FILE_MAGIC)];
+  if(!_file.read(magic, sizeof(magic)) || memcmp(magic, FILE_MAGIC, sizeof(magic)) != 0) {
+    throw DataCorrupt("File \"" + filename + "\" is not a peary run file");
+  }
+  const uint32_t version = get<uint32_t>(_file);
+  if(version != FORMAT_VERSION) {
+    throw DataCorrupt("Unsupported run file format version " + std::to_string(version));
+  }
+
+  const uint32_t entries = get<uint32_t>(_file);
+  for(uint32_t i = 0; i < entries; i++) {
+    std::string key = get_string(_file, size);
+    _header.metadata.emplace_back(std::move(key), get_string(_file, size));
+  }
+  const uint32_t registers = get<uint32_t>(_file);
+  for(uint32_t i = 0; i < registers; i++) {
+    std::string name = get_string(_file, size);
+    _header.registers.emplace_back(std::move(name), get<uint32_t>(_file));
+  }
+  const uint64_t data_start = static_cast<uint64_t>(_file.tellg());
+
+  // Read the frame index from the end of the file if it has been closed properly:
+  if(size >= data_start + TRAILER_SIZE) {
+    _file.seekg(static_cast<std::streamoff>(size - TRAILER_SIZE));
+    const uint64_t index_offset = get<uint64_t>(_file);
+    char index_magic[sizeof(INDEX_MAGIC)];
+    _file.read(index_magic, sizeof(index_magic));
+
+    if(memcmp(index_magic, INDEX_MAGIC, sizeof(index_magic)) == 0 && index_offset >= data_start &&
+       index_offset + 2 * sizeof(uint64_t) + TRAILER_SIZE <= size) {
+      _file.seekg(static_cast<std::streamoff>(index_offset));
+      const uint32_t marker = get<uint32_t>(_file);
+      get<uint32_t>(_file);
+      const uint64_t count = get<uint64_t>(_file);
+      if(marker == INDEX_MARKER && count == (size - index_offset - 2 * sizeof(uint64_t) - TRAILER_SIZE) / sizeof(uint64_t)) {
+        _index.resize(count);
+        _file.read(reinterpret_cast<char*>(_index.data()), static_cast<std::streamsize>(count * sizeof(uint64_t)));
+        LOG(DEBUG) << "Read frame index of run file " << filename << " with " << count << " frames";
+        return;
+      }
+    }
+  }
+
+  // No valid index found, rebuild it from the frame records:
+  LOG(WARNING) << "Run file " << filename << " has no frame index, scanning frame records";
+  _file.clear();
+  uint64_t offset = data_start;
+  uint32_t words;
+  uint64_t timestamp;
+  while(offset + RECORD_HEADER_SIZE <= size && readRecord(offset, words, timestamp)) {
+    const uint64_t next = offset + RECORD_HEADER_SIZE + static_cast<uint64_t>(words) * sizeof(uint32_t);
+    if(next > size) {
+      LOG(WARNING) << "Run file " << filename << " ends with an incomplete frame record, skipping it";
+      break;
+    }
+    _index.push_back(offset);
+    offset = next;
+  }
+  _file.clear();
+  LOG(DEBUG) << "Recovered " << _index.size() << " frames from run file " << filename;
+}
+
+bool runfile_reader::readRecord(uint64_t offset, uint32_t& words, uint64_t& timestamp) {
+  // Avoid discarding the stream buffer when reading records sequentially:
+  if(static_cast<uint64_t>(_file.tellg()) != offset) {
+    _file.seekg(static_cast<std::streamoff>(offset));
+  }
+  uint32_t marker = 0;
+  if(!_file.read(reinterpret_cast<char*>(&marker), sizeof(marker)) || marker != RECORD_MARKER) {
+    return false;
+  }
+  words = get<uint32_t>(_file);
+  timestamp = get<uint64_t>(_file);
+  return true;
+}
+
+bool runfile_reader::read(runfile_frame& frame) {
+  if(_next >= _index.size()) {
+    return false;
+  }
+
+  uint32_t words;
+  const uint64_t offset = _index[_next];
+  if(!readRecord(offset, words, frame.timestamp)) {
+    throw DataCorrupt("Invalid frame record " + std::to_string(_next) + " in run file");
+  }
+
+  // The length of the record is taken from the file, it has to be checked before allocating the frame:
+  if(static_cast<uint64_t>(words) * sizeof(uint32_t) > _size - offset - RECORD_HEADER_SIZE) {
+    throw DataCorrupt("Frame record " + std::to_string(_next) + " of " + std::to_string(words) +
+                      " words exceeds the run file");
+  }
+  frame.sequence = _next++;
+  frame.data.resize(words);
+  if(!_file.read(reinterpret_cast<char*>(frame.data.data()), static_cast<std::streamsize>(words * sizeof(uint32_t)))) {
+    throw DataCorrupt("Unexpected end of run file in frame record " + std::to_string(frame.sequence));
+  }
+  return true;
+}
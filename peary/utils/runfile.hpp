@@ -0,0 +1,187 @@
+/** Binary run file format for raw detector data
+ *
+ *  A run file starts with a header holding free-form metadata (software and firmware version, device name, start time,
+ *  ...) and a snapshot of the device registers. It is followed by one length-prefixed record per readout frame and, once
+ *  the file is closed properly, a frame offset index for random access. All fields are stored in little-endian byte order
+ *  as native to both the Zynq and x86 hosts:
+ *
+ *    file header   char[8] "PEARYRUN", uint32 format version,
+ *                  uint32 number of metadata entries, each as string key and string value,
+ *                  uint32 number of registers, each as string name and uint32 value
+ *    frame record  uint32 record marker, uint32 number of data words, uint64 timestamp, uint32 data words[]
+ *    frame index   uint32 index marker, uint32 reserved, uint64 number of frames, uint64 record offsets[]
+ *    trailer       uint64 offset of the frame index, char[8] "PEARYIDX"
+ *
+ *  Strings are stored as uint32 length followed by the characters without termination. Files without index, e.g. from an
+ *  interrupted run, can still be read, the index is then rebuilt by scanning the frame records.
+ */
+
+#ifndef CARIBOU_RUNFILE_H
+#define CARIBOU_RUNFILE_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "asyncwriter.hpp"
+
+namespace caribou {
+
+  /** Header information stored at the beginning of each run file
+   */
+  struct runfile_header {
+    /**
+     * @brief Free-form metadata as key-value pairs, e.g. "Software version", "Firmware version" or "Timestamp"
+     */
+    std::vector<std::pair<std::string, std::string>> metadata;
+
+    /**
+     * @brief Snapshot of the device register state at the start of the run
+     */
+    std::vector<std::pair<std::string, uint32_t>> registers;
+
+    /**
+     * @brief Retrieve a metadata entry
+     * @param key Key of the metadata entry
+     * @param def Value returned if the entry is not present
+     */
+    std::string get(const std::string& key, const std::string& def = "") const;
+
+    /**
+     * @brief Retrieve the value of a register from the snapshot
+     * @param name Name of the register
+     * @param def Value returned if the register is not part of the snapshot
+     */
+    uint32_t getRegister(const std::string& name, uint32_t def = 0) const;
+  };
+
+  /** Single frame read from a run file
+   */
+  struct runfile_frame {
+    // Frame number, position of the record in the file
+    uint64_t sequence{0};
+    // Timestamp of the readout as provided by the writer, in nanoseconds since epoch for the peary servers
+    uint64_t timestamp{0};
+    // Raw data words of the frame
+    std::vector<uint32_t> data;
+  };
+
+  /** Writer for binary run files
+   *
+   *  Frame records are handed to an asynchronous writer and written to disk by a separate thread in large blocks. The
+   *  frame index is appended when the file is closed, either explicitly or on destruction.
+   */
+  class runfile_writer {
+  public:
+    /**
+     * @brief Create the run file and write the file header
+     * @param filename Path of the file to be created, existing files are overwritten
+     * @param header Metadata and register snapshot to be stored
+     * @param policy Synchronization policy of the written data
+     * @throws DataException if the file cannot be opened for writing
+     */
+    runfile_writer(const std::string& filename,
+                   const runfile_header& header,
+                   async_writer::sync_policy policy = async_writer::sync_policy::close);
+
+    /**
+     * @brief Destructor closes the file and writes the frame index if not done yet
+     */
+    ~runfile_writer();
+
+    runfile_writer(const runfile_writer&) = delete;
+    runfile_writer& operator=(const runfile_writer&) = delete;
+
+    /**
+     * @brief Append a frame record
+     * @param data Pointer to the raw data words of the frame
+     * @param words Number of data words
+     * @param timestamp Timestamp of the frame readout
+     */
+    void write(const uint32_t* data, size_t words, uint64_t timestamp);
+    void write(const std::vector<uint32_t>& data, uint64_t timestamp) { write(data.data(), data.size(), timestamp); }
+
+    /**
+     * @brief Write the frame index and trailer and close the file
+     */
+    void close();
+
+    /**
+     * @brief Number of frames written so far
+     */
+    uint64_t frames() const { return _index.size(); }
+
+    /**
+     * @brief False if writing the file failed, frames written since then are lost
+     */
+    bool good() const { return _file.good(); }
+
+    /**
+     * @brief Current system time in nanoseconds since epoch, to be used as frame timestamp
+     */
+    static uint64_t now();
+
+  private:
+    async_writer _file;
+    bool _open{true};
+    uint64_t _position{0};
+    std::vector<uint64_t> _index;
+  };
+
+  /** Reader for binary run files
+   *
+   *  Frames can be read sequentially or accessed randomly through the frame index.
+   */
+  class runfile_reader {
+  public:
+    /**
+     * @brief Open a run file and read its header and frame index
+     * @param filename Path of the run file
+     * @throws DataException if the file cannot be opened
+     * @throws DataCorrupt if the file is not a valid run file
+     */
+    explicit runfile_reader(const std::string& filename);
+
+    /**
+     * @brief Check if the given file is a binary run file
+     */
+    static bool isRunfile(const std::string& filename);
+
+    /**
+     * @brief Header of the run file
+     */
+    const runfile_header& header() const { return _header; }
+
+    /**
+     * @brief Total number of frames in the file
+     */
+    size_t frames() const { return _index.size(); }
+
+    /**
+     * @brief Read the next frame, the data vector of the frame is reused
+     * @param frame Frame to be filled
+     * @return False if all frames have been read
+     * @throws DataCorrupt if the frame record is invalid
+     */
+    bool read(runfile_frame& frame);
+
+    /**
+     * @brief Position the reader such that the next call to read() returns the given frame
+     */
+    void seek(size_t frame) { _next = frame; }
+
+  private:
+    bool readRecord(uint64_t offset, uint32_t& words, uint64_t& timestamp);
+
+    std::ifstream _file;
+    uint64_t _size{0};
+    runfile_header _header;
+    std::vector<uint64_t> _index;
+    size_t _next{0};
+  };
+
+} // namespace caribou
+
+#endif /* CARIBOU_RUNFILE_H */
@@ -1,5 +1,6 @@
 # coding: utf-8
 
+import collections
 import functools
 import socket
 import struct
@@ -8,11 +9,23 @@ import struct
 PROTOCOL_VERSION = b'1'
 # named message status values
 STATUS_OK = 0
+STATUS_DATA_FRAME = 32
 
 # message length
 LENGTH = struct.Struct('!L')
 # sequence number, status code
 HEADER = struct.Struct('!HH')
+# pushed data frame: frame number, timestamp in ns
+FRAME_HEADER = struct.Struct('!LQ')
+# decoded hit: column, row, raw pixel word, tot, toa, counter, flags
+HIT = struct.Struct('!HHLHHHH')
+# batch result: status code, payload length
+RESULT = struct.Struct('!HL')
+
+def _decode_raw(data):
+    return list(struct.unpack('!{:d}L'.format(len(data) // 4), data))
+def _decode_hits(data):
+    return [HIT.unpack_from(data, _) for _ in range(0, len(data), HIT.size)]
 
 class UnsupportedProtocol(Exception):
     pass
@@ -44,6 +57,13 @@ class PearyClient(object):
         # Cache of available device objects to avoid recreating them
         self._devices = {}
         self._sequence_number = 0
+        # commands waiting for their reply and replies not yet requested
+        self._commands = {}
+        self._replies = {}
+        # subscribed devices by subscribe request sequence number and
+        # pushed messages that have not been read yet
+        self._subscriptions = {}
+        self._pushed = collections.deque()
         self._socket = socket.create_connection((self.host, self.port))
         # check connection and protocol
         version = self._request('protocol_version')
@@ -70,37 +90,134 @@ class PearyClient(object):
     def peername(self):
         return self._socket.getpeername()
 
-    def _request(self, cmd, *args):
+    def _recv(self, size):
         """
-        Send a command to the host and return the reply payload.
+        Receive exactly the given number of bytes.
         """
-        # 1. encode request
-        # encode command and its arguments into message payload
-        req_payload = [cmd,]
-        req_payload.extend(str(_) for _ in args)
-        req_payload = ' '.join(req_payload).encode('utf-8')
-        # encode message header
-        self._sequence_number += 1
-        req_header = HEADER.pack(self._sequence_number, STATUS_OK)
-        # encode message length for framing
-        req_length = LENGTH.pack(len(req_header) + len(req_payload))
-        # 2. send request
-        self._socket.send(req_length)
-        self._socket.send(req_header)
-        self._socket.send(req_payload)
-        # 3. wait for reply and unpack in opposite order
-        rep_length, = LENGTH.unpack(self._socket.recv(4))
+        data = bytearray()
+        while len(data) < size:
+            chunk = self._socket.recv(size - len(data))
+            if not chunk:
+                raise InvalidReply('Connection closed')
+            data.extend(chunk)
+        return bytes(data)
+    def _recv_msg(self):
+        """
+        Receive a message and return sequence number, status, and payload.
+        """
+        rep_length, = LENGTH.unpack(self._recv(4))
         if rep_length < 4:
             raise InvalidReply('Length too small')
-        rep_msg = self._socket.recv(rep_length)
+        rep_msg = self._recv(rep_length)
         rep_seq, rep_status = HEADER.unpack(rep_msg[:4])
-        rep_payload = rep_msg[4:]
+        return rep_seq, rep_status, rep_msg[4:]
+
+    def _send(self, cmd, req_payload):
+        """
+        Send a request with the given payload and return its sequence number.
+        """
+        # 16 bit sequence numbers, skip the ones identifying subscriptions
+        self._sequence_number = (self._sequence_number % 0xffff) + 1
+        while self._sequence_number in self._subscriptions:
+            self._sequence_number = (self._sequence_number % 0xffff) + 1
+        req_header = HEADER.pack(self._sequence_number, STATUS_OK)
+        # encode message length for framing
+        req_length = LENGTH.pack(len(req_header) + len(req_payload))
+        self._socket.sendall(req_length + req_header + req_payload)
+        self._commands[self._sequence_number] = cmd
+        return self._sequence_number
+    def _wait(self, seq):
+        """
+        Wait for the reply with the given sequence number and return its payload.
+        """
+        # replies can arrive in any order, data of subscriptions at any time
+        while seq not in self._replies:
+            rep_seq, rep_status, rep_payload = self._recv_msg()
+            if rep_seq in self._subscriptions:
+                self._pushed.append((rep_seq, rep_status, rep_payload))
+            elif rep_seq in self._commands:
+                self._replies[rep_seq] = (rep_status, rep_payload)
+            else:
+                raise InvalidReply('Unexpected sequence number', rep_seq)
+        cmd = self._commands.pop(seq)
+        rep_status, rep_payload = self._replies.pop(seq)
         if rep_status != STATUS_OK:
             raise Failure(cmd, rep_status, rep_payload.decode('utf-8'))
-        if rep_seq != self._sequence_number:
-            raise InvalidReply('Sequence number missmatch', req_seq, rep_seq)
         return rep_payload
 
+    def submit(self, cmd, *args):
+        """
+        Send a command without waiting for the reply.
+
+        Returns the sequence number that identifies the reply in result().
+        Any number of commands can be submitted, commands for the same device
+        are executed in order and commands which are not specific to a device,
+        e.g. add_device, after all earlier and before all later commands.
+        Replies can arrive in any order.
+        """
+        # encode command and its arguments into message payload
+        req_payload = [cmd,]
+        req_payload.extend(str(_) for _ in args)
+        return self._send(cmd, ' '.join(req_payload).encode('utf-8'))
+    def result(self, seq):
+        """
+        Wait for the reply of a submitted command and return its payload.
+        """
+        return self._wait(seq)
+    def _request(self, cmd, *args):
+        """
+        Send a command to the host and return the reply payload.
+        """
+        return self._wait(self.submit(cmd, *args))
+    def batch(self, commands):
+        """
+        Execute multiple commands in a single round trip.
+
+        Each command is a tuple of the command and its arguments, e.g.
+        ('device.set_register', 0, 'vdd', 12). Commands are executed in the
+        given order. Returns the list of reply payloads.
+        All commands are executed even if some fail, the first failure is
+        raised afterwards.
+        """
+        commands = list(commands)
+        lines = ['batch',]
+        lines.extend(' '.join(str(_) for _ in command) for command in commands)
+        payload = self._wait(self._send('batch', '\n'.join(lines).encode('utf-8')))
+        results = []
+        offset = 0
+        while offset < len(payload):
+            status, length = RESULT.unpack_from(payload, offset)
+            offset += RESULT.size
+            data = payload[offset:offset + length]
+            offset += length
+            if status != STATUS_OK:
+                raise Failure(commands[len(results)][0], status, data.decode('utf-8'))
+            results.append(data)
+        return results
+
+    def read_frame(self):
+        """
+        Wait for the next data frame of any subscribed device.
+
+        Returns the device, the frame number, the readout timestamp in ns,
+        and the frame data, either as a list of raw words or as a list of
+        hit tuples (column, row, raw, tot, toa, counter, flags).
+        """
+        while not self._pushed:
+            self._pushed.append(self._recv_msg())
+        seq, status, payload = self._pushed.popleft()
+        device, hits = self._subscriptions[seq]
+        if status != STATUS_DATA_FRAME:
+            raise Failure('device.subscribe', status, payload.decode('utf-8'))
+        number, timestamp = FRAME_HEADER.unpack_from(payload)
+        data = payload[FRAME_HEADER.size:]
+        return device, number, timestamp, _decode_hits(data) if hits else _decode_raw(data)
+    def _remove_subscription(self, device):
+        seqs = [s for s, (d, _) in self._subscriptions.items() if d is device]
+        for seq in seqs:
+            del self._subscriptions[seq]
+        self._pushed = collections.deque(_ for _ in self._pushed if _[0] not in seqs)
+
     def keep_alive(self):
         """
         Send a keep-alive message to test the connection.
@@ -143,6 +260,45 @@ class PearyClient(object):
             return devices[0]
         else:
             return self.add_device(device_type)
+    def start_telemetry(self, rate, decimation=10):
+        """
+        Start sampling the board telemetry with the given rate in Hz.
+
+        Every `decimation` samples are aggregated into one history record.
+        """
+        self._request('telemetry_start', rate, decimation)
+    def stop_telemetry(self):
+        """Stop sampling the board telemetry."""
+        self._request('telemetry_stop')
+    def telemetry(self, samples=0):
+        """
+        Summarize the sampled board telemetry channels.
+
+        Returns a dictionary mapping the channel name to a dictionary with
+        the last value, the min, max and mean over the last `samples`
+        samples (all buffered samples if zero), the number of samples,
+        the timestamp of the last sample in ns and the unit.
+        """
+        channels = {}
+        for line in self._request('telemetry', samples).decode('utf-8').splitlines():
+            name, last, vmin, vmax, mean, count, timestamp, unit = line.split()
+            channels[name] = {
+                'last': float(last), 'min': float(vmin), 'max': float(vmax),
+                'mean': float(mean), 'samples': int(count),
+                'timestamp': int(timestamp), 'unit': unit}
+        return channels
+    def telemetry_history(self, channel, records=0):
+        """
+        Retrieve the decimated history of a telemetry channel.
+
+        Returns a list of (timestamp, min, max, mean, samples) tuples,
+        oldest first.
+        """
+        history = []
+        for line in self._request('telemetry_history', channel, records).decode('utf-8').splitlines():
+            timestamp, vmin, vmax, mean, count = line.split()
+            history.append((int(timestamp), float(vmin), float(vmax), float(mean), int(count)))
+        return history
 
 class Device(object):
     """
@@ -183,6 +339,9 @@ class Device(object):
     def configure(self):
         """Initialize and configure the device."""
         self._request('configure')
+    def configure_full(self):
+        """Initialize and configure the device from scratch, skipping nothing."""
+        self._request('configure_full')
     def daq_start(self):
         """Start data aquisition for the device."""
         self._request('daq_start')
@@ -199,6 +358,9 @@ class Device(object):
     def set_register(self, name, value):
         """Set the value of a named register."""
         self._request('set_register', name, value)
+    def set_registers(self, values):
+        """Set multiple named registers in a single round trip."""
+        self._client.batch(('device.set_register', self.index, name, value) for name, value in values.items())
 
     def get_current(self, name):
         """Get the measured current of a named periphery port."""
@@ -221,6 +383,31 @@ class Device(object):
         """Switch off a periphery port."""
         self._request('switch_off', name)
 
+    def get_raw_data(self):
+        """Read one frame of raw data as a list of 32-bit words."""
+        return _decode_raw(self._request('get_raw_data'))
+    def get_data(self):
+        """Read one frame of decoded data as a list of hit tuples."""
+        return _decode_hits(self._request('get_data'))
+    def subscribe(self, hits=False, max_backlog=None):
+        """
+        Start streaming raw data or decoded hits from the device.
+
+        Frames are read using the client's read_frame(). Frames are dropped
+        by the server if more than max_backlog bytes are waiting to be sent.
+        """
+        args = ['hits' if hits else 'raw']
+        if max_backlog is not None:
+            args.append(max_backlog)
+        seq = self._client.submit('device.subscribe', self.index, *args)
+        self._client.result(seq)
+        self._client._subscriptions[seq] = (self, hits)
+    def unsubscribe(self):
+        """Stop streaming and return the number of sent and dropped frames."""
+        stats = self._request('unsubscribe').decode('utf-8')
+        self._client._remove_subscription(self)
+        return {k: int(v) for k, v in (_.split(': ') for _ in stats.splitlines())}
+
     # unknown attributes are interpreted as dynamic functions
     # and are forwarded as-is to the pearyd instance
     def __getattr__(self, name):